@@ -0,0 +1,34 @@
+# Writes a C++ source that embeds every shader in SHADER_DIR as a raw string
+# literal, looked up by file name through embedded_shader().
+#
+#   cmake -DSHADER_DIR=<dir> -DOUTPUT=<file.cpp> -P embed_shaders.cmake
+
+file(GLOB shader_files RELATIVE ${SHADER_DIR}
+    ${SHADER_DIR}/*.comp
+    ${SHADER_DIR}/*.frag
+    ${SHADER_DIR}/*.geom
+    ${SHADER_DIR}/*.vert)
+list(SORT shader_files)
+
+set(content "// Generated by cmake/embed_shaders.cmake from shader/. Do not edit.\n")
+string(APPEND content "#include \"embedded_shaders.hpp\"\n\n#include <cstring>\n\n")
+string(APPEND content "namespace {\n\nstruct embedded_file {\n")
+string(APPEND content "    const char *name;\n    const char *source;\n};\n\n")
+string(APPEND content "const embedded_file k_embedded_files[] = {\n")
+foreach(name ${shader_files})
+    file(READ ${SHADER_DIR}/${name} source)
+    string(APPEND content
+        "    {\"${name}\", R\"chaoseq_shader(${source})chaoseq_shader\"},\n")
+endforeach()
+string(APPEND content "};\n\n} // namespace\n\n")
+string(APPEND content "const char *embedded_shader(const char *name) {\n")
+string(APPEND content "    for (const embedded_file &file : k_embedded_files) {\n")
+string(APPEND content "        if (std::strcmp(file.name, name) == 0) {\n")
+string(APPEND content "            return file.source;\n        }\n    }\n")
+string(APPEND content "    return nullptr;\n}\n")
+
+# Only touch the output when it changes so unrelated rebuilds stay cheap.
+file(WRITE ${OUTPUT}.tmp "${content}")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different
+    ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
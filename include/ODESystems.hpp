@@ -1,26 +1,36 @@
 #pragma once
 
 #include "Integrator.hpp"
-#include "glitter.hpp"
+#include "nd_vec.hpp"
 #include <cmath>
+#include <glm/glm.hpp>
 #include <vector>
 
+// Args and deriv_* are templates so the same right-hand sides run on floats
+// (S = float, V = glm::vec3) and on forward-mode dual numbers (dual.hpp),
+// which carry derivatives with respect to the parameters along. Each Args
+// declares the number of state variables; systems with more than three take
+// V = nd_vec<D, T> and index it instead of using .x/.y/.z.
+
 inline void resize_deriv(std::vector<float> &dxdt, int dimension) {
     if (static_cast<int>(dxdt.size()) != dimension) {
         dxdt.resize(static_cast<size_t>(dimension));
     }
 }
 
-struct LorenzArgs {
-    float sigma = 10.0f;
-    float rho = 28.0f;
-    float beta = 8.0f / 3.0f;
+template <typename S> struct BasicLorenzArgs {
+    static constexpr int dimension = 3;
+    S sigma = 10.0f;
+    S rho = 28.0f;
+    S beta = 8.0f / 3.0f;
 };
+using LorenzArgs = BasicLorenzArgs<float>;
 
-inline glm::vec3 deriv_lorenz(const LorenzArgs &args, const glm::vec3 &value) {
-    return glm::vec3(args.sigma * (value.y - value.x),
-                     value.x * (args.rho - value.z) - value.y,
-                     value.x * value.y - args.beta * value.z);
+template <typename S, typename V>
+inline V deriv_lorenz(const BasicLorenzArgs<S> &args, const V &value) {
+    return V(args.sigma * (value.y - value.x),
+             value.x * (args.rho - value.z) - value.y,
+             value.x * value.y - args.beta * value.z);
 }
 
 inline ODESystem make_lorenz_system(const LorenzArgs &args) {
@@ -38,16 +48,18 @@ inline ODESystem make_lorenz_system(const LorenzArgs &args) {
     return system;
 }
 
-struct RosslerArgs {
-    float a = 0.2f;
-    float b = 0.2f;
-    float c = 5.7f;
+template <typename S> struct BasicRosslerArgs {
+    static constexpr int dimension = 3;
+    S a = 0.2f;
+    S b = 0.2f;
+    S c = 5.7f;
 };
+using RosslerArgs = BasicRosslerArgs<float>;
 
-inline glm::vec3 deriv_rossler(const RosslerArgs &args,
-                               const glm::vec3 &value) {
-    return glm::vec3(-(value.y + value.z), value.x + args.a * value.y,
-                     args.b + value.z * (value.x - args.c));
+template <typename S, typename V>
+inline V deriv_rossler(const BasicRosslerArgs<S> &args, const V &value) {
+    return V(-(value.y + value.z), value.x + args.a * value.y,
+             args.b + value.z * (value.x - args.c));
 }
 
 inline ODESystem make_rossler_system(const RosslerArgs &args) {
@@ -65,14 +77,18 @@ inline ODESystem make_rossler_system(const RosslerArgs &args) {
     return system;
 }
 
-struct ThomasArgs {
-    float b = 0.208186f;
+template <typename S> struct BasicThomasArgs {
+    static constexpr int dimension = 3;
+    S b = 0.208186f;
 };
-
-inline glm::vec3 deriv_thomas(const ThomasArgs &args, const glm::vec3 &value) {
-    return glm::vec3(std::sin(value.y) - args.b * value.x,
-                     std::sin(value.z) - args.b * value.y,
-                     std::sin(value.x) - args.b * value.z);
+using ThomasArgs = BasicThomasArgs<float>;
+
+template <typename S, typename V>
+inline V deriv_thomas(const BasicThomasArgs<S> &args, const V &value) {
+    using std::sin;
+    return V(sin(value.y) - args.b * value.x,
+             sin(value.z) - args.b * value.y,
+             sin(value.x) - args.b * value.z);
 }
 
 inline ODESystem make_thomas_system(const ThomasArgs &args) {
@@ -90,23 +106,26 @@ inline ODESystem make_thomas_system(const ThomasArgs &args) {
     return system;
 }
 
-struct AizawaArgs {
-    float a = 0.95f;
-    float b = 0.7f;
-    float c = 0.6f;
-    float d = 3.5f;
-    float e = 0.25f;
-    float f = 0.1f;
+template <typename S> struct BasicAizawaArgs {
+    static constexpr int dimension = 3;
+    S a = 0.95f;
+    S b = 0.7f;
+    S c = 0.6f;
+    S d = 3.5f;
+    S e = 0.25f;
+    S f = 0.1f;
 };
-
-inline glm::vec3 deriv_aizawa(const AizawaArgs &args, const glm::vec3 &value) {
-    const float radius_squared = value.x * value.x + value.y * value.y;
-    return glm::vec3((value.z - args.b) * value.x - args.d * value.y,
-                     args.d * value.x + (value.z - args.b) * value.y,
-                     args.c + args.a * value.z -
-                         (value.z * value.z * value.z) / 3.0f -
-                         radius_squared * (1.0f + args.e * value.z) +
-                         args.f * value.z * value.x * value.x * value.x);
+using AizawaArgs = BasicAizawaArgs<float>;
+
+template <typename S, typename V>
+inline V deriv_aizawa(const BasicAizawaArgs<S> &args, const V &value) {
+    const auto radius_squared = value.x * value.x + value.y * value.y;
+    return V((value.z - args.b) * value.x - args.d * value.y,
+             args.d * value.x + (value.z - args.b) * value.y,
+             args.c + args.a * value.z -
+                 (value.z * value.z * value.z) / 3.0f -
+                 radius_squared * (1.0f + args.e * value.z) +
+                 args.f * value.z * value.x * value.x * value.x);
 }
 
 inline ODESystem make_aizawa_system(const AizawaArgs &args) {
@@ -124,18 +143,21 @@ inline ODESystem make_aizawa_system(const AizawaArgs &args) {
     return system;
 }
 
-struct DadrasArgs {
-    float a = 3.0f;
-    float b = 2.7f;
-    float c = 1.7f;
-    float d = 2.0f;
-    float e = 9.0f;
+template <typename S> struct BasicDadrasArgs {
+    static constexpr int dimension = 3;
+    S a = 3.0f;
+    S b = 2.7f;
+    S c = 1.7f;
+    S d = 2.0f;
+    S e = 9.0f;
 };
+using DadrasArgs = BasicDadrasArgs<float>;
 
-inline glm::vec3 deriv_dadras(const DadrasArgs &args, const glm::vec3 &value) {
-    return glm::vec3(value.y - args.a * value.x + args.b * value.y * value.z,
-                     args.c * value.y - value.x * value.z + value.z,
-                     args.d * value.x * value.y - args.e * value.z);
+template <typename S, typename V>
+inline V deriv_dadras(const BasicDadrasArgs<S> &args, const V &value) {
+    return V(value.y - args.a * value.x + args.b * value.y * value.z,
+             args.c * value.y - value.x * value.z + value.z,
+             args.d * value.x * value.y - args.e * value.z);
 }
 
 inline ODESystem make_dadras_system(const DadrasArgs &args) {
@@ -153,16 +175,19 @@ inline ODESystem make_dadras_system(const DadrasArgs &args) {
     return system;
 }
 
-struct ChenArgs {
-    float alpha = 5.0f;
-    float beta = -10.0f;
-    float delta = -0.38f;
+template <typename S> struct BasicChenArgs {
+    static constexpr int dimension = 3;
+    S alpha = 5.0f;
+    S beta = -10.0f;
+    S delta = -0.38f;
 };
+using ChenArgs = BasicChenArgs<float>;
 
-inline glm::vec3 deriv_chen(const ChenArgs &args, const glm::vec3 &value) {
-    return glm::vec3(args.alpha * value.x - value.y * value.z,
-                     args.beta * value.y + value.x * value.z,
-                     args.delta * value.z + (value.x * value.y) / 3.0f);
+template <typename S, typename V>
+inline V deriv_chen(const BasicChenArgs<S> &args, const V &value) {
+    return V(args.alpha * value.x - value.y * value.z,
+             args.beta * value.y + value.x * value.z,
+             args.delta * value.z + (value.x * value.y) / 3.0f);
 }
 
 inline ODESystem make_chen_system(const ChenArgs &args) {
@@ -180,20 +205,22 @@ inline ODESystem make_chen_system(const ChenArgs &args) {
     return system;
 }
 
-struct Lorenz83Args {
-    float a = 0.95f;
-    float b = 7.91f;
-    float f = 4.83f;
-    float g = 4.66f;
+template <typename S> struct BasicLorenz83Args {
+    static constexpr int dimension = 3;
+    S a = 0.95f;
+    S b = 7.91f;
+    S f = 4.83f;
+    S g = 4.66f;
 };
-
-inline glm::vec3 deriv_lorenz83(const Lorenz83Args &args,
-                                const glm::vec3 &value) {
-    return glm::vec3(-args.a * value.x - value.y * value.y - value.z * value.z +
-                         args.a * args.f,
-                     -value.y + value.x * value.y - args.b * value.x * value.z +
-                         args.g,
-                     -value.z + args.b * value.x * value.y + value.x * value.z);
+using Lorenz83Args = BasicLorenz83Args<float>;
+
+template <typename S, typename V>
+inline V deriv_lorenz83(const BasicLorenz83Args<S> &args, const V &value) {
+    return V(-args.a * value.x - value.y * value.y - value.z * value.z +
+                 args.a * args.f,
+             -value.y + value.x * value.y - args.b * value.x * value.z +
+                 args.g,
+             -value.z + args.b * value.x * value.y + value.x * value.z);
 }
 
 inline ODESystem make_lorenz83_system(const Lorenz83Args &args) {
@@ -211,13 +238,16 @@ inline ODESystem make_lorenz83_system(const Lorenz83Args &args) {
     return system;
 }
 
-struct HalvorsenArgs {
-    float a = 1.4f;
+template <typename S> struct BasicHalvorsenArgs {
+    static constexpr int dimension = 3;
+    S a = 1.4f;
 };
+using HalvorsenArgs = BasicHalvorsenArgs<float>;
 
-inline glm::vec3 deriv_halvorsen(const HalvorsenArgs &args,
-                                 const glm::vec3 &value) {
-    return glm::vec3(
+template <typename S, typename V>
+inline V deriv_halvorsen(const BasicHalvorsenArgs<S> &args,
+                         const V &value) {
+    return V(
         -args.a * value.x - 4.0f * value.y - 4.0f * value.z - value.y * value.y,
         -args.a * value.y - 4.0f * value.z - 4.0f * value.x - value.z * value.z,
         -args.a * value.z - 4.0f * value.x - 4.0f * value.y -
@@ -239,18 +269,21 @@ inline ODESystem make_halvorsen_system(const HalvorsenArgs &args) {
     return system;
 }
 
-struct RabinovichArgs {
-    float alpha = 0.14f;
-    float gamma = 0.1f;
+template <typename S> struct BasicRabinovichArgs {
+    static constexpr int dimension = 3;
+    S alpha = 0.14f;
+    S gamma = 0.1f;
 };
-
-inline glm::vec3 deriv_rabinovich(const RabinovichArgs &args,
-                                  const glm::vec3 &value) {
-    return glm::vec3(value.y * (value.z - 1.0f + value.x * value.x) +
-                         args.gamma * value.x,
-                     value.x * (3.0f * value.z + 1.0f - value.x * value.x) +
-                         args.gamma * value.y,
-                     -2.0f * value.z * (args.alpha + value.x * value.y));
+using RabinovichArgs = BasicRabinovichArgs<float>;
+
+template <typename S, typename V>
+inline V deriv_rabinovich(const BasicRabinovichArgs<S> &args,
+                          const V &value) {
+    return V(value.y * (value.z - 1.0f + value.x * value.x) +
+                 args.gamma * value.x,
+             value.x * (3.0f * value.z + 1.0f - value.x * value.x) +
+                 args.gamma * value.y,
+             -2.0f * value.z * (args.alpha + value.x * value.y));
 }
 
 inline ODESystem make_rabinovich_system(const RabinovichArgs &args) {
@@ -268,21 +301,24 @@ inline ODESystem make_rabinovich_system(const RabinovichArgs &args) {
     return system;
 }
 
-struct ThreeScrollArgs {
-    float a = 32.48f;
-    float b = 45.84f;
-    float c = 1.18f;
-    float d = 0.13f;
-    float e = 0.57f;
-    float f = 14.7f;
+template <typename S> struct BasicThreeScrollArgs {
+    static constexpr int dimension = 3;
+    S a = 32.48f;
+    S b = 45.84f;
+    S c = 1.18f;
+    S d = 0.13f;
+    S e = 0.57f;
+    S f = 14.7f;
 };
-
-inline glm::vec3 deriv_three_scroll(const ThreeScrollArgs &args,
-                                    const glm::vec3 &value) {
-    return glm::vec3(args.a * (value.y - value.x) + args.d * value.x * value.z,
-                     args.b * value.x + args.f * value.y - value.x * value.z,
-                     args.c * value.z + args.e * value.x * value.y +
-                         args.e * value.y * value.z);
+using ThreeScrollArgs = BasicThreeScrollArgs<float>;
+
+template <typename S, typename V>
+inline V deriv_three_scroll(const BasicThreeScrollArgs<S> &args,
+                            const V &value) {
+    return V(args.a * (value.y - value.x) + args.d * value.x * value.z,
+             args.b * value.x + args.f * value.y - value.x * value.z,
+             args.c * value.z + args.e * value.x * value.y +
+                 args.e * value.y * value.z);
 }
 
 inline ODESystem make_three_scroll_system(const ThreeScrollArgs &args) {
@@ -300,14 +336,17 @@ inline ODESystem make_three_scroll_system(const ThreeScrollArgs &args) {
     return system;
 }
 
-struct SprottArgs {
-    float a = 2.07f;
-    float b = 1.79f;
+template <typename S> struct BasicSprottArgs {
+    static constexpr int dimension = 3;
+    S a = 2.07f;
+    S b = 1.79f;
 };
+using SprottArgs = BasicSprottArgs<float>;
 
-inline glm::vec3 deriv_sprott(const SprottArgs &args, const glm::vec3 &value) {
-    return glm::vec3(-args.a * value.x + value.y, -value.z + value.x * value.y,
-                     args.b + value.z * (value.x - 14.0f));
+template <typename S, typename V>
+inline V deriv_sprott(const BasicSprottArgs<S> &args, const V &value) {
+    return V(-args.a * value.x + value.y, -value.z + value.x * value.y,
+             args.b + value.z * (value.x - 14.0f));
 }
 
 inline ODESystem make_sprott_system(const SprottArgs &args) {
@@ -325,16 +364,18 @@ inline ODESystem make_sprott_system(const SprottArgs &args) {
     return system;
 }
 
-struct FourWingArgs {
-    float a = 0.2f;
-    float b = 0.01f;
-    float c = -0.4f;
+template <typename S> struct BasicFourWingArgs {
+    static constexpr int dimension = 3;
+    S a = 0.2f;
+    S b = 0.01f;
+    S c = -0.4f;
 };
+using FourWingArgs = BasicFourWingArgs<float>;
 
-inline glm::vec3 deriv_four_wing(const FourWingArgs &args,
-                                 const glm::vec3 &value) {
-    return glm::vec3(value.y * value.z + args.b, value.x * value.z + args.c,
-                     -value.x * value.y + args.a);
+template <typename S, typename V>
+inline V deriv_four_wing(const BasicFourWingArgs<S> &args, const V &value) {
+    return V(value.y * value.z + args.b, value.x * value.z + args.c,
+             -value.x * value.y + args.a);
 }
 
 inline ODESystem make_four_wing_system(const FourWingArgs &args) {
@@ -351,3 +392,131 @@ inline ODESystem make_four_wing_system(const FourWingArgs &args) {
     };
     return system;
 }
+
+// Rossler's 1979 hyperchaotic system: two positive Lyapunov exponents.
+template <typename S> struct BasicHyperRosslerArgs {
+    static constexpr int dimension = 4;
+    S a = 0.25f;
+    S b = 3.0f;
+    S c = 0.5f;
+    S d = 0.05f;
+};
+using HyperRosslerArgs = BasicHyperRosslerArgs<float>;
+
+template <typename S, typename V>
+inline V deriv_hyper_rossler(const BasicHyperRosslerArgs<S> &args,
+                             const V &value) {
+    return V(-(value[1] + value[2]), value[0] + args.a * value[1] + value[3],
+             args.b + value[0] * value[2],
+             args.d * value[3] - args.c * value[2]);
+}
+
+inline ODESystem make_hyper_rossler_system(const HyperRosslerArgs &args) {
+    constexpr int dimension = HyperRosslerArgs::dimension;
+    ODESystem system;
+    system.dim = dimension;
+    system.deriv = [args](const std::vector<float> &state,
+                          std::vector<float> &derivative, float) {
+        resize_deriv(derivative, dimension);
+        const nd_vec<dimension> value(state[0], state[1], state[2], state[3]);
+        const nd_vec<dimension> delta = deriv_hyper_rossler(args, value);
+        for (int i = 0; i < dimension; ++i) {
+            derivative[static_cast<size_t>(i)] = delta[i];
+        }
+    };
+    return system;
+}
+
+// Lorenz equations extended by Stenflo for acoustic-gravity waves in a
+// rotating atmosphere; s couples in the rotation.
+template <typename S> struct BasicLorenzStenfloArgs {
+    static constexpr int dimension = 4;
+    S a = 1.0f;
+    S b = 0.7f;
+    S r = 26.0f;
+    S s = 1.5f;
+};
+using LorenzStenfloArgs = BasicLorenzStenfloArgs<float>;
+
+template <typename S, typename V>
+inline V deriv_lorenz_stenflo(const BasicLorenzStenfloArgs<S> &args,
+                              const V &value) {
+    return V(args.a * (value[1] - value[0]) + args.s * value[3],
+             value[0] * (args.r - value[2]) - value[1],
+             value[0] * value[1] - args.b * value[2],
+             -value[0] - args.a * value[3]);
+}
+
+inline ODESystem make_lorenz_stenflo_system(const LorenzStenfloArgs &args) {
+    constexpr int dimension = LorenzStenfloArgs::dimension;
+    ODESystem system;
+    system.dim = dimension;
+    system.deriv = [args](const std::vector<float> &state,
+                          std::vector<float> &derivative, float) {
+        resize_deriv(derivative, dimension);
+        const nd_vec<dimension> value(state[0], state[1], state[2], state[3]);
+        const nd_vec<dimension> delta = deriv_lorenz_stenflo(args, value);
+        for (int i = 0; i < dimension; ++i) {
+            derivative[static_cast<size_t>(i)] = delta[i];
+        }
+    };
+    return system;
+}
+
+// Delay differential equations: the right-hand side also reads the state
+// tau time units in the past, so they have no ODESystem form. The particles
+// keep that history (dde_particles.hpp) and the deriv_* functions take the
+// delayed state as a second nd_vec.
+
+template <typename T> inline T integer_power(T base, int exponent) {
+    T result(1.0f);
+    for (; exponent > 0; exponent >>= 1) {
+        if (exponent & 1) {
+            result = result * base;
+        }
+        base = base * base;
+    }
+    return result;
+}
+
+// Mackey and Glass's model of blood cell production; chaotic from about
+// tau = 17 with these rates. n is rounded to an integer exponent.
+template <typename S> struct BasicMackeyGlassArgs {
+    static constexpr int dimension = 1;
+    S beta = 0.2f;
+    S gamma = 0.1f;
+    S n = 10.0f;
+    S tau = 17.0f;
+};
+using MackeyGlassArgs = BasicMackeyGlassArgs<float>;
+
+template <typename S, typename V>
+inline V deriv_mackey_glass(const BasicMackeyGlassArgs<S> &args,
+                            const V &value, const V &delayed) {
+    using T = std::decay_t<decltype(value[0])>;
+    const T lagged = delayed[0];
+    const int exponent = static_cast<int>(args.n + 0.5f);
+    V result;
+    result[0] = T(args.beta) * lagged /
+                    (T(1.0f) + integer_power(lagged, exponent)) -
+                T(args.gamma) * value[0];
+    return result;
+}
+
+// Lorenz system whose x equation is driven by y one delay in the past.
+template <typename S> struct BasicDelayedLorenzArgs {
+    static constexpr int dimension = 3;
+    S sigma = 10.0f;
+    S rho = 28.0f;
+    S beta = 8.0f / 3.0f;
+    S tau = 0.1f;
+};
+using DelayedLorenzArgs = BasicDelayedLorenzArgs<float>;
+
+template <typename S, typename V>
+inline V deriv_delayed_lorenz(const BasicDelayedLorenzArgs<S> &args,
+                              const V &value, const V &delayed) {
+    return V(args.sigma * (delayed[1] - value[0]),
+             value[0] * (args.rho - value[2]) - value[1],
+             value[0] * value[1] - args.beta * value[2]);
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "glitter.hpp"
+#include "shader_cache.hpp"
 #include <iostream>
 #include <string>
 
@@ -11,6 +12,13 @@ class Shader {
     }
 
     void compile(const char *vertex_source, const char *fragment_source) {
+        const uint64_t cache_key = shader_cache_key(
+            {"vertex", vertex_source, "fragment", fragment_source});
+        program_id = load_cached_program(cache_key);
+        if (program_id != 0) {
+            return;
+        }
+
         GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex_shader, 1, &vertex_source, nullptr);
         glCompileShader(vertex_shader);
@@ -22,15 +30,45 @@ class Shader {
         check_shader(fragment_shader, "FRAGMENT");
 
         program_id = glCreateProgram();
+        prepare_cached_program(program_id);
         glAttachShader(program_id, vertex_shader);
         glAttachShader(program_id, fragment_shader);
         glLinkProgram(program_id);
-        check_program(program_id);
+        if (check_program(program_id)) {
+            store_cached_program(program_id, cache_key);
+        }
 
         glDeleteShader(vertex_shader);
         glDeleteShader(fragment_shader);
     }
 
+    // Compute programs need a GL 4.3 context.
+    void compile_compute(const char *compute_source) {
+        const uint64_t cache_key =
+            shader_cache_key({"compute", compute_source});
+        program_id = load_cached_program(cache_key);
+        if (program_id != 0) {
+            return;
+        }
+
+        GLuint compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute_shader, 1, &compute_source, nullptr);
+        glCompileShader(compute_shader);
+        check_shader(compute_shader, "COMPUTE");
+
+        program_id = glCreateProgram();
+        prepare_cached_program(program_id);
+        glAttachShader(program_id, compute_shader);
+        glLinkProgram(program_id);
+        if (check_program(program_id)) {
+            store_cached_program(program_id, cache_key);
+        }
+
+        glDeleteShader(compute_shader);
+    }
+
+    bool valid() const { return program_id != 0; }
+
     void use() const { glUseProgram(program_id); }
 
     void set_mat4(const std::string &name, const glm::mat4 &matrix) const {
@@ -73,7 +111,7 @@ class Shader {
         }
     }
 
-    void check_program(GLuint program) {
+    bool check_program(GLuint program) {
         GLint success = 0;
         glGetProgramiv(program, GL_LINK_STATUS, &success);
         if (!success) {
@@ -83,5 +121,6 @@ class Shader {
             glGetProgramInfoLog(program, log_length, nullptr, log.data());
             std::cerr << "PROGRAM LINK ERROR:\n" << log << "\n";
         }
+        return success != 0;
     }
 };
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "glitter.hpp"
+#include "system_params.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Basins of attraction over a grid of initial conditions. Background
+// workers claim tiles of cells and integrate each cell's orbit until it
+// escapes or stops moving, or for its full length; the samples after the
+// transient then match it to a known attractor by centroid and spread, or
+// make it a new one.
+
+// Cell labels. Everything from basin_label_first_attractor upward indexes
+// basin_job::attractors.
+enum basin_label : uint8_t {
+    basin_label_pending = 0,
+    basin_label_diverged = 1,
+    basin_label_undetermined = 2,
+    basin_label_first_attractor = 3
+};
+
+constexpr int k_max_basin_attractors = 256 - basin_label_first_attractor;
+
+struct basin_settings {
+    // Grid axes (0 = x, 1 = y, 2 = z). The third axis is held at `center`
+    // for a 2D slice, or spans `extent_w` when depth > 1.
+    int axis_u = 0;
+    int axis_v = 2;
+    glm::vec3 center{0.0f, 0.0f, 0.0f};
+    glm::vec2 extent{30.0f, 30.0f};
+    float extent_w = 30.0f;
+    int resolution = 256;
+    int depth = 1;
+
+    float dt = 0.01f;
+    int transient_steps = 3000;
+    int window_steps = 1000;
+    float escape_radius = 1000.0f;
+    float fixed_point_speed = 1e-3f;
+    float match_tolerance = 1.0f;
+};
+
+struct basin_attractor {
+    glm::vec3 centroid{0.0f};
+    float spread = 0.0f;
+    bool fixed_point = false;
+};
+
+struct basin_job {
+    system_params params;
+    basin_settings settings;
+    int width = 0;
+    int height = 0;
+    int depth = 0;
+    size_t tile_count = 0;
+
+    std::unique_ptr<std::atomic<uint8_t>[]> labels;
+    std::atomic<size_t> next_tile{0};
+    std::atomic<size_t> cells_done{0};
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> finished{false};
+
+    std::mutex attractor_mutex;
+    std::vector<basin_attractor> attractors;
+
+    std::thread runner;
+
+    basin_job() = default;
+    basin_job(const basin_job &) = delete;
+    basin_job &operator=(const basin_job &) = delete;
+    ~basin_job() {
+        cancel = true;
+        if (runner.joinable()) {
+            runner.join();
+        }
+    }
+
+    size_t cell_count() const {
+        return static_cast<size_t>(width) * static_cast<size_t>(height) *
+               static_cast<size_t>(depth);
+    }
+};
+
+struct basin_mapper {
+    bool show_window = false;
+    basin_settings settings;
+    std::unique_ptr<basin_job> job;
+    int display_slice = 0;
+    GLuint texture = 0;
+    double last_upload_time = -1.0;
+    int uploaded_slice = -1;
+    bool uploaded_final = false;
+    size_t slice_counts[256] = {};
+};
+
+void start_basin_job(basin_mapper &mapper, const system_params &params);
+void stop_basin_job(basin_mapper &mapper);
+float basin_progress(const basin_job &job);
+glm::vec3 basin_label_color(uint8_t label, const basin_job &job);
+bool export_basin(basin_job &job, int slice, const char *prefix);
+void upload_basin_texture(basin_mapper &mapper, double now);
+void release_basin_gpu(basin_mapper &mapper);
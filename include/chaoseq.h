@@ -0,0 +1,99 @@
+#pragma once
+
+/* C interface of libchaoseq: the particle integrator without a window, a GL
+ * context or C++ types at the boundary. Every call on one session is
+ * serialized by that session's mutex, so a session may be shared between
+ * threads; separate sessions run fully in parallel. Functions returning int
+ * return CHAOSEQ_OK or a negative chaoseq_status. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(CHAOSEQ_BUILDING_LIBRARY)
+#define CHAOSEQ_API __declspec(dllexport)
+#else
+#define CHAOSEQ_API __declspec(dllimport)
+#endif
+#else
+#define CHAOSEQ_API __attribute__((visibility("default")))
+#endif
+
+#define CHAOSEQ_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chaoseq_session chaoseq_session;
+
+typedef enum chaoseq_status {
+    CHAOSEQ_OK = 0,
+    CHAOSEQ_INVALID_ARGUMENT = -1,
+    CHAOSEQ_UNKNOWN_NAME = -2,
+    CHAOSEQ_OUT_OF_MEMORY = -3
+} chaoseq_status;
+
+/* Positions of particle i are the three floats at
+ * (const char *)positions + i * stride. The view aliases the session's own
+ * buffer and stays valid until chaoseq_release_particles. */
+typedef struct chaoseq_particle_view {
+    const float *positions;
+    size_t count;
+    size_t stride; /* bytes */
+    double time;
+    uint64_t steps; /* substeps since the last seed */
+} chaoseq_particle_view;
+
+/* CHAOSEQ_API_VERSION of the loaded library. */
+CHAOSEQ_API uint32_t chaoseq_api_version(void);
+
+/* threads = 0 uses one pinned worker per allowed CPU. Returns NULL when out
+ * of memory. */
+CHAOSEQ_API chaoseq_session *chaoseq_create(unsigned int threads);
+CHAOSEQ_API void chaoseq_destroy(chaoseq_session *session);
+
+/* Lower-case preset names: "lorenz", "rossler", "thomas", "aizawa",
+ * "dadras", "chen", "lorenz83", "halvorsen", "rabinovich", "three_scroll",
+ * "sprott", "four_wing". Each preset keeps its own parameters. The
+ * viewer's four-variable and delay presets are not available here. */
+CHAOSEQ_API int chaoseq_set_system(chaoseq_session *session,
+                                   const char *name);
+/* Parameters of the active preset, by the names the viewer shows
+ * ("sigma", "rho", "beta", ...). */
+CHAOSEQ_API int chaoseq_set_parameter(chaoseq_session *session,
+                                      const char *name, float value);
+CHAOSEQ_API int chaoseq_get_parameter(chaoseq_session *session,
+                                      const char *name, float *value);
+CHAOSEQ_API int chaoseq_set_dt(chaoseq_session *session, float dt);
+
+/* Replaces the particles with count points scattered in a shell of the
+ * given radius around the origin. The same seed gives the same positions
+ * for any thread count. */
+CHAOSEQ_API int chaoseq_seed(chaoseq_session *session, size_t count,
+                             float spawn_radius, uint32_t seed);
+/* Advances every particle by substeps RK4 steps of dt. Particles are never
+ * removed or reordered, so index i is the same particle across calls. */
+CHAOSEQ_API int chaoseq_step(chaoseq_session *session, uint32_t substeps);
+
+/* chaoseq_step that also differentiates with respect to up to 8 parameters
+ * of the active preset. Tangents start at zero, so after the call
+ * jacobians[(i * 3 + axis) * count + k] holds d(position_i[axis]) /
+ * d(parameters[k]) over these substeps. jacobians must hold
+ * particle_count * 3 * count floats. */
+CHAOSEQ_API int chaoseq_step_sensitivity(chaoseq_session *session,
+                                         const char *const *parameters,
+                                         uint32_t count, uint32_t substeps,
+                                         float *jacobians);
+
+/* Locks the session and fills view with the live particle buffer. Other
+ * calls on the session, from any thread, wait until the matching
+ * chaoseq_release_particles; calling them from the locking thread in
+ * between deadlocks. */
+CHAOSEQ_API int chaoseq_acquire_particles(chaoseq_session *session,
+                                          chaoseq_particle_view *view);
+CHAOSEQ_API void chaoseq_release_particles(chaoseq_session *session);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "worker_pool.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+// Grassberger-Procaccia correlation sum C(r), the fraction of point pairs
+// closer than r, on geometrically spaced radii; the correlation dimension
+// is the slope of log C against log r in the scaling region.
+//
+// Pairs are counted from a subset of reference points to every point of the
+// cloud. The points are bucketed into a hash grid with cells one largest
+// radius wide, so each reference point only visits the 27 cells around it
+// instead of the whole cloud.
+
+constexpr int k_max_correlation_radii = 64;
+
+struct correlation_settings {
+    int radii = 24;
+    // Smallest and largest radius; zero takes them as fractions of the
+    // cloud's bounding-box diagonal.
+    float min_radius = 0.0f;
+    float max_radius = 0.0f;
+    float min_fraction = 1e-3f;
+    float max_fraction = 0.05f;
+    // Points whose neighbours are counted; 0 uses every point.
+    size_t reference_points = 4096;
+    // Radius indices of the scaling region used for the fit.
+    int fit_first = 6;
+    int fit_last = 16;
+};
+
+struct correlation_result {
+    std::vector<float> radii;
+    // pairs[k]: reference-point pairs closer than radii[k].
+    std::vector<uint64_t> pairs;
+    size_t points = 0;
+    size_t references = 0;
+    // Ordered pairs examined, references (points - 1), summed over merged
+    // clouds.
+    double pair_total = 0.0;
+    std::vector<double> sum;         // C(r) = pairs / pair_total
+    std::vector<float> local_slope;  // d log C / d log r, central differences
+    double dimension = 0.0;          // least-squares slope over the fit range
+    double intercept = 0.0;
+    double residual = 0.0;           // RMS of the fit in log10 units
+    int fit_count = 0;               // radii with pairs inside the fit range
+    double seconds = 0.0;
+    bool valid = false;
+};
+
+// Buckets of the grid, rebuilt on every estimate and reused across them.
+struct correlation_grid {
+    float cell = 0.0f;
+    uint32_t mask = 0;
+    std::unique_ptr<std::atomic<uint32_t>[]> counts;
+    size_t count_capacity = 0;
+    // Start of each bucket in points, one more bucket for the non-finite
+    // points, and the end.
+    std::vector<uint32_t> bucket_start;
+    std::vector<uint32_t> bucket_of;    // per input point
+    std::vector<glm::vec3> points;      // bucket-sorted
+    std::vector<uint64_t> keys;         // packed cell of each sorted point
+    std::vector<std::vector<uint64_t>> shells; // per-worker pair histograms
+};
+
+// Viewer state: the estimate is refreshed every `interval` seconds while
+// enabled.
+struct correlation_estimator {
+    bool enabled = false;
+    bool automatic = true;
+    float interval = 2.0f;
+    double last_run = -1.0;
+    correlation_settings settings;
+    correlation_grid grid;
+    correlation_result result;
+};
+
+// count radii spaced geometrically from low to high.
+void correlation_radii(int count, float low, float high,
+                       std::vector<float> &radii);
+// Counts the pairs of points[0, count) on the radii of settings into
+// result (without the fit). Non-finite points are skipped. Returns false
+// when fewer than two finite points remain.
+bool count_correlation_pairs(const glm::vec3 *points, size_t count,
+                             const correlation_settings &settings,
+                             worker_pool &pool, correlation_grid &grid,
+                             correlation_result &result);
+// Fills result.sum, local_slope and the fit from result.pairs. Call after
+// merging the pair counts of several clouds on the same radii.
+void fit_correlation_dimension(const correlation_settings &settings,
+                               correlation_result &result);
+// Runs the estimate when the interval has passed or force is set. now is in
+// seconds on any monotonic clock.
+bool update_correlation_estimate(correlation_estimator &estimator,
+                                 const glm::vec3 *points, size_t count,
+                                 worker_pool &pool, double now, bool force);
+bool export_correlation_csv(const correlation_result &result,
+                            const char *path);
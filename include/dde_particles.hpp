@@ -0,0 +1,67 @@
+#pragma once
+
+#include "default_init_allocator.hpp"
+#include "invariant_stats.hpp"
+#include "system_params.hpp"
+#include <cstddef>
+#include <cstdint>
+
+struct simulation_state;
+
+// Particles of the delay systems. Every particle keeps the last tau of its
+// trajectory as the value and slope at each step; a cubic Hermite fit
+// between two steps gives the delayed state at any stage time of the RK4
+// step. k_dde_lanes particles share a block, laid out
+// [slot][value, slope][component][lane], so a delayed lookup for the block
+// reads a few contiguous cache lines instead of one per particle.
+//
+// The rendered points are the state for three-variable systems and the
+// delay embedding (x(t), x(t - tau/2), x(t - tau)) for scalar ones.
+
+constexpr int k_dde_lanes = 8;
+
+struct dde_particle_field {
+    int dimension = 0; // 0 unless the active system has a delay
+    // The layout below was built for this tau and step. tau is raised to
+    // two steps so the lookups never reach the step being taken.
+    float tau = 0.0f;
+    float dt = 0.0f;
+    int slots = 0;
+    // Steps taken; slot step % slots holds the current state. Starts at
+    // slots so the lookups never wrap below zero.
+    uint64_t step = 0;
+    size_t count = 0;
+    particle_array<float> history;
+    float spawn_center[3] = {};
+    // particles x slots is capped so the history fits in this many MiB.
+    float budget_mb = 512.0f;
+};
+
+// History samples per particle for a delay tau at step dt.
+int dde_history_slots(float tau, float dt);
+// How many particles fit in the budget for the active delay system.
+size_t dde_particle_capacity(const dde_particle_field &field, int dimension,
+                             float tau, float dt);
+// Whether the history was built for this delay and step.
+bool dde_history_matches(const dde_particle_field &field, float tau, float dt);
+// Sizes the history for count particles, or frees it when dimension is 0.
+// The storage is untouched; seeding places each block with its worker.
+void allocate_dde_history(dde_particle_field &field, int dimension,
+                          float tau, float dt, size_t count);
+// Seeds [begin, end) on a shell around spawn_center with a constant
+// history and writes the rendered position and spawn phase.
+void seed_dde_particles(simulation_state &state, size_t begin, size_t end,
+                        uint32_t seed);
+// Rebuilds the history for a new tau or dt as a constant history at each
+// particle's current state. Returns false when the particles no longer fit
+// in the budget; the caller reseeds a smaller field then.
+bool restart_dde_history(simulation_state &state, float tau, float dt);
+// One RK4 step of [begin, end). Escaped particles are reseeded unless
+// culling is off and counted in diverged. There is no compaction or stall
+// test, so Compact acts as Respawn. The caller advances field.step once
+// every range is done.
+void integrate_dde_range(simulation_state &state, size_t begin, size_t end,
+                         invariant_accumulator *samples, size_t &diverged);
+// Current state of one particle.
+void dde_particle_state(const dde_particle_field &field, size_t index,
+                        float *out);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Allocator whose value-less construct() default-initializes, so resizing a
+// vector of trivial types leaves the new pages untouched. The first write
+// then decides which NUMA node backs each page (Linux first-touch policy).
+template <typename T, typename Base = std::allocator<T>>
+class default_init_allocator : public Base {
+    using traits = std::allocator_traits<Base>;
+
+  public:
+    template <typename U> struct rebind {
+        using other = default_init_allocator<
+            U, typename traits::template rebind_alloc<U>>;
+    };
+
+    using Base::Base;
+
+    template <typename U> void construct(U *pointer) noexcept(
+        std::is_nothrow_default_constructible<U>::value) {
+        ::new (static_cast<void *>(pointer)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U *pointer, Args &&...args) {
+        traits::construct(static_cast<Base &>(*this), pointer,
+                          std::forward<Args>(args)...);
+    }
+};
+
+template <typename T>
+using particle_array = std::vector<T, default_init_allocator<T>>;
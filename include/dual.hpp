@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cmath>
+
+// Forward-mode dual number carrying N tangents next to the value. The
+// tangent loops have a fixed trip count, so at -O2 every arithmetic operation
+// becomes a handful of packed SIMD instructions across the N lanes.
+template <int N> struct dual {
+    static_assert(N > 0, "a dual number needs at least one tangent");
+
+    float value = 0.0f;
+    alignas(16) float tangent[N] = {};
+
+    dual() = default;
+    // Implicit, so float literals and float parameters mix with duals as
+    // constants (all tangents zero).
+    dual(float constant) : value(constant) {}
+
+    static dual variable(float value, int lane) {
+        dual result(value);
+        result.tangent[lane] = 1.0f;
+        return result;
+    }
+
+    friend dual operator+(const dual &a, const dual &b) {
+        dual result(a.value + b.value);
+        for (int i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] + b.tangent[i];
+        }
+        return result;
+    }
+    friend dual operator-(const dual &a, const dual &b) {
+        dual result(a.value - b.value);
+        for (int i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] - b.tangent[i];
+        }
+        return result;
+    }
+    friend dual operator*(const dual &a, const dual &b) {
+        dual result(a.value * b.value);
+        for (int i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] * b.value + a.value * b.tangent[i];
+        }
+        return result;
+    }
+    friend dual operator/(const dual &a, const dual &b) {
+        const float inverse = 1.0f / b.value;
+        dual result(a.value * inverse);
+        for (int i = 0; i < N; ++i) {
+            result.tangent[i] =
+                (a.tangent[i] - result.value * b.tangent[i]) * inverse;
+        }
+        return result;
+    }
+    friend dual operator-(const dual &a) {
+        dual result(-a.value);
+        for (int i = 0; i < N; ++i) {
+            result.tangent[i] = -a.tangent[i];
+        }
+        return result;
+    }
+
+    // Mixed forms skip the zero tangents a converted float would carry.
+    friend dual operator+(const dual &a, float b) {
+        dual result = a;
+        result.value += b;
+        return result;
+    }
+    friend dual operator+(float a, const dual &b) { return b + a; }
+    friend dual operator-(const dual &a, float b) { return a + (-b); }
+    friend dual operator-(float a, const dual &b) { return -b + a; }
+    friend dual operator*(const dual &a, float b) {
+        dual result(a.value * b);
+        for (int i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] * b;
+        }
+        return result;
+    }
+    friend dual operator*(float a, const dual &b) { return b * a; }
+    friend dual operator/(const dual &a, float b) { return a * (1.0f / b); }
+
+    dual &operator+=(const dual &other) { return *this = *this + other; }
+    dual &operator-=(const dual &other) { return *this = *this - other; }
+    dual &operator*=(const dual &other) { return *this = *this * other; }
+
+    friend dual sin(const dual &a) {
+        dual result(std::sin(a.value));
+        const float slope = std::cos(a.value);
+        for (int i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] * slope;
+        }
+        return result;
+    }
+    friend dual cos(const dual &a) {
+        dual result(std::cos(a.value));
+        const float slope = -std::sin(a.value);
+        for (int i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] * slope;
+        }
+        return result;
+    }
+};
+
+// The 3-vector the generic deriv_* functions and rk4_step need: member
+// access, a three-component constructor, sums and scaling by a float.
+template <int N> struct dual_vec3 {
+    dual<N> x;
+    dual<N> y;
+    dual<N> z;
+
+    dual_vec3() = default;
+    dual_vec3(const dual<N> &x_, const dual<N> &y_, const dual<N> &z_)
+        : x(x_), y(y_), z(z_) {}
+
+    friend dual_vec3 operator+(const dual_vec3 &a, const dual_vec3 &b) {
+        return dual_vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+    }
+    friend dual_vec3 operator*(float s, const dual_vec3 &v) {
+        return dual_vec3(s * v.x, s * v.y, s * v.z);
+    }
+    friend dual_vec3 operator*(const dual_vec3 &v, float s) { return s * v; }
+};
@@ -0,0 +1,5 @@
+#pragma once
+
+// Shader sources compiled into the executable from shader/ by
+// cmake/embed_shaders.cmake. Returns nullptr for an unknown file name.
+const char *embedded_shader(const char *name);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "correlation_dimension.hpp"
+#include "invariant_stats.hpp"
+#include "system_params.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+
+// Sharded ensemble runs for chaoseq_core. The coordinator maps one POSIX
+// shared-memory region, forks one process per shard and aggregates the
+// shard slots and images straight out of the mapping once they exit. A
+// shard that crashes or is OOM-killed only loses its own slot.
+
+struct ensemble_config {
+    system_params params;
+    int shards = 0; // 0: one per allowed CPU
+    size_t particles = 100000;
+    int steps = 10000;
+    // Steps discarded before sampling. Negative: sample from the start and
+    // discard everything until the shard's statistics have settled.
+    int transient = 1000;
+    int sample_every = 10;
+    float dt = 0.01f;
+    float spawn_radius = 1.5f;
+    float escape_radius = 1000.0f;
+    uint32_t seed = 1;
+
+    // When set, shard i runs with the parameter at
+    // mix(sweep_min, sweep_max, i / (shards - 1)) and each shard integrates
+    // the full particle count. Otherwise the particles are split.
+    std::string sweep_parameter;
+    float sweep_min = 0.0f;
+    float sweep_max = 0.0f;
+
+    // Box of the marginal histograms; the density image is the projection
+    // onto two axes, over view_min/view_max on those axes.
+    glm::vec3 range_min{-30.0f, -30.0f, -5.0f};
+    glm::vec3 range_max{30.0f, 30.0f, 55.0f};
+    int bins = 128;
+    int axis_u = 0;
+    int axis_v = 2;
+    glm::vec2 view_min{-30.0f, -5.0f};
+    glm::vec2 view_max{30.0f, 55.0f};
+    int image_size = 512;
+
+    // Correlation sum of each shard's final cloud, merged over the shards.
+    // Radii left at zero span fractions of the histogram box diagonal.
+    bool measure_correlation = false;
+    correlation_settings correlation;
+};
+
+enum shard_status : uint32_t {
+    shard_pending = 0,
+    shard_running = 1,
+    shard_done = 2,
+};
+
+// One per shard, written only by that shard. The coordinator reads the
+// plain fields after seeing shard_done.
+struct alignas(64) shard_slot {
+    std::atomic<uint32_t> status;
+    std::atomic<uint64_t> steps_done;
+    float parameter;
+    uint64_t particles;
+    uint64_t diverged;
+    int64_t settled_step; // -1 when the transient never settled
+    running_moments axes[3];
+    float min[3];
+    float max[3];
+    double seconds;
+    uint64_t correlation_points;
+    uint64_t correlation_references;
+    double correlation_pair_total;
+    uint64_t correlation_pairs[k_max_correlation_radii];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shard slots are shared between processes");
+
+// Runs the whole ensemble and returns the process exit code: 0 when every
+// shard finished, 1 on setup errors, 2 when some shards failed. stats_path
+// receives the merged moments and marginal histograms, correlation_path the
+// merged correlation sum when config.measure_correlation is set.
+int run_ensemble(const ensemble_config &config, const char *image_path,
+                 const char *csv_path, const char *stats_path,
+                 const char *correlation_path);
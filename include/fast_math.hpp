@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Branch-free float sine and cosine for float_lanes. libm's sinf is an
+// opaque call with a slow path for huge arguments, so a loop that calls it
+// is never vectorized; these inline to a few multiplies and selects, which
+// the compiler vectorizes across the lanes. One at a time they are no
+// faster than glibc, so scalar and dual-number code keeps std::sin.
+//
+// x is reduced to r in [-pi/4, pi/4] around the nearest multiple k of pi/2
+// with a three-part Cody-Waite split of pi/2. The first two parts have 12
+// significant bits, so k * part is exact while |k| < 4096; then sin r and
+// cos r come from the Cephes minimax polynomials, and k mod 4 picks the
+// quadrant.
+//
+// Error against libm, checked by tests/fast_math_test.cpp: for
+// |x| <= k_fast_trig_exact_range the result is within k_fast_trig_max_ulp
+// ulp wherever |result| >= k_fast_trig_ulp_floor, and within
+// k_fast_trig_max_abs everywhere; near the zeros an ulp of the result
+// vanishes while the reduction error does not. Up to k_fast_trig_range the
+// absolute error stays below k_fast_trig_range_abs; beyond it the
+// reduction loses k's low bits and the result is not meaningful.
+// Non-finite arguments give NaN.
+
+constexpr float k_fast_trig_exact_range = 6400.0f;
+constexpr int k_fast_trig_max_ulp = 2;
+constexpr float k_fast_trig_ulp_floor = 1.0f / 64.0f;
+constexpr float k_fast_trig_max_abs = 1.0e-7f;
+constexpr float k_fast_trig_range = 1.0e5f;
+constexpr float k_fast_trig_range_abs = 1.0e-6f;
+
+namespace fast_trig {
+
+constexpr float two_over_pi = 0.636619772f;
+constexpr float pio2_1 = 1.5703125f;
+constexpr float pio2_2 = 4.837512969970703125e-4f;
+constexpr float pio2_3 = 7.549790126404332e-8f;
+// Adding 1.5 * 2^23 rounds to an integer in the low mantissa bits.
+constexpr float round_magic = 12582912.0f;
+
+inline uint32_t float_bits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    return bits;
+}
+
+inline float bits_float(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+// sin and cos of r in [-pi/4, pi/4].
+inline float sin_poly(float r, float r2) {
+    return r + r * r2 *
+                   (-1.6666654611e-1f +
+                    r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+}
+
+inline float cos_poly(float r2) {
+    return 1.0f - 0.5f * r2 +
+           r2 * r2 *
+               (4.166664568298827e-2f +
+                r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+}
+
+// Reduces x; quadrant receives k mod 4 in its low bits.
+inline float reduce(float x, uint32_t &quadrant) {
+    const float shifted = x * two_over_pi + round_magic;
+    quadrant = float_bits(shifted);
+    const float k = shifted - round_magic;
+    return ((x - k * pio2_1) - k * pio2_2) - k * pio2_3;
+}
+
+// The polynomial for quadrant q of sin; q + 1 gives cos.
+inline float quadrant_value(float r, uint32_t q) {
+    const float r2 = r * r;
+    const float s = sin_poly(r, r2);
+    const float c = cos_poly(r2);
+    // Selects with masks rather than ?:, which -O2 leaves as a branch.
+    const uint32_t odd = 0u - (q & 1u);
+    const uint32_t value = (float_bits(c) & odd) | (float_bits(s) & ~odd);
+    return bits_float(value ^ ((q & 2u) << 30));
+}
+
+} // namespace fast_trig
+
+inline float fast_sin(float x) {
+    uint32_t quadrant;
+    const float r = fast_trig::reduce(x, quadrant);
+    return fast_trig::quadrant_value(r, quadrant);
+}
+
+inline float fast_cos(float x) {
+    uint32_t quadrant;
+    const float r = fast_trig::reduce(x, quadrant);
+    return fast_trig::quadrant_value(r, quadrant + 1u);
+}
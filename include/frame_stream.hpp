@@ -0,0 +1,105 @@
+#pragma once
+
+#include "system_params.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Live particle frames over POSIX shared memory. The viewer is the only
+// producer and writes each frame into the next slot of a ring; every slot is
+// a seqlock, so readers copy without taking a lock and retry on the newest
+// frame when the producer laps them. The producer never waits on a reader.
+
+constexpr const char *k_default_frame_stream_name = "/chaoseq_frames";
+constexpr uint32_t k_frame_stream_magic = 0x4D525443; // "CTRM"
+constexpr uint32_t k_frame_stream_version = 2;
+constexpr uint32_t k_frame_stream_slots = 4;
+constexpr uint32_t k_frame_max_parameters = 8;
+
+struct frame_stream_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t reserved;
+    uint64_t slot_capacity; // particles per slot
+    uint64_t slot_stride;   // bytes from one slot header to the next
+    uint64_t slots_offset;
+    uint64_t bytes;
+    // Sequence of the newest complete frame, 0 before the first one.
+    std::atomic<uint64_t> published;
+    // Set when the producer exits or replaces the region with a larger one.
+    std::atomic<uint32_t> closed;
+};
+
+// Followed by particle_count packed float triples, then the particle_count
+// stable particle ids as uint32. `lock` is odd while the producer writes the
+// slot and 2 * sequence once the frame is complete.
+struct alignas(64) frame_slot_header {
+    std::atomic<uint64_t> lock;
+    uint64_t sequence;
+    int64_t timestamp_ns; // CLOCK_MONOTONIC
+    float time;           // simulation t
+    uint32_t system;      // system_type
+    uint32_t parameter_count;
+    float parameters[k_frame_max_parameters]; // system_parameters() order
+    uint64_t particle_count;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "frame stream counters are shared between processes");
+
+struct frame_stream {
+    bool enabled = false;
+    std::string name = k_default_frame_stream_name;
+    void *base = nullptr;
+    size_t bytes = 0;
+    frame_stream_header *header = nullptr;
+    uint64_t sequence = 0;
+    frame_slot_header *writing = nullptr;
+};
+
+// Producer side. begin_frame returns the payload of the next slot with room
+// for `count` particles, (re)creating the region when it is too small, or
+// nullptr when the stream cannot be mapped; the ids go to frame_ids of that
+// payload. end_frame stamps the slot and publishes it.
+float *begin_frame(frame_stream &stream, size_t count);
+inline uint32_t *frame_ids(float *payload, size_t count) {
+    return reinterpret_cast<uint32_t *>(payload + 3 * count);
+}
+void end_frame(frame_stream &stream, const system_params &params, float t,
+               size_t count);
+void close_frame_stream(frame_stream &stream);
+
+struct frame_stream_reader {
+    std::string name;
+    void *base = nullptr;
+    size_t bytes = 0;
+    const frame_stream_header *header = nullptr;
+    uint64_t last_sequence = 0;
+    uint64_t frames_skipped = 0;
+};
+
+struct frame_info {
+    uint64_t sequence = 0;
+    int64_t timestamp_ns = 0;
+    float time = 0.0f;
+    system_type system = system_type::lorenz;
+    std::vector<float> parameters;
+};
+
+enum class frame_read_result { frame, no_frame, closed };
+
+// Consumer side. read_frame copies the newest frame published since the
+// last call into `positions` (three floats per particle) and, when ids is
+// not null, the particle ids. Particles keep their id while the viewer
+// reorders or compacts them. Frames a slow reader missed are counted in
+// frames_skipped. On `closed`, close the reader and open it again to follow
+// a restarted or resized stream.
+bool open_frame_stream_reader(frame_stream_reader &reader,
+                              const std::string &name);
+frame_read_result read_frame(frame_stream_reader &reader, frame_info &info,
+                             std::vector<float> &positions,
+                             std::vector<uint32_t> *ids = nullptr);
+void close_frame_stream_reader(frame_stream_reader &reader);
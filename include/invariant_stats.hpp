@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Streaming statistics of the particle ensemble, sampled every few substeps
+// by the workers as they integrate. Each worker owns an accumulator; they
+// are combined with the pairwise update of Chan et al. (extended to the
+// third moment by Pebay), which stays accurate for long runs where a naive
+// sum of squares would cancel.
+
+// Count, mean and central moments M2, M3 of one variable (Welford update).
+struct running_moments {
+    uint64_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    double m3 = 0.0;
+
+    void add(double x) {
+        const double n1 = static_cast<double>(count);
+        ++count;
+        const double n = static_cast<double>(count);
+        const double delta = x - mean;
+        const double delta_n = delta / n;
+        const double term = delta * delta_n * n1;
+        mean += delta_n;
+        m3 += term * delta_n * (n - 2.0) - 3.0 * delta_n * m2;
+        m2 += term;
+    }
+
+    double variance() const {
+        return count > 1 ? m2 / static_cast<double>(count - 1) : 0.0;
+    }
+    double skewness() const;
+};
+
+running_moments merge_moments(const running_moments &a,
+                              const running_moments &b);
+
+struct invariant_settings {
+    int sample_every = 8; // substeps between samples
+    int bins = 128;       // marginal histogram bins per axis
+    int projection_size = 256;
+    int axis_u = 0;
+    int axis_v = 2;
+    // Histogram box; fitted to the particles at the first sample when
+    // auto_range is set.
+    bool auto_range = true;
+    glm::vec3 range_min{-30.0f, -30.0f, 0.0f};
+    glm::vec3 range_max{30.0f, 30.0f, 60.0f};
+    // Convergence: the ensemble counts as settled once the moments of
+    // `settle_windows` consecutive windows of `window_samples` samples each
+    // differ from the previous window by less than `tolerance` standard
+    // deviations.
+    int window_samples = 16;
+    int settle_windows = 3;
+    float tolerance = 0.02f;
+};
+
+// Per-worker state. Only the owning worker writes it during a launch.
+struct invariant_accumulator {
+    running_moments axes[3];
+    running_moments window[3];
+    std::vector<uint64_t> marginals; // 3 * bins, axis-major
+    std::vector<uint32_t> projection;
+    uint64_t outside = 0;
+};
+
+// Box-to-bin mapping, precomputed once per launch.
+struct invariant_binning {
+    glm::vec3 origin{0.0f};
+    glm::vec3 scale{0.0f}; // bins per unit
+    int bins = 0;
+    glm::vec2 projection_origin{0.0f};
+    glm::vec2 projection_scale{0.0f};
+    int projection_size = 0;
+    int axis_u = 0;
+    int axis_v = 2;
+};
+
+struct invariant_stats {
+    bool enabled = false;
+    invariant_settings settings;
+    bool range_valid = false;
+    invariant_binning binning;
+    uint64_t substeps = 0;
+    uint64_t samples = 0; // ensemble snapshots taken
+
+    std::vector<invariant_accumulator> threads;
+    invariant_accumulator total; // merged by collect_invariant_stats
+
+    running_moments previous_window[3];
+    bool have_previous_window = false;
+    int window_fill = 0;
+    int quiet_windows = 0;
+    double drift = -1.0; // last window-to-window change, in std devs
+    bool settled = false;
+    float settled_time = -1.0f;
+    // Drop everything gathered before the ensemble settled, so the totals
+    // describe the invariant measure and not the transient.
+    bool discard_transient = true;
+};
+
+inline void accumulate_sample(invariant_accumulator &accumulator,
+                              const invariant_binning &binning,
+                              const glm::vec3 &p) {
+    if (!std::isfinite(p.x + p.y + p.z)) {
+        ++accumulator.outside;
+        return;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        accumulator.axes[axis].add(p[axis]);
+        accumulator.window[axis].add(p[axis]);
+    }
+    const glm::vec3 cell = (p - binning.origin) * binning.scale;
+    const float bins = static_cast<float>(binning.bins);
+    bool inside = true;
+    for (int axis = 0; axis < 3; ++axis) {
+        // Written so NaN fails both comparisons.
+        if (cell[axis] >= 0.0f && cell[axis] < bins) {
+            ++accumulator.marginals[static_cast<size_t>(axis * binning.bins) +
+                                    static_cast<size_t>(cell[axis])];
+        } else {
+            inside = false;
+        }
+    }
+    const glm::vec2 uv =
+        (glm::vec2(p[binning.axis_u], p[binning.axis_v]) -
+         binning.projection_origin) *
+        binning.projection_scale;
+    const float size = static_cast<float>(binning.projection_size);
+    if (uv.x >= 0.0f && uv.y >= 0.0f && uv.x < size && uv.y < size) {
+        const size_t row = static_cast<size_t>(uv.y);
+        ++accumulator.projection[row * static_cast<size_t>(size) +
+                                 static_cast<size_t>(uv.x)];
+    } else {
+        inside = false;
+    }
+    accumulator.outside += inside ? 0 : 1;
+}
+
+void clear_invariant_stats(invariant_stats &stats);
+// Sets the histogram box, growing it a little so that the first samples
+// do not sit on its edges.
+void fit_invariant_range(invariant_stats &stats, const glm::vec3 &low,
+                         const glm::vec3 &high);
+// Counts one substep. With auto_range, call fit_invariant_range first while
+// range_valid is false. On sampling steps it sizes the per-worker
+// accumulators, refreshes stats.binning and returns true.
+bool begin_invariant_sample(invariant_stats &stats, size_t worker_count);
+// Closes a sampling step after the workers joined: advances the
+// convergence window and, once settled, optionally restarts the totals.
+void finish_invariant_sample(invariant_stats &stats, float t);
+// Merges the worker accumulators into stats.total.
+void collect_invariant_stats(invariant_stats &stats);
+
+// Moments and marginal histograms of stats.total.
+bool export_invariant_csv(const invariant_stats &stats, const char *path);
+// Log-scaled 8-bit PGM of a count image, row 0 at the bottom.
+bool write_count_pgm(const uint32_t *counts, int width, int height,
+                     const char *path);
+bool write_count_pgm(const uint64_t *counts, int width, int height,
+                     const char *path);
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "default_init_allocator.hpp"
+#include "glitter.hpp"
+#include "worker_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One large system on a periodic ring of sites: 10^4 to 10^6 state
+// variables integrated as a single trajectory. Right-hand sides are
+// stencils that read `left` sites before and `right` sites after site i
+// through a pointer to site i. Each worker owns a range of cache-sized
+// blocks and runs all four RK4 stages of a block over a small halo-padded
+// buffer, instead of sweeping the whole ring once per stage.
+
+enum class lattice_model {
+    lorenz96 = 0,        // flow, integrated with RK4
+    coupled_logistic = 1 // Kaneko's coupled map lattice, one map per step
+};
+
+struct Lorenz96Args {
+    static constexpr int left = 2;
+    static constexpr int right = 1;
+    static constexpr bool is_map = false;
+    float forcing = 8.0f;
+
+    float operator()(const float *u) const {
+        return (u[1] - u[-2]) * u[-1] - u[0] + forcing;
+    }
+};
+
+struct CoupledLogisticArgs {
+    static constexpr int left = 1;
+    static constexpr int right = 1;
+    static constexpr bool is_map = true;
+    float r = 3.9f;
+    float coupling = 0.3f;
+
+    float local(float x) const { return r * x * (1.0f - x); }
+    float operator()(const float *u) const {
+        return (1.0f - coupling) * local(u[0]) +
+               0.5f * coupling * (local(u[-1]) + local(u[1]));
+    }
+};
+
+struct lattice_settings {
+    lattice_model model = lattice_model::lorenz96;
+    int sites = 65536;
+    Lorenz96Args lorenz96;
+    CoupledLogisticArgs coupled_logistic;
+    float dt = 0.01f; // flows only
+    int steps_per_frame = 4;
+
+    // Space-time heatmap: one row per recorded step, at most
+    // k_lattice_columns sites sampled evenly across the ring.
+    int history_rows = 256;
+    float display_min = -8.0f;
+    float display_max = 12.0f;
+
+    // Delay embedding (x_p(t), x_p(t - delay), x_p(t - 2 delay)) of one
+    // probe site, drawn as the trajectory in the 3D view.
+    int probe_site = 0;
+    int delay_steps = 8;
+    bool embed_in_view = true;
+};
+
+constexpr int k_lattice_columns = 1024;
+
+struct lattice_state {
+    bool enabled = false;
+    // The model, sites and history rows apply on reset_lattice; the model
+    // parameters and dt apply on the next step.
+    lattice_settings settings;
+
+    // Double-buffered so the blocks of one step only read the old state.
+    particle_array<float> current;
+    particle_array<float> next;
+    // Block ranges per worker, and each worker's stage buffers.
+    std::vector<size_t> block_bounds;
+    std::vector<std::vector<float>> scratch;
+
+    uint64_t steps = 0;
+    double time = 0.0;
+    bool diverged = false;
+    double seconds_per_step = 0.0;
+
+    std::vector<float> probe_history; // ring, 2 * delay_steps + 1 values
+    size_t probe_head = 0;
+    size_t probe_filled = 0;
+
+    int columns = 0;
+    std::vector<uint32_t> history; // history_rows x columns RGBA8
+    int history_head = 0;          // next row to write
+    int pending_rows = 0;          // recorded but not yet uploaded
+    GLuint texture = 0;
+};
+
+// Rebuilds the ring from settings and seeds it; each worker seeds the
+// blocks it integrates.
+void reset_lattice(lattice_state &lattice, worker_pool &pool);
+// Advances the ring by steps and appends one delay-embedding point per
+// step to embedding when it is not null.
+void advance_lattice(lattice_state &lattice, worker_pool &pool, int steps,
+                     std::vector<glm::vec3> *embedding);
+// Uploads the heatmap rows recorded since the last call.
+void upload_lattice_texture(lattice_state &lattice);
+void release_lattice_gpu(lattice_state &lattice);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "default_init_allocator.hpp"
+#include "invariant_stats.hpp"
+#include "stochastic.hpp"
+#include "system_params.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+struct particle_retire_list;
+struct simulation_state;
+
+// Particles of the systems with more than three variables. Each state
+// variable has its own array, so the kernel loads k_nd_lanes particles of
+// one component with a single vector load. The renderer, trails, the frame
+// stream and the statistics keep reading particle_positions, which the
+// kernel fills with the 3D projection in the same pass as the step.
+
+constexpr int k_nd_lanes = 8;
+
+enum class nd_projection_mode {
+    coordinates = 0, // three of the state variables
+    principal = 1,   // top three principal axes of the ensemble
+    custom = 2       // rows edited by hand
+};
+
+// rendered = rows * (state - center).
+struct nd_projection {
+    nd_projection_mode mode = nd_projection_mode::coordinates;
+    int axes[3] = {0, 1, 2};
+    float rows[3][k_max_system_dimension] = {};
+    float center[k_max_system_dimension] = {};
+    // principal: refit every this many launches, 0 only on request.
+    int refit_interval = 240;
+    uint32_t launches_since_fit = 0;
+    bool refit = true;
+    // Fraction of the ensemble variance on each principal axis.
+    float explained[k_max_system_dimension] = {};
+};
+
+struct nd_particle_field {
+    int dimension = 0; // 0 while the active system has three variables
+    particle_array<float> components[k_max_system_dimension];
+    nd_projection projection;
+    // Seeds and respawns go around this state, the reference trajectory's
+    // initial condition: most of the neighbourhood of the origin escapes
+    // from the hyperchaotic Rossler system.
+    float spawn_center[k_max_system_dimension] = {};
+};
+
+inline glm::vec3 project_nd_state(const nd_projection &projection,
+                                  int dimension, const float *state) {
+    glm::vec3 result(0.0f);
+    for (int d = 0; d < dimension; ++d) {
+        const float value = state[d] - projection.center[d];
+        result.x += projection.rows[0][d] * value;
+        result.y += projection.rows[1][d] * value;
+        result.z += projection.rows[2][d] * value;
+    }
+    return result;
+}
+
+// Frees the components when dimension is 0. Like allocate_particle_arrays,
+// it starts from untouched storage so the owning workers place the pages.
+void allocate_nd_components(nd_particle_field &field, int dimension,
+                            size_t count);
+// Rebuilds rows and center for the coordinates mode and clamps the axes.
+// The principal mode keeps its last fit; custom keeps the rows as edited.
+void update_nd_projection(nd_projection &projection, int dimension);
+// Principal axes of a strided sample of at most 16384 particles.
+void fit_principal_projection(nd_particle_field &field, size_t count);
+
+// Seeds [begin, end) on a shell around spawn_center and writes the
+// projection and spawn phase of each particle.
+void seed_nd_particles(simulation_state &state, size_t begin, size_t end,
+                       uint32_t seed);
+// One RK4 step of [begin, end) for the active N-dimensional system, or one
+// step of the noise scheme when noise is not null. Escaped and stalled
+// particles are counted in retired and, unless culling is off, appended to
+// its indices: reseeded in place when respawning, left for compaction
+// otherwise. Keep All counts escapes only. Escapes and stalls are measured
+// in the full state space, not the projection, and respawned particles are
+// drawn inside the spawn ball rather than next to a donor.
+void integrate_nd_range(simulation_state &state, size_t begin, size_t end,
+                        float dt, const sde_coefficients *noise,
+                        invariant_accumulator *samples,
+                        particle_retire_list &retired);
+// Rewrites particle_positions after a projection change.
+void reproject_nd_particles(simulation_state &state);
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "fast_math.hpp"
+#include <type_traits>
+
+// W floats advanced in lock step, one lane per particle. The loops have a
+// fixed trip count, so at -O2 each operation is one packed instruction (two
+// for W = 8 on SSE-only targets).
+template <int W> struct float_lanes {
+    static_assert(W > 0, "float_lanes needs at least one lane");
+
+    alignas(sizeof(float) * W) float lane[W];
+
+    float_lanes() = default;
+    // Implicit, so float parameters and literals broadcast to every lane.
+    float_lanes(float value) {
+        for (int i = 0; i < W; ++i) {
+            lane[i] = value;
+        }
+    }
+
+    friend float_lanes operator+(const float_lanes &a, const float_lanes &b) {
+        float_lanes result;
+        for (int i = 0; i < W; ++i) {
+            result.lane[i] = a.lane[i] + b.lane[i];
+        }
+        return result;
+    }
+    friend float_lanes operator-(const float_lanes &a, const float_lanes &b) {
+        float_lanes result;
+        for (int i = 0; i < W; ++i) {
+            result.lane[i] = a.lane[i] - b.lane[i];
+        }
+        return result;
+    }
+    friend float_lanes operator*(const float_lanes &a, const float_lanes &b) {
+        float_lanes result;
+        for (int i = 0; i < W; ++i) {
+            result.lane[i] = a.lane[i] * b.lane[i];
+        }
+        return result;
+    }
+    friend float_lanes operator/(const float_lanes &a, const float_lanes &b) {
+        float_lanes result;
+        for (int i = 0; i < W; ++i) {
+            result.lane[i] = a.lane[i] / b.lane[i];
+        }
+        return result;
+    }
+    friend float_lanes operator-(const float_lanes &a) {
+        float_lanes result;
+        for (int i = 0; i < W; ++i) {
+            result.lane[i] = -a.lane[i];
+        }
+        return result;
+    }
+    // libm's sinf is an opaque call per lane; the polynomials of
+    // fast_math.hpp vectorize like the operators above.
+    friend float_lanes sin(const float_lanes &a) {
+        float_lanes result;
+        for (int i = 0; i < W; ++i) {
+            result.lane[i] = fast_sin(a.lane[i]);
+        }
+        return result;
+    }
+    friend float_lanes cos(const float_lanes &a) {
+        float_lanes result;
+        for (int i = 0; i < W; ++i) {
+            result.lane[i] = fast_cos(a.lane[i]);
+        }
+        return result;
+    }
+};
+
+// x, y and z of W particles, for the three-variable deriv_* functions.
+template <int W> struct vec3_lanes {
+    float_lanes<W> x;
+    float_lanes<W> y;
+    float_lanes<W> z;
+
+    vec3_lanes() = default;
+    vec3_lanes(const float_lanes<W> &x_, const float_lanes<W> &y_,
+               const float_lanes<W> &z_)
+        : x(x_), y(y_), z(z_) {}
+
+    friend vec3_lanes operator+(const vec3_lanes &a, const vec3_lanes &b) {
+        return vec3_lanes(a.x + b.x, a.y + b.y, a.z + b.z);
+    }
+    friend vec3_lanes operator*(float s, const vec3_lanes &v) {
+        const float_lanes<W> scale(s);
+        return vec3_lanes(scale * v.x, scale * v.y, scale * v.z);
+    }
+    friend vec3_lanes operator*(const vec3_lanes &v, float s) { return s * v; }
+};
+
+// State vector of a system with D variables. T is float for one state or
+// float_lanes<W> for W particles at once; the deriv_* functions of the
+// N-dimensional systems index it with value[i].
+template <int D, typename T = float> struct nd_vec {
+    static_assert(D > 0, "nd_vec needs at least one component");
+    static constexpr int dimension = D;
+
+    T component[D];
+
+    nd_vec() = default;
+    template <typename... C,
+              typename = std::enable_if_t<sizeof...(C) == D && (D > 1)>>
+    nd_vec(const C &...values) : component{T(values)...} {}
+
+    T &operator[](int i) { return component[i]; }
+    const T &operator[](int i) const { return component[i]; }
+
+    friend nd_vec operator+(const nd_vec &a, const nd_vec &b) {
+        nd_vec result;
+        for (int i = 0; i < D; ++i) {
+            result.component[i] = a.component[i] + b.component[i];
+        }
+        return result;
+    }
+    friend nd_vec operator*(float s, const nd_vec &v) {
+        nd_vec result;
+        for (int i = 0; i < D; ++i) {
+            result.component[i] = T(s) * v.component[i];
+        }
+        return result;
+    }
+    friend nd_vec operator*(const nd_vec &v, float s) { return s * v; }
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct simulation_state;
+
+// Periodic reordering of the particle arrays along a 3D Morton curve over
+// the particles' bounding box. Integration never reorders particles, so as
+// a chaotic flow stretches the cloud, neighbours in memory drift apart on
+// the attractor and the kernels, the trail copies and the rasterizer touch
+// scattered cache lines and framebuffer tiles. A sort puts spatial
+// neighbours back next to each other.
+//
+// Locality is measured as the mean distance between particles adjacent in
+// memory over a strided sample. A sort runs every `interval` frames, or
+// sooner once that distance grows past `degrade_ratio` times its value
+// just after the last sort. particle_ids travel with the particles, so a
+// consumer can follow one particle across reorders.
+
+constexpr int k_morton_bits = 10; // per axis, 30-bit codes
+constexpr int k_morton_radix_bits = 10;
+
+struct particle_reorder {
+    bool enabled = false;
+    // Frames between sorts; 0 sorts only when locality degrades.
+    int interval = 600;
+    // 0 sorts only on the interval.
+    float degrade_ratio = 2.0f;
+    // Set when the arrays are refilled in spawn order; the next frame sorts.
+    bool pending = true;
+    int frames_since_sort = 0;
+    // Locality just after the last sort and at the last check, in units of
+    // the bounding-box diagonal.
+    float baseline = 0.0f;
+    float locality = 0.0f;
+    size_t sorts = 0;
+    double last_ms = 0.0;
+    // Radix sort scratch, reused across sorts.
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> keys_swap;
+    std::vector<uint32_t> order_swap;
+    std::vector<uint32_t> histograms; // per worker, one bucket per digit
+};
+
+// Mean distance between particles adjacent in memory, over at most 4096
+// strided pairs, divided by the bounding-box diagonal. Non-finite pairs are
+// skipped; returns 0 when nothing is left to measure.
+float measure_particle_locality(const simulation_state &state);
+// Called once per simulated frame; sorts when the interval has passed or
+// locality degraded. A sort clears the particle trails, so it waits while
+// they are drawn. Returns whether the particles were reordered.
+bool update_particle_order(simulation_state &state);
+// Sorts the particles by Morton code now. Delay-system particles keep their
+// history in lane blocks and are left alone, and so are segments, which
+// must stay contiguous.
+bool reorder_particles(simulation_state &state);
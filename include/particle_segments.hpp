@@ -0,0 +1,107 @@
+#pragma once
+
+#include "system_params.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+class Shader;
+struct simulation_state;
+
+// Several systems side by side in one particle ensemble, for comparing
+// presets or parameter sets. Each segment is a contiguous range of the
+// particle arrays with its own system_params and a placement (offset and
+// uniform scale). The particle, trail and rasterizer shaders look the
+// placement up by particle index, so the ensemble is still drawn with one
+// call, and a particle's system id is the segment its index falls in.
+//
+// Segment 0 is the active system and follows the main parameter controls;
+// the others keep their own copy of the parameters. The kernel splits every
+// segment into chunks that the workers claim from a shared counter, so a
+// worker done with cheap Lorenz chunks goes on with the Thomas ones. That
+// trades the fixed partitions' NUMA first-touch locality for load balance:
+// a chunk may run on a worker far from the node that holds its pages. The
+// Poincare sections, invariant statistics and correlation dimension
+// measure segment 0 only, the Morton reorder is off while segments are in
+// use, and the frame stream publishes positions without the placements.
+// Only three-variable presets without a delay can be compared.
+
+constexpr int k_max_segments = 8;
+// Particles per scheduled chunk; a multiple of k_particle_lanes.
+constexpr size_t k_segment_chunk = 8192;
+// Simulated frames after a reseed before the segments are laid out from
+// their particle bounds, so the particles have reached their attractors.
+constexpr int k_segment_arrange_frames = 240;
+
+struct particle_segment {
+    system_params params; // unused for segment 0
+    glm::vec3 offset{0.0f};
+    float scale = 1.0f;
+    size_t first = 0;
+    size_t count = 0;
+};
+
+struct segment_chunk {
+    size_t begin = 0;
+    size_t end = 0;
+    uint32_t segment = 0;
+};
+
+struct particle_segments {
+    bool enabled = false;
+    std::vector<particle_segment> list;
+    // Gap between arranged segments, in widths of segment 0.
+    float spacing = 0.25f;
+    // Scale each segment to the size of segment 0 when arranging.
+    bool match_size = true;
+    // Frames until the automatic arrangement; negative when done.
+    int arrange_countdown = -1;
+    std::vector<segment_chunk> chunks;
+    std::atomic<size_t> next_chunk{0};
+};
+
+// Whether advance_particles and the shaders treat the ensemble as
+// segments: enabled, more than one segment, and a three-variable active
+// system without a delay.
+bool segments_active(const simulation_state &state);
+const system_params &segment_params(const simulation_state &state,
+                                    size_t segment);
+// Appends a segment running a copy of the active system's parameters, or
+// removes one; segment 0 stays. Both reseed on the next
+// initialize_particle_field.
+void add_segment(simulation_state &state);
+void remove_segment(simulation_state &state, size_t segment);
+// Splits total particles evenly between the segments, each range starting
+// on a multiple of k_particle_lanes, and schedules the arrangement.
+void assign_segment_ranges(particle_segments &segments, size_t total);
+// Shrinks the ranges after compaction removed the particles at the sorted
+// indices. The ranges then start wherever compaction left them, not on a
+// lane multiple. The kernel's lane blocks start where a chunk's walk does
+// and each particle's noise is keyed by its index, so results are the same
+// and a chunk's last lane block may just run partly filled; the next
+// reseed aligns the ranges again.
+void shrink_segment_ranges(particle_segments &segments,
+                           const std::vector<uint32_t> &removed);
+// Runs task on every chunk of every segment, the chunks handed out to
+// thread_count workers on demand.
+void run_segment_chunks(
+    simulation_state &state, unsigned int thread_count,
+    const std::function<void(const segment_chunk &, unsigned int)> &task);
+// Called once per simulated frame; arranges the segments when the countdown
+// after a reseed runs out.
+void update_segment_layout(simulation_state &state);
+// Places the segments in a row along x from their particle bounds, next to
+// segment 0, which keeps its place.
+void arrange_segments(simulation_state &state);
+// Bounds of the particles as drawn, with the placements applied.
+bool placed_particle_bounds(const simulation_state &state,
+                            glm::vec3 &out_min, glm::vec3 &out_max);
+// Sets uSegmentCount, uSegmentEnd[] and uSegmentPlacement[] on a shader
+// that is in use; uSegmentCount is 0 while segments are inactive.
+void set_segment_uniforms(const Shader &shader,
+                          const simulation_state &state);
+// Particles of segment 0, which the measurements are restricted to.
+size_t primary_segment_count(const simulation_state &state);
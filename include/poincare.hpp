@@ -0,0 +1,85 @@
+#pragma once
+
+#include "glitter.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct simulation_state;
+
+// Poincare sections of the particle ensemble. The integration kernel tests
+// every particle step against the planes, refines each crossing with a
+// cubic Hermite fit between the two substeps, and streams the hits into
+// one section_cloud per plane.
+
+constexpr int k_max_section_planes = 4;
+constexpr int k_section_grid_size = 512;
+
+// Plane n . x = offset. direction selects which crossings count: +1 for
+// n . x increasing, -1 for decreasing, 0 for both.
+struct section_plane {
+    glm::vec3 normal{0.0f, 0.0f, 1.0f};
+    float offset = 27.0f;
+    int direction = 1;
+    bool enabled = true;
+};
+
+// Normalized plane with an in-plane basis, rebuilt once per kernel launch.
+struct section_frame {
+    glm::vec3 normal{0.0f, 0.0f, 1.0f};
+    glm::vec3 u{1.0f, 0.0f, 0.0f};
+    glm::vec3 v{0.0f, 1.0f, 0.0f};
+    float offset = 0.0f;
+    int direction = 0;
+    bool enabled = false;
+};
+
+struct section_hit {
+    glm::vec3 position;
+    int plane;
+};
+
+// Streaming point cloud for one plane: a ring of the newest hits plus a
+// density grid in plane coordinates for display.
+struct section_cloud {
+    std::vector<glm::vec3> points;
+    size_t head = 0;
+    size_t count = 0;
+    glm::vec2 bounds_min{0.0f};
+    glm::vec2 bounds_max{0.0f};
+    bool bounds_valid = false;
+    size_t outside = 0;
+    std::vector<uint32_t> density;
+    uint32_t density_max = 0;
+    bool dirty = false;
+};
+
+struct poincare_state {
+    bool enabled = false;
+    std::vector<section_plane> planes{section_plane{}};
+    size_t capacity = 1u << 20;
+    int display_plane = 0;
+    uint64_t total_hits = 0;
+
+    section_frame frames[k_max_section_planes];
+    // One buffer per worker; each worker only appends to its own, and the
+    // buffers are merged after the workers have joined.
+    std::vector<std::vector<section_hit>> thread_hits;
+    section_cloud clouds[k_max_section_planes];
+
+    GLuint texture = 0;
+    int texture_plane = -1;
+};
+
+void prepare_poincare(poincare_state &poincare, size_t worker_count);
+void detect_section_crossings(const simulation_state &state,
+                              const glm::vec3 &before, const glm::vec3 &after,
+                              float dt, std::vector<section_hit> &hits);
+void merge_section_hits(poincare_state &poincare);
+void clear_poincare(poincare_state &poincare);
+void clear_section_plane(poincare_state &poincare, int plane);
+glm::vec2 section_coordinates(const section_frame &frame,
+                              const glm::vec3 &point);
+bool export_poincare_csv(const poincare_state &poincare, const char *path);
+void upload_section_texture(poincare_state &poincare);
+void release_poincare_gpu(poincare_state &poincare);
@@ -0,0 +1,80 @@
+#pragma once
+
+// Hot-path profiler. Everything here compiles to nothing unless the build
+// defines CHAOSEQ_PROFILE (cmake -DCHAOSEQ_PROFILE=ON).
+//
+// CPU scopes are recorded into one log per thread slot: slot 0 is the main
+// thread, worker threads bind a slot with CHAOSEQ_PROFILE_THREAD before they
+// record anything. Logs are only read in profiler_end_frame(), after the
+// workers have been joined, so recording never takes a lock.
+
+#include <cstddef>
+#include <cstdint>
+
+enum class profile_counter {
+    derivative_evaluations = 0,
+    particle_steps,
+    bytes_uploaded,
+    count
+};
+
+#ifdef CHAOSEQ_PROFILE
+
+constexpr int k_profiler_max_threads = 256;
+
+uint64_t profiler_now_ns();
+void profiler_bind_thread(int slot);
+void profiler_record(const char *name, uint64_t start_ns, uint64_t end_ns);
+void profiler_add(profile_counter counter, uint64_t amount);
+
+void profiler_begin_frame();
+void profiler_end_frame(float frame_dt);
+void profiler_gpu_begin(const char *name);
+void profiler_gpu_end();
+void profiler_release_gpu();
+bool profiler_export_chrome_trace(const char *path);
+void draw_profiler_overlay(bool *open);
+
+struct profile_scope {
+    explicit profile_scope(const char *scope_name)
+        : name(scope_name), start_ns(profiler_now_ns()) {}
+    ~profile_scope() { profiler_record(name, start_ns, profiler_now_ns()); }
+    profile_scope(const profile_scope &) = delete;
+    profile_scope &operator=(const profile_scope &) = delete;
+
+    const char *name;
+    uint64_t start_ns;
+};
+
+struct profile_gpu_scope {
+    explicit profile_gpu_scope(const char *name) { profiler_gpu_begin(name); }
+    ~profile_gpu_scope() { profiler_gpu_end(); }
+    profile_gpu_scope(const profile_gpu_scope &) = delete;
+    profile_gpu_scope &operator=(const profile_gpu_scope &) = delete;
+};
+
+#define CHAOSEQ_PROFILE_CONCAT_INNER(a, b) a##b
+#define CHAOSEQ_PROFILE_CONCAT(a, b) CHAOSEQ_PROFILE_CONCAT_INNER(a, b)
+#define CHAOSEQ_PROFILE_SCOPE(name)                                           \
+    profile_scope CHAOSEQ_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define CHAOSEQ_PROFILE_GPU_SCOPE(name)                                       \
+    profile_gpu_scope CHAOSEQ_PROFILE_CONCAT(profile_gpu_scope_,             \
+                                             __LINE__)(name)
+#define CHAOSEQ_PROFILE_THREAD(slot) profiler_bind_thread(slot)
+#define CHAOSEQ_PROFILE_COUNT(counter, amount)                                \
+    profiler_add(counter, static_cast<uint64_t>(amount))
+
+#else
+
+inline void profiler_begin_frame() {}
+inline void profiler_end_frame(float) {}
+inline void profiler_release_gpu() {}
+inline bool profiler_export_chrome_trace(const char *) { return false; }
+inline void draw_profiler_overlay(bool *) {}
+
+#define CHAOSEQ_PROFILE_SCOPE(name) ((void)0)
+#define CHAOSEQ_PROFILE_GPU_SCOPE(name) ((void)0)
+#define CHAOSEQ_PROFILE_THREAD(slot) ((void)0)
+#define CHAOSEQ_PROFILE_COUNT(counter, amount) ((void)0)
+
+#endif
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "simulation.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Scripted frame-time scenarios for `--scenario <file>`. The viewer runs the
+// full frame (simulation, uploads, drawing and UI) into an offscreen
+// framebuffer with a fixed simulated step per frame, replays the script's
+// inputs while the mouse and keyboard are ignored, and times every frame up
+// to glFinish. It exits with a failure status when a budget in the script
+// is exceeded, and with k_scenario_skipped when no GL context can be made.
+//
+// One command per line; '#' starts a comment:
+//
+//   frame-dt <seconds>         simulated time per frame (default 1/60)
+//   hitch <ms>                 frames slower than this are hitches
+//   budget p50|p99 <ms>        limits on the measured frames
+//   budget hitches <n>
+//   system <name>              switch preset, as from the System combo
+//   set <name>=<value>         set a parameter of the active system
+//   particles <n>              reseed with n particles
+//   render alpha|hdr|compute
+//   trails on|off
+//   camera fps|orbit
+//   warmup <frames>            run frames that are not measured
+//   frames <frames> [label]    run and measure frames
+//   drag <name> <from> <to> <frames> [label]
+//                              move a parameter linearly, one value a frame
+//   orbit <degrees> <frames> [label]
+//                              turn the orbit camera around its target
+//
+// Budget and hitch lines apply to every frames, drag or orbit command after
+// them until they are changed, and each of those commands is checked on its
+// own, so a cheap segment gets a tight limit next to an expensive one.
+
+// Exit status of a run without a GL context; ctest reports it as skipped.
+constexpr int k_scenario_skipped = 77;
+
+struct scenario_budget {
+    float hitch_ms = 33.3f;
+    // Non-positive limits are not checked.
+    float p50_ms = 0.0f;
+    float p99_ms = 0.0f;
+    int hitches = -1;
+};
+
+enum class scenario_op {
+    system,
+    set,
+    particles,
+    render,
+    trails,
+    camera,
+    warmup,
+    frames,
+    drag,
+    orbit
+};
+
+struct scenario_command {
+    scenario_op op = scenario_op::frames;
+    int line = 0;
+    std::string name; // system or parameter
+    std::string label;
+    float from = 0.0f; // set value, drag start or orbit degrees
+    float to = 0.0f;
+    int frames = 0;
+    int mode = 0; // render mode, trails on, camera mode
+    scenario_budget budget; // frames, drag and orbit
+};
+
+struct scenario_script {
+    std::string path;
+    float frame_dt = 1.0f / 60.0f;
+    // While loading: the budget of the next measured command.
+    scenario_budget budget;
+    std::vector<scenario_command> commands;
+};
+
+// Measured frames of one frames, drag or orbit command.
+struct scenario_segment {
+    std::string label;
+    size_t first = 0;
+    size_t end = 0;
+    scenario_budget budget;
+};
+
+struct scenario_runner {
+    scenario_script script;
+    size_t command = 0;
+    int frame = 0; // frames done of the current command
+    bool failed = false;
+    std::vector<float> frame_ms;
+    std::vector<scenario_segment> segments;
+};
+
+bool load_scenario(const char *path, scenario_script &script);
+// Applies the commands due before the next frame. Returns false once the
+// script is done or a command failed.
+bool scenario_begin_frame(scenario_runner &runner, simulation_state &state,
+                          orbit_camera &orbit, Camera &camera);
+// Records the time of the frame begun last.
+void scenario_end_frame(scenario_runner &runner, double ms);
+// Prints p50, p99, max and hitches per segment and overall and checks each
+// segment against its budget. Returns whether the run passed.
+bool report_scenario(const scenario_runner &runner);
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "dual.hpp"
+#include "system_params.hpp"
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// Parameter sensitivities by forward-mode AD. The Args of the active system
+// are lifted to dual<N> with tangent lane k seeded on one chosen parameter,
+// and rk4_step on dual_vec3<N> then carries d(position)/d(parameter) for all
+// lanes in the same pass as the position itself.
+
+// Parameters are named by their index in system_parameters() order, which
+// is also the field order of every Args struct.
+template <int N, template <typename> class Args>
+Args<dual<N>> lift_args(const Args<float> &args, const int *parameters,
+                        int count) {
+    constexpr size_t fields = sizeof(Args<float>) / sizeof(float);
+    static_assert(sizeof(Args<dual<N>>) == fields * sizeof(dual<N>),
+                  "Args structs hold nothing but their scalars");
+    static_assert(std::is_trivially_copyable<Args<dual<N>>>::value,
+                  "lifted Args are filled with memcpy");
+    float values[fields];
+    std::memcpy(values, &args, sizeof(values));
+    dual<N> lifted_values[fields];
+    for (size_t field = 0; field < fields; ++field) {
+        lifted_values[field] = dual<N>(values[field]);
+    }
+    for (int lane = 0; lane < count && lane < N; ++lane) {
+        const int field = parameters[lane];
+        if (field >= 0 && static_cast<size_t>(field) < fields) {
+            lifted_values[field].tangent[lane] = 1.0f;
+        }
+    }
+    Args<dual<N>> lifted;
+    std::memcpy(&lifted, lifted_values, sizeof(lifted));
+    return lifted;
+}
+
+// Like dispatch_system, but f receives a dual_vec3<N> -> dual_vec3<N>
+// callable whose tangent lane k is the derivative with respect to
+// parameters[k].
+template <int N, typename F>
+decltype(auto) dispatch_sensitivity(const system_params &params,
+                                    const int *parameters, int count, F &&f) {
+    auto lift = [&](const auto &args) {
+        return lift_args<N>(args, parameters, count);
+    };
+    switch (params.current_system) {
+    case system_type::rossler: {
+        const auto args = lift(params.rossler_args);
+        return f([&](const dual_vec3<N> &v) { return deriv_rossler(args, v); });
+    }
+    case system_type::thomas: {
+        const auto args = lift(params.thomas_args);
+        return f([&](const dual_vec3<N> &v) { return deriv_thomas(args, v); });
+    }
+    case system_type::aizawa: {
+        const auto args = lift(params.aizawa_args);
+        return f([&](const dual_vec3<N> &v) { return deriv_aizawa(args, v); });
+    }
+    case system_type::dadras: {
+        const auto args = lift(params.dadras_args);
+        return f([&](const dual_vec3<N> &v) { return deriv_dadras(args, v); });
+    }
+    case system_type::chen: {
+        const auto args = lift(params.chen_args);
+        return f([&](const dual_vec3<N> &v) { return deriv_chen(args, v); });
+    }
+    case system_type::lorenz83: {
+        const auto args = lift(params.lorenz83_args);
+        return f(
+            [&](const dual_vec3<N> &v) { return deriv_lorenz83(args, v); });
+    }
+    case system_type::halvorsen: {
+        const auto args = lift(params.halvorsen_args);
+        return f(
+            [&](const dual_vec3<N> &v) { return deriv_halvorsen(args, v); });
+    }
+    case system_type::rabinovich: {
+        const auto args = lift(params.rabinovich_args);
+        return f(
+            [&](const dual_vec3<N> &v) { return deriv_rabinovich(args, v); });
+    }
+    case system_type::three_scroll: {
+        const auto args = lift(params.three_scroll_args);
+        return f([&](const dual_vec3<N> &v) {
+            return deriv_three_scroll(args, v);
+        });
+    }
+    case system_type::sprott: {
+        const auto args = lift(params.sprott_args);
+        return f([&](const dual_vec3<N> &v) { return deriv_sprott(args, v); });
+    }
+    case system_type::four_wing: {
+        const auto args = lift(params.four_wing_args);
+        return f(
+            [&](const dual_vec3<N> &v) { return deriv_four_wing(args, v); });
+    }
+    case system_type::hyper_rossler:
+    case system_type::lorenz_stenflo:
+    case system_type::mackey_glass:
+    case system_type::delayed_lorenz:
+        // Rejected by chaoseq_set_system.
+    case system_type::lorenz:
+        break;
+    }
+    const auto args = lift(params.lorenz_args);
+    return f([&](const dual_vec3<N> &v) { return deriv_lorenz(args, v); });
+}
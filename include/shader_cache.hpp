@@ -0,0 +1,18 @@
+#pragma once
+
+#include "glitter.hpp"
+#include <cstdint>
+#include <initializer_list>
+
+// On-disk cache of linked program binaries (glGetProgramBinary), stored
+// under $XDG_CACHE_HOME/chaoseq or ~/.cache/chaoseq. Keys hash the driver
+// vendor, renderer and version strings together with the shader sources, so
+// a driver update or a shader edit simply misses.
+
+uint64_t shader_cache_key(std::initializer_list<const char *> sources);
+// Returns a linked program, or 0 on a miss.
+GLuint load_cached_program(uint64_t key);
+// Call before glLinkProgram so the driver keeps the binary around.
+void prepare_cached_program(GLuint program);
+void store_cached_program(GLuint program, uint64_t key);
+void shader_cache_stats(int &hits, int &misses);
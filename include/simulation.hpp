@@ -4,25 +4,49 @@
 #include "Integrator.hpp"
 #include "ODESystems.hpp"
 #include "Shader.hpp"
+#include "basin.hpp"
+#include "correlation_dimension.hpp"
+#include "dde_particles.hpp"
+#include "default_init_allocator.hpp"
+#include "frame_stream.hpp"
 #include "glitter.hpp"
+#include "invariant_stats.hpp"
+#include "lattice.hpp"
+#include "nd_particles.hpp"
+#include "particle_order.hpp"
+#include "particle_segments.hpp"
+#include "poincare.hpp"
+#include "stochastic.hpp"
+#include "system_params.hpp"
+#include "trails.hpp"
+#include "worker_pool.hpp"
+#include <cstdint>
+#include <functional>
 #include <vector>
 
-enum class system_type {
-    lorenz = 0,
-    rossler,
-    thomas,
-    aizawa,
-    dadras,
-    chen,
-    lorenz83,
-    halvorsen,
-    rabinovich,
-    three_scroll,
-    sprott,
-    four_wing
+enum class camera_mode { fps = 0, orbit = 1 };
+
+// Particles the three-variable kernel generates noise for and steps
+// together, in lanes.
+constexpr int k_particle_lanes = 8;
+
+// What advance_particles does with particles that escape, go non-finite or
+// stall on a fixed point. The integration kernels flag them as they step;
+// respawned 3D particles restart next to a live donor.
+enum class particle_cull_mode { off = 0, compact, respawn };
+
+// Particles retired by one worker during a kernel launch, in index order.
+struct particle_retire_list {
+    std::vector<uint32_t> indices;
+    size_t diverged = 0;
+    size_t stalled = 0;
 };
 
-enum class camera_mode { fps = 0, orbit = 1 };
+enum class particle_render_mode {
+    alpha_blend = 0,
+    additive_hdr = 1,
+    compute_raster = 2
+};
 
 struct orbit_camera {
     glm::vec3 target{0.0f, 0.0f, 0.0f};
@@ -40,22 +64,7 @@ struct orbit_camera {
     void clamp_radius();
 };
 
-struct simulation_state {
-    system_type current_system = system_type::lorenz;
-
-    LorenzArgs lorenz_args;
-    RosslerArgs rossler_args;
-    ThomasArgs thomas_args;
-    AizawaArgs aizawa_args;
-    DadrasArgs dadras_args;
-    ChenArgs chen_args;
-    Lorenz83Args lorenz83_args;
-    HalvorsenArgs halvorsen_args;
-    RabinovichArgs rabinovich_args;
-    ThreeScrollArgs three_scroll_args;
-    SprottArgs sprott_args;
-    FourWingArgs four_wing_args;
-
+struct simulation_state : system_params {
     ODESystem system;
     IntegratorRK4 integrator;
 
@@ -78,8 +87,17 @@ struct simulation_state {
 
     size_t particle_count = 10000;
     float particle_spawn_radius = 1.5f;
-    std::vector<glm::vec3> particle_positions;
-    std::vector<float> particle_phases;
+    // For systems with more than three variables this holds the projection
+    // of nd; it is what the renderer and every consumer downstream read.
+    particle_array<glm::vec3> particle_positions;
+    particle_array<float> particle_phases;
+    // Stable identity of the particle in each slot; reordering and
+    // compaction move it with the particle.
+    particle_array<uint32_t> particle_ids;
+    nd_particle_field nd;
+    // History of the delay-system particles; positions hold their state or
+    // delay embedding.
+    dde_particle_field dde;
     bool particle_spawn_from_origin = false;
     float particle_origin_jitter = 0.02f;
     float particle_color_speed = 0.35f;
@@ -88,25 +106,124 @@ struct simulation_state {
     GLuint particle_phase_vbo = 0;
     float particle_point_size = 3.0f;
     size_t particle_buffer_capacity = 0;
+    // Pinned workers and the particle range each one owns.
+    worker_pool workers;
+    std::vector<size_t> particle_partitions;
+    bool particle_phases_dirty = false;
+    // Set whenever the host positions change; update_particle_gpu skips the
+    // position upload while it is clear.
+    bool particle_positions_dirty = true;
+    particle_reorder reorder;
+    particle_segments segments;
+
+    // Noise on the particles; the reference trajectory stays deterministic.
+    noise_settings noise;
+
+    // Off by default: compacting or respawning changes the ensemble being
+    // shown, which the user opts into.
+    particle_cull_mode cull_mode = particle_cull_mode::off;
+    float particle_escape_radius = 1000.0f;
+    float particle_stall_speed = 1e-3f;
+    int particle_stall_steps = 512;
+    particle_array<uint16_t> particle_still_steps;
+    std::vector<particle_retire_list> particle_retired;
+    size_t particles_diverged = 0;
+    size_t particles_stalled = 0;
+    size_t particles_respawned = 0;
+    uint32_t particle_launches = 0;
+
+    particle_render_mode render_mode = particle_render_mode::alpha_blend;
+    float hdr_exposure = 1.0f;
+    float hdr_intensity = 0.25f;
+    GLuint hdr_fbo = 0;
+    GLuint hdr_color_texture = 0;
+    GLuint fullscreen_vao = 0;
+    int hdr_width = 0;
+    int hdr_height = 0;
+    // Framebuffer the frame is drawn into: 0 for the window, or an
+    // offscreen target for scripted runs without a surface.
+    GLuint frame_fbo = 0;
+    GLuint frame_color_rbo = 0;
+    GLuint frame_depth_rbo = 0;
+
+    bool show_particle_trails = false;
+    int particle_trail_length = 32;
+    float trail_budget_mb = 256.0f;
+    float trail_opacity = 0.35f;
+    bool show_trajectory = true;
+    int trajectory_trail_length = 4096;
+    glm::vec3 trajectory_color{1.0f, 0.85f, 0.3f};
+    trail_ring particle_trails;
+    trail_ring trajectory_trail;
+    std::vector<glm::vec3> trajectory_pending;
+    float trails_last_t = -1.0f;
+
+    poincare_state poincare;
+    basin_mapper basin;
+    frame_stream stream;
+    invariant_stats stats;
+    GLuint stats_texture = 0;
+    double stats_upload_time = -1.0;
+    lattice_state lattice;
+    correlation_estimator correlation;
+
+    bool compute_supported = false;
+    GLuint raster_accum_ssbo = 0;
+    int raster_width = 0;
+    int raster_height = 0;
 };
 
-glm::vec3 evaluate_derivative(const simulation_state &state,
-                              const glm::vec3 &position);
-glm::vec3 integrate_particle_rk4(const simulation_state &state,
-                                 const glm::vec3 &position, float dt);
 float compute_spawn_phase(const glm::vec3 &position);
 void ensure_particle_buffers(simulation_state &state);
+void allocate_particle_arrays(simulation_state &state, size_t count);
 void initialize_particle_field(simulation_state &state);
+// Splits [0, total) over the worker pool and returns the partition count.
+// Partition w always runs on worker w, so while the total is unchanged
+// every particle stays on the same core and memory node.
+unsigned int plan_particle_partitions(simulation_state &state, size_t total);
+void run_particle_partitions(
+    simulation_state &state,
+    const std::function<void(size_t, size_t, unsigned int)> &task);
 void update_particle_gpu(simulation_state &state);
 void advance_particles(simulation_state &state, float dt);
+// Copies the particle field into the next frame stream slot, each worker
+// its own partition, and publishes it.
+void publish_particle_frame(simulation_state &state);
+// Bounds of the particles of segment 0, which are all of them unless
+// segments are active.
 bool compute_particle_bounds(const simulation_state &state, glm::vec3 &out_min,
                              glm::vec3 &out_max);
 void upload_axes_vertices(const simulation_state &state);
 void create_axes(simulation_state &state);
-glm::vec3 reset_simulation(simulation_state &state);
+std::vector<float> build_active_system(simulation_state &state);
+// The reference trajectory's state as drawn, projected like the particles.
+glm::vec3 trajectory_point(const simulation_state &state);
+glm::vec3 reset_simulation(simulation_state &state,
+                           bool seed_particles = true);
 void step_simulation(simulation_state &state, float frame_dt);
 void draw_particles(const Shader &shader, const simulation_state &state,
                     const glm::mat4 &view, const glm::mat4 &proj);
+void ensure_hdr_target(simulation_state &state, int width, int height);
+// Creates a multisampled colour and depth target the size of the window and
+// binds it as frame_fbo, in place of the window's default framebuffer.
+void create_offscreen_frame(simulation_state &state, int width, int height);
+void draw_particles_hdr(const Shader &accum_shader,
+                        const Shader &tonemap_shader, simulation_state &state,
+                        const glm::mat4 &view, const glm::mat4 &proj,
+                        int width, int height);
+void ensure_raster_target(simulation_state &state, int width, int height);
+void release_render_targets(simulation_state &state);
+void draw_particles_compute(const Shader &raster_shader,
+                            const Shader &resolve_shader,
+                            simulation_state &state, const glm::mat4 &view,
+                            const glm::mat4 &proj, int width, int height);
+// Colours stats.total.projection into stats_texture for the UI.
+void upload_stats_texture(simulation_state &state);
+void release_stats_gpu(simulation_state &state);
+void update_trails_gpu(simulation_state &state);
+void draw_trails(const Shader &shader, const simulation_state &state,
+                 const glm::mat4 &view_proj);
+void release_trails(simulation_state &state);
 void draw_axes(const Shader &shader, const simulation_state &state,
                const glm::mat4 &mvp);
 void sync_orbit_from_fps(const simulation_state &state, const Camera &fps,
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "simulation.hpp"
+
+constexpr const char *k_default_snapshot_path = "chaoseq.snap";
+
+// Binary checkpoint of the simulation: the active system and every preset's
+// parameters, dt, t, the reference trajectory, both cameras and the particle
+// arrays. The particle block starts on a page boundary so load_snapshot can
+// map the file and hand the block to the driver without parsing it. With
+// segments active only segment 0 is saved.
+bool save_snapshot(const simulation_state &state, const Camera &camera,
+                   const orbit_camera &orbit, const char *path);
+bool load_snapshot(simulation_state &state, Camera &camera,
+                   orbit_camera &orbit, const char *path);
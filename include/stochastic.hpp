@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Noise-driven particles: dx = f(x) dt + g(x) dW with diagonal noise,
+// g = sigma (additive) or g_i = sigma x_i (multiplicative). Every particle
+// draws its increments from its own Philox stream, keyed by particle index
+// and seed and counted by launch, so the noise does not depend on the thread
+// count and no generator state is shared or stored.
+
+enum class noise_mode { off = 0, additive = 1, multiplicative = 2 };
+
+enum class sde_scheme {
+    euler_maruyama = 0, // strong order 0.5 (1.0 for additive noise)
+    platen = 1          // derivative-free strong order 1.0
+};
+
+struct noise_settings {
+    noise_mode mode = noise_mode::off;
+    sde_scheme scheme = sde_scheme::euler_maruyama;
+    float sigma = 0.5f;
+    uint32_t seed = 1;
+    // Counter of the Philox streams, advanced once per particle launch.
+    uint64_t launch = 0;
+};
+
+// Per-step constants of a scheme.
+struct sde_coefficients {
+    float sigma = 0.0f;
+    float dt = 0.0f;
+    float sqrt_dt = 0.0f;
+    float inv_two_sqrt_dt = 0.0f;
+    bool multiplicative = false;
+    bool platen = false;
+};
+
+inline sde_coefficients make_sde_coefficients(const noise_settings &settings,
+                                              float dt) {
+    sde_coefficients result;
+    result.sigma = settings.sigma;
+    result.dt = dt;
+    result.sqrt_dt = std::sqrt(dt);
+    result.inv_two_sqrt_dt = 0.5f / result.sqrt_dt;
+    result.multiplicative = settings.mode == noise_mode::multiplicative;
+    result.platen = settings.scheme == sde_scheme::platen;
+    return result;
+}
+
+// One component of a step from x with drift f(x) and standard normal xi; T
+// is float or float_lanes<W>.
+// Platen's scheme adds (g(support) - g(x)) (dW^2 - dt) / (2 sqrt(dt)) with
+// support = x + f dt + g sqrt(dt); for additive noise that term vanishes and
+// both schemes coincide.
+template <typename T>
+inline T sde_component(const sde_coefficients &c, const T &x, const T &drift,
+                       const T &xi) {
+    const T deterministic = x + T(c.dt) * drift;
+    const T dw = T(c.sqrt_dt) * xi;
+    if (!c.multiplicative) {
+        return deterministic + T(c.sigma) * dw;
+    }
+    const T g = T(c.sigma) * x;
+    T result = deterministic + g * dw;
+    if (c.platen) {
+        const T support_g = T(c.sigma) * (deterministic + T(c.sqrt_dt) * g);
+        result = result + (support_g - g) * (dw * dw - T(c.dt)) *
+                              T(c.inv_two_sqrt_dt);
+    }
+    return result;
+}
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3") on W independent counters. Every operation is a fixed-count loop over
+// the lanes, so the rounds compile to packed integer multiplies.
+template <int W> struct philox_lanes {
+    uint32_t counter[4][W];
+    uint32_t key0[W];
+    uint32_t key1 = 0;
+
+    void generate() {
+        for (int round = 0; round < 10; ++round) {
+            const uint32_t bump0 = static_cast<uint32_t>(round) * 0x9E3779B9u;
+            const uint32_t round_key1 =
+                key1 + static_cast<uint32_t>(round) * 0xBB67AE85u;
+            for (int l = 0; l < W; ++l) {
+                const uint64_t product0 =
+                    static_cast<uint64_t>(0xD2511F53u) * counter[0][l];
+                const uint64_t product1 =
+                    static_cast<uint64_t>(0xCD9E8D57u) * counter[2][l];
+                const uint32_t odd1 = counter[1][l];
+                const uint32_t odd3 = counter[3][l];
+                counter[0][l] = static_cast<uint32_t>(product1 >> 32) ^ odd1 ^
+                                (key0[l] + bump0);
+                counter[1][l] = static_cast<uint32_t>(product1);
+                counter[2][l] =
+                    static_cast<uint32_t>(product0 >> 32) ^ odd3 ^ round_key1;
+                counter[3][l] = static_cast<uint32_t>(product0);
+            }
+        }
+    }
+};
+
+// Natural log for x > 0 from the exponent and a polynomial on the mantissa
+// (the Cephes logf expansion); about 1 ulp, and vectorizable unlike logf.
+inline float fast_log(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof bits);
+    // Mantissas below sqrt(1/2) use 2m and one less in the exponent. The
+    // test is on the integer bits so the compiler can turn it into a mask.
+    const uint32_t mantissa = bits & 0x007FFFFFu;
+    const int low = mantissa < 0x003504F3u ? 1 : 0;
+    const float exponent =
+        static_cast<float>(static_cast<int>(bits >> 23) - 126 - low);
+    bits = mantissa | (static_cast<uint32_t>(126 + low) << 23);
+    float m;
+    std::memcpy(&m, &bits, sizeof m);
+    m -= 1.0f;
+    const float z = m * m;
+    float y = 7.0376836292e-2f;
+    y = y * m - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+    y += exponent * -2.12194440e-4f;
+    y -= 0.5f * z;
+    return m + y + exponent * 0.693359375f;
+}
+
+// Central branch of Giles' single-precision erfinv ("Approximating the
+// erfinv function", GPU Gems Pro), valid while w = -log(1 - x^2) < 5.
+inline float erfinv_central(float x, float w) {
+    w -= 2.5f;
+    float p = 2.81022636e-08f;
+    p = 3.43273939e-07f + p * w;
+    p = -3.5233877e-06f + p * w;
+    p = -4.39150654e-06f + p * w;
+    p = 0.00021858087f + p * w;
+    p = -0.00125372503f + p * w;
+    p = -0.00417768164f + p * w;
+    p = 0.246640727f + p * w;
+    p = 1.50140941f + p * w;
+    return p * x;
+}
+
+inline float erfinv_tail(float x, float w) {
+    w = std::sqrt(w) - 3.0f;
+    float p = -0.000200214257f;
+    p = 0.000100950558f + p * w;
+    p = 0.00134934322f + p * w;
+    p = -0.00367342844f + p * w;
+    p = 0.00573950773f + p * w;
+    p = -0.0076224613f + p * w;
+    p = 0.00943887047f + p * w;
+    p = 1.00167406f + p * w;
+    p = 2.83297682f + p * w;
+    return p * x;
+}
+
+// C standard normals per particle for W consecutive particles. Particle i
+// uses key (i, seed) and counter (launch, group), four normals per group,
+// by inverting the normal CDF: no rejection, so all lanes stay in step.
+// Only |z| > 2.9 (about 0.4% of draws) takes the scalar tail fix-up.
+template <int W, int C>
+inline void gaussian_lanes(uint32_t seed, uint64_t launch, size_t first,
+                           float (&out)[C][W]) {
+    constexpr int groups = (C + 3) / 4;
+    for (int group = 0; group < groups; ++group) {
+        philox_lanes<W> philox;
+        for (int l = 0; l < W; ++l) {
+            philox.counter[0][l] = static_cast<uint32_t>(launch);
+            philox.counter[1][l] = static_cast<uint32_t>(launch >> 32);
+            philox.counter[2][l] = static_cast<uint32_t>(group);
+            philox.counter[3][l] = 0u;
+            philox.key0[l] = static_cast<uint32_t>(first + l);
+        }
+        philox.key1 = seed;
+        philox.generate();
+        for (int word = 0; word < 4 && group * 4 + word < C; ++word) {
+            float *row = out[group * 4 + word];
+            float x[W];
+            float w[W];
+            bool tail = false;
+            for (int l = 0; l < W; ++l) {
+                // Odd multiples of 2^-24 in (-1, 1), so 1 - x^2 > 0.
+                x[l] = static_cast<float>(
+                           static_cast<int32_t>(
+                               (philox.counter[word][l] >> 7) | 1u) -
+                           (1 << 24)) *
+                       (1.0f / 16777216.0f);
+                w[l] = -fast_log((1.0f - x[l]) * (1.0f + x[l]));
+                row[l] = 1.41421356f * erfinv_central(x[l], w[l]);
+            }
+            for (int l = 0; l < W; ++l) {
+                tail |= w[l] >= 5.0f;
+            }
+            if (tail) {
+                for (int l = 0; l < W; ++l) {
+                    if (w[l] >= 5.0f) {
+                        row[l] = 1.41421356f * erfinv_tail(x[l], w[l]);
+                    }
+                }
+            }
+        }
+    }
+}
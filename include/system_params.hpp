@@ -0,0 +1,273 @@
+#pragma once
+
+#include "ODESystems.hpp"
+#include <string>
+#include <type_traits>
+#include <vector>
+
+enum class system_type {
+    lorenz = 0,
+    rossler,
+    thomas,
+    aizawa,
+    dadras,
+    chen,
+    lorenz83,
+    halvorsen,
+    rabinovich,
+    three_scroll,
+    sprott,
+    four_wing,
+    hyper_rossler,
+    lorenz_stenflo,
+    mackey_glass,
+    delayed_lorenz
+};
+
+// Most state variables of any preset; sizes the N-dimensional particle
+// storage.
+constexpr int k_max_system_dimension = 4;
+
+// The active preset and the parameters of every preset. Plain data, so a
+// background job can take a snapshot by copying it.
+struct system_params {
+    system_type current_system = system_type::lorenz;
+
+    LorenzArgs lorenz_args;
+    RosslerArgs rossler_args;
+    ThomasArgs thomas_args;
+    AizawaArgs aizawa_args;
+    DadrasArgs dadras_args;
+    ChenArgs chen_args;
+    Lorenz83Args lorenz83_args;
+    HalvorsenArgs halvorsen_args;
+    RabinovichArgs rabinovich_args;
+    ThreeScrollArgs three_scroll_args;
+    SprottArgs sprott_args;
+    FourWingArgs four_wing_args;
+    HyperRosslerArgs hyper_rossler_args;
+    LorenzStenfloArgs lorenz_stenflo_args;
+    MackeyGlassArgs mackey_glass_args;
+    DelayedLorenzArgs delayed_lorenz_args;
+};
+
+// Lower-case preset names ("lorenz", "three_scroll", ...) for command
+// lines and file formats.
+const char *system_name(system_type type);
+bool parse_system_type(const std::string &name, system_type &type);
+// The Args::dimension of the preset. Everything built on glm::vec3
+// (dispatch_system, the basin mapper, Poincare sections, sensitivities,
+// chaoseq_core and the C API) handles only the three-variable presets
+// without a delay.
+int system_dimension(system_type type);
+bool system_has_delay(system_type type);
+// tau of the active delay system, 0 for the ODEs.
+float system_delay(const system_params &params);
+
+struct named_parameter {
+    const char *name;
+    float *value;
+};
+
+// The parameters of the active system, by the names the UI shows.
+std::vector<named_parameter> system_parameters(system_params &params);
+float *find_system_parameter(system_params &params, const std::string &name);
+
+// Calls f with a callable vec3 -> vec3 for the active system. The switch
+// runs once, so loops inside f are specialized for a single system.
+template <typename F>
+decltype(auto) dispatch_system(const system_params &params, F &&f) {
+    switch (params.current_system) {
+    case system_type::rossler:
+        return f([&](const glm::vec3 &v) {
+            return deriv_rossler(params.rossler_args, v);
+        });
+    case system_type::thomas:
+        return f([&](const glm::vec3 &v) {
+            return deriv_thomas(params.thomas_args, v);
+        });
+    case system_type::aizawa:
+        return f([&](const glm::vec3 &v) {
+            return deriv_aizawa(params.aizawa_args, v);
+        });
+    case system_type::dadras:
+        return f([&](const glm::vec3 &v) {
+            return deriv_dadras(params.dadras_args, v);
+        });
+    case system_type::chen:
+        return f([&](const glm::vec3 &v) {
+            return deriv_chen(params.chen_args, v);
+        });
+    case system_type::lorenz83:
+        return f([&](const glm::vec3 &v) {
+            return deriv_lorenz83(params.lorenz83_args, v);
+        });
+    case system_type::halvorsen:
+        return f([&](const glm::vec3 &v) {
+            return deriv_halvorsen(params.halvorsen_args, v);
+        });
+    case system_type::rabinovich:
+        return f([&](const glm::vec3 &v) {
+            return deriv_rabinovich(params.rabinovich_args, v);
+        });
+    case system_type::three_scroll:
+        return f([&](const glm::vec3 &v) {
+            return deriv_three_scroll(params.three_scroll_args, v);
+        });
+    case system_type::sprott:
+        return f([&](const glm::vec3 &v) {
+            return deriv_sprott(params.sprott_args, v);
+        });
+    case system_type::four_wing:
+        return f([&](const glm::vec3 &v) {
+            return deriv_four_wing(params.four_wing_args, v);
+        });
+    case system_type::hyper_rossler:
+    case system_type::lorenz_stenflo:
+    case system_type::mackey_glass:
+    case system_type::delayed_lorenz:
+        // No vec3 form; callers check system_dimension() and
+        // system_has_delay() first.
+    case system_type::lorenz:
+        break;
+    }
+    return f([&](const glm::vec3 &v) {
+        return deriv_lorenz(params.lorenz_args, v);
+    });
+}
+
+// The systems with more than three variables. f receives the dimension as
+// std::integral_constant<int, D> and a generic callable V -> V for
+// V = nd_vec<D, T>, so the same kernel runs on single states and on lanes.
+template <typename F>
+decltype(auto) dispatch_nd_system(const system_params &params, F &&f) {
+    if (params.current_system == system_type::lorenz_stenflo) {
+        return f(std::integral_constant<int, LorenzStenfloArgs::dimension>(),
+                 [&](const auto &v) {
+                     return deriv_lorenz_stenflo(params.lorenz_stenflo_args,
+                                                 v);
+                 });
+    }
+    return f(std::integral_constant<int, HyperRosslerArgs::dimension>(),
+             [&](const auto &v) {
+                 return deriv_hyper_rossler(params.hyper_rossler_args, v);
+             });
+}
+
+// The delay systems, like dispatch_nd_system but with a callable
+// (V value, V delayed) -> V.
+template <typename F>
+decltype(auto) dispatch_dde_system(const system_params &params, F &&f) {
+    if (params.current_system == system_type::delayed_lorenz) {
+        return f(std::integral_constant<int, DelayedLorenzArgs::dimension>(),
+                 [&](const auto &v, const auto &delayed) {
+                     return deriv_delayed_lorenz(params.delayed_lorenz_args,
+                                                 v, delayed);
+                 });
+    }
+    return f(std::integral_constant<int, MackeyGlassArgs::dimension>(),
+             [&](const auto &v, const auto &delayed) {
+                 return deriv_mackey_glass(params.mackey_glass_args, v,
+                                           delayed);
+             });
+}
+
+// V is glm::vec3, nd_vec<D, T>, or dual_vec3<N> to carry tangents through
+// the step.
+template <typename Deriv, typename V>
+inline V rk4_step(const Deriv &deriv, const V &position, float dt) {
+    const V k1 = deriv(position);
+    const V k2 = deriv(position + 0.5f * dt * k1);
+    const V k3 = deriv(position + 0.5f * dt * k2);
+    const V k4 = deriv(position + dt * k3);
+    return position + (dt / 6.0f) * (k1 + 2.0f * k2 + 2.0f * k3 + k4);
+}
+
+inline glm::vec3 evaluate_derivative(const system_params &params,
+                                     const glm::vec3 &position) {
+    switch (params.current_system) {
+    case system_type::lorenz:
+        return deriv_lorenz(params.lorenz_args, position);
+    case system_type::rossler:
+        return deriv_rossler(params.rossler_args, position);
+    case system_type::thomas:
+        return deriv_thomas(params.thomas_args, position);
+    case system_type::aizawa:
+        return deriv_aizawa(params.aizawa_args, position);
+    case system_type::dadras:
+        return deriv_dadras(params.dadras_args, position);
+    case system_type::chen:
+        return deriv_chen(params.chen_args, position);
+    case system_type::lorenz83:
+        return deriv_lorenz83(params.lorenz83_args, position);
+    case system_type::halvorsen:
+        return deriv_halvorsen(params.halvorsen_args, position);
+    case system_type::rabinovich:
+        return deriv_rabinovich(params.rabinovich_args, position);
+    case system_type::three_scroll:
+        return deriv_three_scroll(params.three_scroll_args, position);
+    case system_type::sprott:
+        return deriv_sprott(params.sprott_args, position);
+    case system_type::four_wing:
+        return deriv_four_wing(params.four_wing_args, position);
+    case system_type::hyper_rossler:
+    case system_type::lorenz_stenflo:
+    case system_type::mackey_glass:
+    case system_type::delayed_lorenz:
+        break;
+    }
+    return glm::vec3(0.0f);
+}
+
+inline glm::vec3 integrate_particle_rk4(const system_params &params,
+                                        const glm::vec3 &position, float dt) {
+    return rk4_step(
+        [&](const glm::vec3 &v) { return evaluate_derivative(params, v); },
+        position, dt);
+}
+
+// Whether the particle kernel steps this preset W particles at a time. That
+// pays off when the right-hand side calls sin or cos: on floats each call
+// goes to libm, while float_lanes evaluates the vectorized polynomials of
+// fast_math.hpp. The polynomial presets are as fast one particle at a time.
+inline bool system_steps_in_lanes(system_type type) {
+    return type == system_type::thomas;
+}
+
+// evaluate_derivative for W particles of a three-variable preset.
+template <int W>
+inline vec3_lanes<W> evaluate_derivative(const system_params &params,
+                                        const vec3_lanes<W> &position) {
+    switch (params.current_system) {
+    case system_type::lorenz:
+        return deriv_lorenz(params.lorenz_args, position);
+    case system_type::rossler:
+        return deriv_rossler(params.rossler_args, position);
+    case system_type::thomas:
+        return deriv_thomas(params.thomas_args, position);
+    case system_type::aizawa:
+        return deriv_aizawa(params.aizawa_args, position);
+    case system_type::dadras:
+        return deriv_dadras(params.dadras_args, position);
+    case system_type::chen:
+        return deriv_chen(params.chen_args, position);
+    case system_type::lorenz83:
+        return deriv_lorenz83(params.lorenz83_args, position);
+    case system_type::halvorsen:
+        return deriv_halvorsen(params.halvorsen_args, position);
+    case system_type::rabinovich:
+        return deriv_rabinovich(params.rabinovich_args, position);
+    case system_type::three_scroll:
+        return deriv_three_scroll(params.three_scroll_args, position);
+    case system_type::sprott:
+        return deriv_sprott(params.sprott_args, position);
+    case system_type::four_wing:
+        return deriv_four_wing(params.four_wing_args, position);
+    case system_type::hyper_rossler:
+    case system_type::lorenz_stenflo:
+    case system_type::mackey_glass:
+    case system_type::delayed_lorenz:
+        break;
+    }
+    return vec3_lanes<W>(0.0f, 0.0f, 0.0f);
+}
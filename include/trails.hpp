@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Shader.hpp"
+#include "glitter.hpp"
+#include <cstddef>
+
+// History ring on the GPU. The buffer is slot-major: slot s holds `stride`
+// consecutive points, so appending a frame touches exactly one contiguous
+// slice and older slices are never re-uploaded. Trails are drawn as one
+// instanced line strip per point, walking back from the head modulo the
+// ring length in the vertex shader.
+struct trail_ring {
+    GLuint vao = 0;
+    GLuint buffer = 0;
+    GLuint texture = 0;
+    size_t stride = 0;
+    int length = 0;
+    int head = 0;
+    int filled = 0;
+};
+
+int trail_length_within_budget(size_t stride, int requested,
+                               size_t budget_bytes);
+bool ensure_trail_ring(trail_ring &ring, size_t stride, int length);
+void reset_trail_ring(trail_ring &ring);
+void release_trail_ring(trail_ring &ring);
+void push_trail_points(trail_ring &ring, const glm::vec3 *points,
+                       size_t count);
+void copy_trail_slice(trail_ring &ring, GLuint source_buffer);
+void draw_trail_ring(const Shader &shader, const trail_ring &ring);
@@ -4,3 +4,8 @@
 
 void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
              bool &mouse_look_enabled, bool &orbit_dragging);
+void draw_poincare_ui(simulation_state &state);
+void draw_basin_ui(simulation_state &state);
+void draw_stats_ui(simulation_state &state);
+void draw_lattice_ui(simulation_state &state);
+void draw_correlation_ui(simulation_state &state);
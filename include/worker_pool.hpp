@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A logical CPU a worker can be pinned to.
+struct cpu_slot {
+    int cpu = -1; // -1 leaves the worker unpinned
+    int node = 0;
+    // Relative throughput; efficiency cores on hybrid parts get less than 1.
+    float weight = 1.0f;
+};
+
+// Reads the allowed CPUs, their NUMA nodes and core types from sysfs. SMT
+// siblings are listed after every physical core, and slots are grouped by
+// node so consecutive partitions share a socket. Off Linux, one unpinned
+// slot per hardware thread.
+std::vector<cpu_slot> detect_cpu_slots();
+// Pins the calling thread to one CPU; a negative cpu, or a platform other
+// than Linux, makes it a no-op.
+void pin_current_thread(int cpu);
+
+// Persistent workers, each pinned to one slot for its whole life. Worker w
+// always runs partition w, so the pages it touched first stay local to it.
+struct worker_pool {
+    std::vector<cpu_slot> slots;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(unsigned int)> *task = nullptr;
+    unsigned int active = 0;
+    unsigned int remaining = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    worker_pool() = default;
+    worker_pool(const worker_pool &) = delete;
+    worker_pool &operator=(const worker_pool &) = delete;
+    ~worker_pool();
+};
+
+// Starts one worker per detected slot, or only the first max_threads slots
+// when max_threads is non-zero.
+void start_worker_pool(worker_pool &pool, unsigned int max_threads = 0);
+void stop_worker_pool(worker_pool &pool);
+unsigned int worker_count(const worker_pool &pool);
+// Runs task(w) for every w below count, each on worker w, and waits. count
+// is capped at the number of workers; without workers the tasks run inline.
+void run_workers(worker_pool &pool, unsigned int count,
+                 const std::function<void(unsigned int)> &task);
+// Splits [0, total) into count ranges sized by the slot weights. bounds
+// receives count + 1 entries.
+void partition_by_weight(const worker_pool &pool, size_t total,
+                         unsigned int count, std::vector<size_t> &bounds);
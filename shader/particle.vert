@@ -11,6 +11,22 @@ uniform int uMonochrome;
 
 out vec3 vColor;
 
+// Segments drawn side by side. Particles are grouped by segment, so the
+// index picks the placement; uSegmentCount is 0 for a single system.
+const int kMaxSegments = 8;
+uniform int uSegmentCount;
+uniform int uSegmentEnd[kMaxSegments];
+uniform vec4 uSegmentPlacement[kMaxSegments];
+
+vec3 placeSegment(vec3 pos, int index) {
+    for (int s = 0; s < uSegmentCount; ++s) {
+        if (index < uSegmentEnd[s]) {
+            return pos * uSegmentPlacement[s].w + uSegmentPlacement[s].xyz;
+        }
+    }
+    return pos;
+}
+
 vec3 computeColor(vec3 pos, float phase, float time, float colorSpeed) {
     float radius = length(pos);
     vec3 dir = radius > 1e-5 ? normalize(pos) : vec3(1.0, 0.0, 0.0);
@@ -30,7 +46,7 @@ void main() {
         color = vec3(1.0);
     }
     vColor = color;
-    vec4 viewPos = uView * vec4(aPos, 1.0);
+    vec4 viewPos = uView * vec4(placeSegment(aPos, gl_VertexID), 1.0);
     float dist = length(viewPos.xyz);
     float attenuation = 15.0 / (dist + 5.0);
     float size = uPointSize * attenuation;
@@ -0,0 +1,15 @@
+#version 400 core
+in vec3 vColor;
+out vec4 FragColor;
+
+uniform float uIntensity;
+
+// Additive accumulation variant of particle.frag: no discard and no depth,
+// every fragment adds its weighted colour to the HDR target.
+void main() {
+    vec2 coord = gl_PointCoord * 2.0 - 1.0;
+    float r2 = dot(coord, coord);
+    float weight = 1.0 - smoothstep(0.6, 1.0, r2);
+    weight *= uIntensity;
+    FragColor = vec4(vColor * weight, weight);
+}
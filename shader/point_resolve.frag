@@ -0,0 +1,19 @@
+#version 430 core
+out vec4 FragColor;
+
+layout(std430, binding = 2) readonly buffer Accum { uint accum[]; };
+
+uniform int uWidth;
+uniform float uExposure;
+
+const float kFixedPointScale = 256.0;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uint base = uint(pixel.y * uWidth + pixel.x) * 4u;
+    vec4 value = vec4(accum[base], accum[base + 1u], accum[base + 2u],
+                      accum[base + 3u]) / kFixedPointScale;
+    vec3 color = vec3(1.0) - exp(-value.rgb * uExposure);
+    float coverage = 1.0 - exp(-value.a * uExposure);
+    FragColor = vec4(color, coverage);
+}
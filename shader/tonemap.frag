@@ -0,0 +1,14 @@
+#version 400 core
+in vec2 vUV;
+out vec4 FragColor;
+
+uniform sampler2D uAccum;
+uniform float uExposure;
+
+void main() {
+    vec4 accum = texture(uAccum, vUV);
+    vec3 color = vec3(1.0) - exp(-accum.rgb * uExposure);
+    float coverage = 1.0 - exp(-accum.a * uExposure);
+    // Premultiplied output, composited over the axes with ONE/ONE_MINUS_SRC_ALPHA.
+    FragColor = vec4(color, coverage);
+}
@@ -0,0 +1,7 @@
+#version 400 core
+in vec4 vColor;
+out vec4 FragColor;
+
+void main() {
+    FragColor = vColor;
+}
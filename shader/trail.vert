@@ -0,0 +1,63 @@
+#version 400 core
+// Per-instance phase; unused (reads as 0) for the reference trajectory.
+layout (location = 1) in float aPhase;
+
+uniform samplerBuffer uHistory;
+uniform mat4 uViewProj;
+uniform int uStride;
+uniform int uLength;
+uniform int uHead;
+uniform int uFilled;
+uniform float uTime;
+uniform float uColorSpeed;
+uniform int uMonochrome;
+uniform int uUsePhase;
+uniform vec3 uColor;
+uniform float uOpacity;
+
+out vec4 vColor;
+
+// Segments drawn side by side. Particles are grouped by segment, so the
+// index picks the placement; uSegmentCount is 0 for a single system.
+const int kMaxSegments = 8;
+uniform int uSegmentCount;
+uniform int uSegmentEnd[kMaxSegments];
+uniform vec4 uSegmentPlacement[kMaxSegments];
+
+vec3 placeSegment(vec3 pos, int index) {
+    for (int s = 0; s < uSegmentCount; ++s) {
+        if (index < uSegmentEnd[s]) {
+            return pos * uSegmentPlacement[s].w + uSegmentPlacement[s].xyz;
+        }
+    }
+    return pos;
+}
+
+vec3 computeColor(vec3 pos, float phase, float time, float colorSpeed) {
+    float radius = length(pos);
+    vec3 dir = radius > 1e-5 ? normalize(pos) : vec3(1.0, 0.0, 0.0);
+    float hue = phase + time * colorSpeed;
+    vec3 wave = dir * 2.0 + vec3(radius * 0.12);
+    float r = 0.5 + 0.5 * sin(hue + wave.x);
+    float g = 0.5 + 0.5 * sin(hue + wave.y + 2.0943951);
+    float b = 0.5 + 0.5 * sin(hue + wave.z + 4.1887902);
+    vec3 base = vec3(r, g, b);
+    float glow = clamp(radius * 0.02, 0.0, 1.0);
+    return mix(base, vec3(1.0), glow * 0.25);
+}
+
+void main() {
+    // Vertex 0 is the newest sample; walk backwards from the ring head.
+    int age = gl_VertexID;
+    int slot = (uHead - 1 - age + 2 * uLength) % uLength;
+    vec3 pos = texelFetch(uHistory, slot * uStride + gl_InstanceID).xyz;
+
+    vec3 color = uColor;
+    if (uUsePhase != 0) {
+        color = uMonochrome != 0 ? vec3(1.0)
+                                 : computeColor(pos, aPhase, uTime, uColorSpeed);
+    }
+    float fade = 1.0 - float(age) / float(max(uFilled - 1, 1));
+    vColor = vec4(color, fade * fade * uOpacity);
+    gl_Position = uViewProj * vec4(placeSegment(pos, gl_InstanceID), 1.0);
+}
@@ -0,0 +1,491 @@
+#include "basin.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+constexpr int k_tile_size = 16;
+constexpr int k_lanes = 16;
+constexpr int k_sweep_steps = 16;
+constexpr int k_still_sweeps = 4;
+constexpr double k_upload_interval = 0.1;
+
+vec3 lane_value(const vec3_lanes<k_lanes> &v, int lane) {
+    return vec3(v.x.lane[lane], v.y.lane[lane], v.z.lane[lane]);
+}
+
+void set_lane(vec3_lanes<k_lanes> &v, int lane, const vec3 &value) {
+    v.x.lane[lane] = value.x;
+    v.y.lane[lane] = value.y;
+    v.z.lane[lane] = value.z;
+}
+
+// Batch of in-flight initial conditions on float_lanes, stepped k_lanes at
+// a time like the particle kernel. Lanes that reach a verdict are refilled
+// from the current tile, and once the tile runs dry the batch is compacted
+// into the first active lanes; the idle lanes past them are stepped too,
+// but never read.
+struct lane_batch {
+    vec3_lanes<k_lanes> position{0.0f, 0.0f, 0.0f};
+    vec3_lanes<k_lanes> last{0.0f, 0.0f, 0.0f};
+    vec3_lanes<k_lanes> sum{0.0f, 0.0f, 0.0f};
+    float_lanes<k_lanes> sum_sq{0.0f};
+    int steps[k_lanes];
+    int still[k_lanes];
+    size_t cell[k_lanes];
+    int active = 0;
+
+    // initial_weight is 1 when the initial condition is itself a sample.
+    void load(int lane, size_t cell_index, const vec3 &p,
+              float initial_weight) {
+        set_lane(position, lane, p);
+        set_lane(last, lane, p);
+        set_lane(sum, lane, initial_weight * p);
+        sum_sq.lane[lane] = initial_weight * dot(p, p);
+        steps[lane] = 0;
+        still[lane] = 0;
+        cell[lane] = cell_index;
+    }
+
+    void move(int to, int from) {
+        set_lane(position, to, lane_value(position, from));
+        set_lane(last, to, lane_value(last, from));
+        set_lane(sum, to, lane_value(sum, from));
+        sum_sq.lane[to] = sum_sq.lane[from];
+        steps[to] = steps[from];
+        still[to] = still[from];
+        cell[to] = cell[from];
+    }
+};
+
+vec3 cell_position(const basin_job &job, size_t cell) {
+    const basin_settings &settings = job.settings;
+    const size_t width = static_cast<size_t>(job.width);
+    const size_t height = static_cast<size_t>(job.height);
+    const float i = static_cast<float>(cell % width);
+    const float j = static_cast<float>((cell / width) % height);
+    const float k = static_cast<float>(cell / (width * height));
+    vec3 position = settings.center;
+    position[settings.axis_u] +=
+        ((i + 0.5f) / static_cast<float>(job.width) * 2.0f - 1.0f) *
+        settings.extent.x;
+    position[settings.axis_v] +=
+        ((j + 0.5f) / static_cast<float>(job.height) * 2.0f - 1.0f) *
+        settings.extent.y;
+    if (job.depth > 1) {
+        const int axis_w = 3 - settings.axis_u - settings.axis_v;
+        position[axis_w] +=
+            ((k + 0.5f) / static_cast<float>(job.depth) * 2.0f - 1.0f) *
+            settings.extent_w;
+    }
+    return position;
+}
+
+uint8_t classify(basin_job &job, const basin_attractor &candidate) {
+    lock_guard<mutex> lock(job.attractor_mutex);
+    for (size_t index = 0; index < job.attractors.size(); ++index) {
+        const basin_attractor &known = job.attractors[index];
+        if (known.fixed_point != candidate.fixed_point) {
+            continue;
+        }
+        const float allowed = job.settings.match_tolerance +
+                              0.25f * std::max(known.spread, candidate.spread);
+        if (distance(known.centroid, candidate.centroid) <= allowed &&
+            std::abs(known.spread - candidate.spread) <= allowed) {
+            return static_cast<uint8_t>(basin_label_first_attractor + index);
+        }
+    }
+    if (job.attractors.size() >= static_cast<size_t>(k_max_basin_attractors)) {
+        return basin_label_undetermined;
+    }
+    job.attractors.push_back(candidate);
+    return static_cast<uint8_t>(basin_label_first_attractor +
+                                job.attractors.size() - 1);
+}
+
+void run_basin_worker(basin_job &job) {
+    const basin_settings &settings = job.settings;
+    const system_params &params = job.params;
+    const float dt = settings.dt;
+    const int tiles_x = (job.width + k_tile_size - 1) / k_tile_size;
+    const int tiles_y = (job.height + k_tile_size - 1) / k_tile_size;
+    const int verdict_steps = settings.transient_steps + settings.window_steps;
+    const float escape_sq = settings.escape_radius * settings.escape_radius;
+    const float still_distance =
+        settings.fixed_point_speed * dt * static_cast<float>(k_sweep_steps);
+    // The samples are the states from transient_steps steps on, so after n
+    // steps a lane holds n - transient_steps + 1 of them; without a
+    // transient the initial condition is the first.
+    const float initial_weight = settings.transient_steps == 0 ? 1.0f : 0.0f;
+
+    int tile_x0 = 0;
+    int tile_y0 = 0;
+    int tile_k = 0;
+    int tile_cursor = k_tile_size * k_tile_size;
+    auto next_cell = [&](size_t &cell) {
+        for (;;) {
+            while (tile_cursor < k_tile_size * k_tile_size) {
+                const int i = tile_x0 + tile_cursor % k_tile_size;
+                const int j = tile_y0 + tile_cursor / k_tile_size;
+                ++tile_cursor;
+                if (i < job.width && j < job.height) {
+                    cell = (static_cast<size_t>(tile_k) *
+                                static_cast<size_t>(job.height) +
+                            static_cast<size_t>(j)) *
+                               static_cast<size_t>(job.width) +
+                           static_cast<size_t>(i);
+                    return true;
+                }
+            }
+            if (job.cancel.load(memory_order_relaxed)) {
+                return false;
+            }
+            const size_t tile = job.next_tile.fetch_add(1);
+            if (tile >= job.tile_count) {
+                return false;
+            }
+            const size_t per_slice =
+                static_cast<size_t>(tiles_x) * static_cast<size_t>(tiles_y);
+            tile_k = static_cast<int>(tile / per_slice);
+            const int in_slice = static_cast<int>(tile % per_slice);
+            tile_x0 = in_slice % tiles_x * k_tile_size;
+            tile_y0 = in_slice / tiles_x * k_tile_size;
+            tile_cursor = 0;
+        }
+    };
+
+    lane_batch batch;
+    size_t cell = 0;
+    while (batch.active < k_lanes && next_cell(cell)) {
+        batch.load(batch.active++, cell, cell_position(job, cell),
+                   initial_weight);
+    }
+
+    while (batch.active > 0) {
+        if (job.cancel.load(memory_order_relaxed)) {
+            return;
+        }
+        for (int step = 0; step < k_sweep_steps; ++step) {
+            batch.position = rk4_step(
+                [&](const vec3_lanes<k_lanes> &value) {
+                    return evaluate_derivative(params, value);
+                },
+                batch.position, dt);
+            // The state after steps + step + 1 steps.
+            float_lanes<k_lanes> weight;
+            for (int lane = 0; lane < k_lanes; ++lane) {
+                weight.lane[lane] =
+                    batch.steps[lane] + step + 1 >= settings.transient_steps
+                        ? 1.0f
+                        : 0.0f;
+            }
+            const vec3_lanes<k_lanes> &p = batch.position;
+            batch.sum = vec3_lanes<k_lanes>(batch.sum.x + weight * p.x,
+                                            batch.sum.y + weight * p.y,
+                                            batch.sum.z + weight * p.z);
+            batch.sum_sq = batch.sum_sq +
+                           weight * (p.x * p.x + p.y * p.y + p.z * p.z);
+        }
+
+        for (int lane = 0; lane < batch.active;) {
+            batch.steps[lane] += k_sweep_steps;
+            const vec3 p = lane_value(batch.position, lane);
+            const vec3 last = lane_value(batch.last, lane);
+            set_lane(batch.last, lane, p);
+
+            uint8_t label = basin_label_pending;
+            const float radius_sq = dot(p, p);
+            if (!std::isfinite(radius_sq) || radius_sq > escape_sq) {
+                label = basin_label_diverged;
+            } else {
+                batch.still[lane] =
+                    distance(p, last) < still_distance ? batch.still[lane] + 1
+                                                       : 0;
+                if (batch.still[lane] >= k_still_sweeps) {
+                    label = classify(job, {p, 0.0f, true});
+                } else if (batch.steps[lane] >= verdict_steps) {
+                    const float samples = static_cast<float>(
+                        batch.steps[lane] - settings.transient_steps + 1);
+                    const vec3 mean = lane_value(batch.sum, lane) / samples;
+                    const float spread = std::sqrt(std::max(
+                        batch.sum_sq.lane[lane] / samples - dot(mean, mean),
+                        0.0f));
+                    const bool fixed_point =
+                        spread < 0.1f * settings.match_tolerance;
+                    label = classify(job, {mean, spread, fixed_point});
+                }
+            }
+            if (label == basin_label_pending) {
+                ++lane;
+                continue;
+            }
+
+            job.labels[batch.cell[lane]].store(label, memory_order_relaxed);
+            job.cells_done.fetch_add(1, memory_order_relaxed);
+            if (next_cell(cell)) {
+                batch.load(lane, cell, cell_position(job, cell),
+                           initial_weight);
+                ++lane;
+            } else {
+                // The moved lane has not been checked this sweep yet, so the
+                // index is not advanced.
+                --batch.active;
+                batch.move(lane, batch.active);
+            }
+        }
+    }
+}
+
+vec3 hue_color(float hue, float value) {
+    const vec3 k(0.0f, 2.0f / 3.0f, 1.0f / 3.0f);
+    vec3 rgb;
+    for (int c = 0; c < 3; ++c) {
+        const float h = std::fmod(hue + k[c], 1.0f) * 6.0f - 3.0f;
+        rgb[c] = glm::clamp(std::abs(h) - 1.0f, 0.0f, 1.0f);
+    }
+    return mix(vec3(1.0f), rgb, 0.8f) * value;
+}
+
+// One 8-bit channel of a color in [0, 1].
+uint8_t color_byte(float channel) {
+    return static_cast<uint8_t>(glm::clamp(channel, 0.0f, 1.0f) * 255.0f +
+                                0.5f);
+}
+
+} // namespace
+
+void start_basin_job(basin_mapper &mapper, const system_params &params) {
+    stop_basin_job(mapper);
+    if (system_dimension(params.current_system) != 3) {
+        cerr << "Basin mapper: " << system_name(params.current_system)
+             << " has more than three variables\n";
+        return;
+    }
+    if (system_has_delay(params.current_system)) {
+        cerr << "Basin mapper: " << system_name(params.current_system)
+             << " has a delay\n";
+        return;
+    }
+
+    auto job = make_unique<basin_job>();
+    job->params = params;
+    job->settings = mapper.settings;
+    basin_settings &settings = job->settings;
+    settings.axis_u = glm::clamp(settings.axis_u, 0, 2);
+    settings.axis_v = glm::clamp(settings.axis_v, 0, 2);
+    if (settings.axis_v == settings.axis_u) {
+        settings.axis_v = (settings.axis_u + 1) % 3;
+    }
+    settings.dt = glm::clamp(settings.dt, 1e-5f, 0.2f);
+    settings.transient_steps = std::max(settings.transient_steps, 0);
+    settings.window_steps = std::max(settings.window_steps, k_sweep_steps);
+
+    job->width = glm::clamp(settings.resolution, 8, 4096);
+    job->height = job->width;
+    job->depth = glm::clamp(settings.depth, 1, 1024);
+    const size_t tiles_x =
+        static_cast<size_t>((job->width + k_tile_size - 1) / k_tile_size);
+    const size_t tiles_y =
+        static_cast<size_t>((job->height + k_tile_size - 1) / k_tile_size);
+    job->tile_count = tiles_x * tiles_y * static_cast<size_t>(job->depth);
+
+    const size_t cells = job->cell_count();
+    job->labels = make_unique<atomic<uint8_t>[]>(cells);
+    for (size_t i = 0; i < cells; ++i) {
+        job->labels[i].store(basin_label_pending, memory_order_relaxed);
+    }
+
+    basin_job *raw = job.get();
+    job->runner = thread([raw]() {
+        auto work = [raw]() { run_basin_worker(*raw); };
+        const unsigned int worker_count =
+            std::max(1u, thread::hardware_concurrency());
+        vector<thread> workers;
+        workers.reserve(worker_count - 1);
+        for (unsigned int i = 1; i < worker_count; ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (thread &worker : workers) {
+            worker.join();
+        }
+        raw->finished = true;
+    });
+
+    mapper.job = std::move(job);
+    mapper.display_slice = glm::clamp(mapper.display_slice, 0,
+                                      mapper.job->depth - 1);
+    mapper.last_upload_time = -1.0;
+    mapper.uploaded_final = false;
+}
+
+void stop_basin_job(basin_mapper &mapper) {
+    if (!mapper.job) {
+        return;
+    }
+    mapper.job->cancel = true;
+    if (mapper.job->runner.joinable()) {
+        mapper.job->runner.join();
+    }
+}
+
+float basin_progress(const basin_job &job) {
+    const size_t cells = job.cell_count();
+    if (cells == 0) {
+        return 0.0f;
+    }
+    return static_cast<float>(job.cells_done.load(memory_order_relaxed)) /
+           static_cast<float>(cells);
+}
+
+vec3 basin_label_color(uint8_t label, const basin_job &job) {
+    switch (label) {
+    case basin_label_pending:
+        return vec3(0.12f);
+    case basin_label_diverged:
+        return vec3(0.0f);
+    case basin_label_undetermined:
+        return vec3(1.0f, 0.0f, 1.0f);
+    default:
+        break;
+    }
+    const size_t index =
+        static_cast<size_t>(label - basin_label_first_attractor);
+    const float hue = std::fmod(0.12f + 0.618034f * static_cast<float>(index),
+                                1.0f);
+    const bool fixed_point =
+        index < job.attractors.size() && job.attractors[index].fixed_point;
+    return hue_color(hue, fixed_point ? 0.65f : 1.0f);
+}
+
+bool export_basin(basin_job &job, int slice, const char *prefix) {
+    slice = glm::clamp(slice, 0, job.depth - 1);
+    const size_t width = static_cast<size_t>(job.width);
+    const size_t height = static_cast<size_t>(job.height);
+    lock_guard<mutex> lock(job.attractor_mutex);
+
+    const string image_path = string(prefix) + ".ppm";
+    ofstream image(image_path, ios::binary);
+    if (!image) {
+        cerr << "Failed to open basin export file: " << image_path << "\n";
+        return false;
+    }
+    image << "P6\n" << width << " " << height << "\n255\n";
+    const size_t slice_offset = static_cast<size_t>(slice) * width * height;
+    for (size_t row = height; row-- > 0;) {
+        for (size_t column = 0; column < width; ++column) {
+            const uint8_t label =
+                job.labels[slice_offset + row * width + column].load(
+                    memory_order_relaxed);
+            const vec3 color = basin_label_color(label, job);
+            const uint8_t rgb[3] = {color_byte(color.x), color_byte(color.y),
+                                    color_byte(color.z)};
+            image.write(reinterpret_cast<const char *>(rgb), 3);
+        }
+    }
+
+    if (job.depth > 1) {
+        const string volume_path = string(prefix) + "_volume.raw";
+        ofstream volume(volume_path, ios::binary);
+        if (!volume) {
+            cerr << "Failed to open basin export file: " << volume_path << "\n";
+            return false;
+        }
+        vector<uint8_t> row(width);
+        for (size_t offset = 0; offset < job.cell_count(); offset += width) {
+            for (size_t column = 0; column < width; ++column) {
+                row[column] =
+                    job.labels[offset + column].load(memory_order_relaxed);
+            }
+            volume.write(reinterpret_cast<const char *>(row.data()),
+                         static_cast<streamsize>(width));
+        }
+    }
+
+    const string legend_path = string(prefix) + "_attractors.csv";
+    ofstream legend(legend_path);
+    if (!legend) {
+        cerr << "Failed to open basin export file: " << legend_path << "\n";
+        return false;
+    }
+    legend << "# " << job.width << "x" << job.height << "x" << job.depth
+           << " labels: 0 pending, 1 diverged, 2 undetermined\n";
+    legend << "label,kind,cx,cy,cz,spread\n";
+    for (size_t index = 0; index < job.attractors.size(); ++index) {
+        const basin_attractor &attractor = job.attractors[index];
+        legend << basin_label_first_attractor + index << ","
+               << (attractor.fixed_point ? "fixed_point" : "attractor") << ","
+               << attractor.centroid.x << "," << attractor.centroid.y << ","
+               << attractor.centroid.z << "," << attractor.spread << "\n";
+    }
+    return static_cast<bool>(legend);
+}
+
+void upload_basin_texture(basin_mapper &mapper, double now) {
+    if (!mapper.job) {
+        return;
+    }
+    basin_job &job = *mapper.job;
+    const int slice = glm::clamp(mapper.display_slice, 0, job.depth - 1);
+    const bool finished = job.finished.load();
+    const bool slice_changed = slice != mapper.uploaded_slice;
+    const bool due = now - mapper.last_upload_time >= k_upload_interval;
+    if (!slice_changed && (mapper.uploaded_final || (!finished && !due))) {
+        return;
+    }
+
+    if (mapper.texture == 0) {
+        glGenTextures(1, &mapper.texture);
+        glBindTexture(GL_TEXTURE_2D, mapper.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    const size_t texels =
+        static_cast<size_t>(job.width) * static_cast<size_t>(job.height);
+    const size_t slice_offset = static_cast<size_t>(slice) * texels;
+    vector<uint32_t> pixels(texels);
+    fill(begin(mapper.slice_counts), end(mapper.slice_counts), size_t{0});
+    {
+        lock_guard<mutex> lock(job.attractor_mutex);
+        uint32_t palette[256];
+        for (int label = 0; label < 256; ++label) {
+            const vec3 color =
+                basin_label_color(static_cast<uint8_t>(label), job);
+            palette[label] = 0xFF000000u |
+                             (uint32_t{color_byte(color.z)} << 16) |
+                             (uint32_t{color_byte(color.y)} << 8) |
+                             uint32_t{color_byte(color.x)};
+        }
+        for (size_t i = 0; i < texels; ++i) {
+            const uint8_t label =
+                job.labels[slice_offset + i].load(memory_order_relaxed);
+            pixels[i] = palette[label];
+            ++mapper.slice_counts[label];
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, mapper.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, job.width, job.height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    mapper.uploaded_slice = slice;
+    mapper.last_upload_time = now;
+    mapper.uploaded_final = finished;
+}
+
+void release_basin_gpu(basin_mapper &mapper) {
+    if (mapper.texture != 0) {
+        glDeleteTextures(1, &mapper.texture);
+        mapper.texture = 0;
+    }
+}
@@ -0,0 +1,299 @@
+#include "chaoseq.h"
+#include "default_init_allocator.hpp"
+#include "sensitivity.hpp"
+#include "system_params.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+static_assert(sizeof(vec3) == 3 * sizeof(float),
+              "the particle view exposes vec3 storage as float triples");
+
+struct chaoseq_session {
+    mutex lock;
+    system_params params;
+    float dt = 0.01f;
+    double time = 0.0;
+    uint64_t steps = 0;
+    unsigned int max_threads = 0;
+    worker_pool workers;
+    vector<size_t> partitions;
+    particle_array<vec3> positions;
+};
+
+namespace {
+
+constexpr size_t k_min_per_thread = 4096;
+// Particles taken through all substeps of a chaoseq_step call at once.
+constexpr size_t k_step_block = 1024;
+constexpr uint32_t k_max_sensitivity_parameters = 8;
+
+uint32_t hash_particle(uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+    return value;
+}
+
+float hash_unit(uint32_t &state) {
+    state = hash_particle(state + 0x9e3779b9u);
+    return (static_cast<float>(state >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+// Same shell as the viewer's seeding, drawn from a per-index hash instead of
+// a per-worker generator so the result does not depend on the partitioning.
+vec3 seed_position(size_t index, float spawn_radius, uint32_t seed) {
+    uint32_t state =
+        hash_particle(hash_particle(seed) ^ static_cast<uint32_t>(index));
+    const float z = 2.0f * hash_unit(state) - 1.0f;
+    const float phi = 6.28318531f * hash_unit(state);
+    const float ring = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    const vec3 direction(ring * std::cos(phi), ring * std::sin(phi), z);
+    // Box-Muller for the |N(0, 1)| radial jitter.
+    const float u1 = hash_unit(state);
+    const float u2 = hash_unit(state);
+    const float normal =
+        std::sqrt(-2.0f * std::log(u1)) * std::cos(6.28318531f * u2);
+    const float radius = std::abs(normal) * 0.5f + 0.5f;
+    return direction * radius * spawn_radius;
+}
+
+void run_partitions(chaoseq_session &session,
+                    const function<void(size_t, size_t)> &task) {
+    const size_t total = session.positions.size();
+    start_worker_pool(session.workers, session.max_threads);
+    const unsigned int wanted = static_cast<unsigned int>(
+        (total + k_min_per_thread - 1) / k_min_per_thread);
+    const unsigned int thread_count = std::min(
+        std::max(1u, wanted), std::max(1u, worker_count(session.workers)));
+    if (session.partitions.size() != thread_count + 1 ||
+        session.partitions.back() != total) {
+        partition_by_weight(session.workers, total, thread_count,
+                            session.partitions);
+    }
+    const vector<size_t> &bounds = session.partitions;
+    run_workers(session.workers, thread_count, [&](unsigned int worker) {
+        task(bounds[worker], bounds[worker + 1]);
+    });
+}
+
+// Positions advance as in chaoseq_step; tangents restart at zero for every
+// particle and are written out after the last substep.
+template <int N>
+void step_with_tangents(chaoseq_session &session, const int *parameters,
+                        int count, uint32_t substeps, float *jacobians) {
+    const float dt = session.dt;
+    vec3 *positions = session.positions.data();
+    const size_t stride = 3 * static_cast<size_t>(count);
+    dispatch_sensitivity<N>(
+        session.params, parameters, count, [&](auto deriv) {
+            run_partitions(session, [&](size_t begin, size_t end) {
+                for (size_t index = begin; index < end; ++index) {
+                    const vec3 start = positions[index];
+                    dual_vec3<N> state(start.x, start.y, start.z);
+                    for (uint32_t step = 0; step < substeps; ++step) {
+                        state = rk4_step(deriv, state, dt);
+                    }
+                    positions[index] =
+                        vec3(state.x.value, state.y.value, state.z.value);
+                    float *out = jacobians + index * stride;
+                    for (int lane = 0; lane < count; ++lane) {
+                        out[lane] = state.x.tangent[lane];
+                        out[count + lane] = state.y.tangent[lane];
+                        out[2 * count + lane] = state.z.tangent[lane];
+                    }
+                }
+            });
+        });
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t chaoseq_api_version(void) { return CHAOSEQ_API_VERSION; }
+
+chaoseq_session *chaoseq_create(unsigned int threads) {
+    chaoseq_session *session = new (nothrow) chaoseq_session();
+    if (session) {
+        session->max_threads = threads;
+    }
+    return session;
+}
+
+void chaoseq_destroy(chaoseq_session *session) { delete session; }
+
+int chaoseq_set_system(chaoseq_session *session, const char *name) {
+    if (!session || !name) {
+        return CHAOSEQ_INVALID_ARGUMENT;
+    }
+    system_type type;
+    if (!parse_system_type(name, type) || system_dimension(type) != 3 ||
+        system_has_delay(type)) {
+        return CHAOSEQ_UNKNOWN_NAME;
+    }
+    lock_guard<mutex> guard(session->lock);
+    session->params.current_system = type;
+    return CHAOSEQ_OK;
+}
+
+int chaoseq_set_parameter(chaoseq_session *session, const char *name,
+                          float value) {
+    if (!session || !name || !std::isfinite(value)) {
+        return CHAOSEQ_INVALID_ARGUMENT;
+    }
+    lock_guard<mutex> guard(session->lock);
+    float *parameter = find_system_parameter(session->params, name);
+    if (!parameter) {
+        return CHAOSEQ_UNKNOWN_NAME;
+    }
+    *parameter = value;
+    return CHAOSEQ_OK;
+}
+
+int chaoseq_get_parameter(chaoseq_session *session, const char *name,
+                          float *value) {
+    if (!session || !name || !value) {
+        return CHAOSEQ_INVALID_ARGUMENT;
+    }
+    lock_guard<mutex> guard(session->lock);
+    const float *parameter = find_system_parameter(session->params, name);
+    if (!parameter) {
+        return CHAOSEQ_UNKNOWN_NAME;
+    }
+    *value = *parameter;
+    return CHAOSEQ_OK;
+}
+
+int chaoseq_set_dt(chaoseq_session *session, float dt) {
+    if (!session || !(dt > 0.0f) || !std::isfinite(dt)) {
+        return CHAOSEQ_INVALID_ARGUMENT;
+    }
+    lock_guard<mutex> guard(session->lock);
+    session->dt = dt;
+    return CHAOSEQ_OK;
+}
+
+int chaoseq_seed(chaoseq_session *session, size_t count, float spawn_radius,
+                 uint32_t seed) {
+    if (!session || !(spawn_radius >= 0.0f) || !std::isfinite(spawn_radius)) {
+        return CHAOSEQ_INVALID_ARGUMENT;
+    }
+    lock_guard<mutex> guard(session->lock);
+    try {
+        // Fresh, untouched storage: each worker's first write places its
+        // partition on its own memory node.
+        particle_array<vec3>().swap(session->positions);
+        session->positions.resize(count);
+    } catch (const bad_alloc &) {
+        particle_array<vec3>().swap(session->positions);
+        return CHAOSEQ_OUT_OF_MEMORY;
+    }
+    run_partitions(*session, [&](size_t begin, size_t end) {
+        for (size_t index = begin; index < end; ++index) {
+            session->positions[index] =
+                seed_position(index, spawn_radius, seed);
+        }
+    });
+    session->time = 0.0;
+    session->steps = 0;
+    return CHAOSEQ_OK;
+}
+
+int chaoseq_step(chaoseq_session *session, uint32_t substeps) {
+    if (!session) {
+        return CHAOSEQ_INVALID_ARGUMENT;
+    }
+    lock_guard<mutex> guard(session->lock);
+    const float dt = session->dt;
+    vec3 *positions = session->positions.data();
+    // Particles are independent, so each block goes through every substep
+    // while it is still in L1 instead of streaming the range per substep.
+    dispatch_system(session->params, [&](auto deriv) {
+        run_partitions(*session, [&](size_t begin, size_t end) {
+            for (size_t block = begin; block < end; block += k_step_block) {
+                const size_t block_end = std::min(block + k_step_block, end);
+                for (uint32_t step = 0; step < substeps; ++step) {
+                    for (size_t index = block; index < block_end; ++index) {
+                        positions[index] =
+                            rk4_step(deriv, positions[index], dt);
+                    }
+                }
+            }
+        });
+    });
+    session->time += static_cast<double>(dt) * substeps;
+    session->steps += substeps;
+    return CHAOSEQ_OK;
+}
+
+int chaoseq_step_sensitivity(chaoseq_session *session,
+                             const char *const *parameters, uint32_t count,
+                             uint32_t substeps, float *jacobians) {
+    if (!session || !parameters || count == 0 ||
+        count > k_max_sensitivity_parameters || !jacobians) {
+        return CHAOSEQ_INVALID_ARGUMENT;
+    }
+    lock_guard<mutex> guard(session->lock);
+    vector<named_parameter> named = system_parameters(session->params);
+    int indices[k_max_sensitivity_parameters];
+    for (uint32_t lane = 0; lane < count; ++lane) {
+        if (!parameters[lane]) {
+            return CHAOSEQ_INVALID_ARGUMENT;
+        }
+        auto match = find_if(named.begin(), named.end(),
+                             [&](const named_parameter &candidate) {
+                                 return strcmp(candidate.name,
+                                               parameters[lane]) == 0;
+                             });
+        if (match == named.end()) {
+            return CHAOSEQ_UNKNOWN_NAME;
+        }
+        indices[lane] = static_cast<int>(match - named.begin());
+    }
+    // Four lanes fill one SSE register per operation; more take eight.
+    const int lanes = static_cast<int>(count);
+    if (lanes <= 4) {
+        step_with_tangents<4>(*session, indices, lanes, substeps, jacobians);
+    } else {
+        step_with_tangents<8>(*session, indices, lanes, substeps, jacobians);
+    }
+    session->time += static_cast<double>(session->dt) * substeps;
+    session->steps += substeps;
+    return CHAOSEQ_OK;
+}
+
+int chaoseq_acquire_particles(chaoseq_session *session,
+                              chaoseq_particle_view *view) {
+    if (!session || !view) {
+        return CHAOSEQ_INVALID_ARGUMENT;
+    }
+    session->lock.lock();
+    view->positions =
+        reinterpret_cast<const float *>(session->positions.data());
+    view->count = session->positions.size();
+    view->stride = sizeof(vec3);
+    view->time = session->time;
+    view->steps = session->steps;
+    return CHAOSEQ_OK;
+}
+
+void chaoseq_release_particles(chaoseq_session *session) {
+    if (session) {
+        session->lock.unlock();
+    }
+}
+
+} // extern "C"
@@ -0,0 +1,484 @@
+#include "ensemble.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+constexpr uint32_t k_ensemble_magic = 0x43534E45; // "ENSC"
+
+struct ensemble_header {
+    uint32_t magic;
+    uint32_t shard_count;
+    uint32_t image_size;
+    uint32_t reserved;
+    uint64_t slots_offset;
+    uint64_t images_offset;
+    uint64_t marginals_offset;
+    uint64_t bytes;
+};
+
+struct ensemble_region {
+    string name;
+    void *base = nullptr;
+    size_t bytes = 0;
+    ensemble_header *header = nullptr;
+    shard_slot *slots = nullptr;
+    uint32_t *images = nullptr;
+    uint64_t *marginals = nullptr;
+};
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t image_texels(const ensemble_config &config) {
+    return static_cast<size_t>(config.image_size) *
+           static_cast<size_t>(config.image_size);
+}
+
+size_t marginal_bins(const ensemble_config &config) {
+    return 3 * static_cast<size_t>(config.bins);
+}
+
+bool map_region(ensemble_region &region, const ensemble_config &config,
+                int shards) {
+    region.name = "/chaoseq_ensemble_" + to_string(getpid());
+    const int fd =
+        shm_open(region.name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        cerr << "Failed to create shared memory " << region.name << "\n";
+        return false;
+    }
+    const uint64_t slots_offset = align_up(sizeof(ensemble_header), 64);
+    const uint64_t images_offset =
+        align_up(slots_offset + sizeof(shard_slot) * shards, 4096);
+    const uint64_t marginals_offset = align_up(
+        images_offset + sizeof(uint32_t) * image_texels(config) * shards, 64);
+    const uint64_t bytes =
+        marginals_offset + sizeof(uint64_t) * marginal_bins(config) * shards;
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        cerr << "Failed to size shared memory " << region.name << "\n";
+        close(fd);
+        shm_unlink(region.name.c_str());
+        return false;
+    }
+    region.base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+    close(fd);
+    if (region.base == MAP_FAILED) {
+        cerr << "Failed to map shared memory " << region.name << "\n";
+        region.base = nullptr;
+        shm_unlink(region.name.c_str());
+        return false;
+    }
+    region.bytes = bytes;
+    char *base = static_cast<char *>(region.base);
+    region.header = reinterpret_cast<ensemble_header *>(base);
+    *region.header = {k_ensemble_magic,
+                      static_cast<uint32_t>(shards),
+                      static_cast<uint32_t>(config.image_size),
+                      0,
+                      slots_offset,
+                      images_offset,
+                      marginals_offset,
+                      bytes};
+    region.slots = reinterpret_cast<shard_slot *>(base + slots_offset);
+    for (int shard = 0; shard < shards; ++shard) {
+        new (&region.slots[shard]) shard_slot();
+    }
+    region.images = reinterpret_cast<uint32_t *>(base + images_offset);
+    region.marginals = reinterpret_cast<uint64_t *>(base + marginals_offset);
+    return true;
+}
+
+void unmap_region(ensemble_region &region) {
+    if (region.base) {
+        munmap(region.base, region.bytes);
+        region.base = nullptr;
+    }
+    shm_unlink(region.name.c_str());
+}
+
+float shard_parameter(const ensemble_config &config, int shard, int shards) {
+    const float s = shards > 1 ? static_cast<float>(shard) /
+                                     static_cast<float>(shards - 1)
+                               : 0.0f;
+    return mix(config.sweep_min, config.sweep_max, s);
+}
+
+size_t shard_particles(const ensemble_config &config, int shard, int shards) {
+    if (!config.sweep_parameter.empty()) {
+        return config.particles;
+    }
+    const size_t count = static_cast<size_t>(shards);
+    return config.particles / count +
+           (static_cast<size_t>(shard) < config.particles % count ? 1 : 0);
+}
+
+// Runs in the forked child. Everything it produces goes into its own slot
+// and image, so no shard ever writes memory another shard reads.
+void run_shard(const ensemble_config &config, ensemble_region &region,
+               int shard, int shards) {
+    const auto start = chrono::steady_clock::now();
+    shard_slot &slot = region.slots[shard];
+    slot.status.store(shard_running, memory_order_relaxed);
+
+    system_params params = config.params;
+    if (!config.sweep_parameter.empty()) {
+        slot.parameter = shard_parameter(config, shard, shards);
+        *find_system_parameter(params, config.sweep_parameter) =
+            slot.parameter;
+    }
+
+    const size_t particles = shard_particles(config, shard, shards);
+    vector<vec3> positions(particles);
+    mt19937 rng{config.seed * 0x9e3779b9u + static_cast<uint32_t>(shard)};
+    normal_distribution<float> normal_dist(0.0f, 1.0f);
+    for (vec3 &position : positions) {
+        vec3 direction(normal_dist(rng), normal_dist(rng), normal_dist(rng));
+        if (dot(direction, direction) < 1e-6f) {
+            direction = vec3(1.0f, 0.0f, 0.0f);
+        }
+        const float radius = std::abs(normal_dist(rng)) * 0.5f + 0.5f;
+        position = normalize(direction) * radius * config.spawn_radius;
+    }
+
+    // The shard's statistics live in its own address space until the end;
+    // only the progress counter is shared while it runs.
+    invariant_stats stats;
+    invariant_settings &settings = stats.settings;
+    settings.sample_every = std::max(config.sample_every, 1);
+    settings.bins = config.bins;
+    settings.projection_size = config.image_size;
+    settings.axis_u = config.axis_u;
+    settings.axis_v = config.axis_v;
+    settings.auto_range = false;
+    settings.range_min = config.range_min;
+    settings.range_max = config.range_max;
+    settings.range_min[config.axis_u] = config.view_min.x;
+    settings.range_min[config.axis_v] = config.view_min.y;
+    settings.range_max[config.axis_u] = config.view_max.x;
+    settings.range_max[config.axis_v] = config.view_max.y;
+    const bool auto_transient = config.transient < 0;
+    stats.discard_transient = auto_transient;
+    const int transient = auto_transient ? 0 : config.transient;
+    int64_t settled_step = -1;
+
+    const float escape_sq = config.escape_radius * config.escape_radius;
+    uint64_t diverged = 0;
+    vec3 low(numeric_limits<float>::max());
+    vec3 high(-numeric_limits<float>::max());
+
+    dispatch_system(params, [&](auto deriv) {
+        for (int step = 0; step < config.steps; ++step) {
+            const bool sample =
+                step >= transient && begin_invariant_sample(stats, 1);
+            invariant_accumulator *samples =
+                sample ? &stats.threads[0] : nullptr;
+            for (size_t i = 0; i < positions.size();) {
+                const vec3 p = rk4_step(deriv, positions[i], config.dt);
+                // NaN fails the comparison too.
+                if (!(dot(p, p) <= escape_sq)) {
+                    positions[i] = positions.back();
+                    positions.pop_back();
+                    ++diverged;
+                    continue;
+                }
+                positions[i] = p;
+                ++i;
+                if (samples) {
+                    accumulate_sample(*samples, stats.binning, p);
+                    low = glm::min(low, p);
+                    high = glm::max(high, p);
+                }
+            }
+            if (sample) {
+                finish_invariant_sample(stats, config.dt * (step + 1));
+                if (auto_transient && stats.settled && settled_step < 0) {
+                    settled_step = step + 1;
+                    low = vec3(numeric_limits<float>::max());
+                    high = vec3(-numeric_limits<float>::max());
+                }
+            }
+            if ((step & 63) == 63) {
+                slot.steps_done.store(static_cast<uint64_t>(step) + 1,
+                                      memory_order_relaxed);
+            }
+        }
+    });
+
+    collect_invariant_stats(stats);
+    const invariant_accumulator &total = stats.total;
+    if (total.projection.size() == image_texels(config)) {
+        memcpy(region.images + image_texels(config) * shard,
+               total.projection.data(),
+               sizeof(uint32_t) * total.projection.size());
+    }
+    if (total.marginals.size() == marginal_bins(config)) {
+        memcpy(region.marginals + marginal_bins(config) * shard,
+               total.marginals.data(),
+               sizeof(uint64_t) * total.marginals.size());
+    }
+    if (config.measure_correlation) {
+        // Single-threaded: the shard already owns one CPU.
+        worker_pool inline_pool;
+        correlation_grid grid;
+        correlation_result result;
+        if (count_correlation_pairs(positions.data(), positions.size(),
+                                    config.correlation, inline_pool, grid,
+                                    result)) {
+            slot.correlation_points = result.points;
+            slot.correlation_references = result.references;
+            slot.correlation_pair_total = result.pair_total;
+            copy(result.pairs.begin(), result.pairs.end(),
+                 slot.correlation_pairs);
+        }
+    }
+    slot.particles = particles;
+    slot.diverged = diverged;
+    slot.settled_step = settled_step;
+    for (int axis = 0; axis < 3; ++axis) {
+        slot.axes[axis] = total.axes[axis];
+        slot.min[axis] = low[axis];
+        slot.max[axis] = high[axis];
+    }
+    slot.seconds =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    slot.steps_done.store(static_cast<uint64_t>(config.steps),
+                          memory_order_relaxed);
+    slot.status.store(shard_done, memory_order_release);
+}
+
+} // namespace
+
+int run_ensemble(const ensemble_config &base_config, const char *image_path,
+                 const char *csv_path, const char *stats_path,
+                 const char *correlation_path) {
+    // Every shard counts pairs on the same radii so the counts add up.
+    ensemble_config config = base_config;
+    correlation_settings &correlation = config.correlation;
+    const float diagonal = length(config.range_max - config.range_min);
+    if (correlation.min_radius <= 0.0f) {
+        correlation.min_radius = correlation.min_fraction * diagonal;
+    }
+    if (correlation.max_radius <= 0.0f) {
+        correlation.max_radius = correlation.max_fraction * diagonal;
+    }
+    const vector<cpu_slot> cpus = detect_cpu_slots();
+    const int shards =
+        config.shards > 0 ? config.shards : static_cast<int>(cpus.size());
+    if (!config.sweep_parameter.empty()) {
+        system_params probe = config.params;
+        if (!find_system_parameter(probe, config.sweep_parameter)) {
+            cerr << "Unknown parameter '" << config.sweep_parameter
+                 << "' for system " << system_name(config.params.current_system)
+                 << "\n";
+            return 1;
+        }
+    }
+
+    ensemble_region region;
+    if (!map_region(region, config, shards)) {
+        return 1;
+    }
+    cout << "Running " << shards << " shards of "
+         << system_name(config.params.current_system) << " in "
+         << region.name << " (" << region.bytes / (1024 * 1024) << " MiB)\n";
+    // Anything still buffered would be flushed once per child.
+    cout.flush();
+    cerr.flush();
+
+    vector<pid_t> pids(static_cast<size_t>(shards), -1);
+    for (int shard = 0; shard < shards; ++shard) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            pin_current_thread(cpus[static_cast<size_t>(shard) % cpus.size()].cpu);
+            run_shard(config, region, shard, shards);
+            _exit(0);
+        }
+        if (pid < 0) {
+            cerr << "Failed to fork shard " << shard << "\n";
+        }
+        pids[static_cast<size_t>(shard)] = pid;
+    }
+
+    int live = static_cast<int>(
+        count_if(pids.begin(), pids.end(), [](pid_t pid) { return pid > 0; }));
+    const double total_steps = static_cast<double>(config.steps) * shards;
+    while (live > 0) {
+        int status = 0;
+        const pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0) {
+            const auto it = find(pids.begin(), pids.end(), pid);
+            const int shard = static_cast<int>(it - pids.begin());
+            if (WIFSIGNALED(status)) {
+                cerr << "\nShard " << shard << " killed by signal "
+                     << WTERMSIG(status) << "\n";
+            } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+                cerr << "\nShard " << shard << " exited with code "
+                     << WEXITSTATUS(status) << "\n";
+            }
+            --live;
+            continue;
+        }
+        if (pid < 0) {
+            break;
+        }
+        double done = 0.0;
+        for (int shard = 0; shard < shards; ++shard) {
+            done += static_cast<double>(
+                region.slots[shard].steps_done.load(memory_order_relaxed));
+        }
+        cout << "\r" << static_cast<int>(100.0 * done / total_steps) << "% "
+             << flush;
+        this_thread::sleep_for(chrono::milliseconds(200));
+    }
+    cout << "\r100%\n";
+
+    // Chan et al. pairwise combination of the per-shard moments.
+    invariant_stats merged;
+    merged.settings.bins = config.bins;
+    merged.settings.range_min = config.range_min;
+    merged.settings.range_max = config.range_max;
+    merged.settings.range_min[config.axis_u] = config.view_min.x;
+    merged.settings.range_min[config.axis_v] = config.view_min.y;
+    merged.settings.range_max[config.axis_u] = config.view_max.x;
+    merged.settings.range_max[config.axis_v] = config.view_max.y;
+    invariant_accumulator &total = merged.total;
+    total.marginals.assign(marginal_bins(config), 0);
+    uint64_t particles = 0;
+    uint64_t diverged = 0;
+    int failed = 0;
+    int settled = 0;
+    int64_t last_settled_step = -1;
+    vector<uint64_t> density(image_texels(config), 0);
+    // Pair counts of every shard on the shared radii.
+    correlation_result merged_correlation;
+    if (config.measure_correlation) {
+        correlation_radii(correlation.radii, correlation.min_radius,
+                          correlation.max_radius, merged_correlation.radii);
+        merged_correlation.pairs.assign(merged_correlation.radii.size(), 0);
+    }
+    ofstream csv;
+    if (csv_path) {
+        csv.open(csv_path);
+        if (!csv) {
+            cerr << "Failed to open summary file: " << csv_path << "\n";
+        } else {
+            csv << "shard,parameter,particles,diverged,settled_step,samples,"
+                   "mean_x,mean_y,mean_z,std_x,std_y,std_z,skew_x,skew_y,"
+                   "skew_z,seconds\n";
+        }
+    }
+    for (int shard = 0; shard < shards; ++shard) {
+        const shard_slot &slot = region.slots[shard];
+        if (slot.status.load(memory_order_acquire) != shard_done) {
+            ++failed;
+            continue;
+        }
+        particles += slot.particles;
+        diverged += slot.diverged;
+        if (config.measure_correlation) {
+            merged_correlation.points += slot.correlation_points;
+            merged_correlation.references += slot.correlation_references;
+            merged_correlation.pair_total += slot.correlation_pair_total;
+            for (size_t k = 0; k < merged_correlation.pairs.size(); ++k) {
+                merged_correlation.pairs[k] += slot.correlation_pairs[k];
+            }
+        }
+        settled += slot.settled_step >= 0 ? 1 : 0;
+        last_settled_step = std::max(last_settled_step, slot.settled_step);
+        if (csv.is_open() && csv) {
+            csv << shard << "," << slot.parameter << "," << slot.particles
+                << "," << slot.diverged << "," << slot.settled_step << ","
+                << slot.axes[0].count;
+            for (int axis = 0; axis < 3; ++axis) {
+                csv << "," << slot.axes[axis].mean;
+            }
+            for (int axis = 0; axis < 3; ++axis) {
+                csv << "," << std::sqrt(slot.axes[axis].variance());
+            }
+            for (int axis = 0; axis < 3; ++axis) {
+                csv << "," << slot.axes[axis].skewness();
+            }
+            csv << "," << slot.seconds << "\n";
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            total.axes[axis] = merge_moments(total.axes[axis], slot.axes[axis]);
+        }
+        const uint32_t *image = region.images + image_texels(config) * shard;
+        for (size_t i = 0; i < density.size(); ++i) {
+            density[i] += image[i];
+        }
+        const uint64_t *marginals =
+            region.marginals + marginal_bins(config) * shard;
+        for (size_t i = 0; i < total.marginals.size(); ++i) {
+            total.marginals[i] += marginals[i];
+        }
+    }
+
+    const uint64_t samples = total.axes[0].count;
+    cout << shards - failed << "/" << shards << " shards finished, "
+         << particles << " particles, " << diverged << " diverged, "
+         << samples << " samples\n";
+    if (config.transient < 0) {
+        cout << settled << "/" << shards - failed
+             << " shards settled before sampling\n";
+    }
+    if (samples > 1) {
+        cout << "mean (" << total.axes[0].mean << ", " << total.axes[1].mean
+             << ", " << total.axes[2].mean << ")  std (";
+        for (int axis = 0; axis < 3; ++axis) {
+            cout << std::sqrt(total.axes[axis].variance())
+                 << (axis < 2 ? ", " : ")  skew (");
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            cout << total.axes[axis].skewness() << (axis < 2 ? ", " : ")\n");
+        }
+    }
+    if (image_path) {
+        write_count_pgm(density.data(), config.image_size, config.image_size,
+                        image_path);
+    }
+    if (stats_path) {
+        merged.samples = samples;
+        merged.settled = settled > 0 && settled == shards - failed;
+        if (merged.settled) {
+            merged.settled_time =
+                config.dt * static_cast<float>(last_settled_step);
+        }
+        export_invariant_csv(merged, stats_path);
+    }
+    if (config.measure_correlation) {
+        fit_correlation_dimension(correlation, merged_correlation);
+        if (merged_correlation.valid) {
+            cout << "correlation dimension " << merged_correlation.dimension
+                 << " (rms " << merged_correlation.residual << ", "
+                 << merged_correlation.references << " references)\n";
+        } else {
+            cout << "correlation dimension: too few pairs in the fit range\n";
+        }
+        if (correlation_path) {
+            export_correlation_csv(merged_correlation, correlation_path);
+        }
+    }
+    unmap_region(region);
+    return failed > 0 ? 2 : 0;
+}
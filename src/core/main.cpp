@@ -0,0 +1,218 @@
+#include "ensemble.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Headless entry point: integrates particle ensembles without a window or a
+// GL context, sharded over forked worker processes.
+
+static void print_usage(const char *program) {
+    cerr << "Usage: " << program << " [options]\n"
+         << "  --system <name>          lorenz, rossler, thomas, aizawa, "
+            "dadras, chen,\n"
+         << "                           lorenz83, halvorsen, rabinovich, "
+            "three_scroll,\n"
+         << "                           sprott, four_wing (default lorenz)\n"
+         << "  --set <name>=<value>     set a parameter of the system\n"
+         << "  --shards <n>             worker processes (default: one per "
+            "CPU)\n"
+         << "  --particles <n>          particles, split across shards\n"
+         << "  --steps <n>              RK4 steps per particle\n"
+         << "  --transient <n|auto>     steps discarded before sampling; auto "
+            "waits until\n"
+         << "                           the statistics settle\n"
+         << "  --sample-every <n>       steps between samples\n"
+         << "  --dt <value>             step size\n"
+         << "  --escape-radius <value>  particles beyond this are dropped\n"
+         << "  --sweep <name>:<min>:<max>\n"
+         << "                           give each shard its own parameter "
+            "value\n"
+         << "  --axes <uv>              projection for the image, e.g. xz\n"
+         << "  --window <u0>:<u1>:<v0>:<v1>\n"
+         << "                           projected region covered by the "
+            "image\n"
+         << "  --range <x0>:<x1>:<y0>:<y1>:<z0>:<z1>\n"
+         << "                           box of the marginal histograms\n"
+         << "  --bins <n>               histogram bins per axis\n"
+         << "  --image-size <n>         image side in pixels\n"
+         << "  --image <file.pgm>       write the aggregated density\n"
+         << "  --csv <file.csv>         write per-shard statistics\n"
+         << "  --stats <file.csv>       write merged moments and marginals\n"
+         << "  --correlation <file.csv> write the correlation sum C(r) of the "
+            "final\n"
+         << "                           particles and its dimension fit\n"
+         << "  --correlation-radii <min>:<max>\n"
+         << "                           radius range (default: fractions of "
+            "the --range\n"
+         << "                           box diagonal)\n"
+         << "  --correlation-fit <first>:<last>\n"
+         << "                           radius indices of the scaling "
+            "region\n"
+         << "  --seed <n>\n";
+}
+
+static bool parse_float(const char *text, float &value) {
+    char *end = nullptr;
+    value = strtof(text, &end);
+    return end != text && *end == '\0';
+}
+
+static bool parse_int(const char *text, long long &value) {
+    char *end = nullptr;
+    value = strtoll(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+static bool parse_axis(char name, int &axis) {
+    if (name < 'x' || name > 'z') {
+        return false;
+    }
+    axis = name - 'x';
+    return true;
+}
+
+int main(int argc, char **argv) {
+    ensemble_config config;
+    const char *image_path = nullptr;
+    const char *csv_path = nullptr;
+    const char *stats_path = nullptr;
+    const char *correlation_path = nullptr;
+    // Parameter assignments wait until the system is known.
+    string assignments;
+
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        long long number = 0;
+        bool ok = value != nullptr;
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (!ok) {
+            cerr << "Missing value for " << arg << "\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else if (arg == "--system") {
+            // Shards integrate glm::vec3 particles without a history.
+            ok = parse_system_type(value, config.params.current_system) &&
+                 system_dimension(config.params.current_system) == 3 &&
+                 !system_has_delay(config.params.current_system);
+        } else if (arg == "--set") {
+            assignments += string(value) + ";";
+        } else if (arg == "--shards") {
+            ok = parse_int(value, number) && number > 0;
+            config.shards = static_cast<int>(number);
+        } else if (arg == "--particles") {
+            ok = parse_int(value, number) && number > 0;
+            config.particles = static_cast<size_t>(number);
+        } else if (arg == "--steps") {
+            ok = parse_int(value, number) && number > 0;
+            config.steps = static_cast<int>(number);
+        } else if (arg == "--transient") {
+            if (strcmp(value, "auto") == 0) {
+                number = -1;
+            } else {
+                ok = parse_int(value, number) && number >= 0;
+            }
+            config.transient = static_cast<int>(number);
+        } else if (arg == "--sample-every") {
+            ok = parse_int(value, number) && number > 0;
+            config.sample_every = static_cast<int>(number);
+        } else if (arg == "--dt") {
+            ok = parse_float(value, config.dt) && config.dt > 0.0f;
+        } else if (arg == "--escape-radius") {
+            ok = parse_float(value, config.escape_radius);
+        } else if (arg == "--sweep") {
+            const string text = value;
+            const size_t first = text.find(':');
+            const size_t second = text.find(':', first + 1);
+            ok = first != string::npos && second != string::npos &&
+                 parse_float(text.substr(first + 1, second - first - 1).c_str(),
+                             config.sweep_min) &&
+                 parse_float(text.substr(second + 1).c_str(), config.sweep_max);
+            config.sweep_parameter = text.substr(0, first);
+        } else if (arg == "--axes") {
+            ok = strlen(value) == 2 && parse_axis(value[0], config.axis_u) &&
+                 parse_axis(value[1], config.axis_v) &&
+                 config.axis_u != config.axis_v;
+        } else if (arg == "--window") {
+            ok = sscanf(value, "%f:%f:%f:%f", &config.view_min.x,
+                        &config.view_max.x, &config.view_min.y,
+                        &config.view_max.y) == 4 &&
+                 config.view_max.x > config.view_min.x &&
+                 config.view_max.y > config.view_min.y;
+        } else if (arg == "--range") {
+            glm::vec3 &low = config.range_min;
+            glm::vec3 &high = config.range_max;
+            ok = sscanf(value, "%f:%f:%f:%f:%f:%f", &low.x, &high.x, &low.y,
+                        &high.y, &low.z, &high.z) == 6 &&
+                 high.x > low.x && high.y > low.y && high.z > low.z;
+        } else if (arg == "--bins") {
+            ok = parse_int(value, number) && number >= 2 && number <= 65536;
+            config.bins = static_cast<int>(number);
+        } else if (arg == "--image-size") {
+            ok = parse_int(value, number) && number >= 16 && number <= 8192;
+            config.image_size = static_cast<int>(number);
+        } else if (arg == "--image") {
+            image_path = value;
+        } else if (arg == "--csv") {
+            csv_path = value;
+        } else if (arg == "--stats") {
+            stats_path = value;
+        } else if (arg == "--correlation") {
+            correlation_path = value;
+            config.measure_correlation = true;
+        } else if (arg == "--correlation-radii") {
+            correlation_settings &correlation = config.correlation;
+            ok = sscanf(value, "%f:%f", &correlation.min_radius,
+                        &correlation.max_radius) == 2 &&
+                 correlation.min_radius > 0.0f &&
+                 correlation.max_radius > correlation.min_radius;
+        } else if (arg == "--correlation-fit") {
+            correlation_settings &correlation = config.correlation;
+            ok = sscanf(value, "%d:%d", &correlation.fit_first,
+                        &correlation.fit_last) == 2 &&
+                 correlation.fit_first >= 0 &&
+                 correlation.fit_last > correlation.fit_first;
+        } else if (arg == "--seed") {
+            ok = parse_int(value, number);
+            config.seed = static_cast<uint32_t>(number);
+        } else {
+            cerr << "Unknown option " << arg << "\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (!ok) {
+            cerr << "Invalid value for " << arg << ": " << value << "\n";
+            return EXIT_FAILURE;
+        }
+        ++i;
+    }
+
+    size_t start = 0;
+    while (start < assignments.size()) {
+        const size_t end = assignments.find(';', start);
+        const string item = assignments.substr(start, end - start);
+        start = end + 1;
+        const size_t equals = item.find('=');
+        float *parameter =
+            equals == string::npos
+                ? nullptr
+                : find_system_parameter(config.params, item.substr(0, equals));
+        if (!parameter ||
+            !parse_float(item.substr(equals + 1).c_str(), *parameter)) {
+            cerr << "Invalid parameter assignment for "
+                 << system_name(config.params.current_system) << ": " << item
+                 << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    return run_ensemble(config, image_path, csv_path, stats_path,
+                        correlation_path);
+}
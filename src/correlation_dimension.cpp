@@ -0,0 +1,428 @@
+#include "correlation_dimension.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// References are handed out in chunks so dense and sparse regions of the
+// cloud balance across the workers.
+constexpr size_t k_reference_chunk = 64;
+
+int64_t cell_coordinate(float value, float inv_cell) {
+    // Clamped so far-out points stay representable; the distance test
+    // rejects anything the wrapped key below lets through.
+    const double cell = glm::clamp(static_cast<double>(value) * inv_cell,
+                                   -1e15, 1e15);
+    return static_cast<int64_t>(std::floor(cell));
+}
+
+// 21 bits per axis; cells further apart than that alias, which only costs
+// extra distance tests.
+uint64_t pack_cell(int64_t x, int64_t y, int64_t z) {
+    constexpr uint64_t bits = (1u << 21) - 1u;
+    return (static_cast<uint64_t>(x) & bits) |
+           ((static_cast<uint64_t>(y) & bits) << 21) |
+           ((static_cast<uint64_t>(z) & bits) << 42);
+}
+
+uint32_t hash_cell(uint64_t key) {
+    key ^= key >> 31;
+    key *= 0x9E3779B97F4A7C15ull;
+    return static_cast<uint32_t>(key >> 32);
+}
+
+bool finite_point(const vec3 &p) { return std::isfinite(p.x + p.y + p.z); }
+
+// log2 to within 0.09 from the exponent and a linear mantissa: only a first
+// guess for the shell, which the caller corrects against the exact radii.
+// With many radii per octave the guess can be several shells off.
+float rough_log2(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof bits);
+    return static_cast<float>(static_cast<int>(bits >> 23) - 127) +
+           static_cast<float>(bits & 0x007FFFFFu) * (1.0f / 8388608.0f);
+}
+
+unsigned int task_count(worker_pool &pool, size_t total) {
+    constexpr size_t k_min_per_thread = 16384;
+    const unsigned int wanted = static_cast<unsigned int>(
+        (total + k_min_per_thread - 1) / k_min_per_thread);
+    return std::min(std::max(wanted, 1u), std::max(worker_count(pool), 1u));
+}
+
+// Radii from the settings, or from the bounding box of the finite points.
+bool choose_radii(const vec3 *points, size_t count,
+                  const correlation_settings &settings,
+                  correlation_result &result) {
+    float low = settings.min_radius;
+    float high = settings.max_radius;
+    if (low <= 0.0f || high <= 0.0f) {
+        vec3 box_min(numeric_limits<float>::max());
+        vec3 box_max(-numeric_limits<float>::max());
+        for (size_t i = 0; i < count; ++i) {
+            if (finite_point(points[i])) {
+                box_min = glm::min(box_min, points[i]);
+                box_max = glm::max(box_max, points[i]);
+            }
+        }
+        if (box_min.x > box_max.x) {
+            return false;
+        }
+        const float diagonal = glm::length(box_max - box_min);
+        if (!(diagonal > 0.0f) || !std::isfinite(diagonal)) {
+            return false;
+        }
+        low = low > 0.0f ? low : settings.min_fraction * diagonal;
+        high = high > 0.0f ? high : settings.max_fraction * diagonal;
+    }
+    if (!(low > 0.0f) || !(high > low)) {
+        return false;
+    }
+    correlation_radii(settings.radii, low, high, result.radii);
+    return true;
+}
+
+// Buckets every point by the hash of its cell with a parallel counting
+// sort. Non-finite points go to one extra bucket that is never visited.
+void build_grid(const vec3 *points, size_t count, float cell,
+                worker_pool &pool, correlation_grid &grid) {
+    size_t buckets = 1024;
+    while (buckets < count) {
+        buckets <<= 1;
+    }
+    grid.cell = cell;
+    grid.mask = static_cast<uint32_t>(buckets - 1);
+    const size_t slots = buckets + 1;
+    if (grid.count_capacity < slots) {
+        grid.counts.reset(new atomic<uint32_t>[slots]);
+        grid.count_capacity = slots;
+    }
+    for (size_t b = 0; b < slots; ++b) {
+        grid.counts[b].store(0, memory_order_relaxed);
+    }
+    grid.bucket_of.resize(count);
+    grid.points.resize(count);
+    grid.keys.resize(count);
+
+    const float inv_cell = 1.0f / cell;
+    const unsigned int tasks = task_count(pool, count);
+    vector<size_t> bounds;
+    partition_by_weight(pool, count, tasks, bounds);
+    run_workers(pool, tasks, [&](unsigned int task) {
+        for (size_t i = bounds[task]; i < bounds[task + 1]; ++i) {
+            const vec3 &p = points[i];
+            uint32_t bucket = grid.mask + 1;
+            if (finite_point(p)) {
+                const uint64_t key = pack_cell(cell_coordinate(p.x, inv_cell),
+                                               cell_coordinate(p.y, inv_cell),
+                                               cell_coordinate(p.z, inv_cell));
+                bucket = hash_cell(key) & grid.mask;
+            }
+            grid.bucket_of[i] = bucket;
+            grid.counts[bucket].fetch_add(1, memory_order_relaxed);
+        }
+    });
+
+    // The counts become each bucket's write cursor.
+    grid.bucket_start.resize(slots + 1);
+    uint32_t running = 0;
+    for (size_t b = 0; b < slots; ++b) {
+        grid.bucket_start[b] = running;
+        running += grid.counts[b].load(memory_order_relaxed);
+        grid.counts[b].store(grid.bucket_start[b], memory_order_relaxed);
+    }
+    grid.bucket_start[slots] = running;
+
+    run_workers(pool, tasks, [&](unsigned int task) {
+        for (size_t i = bounds[task]; i < bounds[task + 1]; ++i) {
+            const uint32_t slot = grid.counts[grid.bucket_of[i]].fetch_add(
+                1, memory_order_relaxed);
+            const vec3 &p = points[i];
+            grid.points[slot] = p;
+            grid.keys[slot] = grid.bucket_of[i] > grid.mask
+                                  ? 0
+                                  : pack_cell(cell_coordinate(p.x, inv_cell),
+                                              cell_coordinate(p.y, inv_cell),
+                                              cell_coordinate(p.z, inv_cell));
+        }
+    });
+}
+
+// Shell s holds the pairs with squared distance in [edge[s], edge[s + 1]):
+// edge[s] is the squared radius s - 1, with -1 and infinity at the ends.
+struct shell_table {
+    vector<float> edge;
+    float inv_min_sq = 0.0f;
+    float shells_per_log2 = 0.0f; // shells per unit of log2(d^2)
+    int radii = 0;
+};
+
+// Adds the pairs of p with the points of one cell in [begin, end).
+void count_cell(const correlation_grid &grid, uint32_t begin, uint32_t end,
+                uint64_t key, uint32_t self, const vec3 &p,
+                const shell_table &table, uint64_t *shells) {
+    const float *edge = table.edge.data();
+    const float max_sq = edge[table.radii];
+    const vec3 *points = grid.points.data();
+    const uint64_t *keys = grid.keys.data();
+    for (uint32_t j = begin; j < end; ++j) {
+        const float dx = points[j].x - p.x;
+        const float dy = points[j].y - p.y;
+        const float dz = points[j].z - p.z;
+        const float d_sq = dx * dx + dy * dy + dz * dz;
+        // Too far, another cell that hashed to the same bucket, or the
+        // point itself.
+        if (!(d_sq < max_sq) || keys[j] != key || j == self) {
+            continue;
+        }
+        const float guess =
+            rough_log2(std::max(d_sq * table.inv_min_sq, 0.25f)) *
+            table.shells_per_log2;
+        int shell = glm::clamp(static_cast<int>(guess) + 1, 0, table.radii);
+        // Closely spaced radii put several shells inside the guess's error,
+        // so walk to the exact shell; the -1 and infinite edges stop it.
+        while (d_sq < edge[shell]) {
+            --shell;
+        }
+        while (d_sq >= edge[shell + 1]) {
+            ++shell;
+        }
+        ++shells[shell];
+    }
+}
+
+} // namespace
+
+void correlation_radii(int count, float low, float high,
+                       vector<float> &radii) {
+    count = glm::clamp(count, 2, k_max_correlation_radii);
+    radii.resize(static_cast<size_t>(count));
+    const double ratio = std::log(static_cast<double>(high) / low) /
+                         static_cast<double>(count - 1);
+    for (int k = 0; k < count; ++k) {
+        radii[static_cast<size_t>(k)] =
+            static_cast<float>(low * std::exp(ratio * k));
+    }
+    radii.back() = high;
+}
+
+bool count_correlation_pairs(const vec3 *points, size_t count,
+                             const correlation_settings &settings,
+                             worker_pool &pool, correlation_grid &grid,
+                             correlation_result &result) {
+    result.valid = false;
+    result.pairs.clear();
+    if (!choose_radii(points, count, settings, result)) {
+        return false;
+    }
+    const size_t radii = result.radii.size();
+    build_grid(points, count, result.radii.back(), pool, grid);
+    // Sorted positions past the last regular bucket hold non-finite points.
+    const size_t finite = grid.bucket_start[static_cast<size_t>(grid.mask) + 1];
+    if (finite < 2) {
+        return false;
+    }
+    const size_t references =
+        settings.reference_points > 0
+            ? std::min(settings.reference_points, finite)
+            : finite;
+
+    shell_table table;
+    table.radii = static_cast<int>(radii);
+    table.edge.resize(radii + 2);
+    table.edge[0] = -1.0f;
+    for (size_t k = 0; k < radii; ++k) {
+        table.edge[k + 1] = result.radii[k] * result.radii[k];
+    }
+    table.edge[radii + 1] = numeric_limits<float>::infinity();
+    table.inv_min_sq = 1.0f / table.edge[1];
+    table.shells_per_log2 =
+        static_cast<float>(radii - 1) /
+        (2.0f * std::log2(result.radii.back() / result.radii[0]));
+    const float inv_cell = 1.0f / grid.cell;
+
+    const unsigned int tasks =
+        std::max(std::min(worker_count(pool),
+                          static_cast<unsigned int>(
+                              (references + k_reference_chunk - 1) /
+                              k_reference_chunk)),
+                 1u);
+    grid.shells.resize(tasks);
+    atomic<size_t> next_chunk{0};
+    run_workers(pool, tasks, [&](unsigned int task) {
+        // shells[s]: pairs whose first radius above the distance is s.
+        vector<uint64_t> &shells = grid.shells[task];
+        shells.assign(radii, 0);
+        for (;;) {
+            const size_t first = next_chunk.fetch_add(k_reference_chunk,
+                                                      memory_order_relaxed);
+            if (first >= references) {
+                break;
+            }
+            const size_t last = std::min(first + k_reference_chunk, references);
+            for (size_t r = first; r < last; ++r) {
+                // Spread evenly over the sorted points, so consecutive
+                // references share cells.
+                const size_t self = r * finite / references;
+                const vec3 p = grid.points[self];
+                const int64_t cx = cell_coordinate(p.x, inv_cell);
+                const int64_t cy = cell_coordinate(p.y, inv_cell);
+                const int64_t cz = cell_coordinate(p.z, inv_cell);
+                for (int dz = -1; dz <= 1; ++dz) {
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            const uint64_t key =
+                                pack_cell(cx + dx, cy + dy, cz + dz);
+                            const uint32_t bucket = hash_cell(key) & grid.mask;
+                            count_cell(grid, grid.bucket_start[bucket],
+                                       grid.bucket_start[bucket + 1], key,
+                                       static_cast<uint32_t>(self), p, table,
+                                       shells.data());
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    result.pairs.assign(radii, 0);
+    for (const vector<uint64_t> &shells : grid.shells) {
+        for (size_t k = 0; k < radii; ++k) {
+            result.pairs[k] += shells[k];
+        }
+    }
+    for (size_t k = 1; k < radii; ++k) {
+        result.pairs[k] += result.pairs[k - 1];
+    }
+    result.points = finite;
+    result.references = references;
+    result.pair_total =
+        static_cast<double>(references) * static_cast<double>(finite - 1);
+    return true;
+}
+
+void fit_correlation_dimension(const correlation_settings &settings,
+                               correlation_result &result) {
+    const size_t radii = result.radii.size();
+    result.sum.assign(radii, 0.0);
+    result.local_slope.assign(radii, 0.0f);
+    result.dimension = 0.0;
+    result.intercept = 0.0;
+    result.residual = 0.0;
+    result.fit_count = 0;
+    result.valid = false;
+    if (radii < 2 || result.pairs.size() != radii ||
+        !(result.pair_total > 0.0)) {
+        return;
+    }
+    for (size_t k = 0; k < radii; ++k) {
+        result.sum[k] =
+            static_cast<double>(result.pairs[k]) / result.pair_total;
+    }
+    auto log_sum = [&](size_t k) { return std::log10(result.sum[k]); };
+    auto log_radius = [&](size_t k) {
+        return std::log10(static_cast<double>(result.radii[k]));
+    };
+    for (size_t k = 0; k < radii; ++k) {
+        const size_t lo = k > 0 ? k - 1 : k;
+        const size_t hi = k + 1 < radii ? k + 1 : k;
+        if (result.pairs[lo] > 0 && result.pairs[hi] > 0) {
+            result.local_slope[k] =
+                static_cast<float>((log_sum(hi) - log_sum(lo)) /
+                                   (log_radius(hi) - log_radius(lo)));
+        }
+    }
+
+    // Least squares of log C on log r over the scaling region.
+    const int last_index = static_cast<int>(radii) - 1;
+    const size_t first = static_cast<size_t>(
+        glm::clamp(settings.fit_first, 0, last_index));
+    const size_t last = static_cast<size_t>(
+        glm::clamp(settings.fit_last, static_cast<int>(first), last_index));
+    double sx = 0.0;
+    double sy = 0.0;
+    double sxx = 0.0;
+    double sxy = 0.0;
+    int n = 0;
+    for (size_t k = first; k <= last; ++k) {
+        if (result.pairs[k] == 0) {
+            continue;
+        }
+        const double x = log_radius(k);
+        const double y = log_sum(k);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        ++n;
+    }
+    result.fit_count = n;
+    const double denominator = n * sxx - sx * sx;
+    if (n < 2 || !(std::abs(denominator) > 0.0)) {
+        return;
+    }
+    result.dimension = (n * sxy - sx * sy) / denominator;
+    result.intercept = (sy - result.dimension * sx) / n;
+    double squares = 0.0;
+    for (size_t k = first; k <= last; ++k) {
+        if (result.pairs[k] > 0) {
+            const double fitted =
+                result.intercept + result.dimension * log_radius(k);
+            const double error = log_sum(k) - fitted;
+            squares += error * error;
+        }
+    }
+    result.residual = std::sqrt(squares / n);
+    result.valid = true;
+}
+
+bool update_correlation_estimate(correlation_estimator &estimator,
+                                 const vec3 *points, size_t count,
+                                 worker_pool &pool, double now, bool force) {
+    if (!force && (!estimator.automatic ||
+                   (estimator.last_run >= 0.0 &&
+                    now - estimator.last_run < estimator.interval))) {
+        return false;
+    }
+    estimator.last_run = now;
+    const auto start = chrono::steady_clock::now();
+    correlation_result &result = estimator.result;
+    if (count_correlation_pairs(points, count, estimator.settings, pool,
+                                estimator.grid, result)) {
+        fit_correlation_dimension(estimator.settings, result);
+    }
+    result.seconds =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result.valid;
+}
+
+bool export_correlation_csv(const correlation_result &result,
+                            const char *path) {
+    ofstream out(path);
+    if (!out) {
+        cerr << "Failed to open correlation file: " << path << "\n";
+        return false;
+    }
+    out << "points," << result.points << ",references," << result.references
+        << ",pair_total," << result.pair_total << ",dimension,"
+        << result.dimension << ",intercept," << result.intercept
+        << ",residual," << result.residual << "\n";
+    out << "radius,pairs,correlation_sum,local_slope\n";
+    for (size_t k = 0; k < result.radii.size(); ++k) {
+        out << result.radii[k] << ","
+            << (k < result.pairs.size() ? result.pairs[k] : 0) << ","
+            << (k < result.sum.size() ? result.sum[k] : 0.0) << ","
+            << (k < result.local_slope.size() ? result.local_slope[k] : 0.0f)
+            << "\n";
+    }
+    return static_cast<bool>(out);
+}
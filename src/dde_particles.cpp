@@ -0,0 +1,399 @@
+#include "dde_particles.hpp"
+#include "profiler.hpp"
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+uint32_t hash_particle(uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+    return value;
+}
+
+float hash_unit(uint32_t &seed) {
+    seed = hash_particle(seed + 0x9e3779b9u);
+    return (static_cast<float>(seed >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+size_t block_stride(int dimension, int slots) {
+    return static_cast<size_t>(slots) * 2 * static_cast<size_t>(dimension) *
+           k_dde_lanes;
+}
+
+// First float of (slot, kind) in a block; components follow with a stride
+// of k_dde_lanes.
+size_t history_offset(int dimension, int slots, size_t block, size_t slot,
+                      int kind) {
+    return block * block_stride(dimension, slots) +
+           (slot * 2 + static_cast<size_t>(kind)) *
+               static_cast<size_t>(dimension) * k_dde_lanes;
+}
+
+// Weights of the Hermite fit at `steps` (negative) from the current slot.
+// The same for every particle, so they are computed once per launch.
+struct delay_lookup {
+    size_t slot0 = 0;
+    size_t slot1 = 0;
+    float value0 = 0.0f;
+    float slope0 = 0.0f;
+    float value1 = 0.0f;
+    float slope1 = 0.0f;
+};
+
+delay_lookup make_lookup(const dde_particle_field &field, double steps) {
+    const double floor_steps = std::floor(steps);
+    const float theta = static_cast<float>(steps - floor_steps);
+    const uint64_t base =
+        field.step + static_cast<uint64_t>(static_cast<int64_t>(floor_steps));
+    const uint64_t slots = static_cast<uint64_t>(field.slots);
+    delay_lookup lookup;
+    lookup.slot0 = static_cast<size_t>(base % slots);
+    lookup.slot1 = static_cast<size_t>((base + 1) % slots);
+    const float one_minus = 1.0f - theta;
+    lookup.value0 = (1.0f + 2.0f * theta) * one_minus * one_minus;
+    lookup.slope0 = theta * one_minus * one_minus * field.dt;
+    lookup.value1 = theta * theta * (3.0f - 2.0f * theta);
+    lookup.slope1 = -theta * theta * one_minus * field.dt;
+    return lookup;
+}
+
+// Constant history at values for one lane.
+void fill_lane(dde_particle_field &field, size_t index, const float *values) {
+    const int n = field.dimension;
+    const size_t block = index / k_dde_lanes;
+    const size_t lane = index % k_dde_lanes;
+    for (int slot = 0; slot < field.slots; ++slot) {
+        float *value = field.history.data() +
+                       history_offset(n, field.slots, block,
+                                      static_cast<size_t>(slot), 0) +
+                       lane;
+        float *slope = field.history.data() +
+                       history_offset(n, field.slots, block,
+                                      static_cast<size_t>(slot), 1) +
+                       lane;
+        for (int d = 0; d < n; ++d) {
+            value[d * k_dde_lanes] = values[d];
+            slope[d * k_dde_lanes] = 0.0f;
+        }
+    }
+}
+
+void random_state(float *values, int dimension, uint32_t seed,
+                  const float *center, float spawn_radius) {
+    float norm_sq = 0.0f;
+    for (int d = 0; d < dimension; ++d) {
+        values[d] = hash_unit(seed) - 0.5f;
+        norm_sq += values[d] * values[d];
+    }
+    const float scale = spawn_radius * (0.5f + 0.5f * hash_unit(seed)) /
+                        std::sqrt(std::max(norm_sq, 1e-12f));
+    for (int d = 0; d < dimension; ++d) {
+        values[d] = center[d] + values[d] * scale;
+    }
+}
+
+template <int D, typename Deriv> struct dde_range_kernel {
+    simulation_state &state;
+    dde_particle_field &field;
+    const Deriv &deriv;
+    invariant_accumulator *samples;
+    size_t &diverged;
+    float escape_sq;
+    bool respawn;
+    uint32_t launch_seed;
+    // Stage times t - tau, t + h/2 - tau and t + h - tau, and for scalar
+    // systems the lags tau/2 and tau behind the new state at t + h.
+    delay_lookup stage[3];
+    delay_lookup embed_half;
+    delay_lookup embed_full;
+
+    template <int W>
+    nd_vec<D, float_lanes<W>> lookup(const delay_lookup &at, size_t block,
+                                     size_t lane0) const {
+        const float *history = field.history.data();
+        const float *value0 =
+            history + history_offset(D, field.slots, block, at.slot0, 0);
+        const float *slope0 =
+            history + history_offset(D, field.slots, block, at.slot0, 1);
+        const float *value1 =
+            history + history_offset(D, field.slots, block, at.slot1, 0);
+        const float *slope1 =
+            history + history_offset(D, field.slots, block, at.slot1, 1);
+        nd_vec<D, float_lanes<W>> result;
+        for (int d = 0; d < D; ++d) {
+            const size_t offset = static_cast<size_t>(d) * k_dde_lanes + lane0;
+            for (int l = 0; l < W; ++l) {
+                result[d].lane[l] = at.value0 * value0[offset + l] +
+                                    at.slope0 * slope0[offset + l] +
+                                    at.value1 * value1[offset + l] +
+                                    at.slope1 * slope1[offset + l];
+            }
+        }
+        return result;
+    }
+
+    template <int W> void step_block(size_t index) {
+        using lanes = float_lanes<W>;
+        using state_vec = nd_vec<D, lanes>;
+        const size_t block = index / k_dde_lanes;
+        const size_t lane0 = index % k_dde_lanes;
+        const size_t slots = static_cast<size_t>(field.slots);
+        const size_t current = static_cast<size_t>(field.step % slots);
+        const size_t next = (current + 1) % slots;
+        float *history = field.history.data();
+        float *value_now =
+            history + history_offset(D, field.slots, block, current, 0);
+        float *slope_now =
+            history + history_offset(D, field.slots, block, current, 1);
+        float *value_next =
+            history + history_offset(D, field.slots, block, next, 0);
+
+        state_vec x;
+        for (int d = 0; d < D; ++d) {
+            for (int l = 0; l < W; ++l) {
+                x[d].lane[l] = value_now[d * k_dde_lanes + lane0 + l];
+            }
+        }
+        const float h = field.dt;
+        const state_vec k1 = deriv(x, lookup<W>(stage[0], block, lane0));
+        // The slope at the current step completes its Hermite segment
+        // before the last stage, which may read it.
+        for (int d = 0; d < D; ++d) {
+            for (int l = 0; l < W; ++l) {
+                slope_now[d * k_dde_lanes + lane0 + l] = k1[d].lane[l];
+            }
+        }
+        const state_vec half = lookup<W>(stage[1], block, lane0);
+        const state_vec k2 = deriv(x + (0.5f * h) * k1, half);
+        const state_vec k3 = deriv(x + (0.5f * h) * k2, half);
+        const state_vec k4 =
+            deriv(x + h * k3, lookup<W>(stage[2], block, lane0));
+        x = x + (h / 6.0f) * (k1 + 2.0f * k2 + 2.0f * k3 + k4);
+        for (int d = 0; d < D; ++d) {
+            for (int l = 0; l < W; ++l) {
+                value_next[d * k_dde_lanes + lane0 + l] = x[d].lane[l];
+            }
+        }
+
+        lanes rendered[3];
+        if (D >= 3) {
+            for (int axis = 0; axis < 3; ++axis) {
+                rendered[axis] = x[axis];
+            }
+        } else {
+            rendered[0] = x[0];
+            rendered[1] = lookup<W>(embed_half, block, lane0)[0];
+            rendered[2] = lookup<W>(embed_full, block, lane0)[0];
+        }
+        vec3 *out = state.particle_positions.data() + index;
+        for (int l = 0; l < W; ++l) {
+            vec3 position(rendered[0].lane[l], rendered[1].lane[l],
+                          rendered[2].lane[l]);
+            float radius_sq = 0.0f;
+            for (int d = 0; d < D; ++d) {
+                radius_sq += x[d].lane[l] * x[d].lane[l];
+            }
+            // Written so NaN fails the comparison too.
+            if (!(radius_sq <= escape_sq)) {
+                ++diverged;
+                if (respawn) {
+                    float fresh[D];
+                    const uint32_t seed =
+                        hash_particle(static_cast<uint32_t>(index + l) ^
+                                      launch_seed);
+                    random_state(fresh, D, seed, field.spawn_center,
+                                 state.particle_spawn_radius);
+                    fill_lane(field, index + l, fresh);
+                    position = vec3(fresh[0], D > 1 ? fresh[1] : fresh[0],
+                                    D > 2 ? fresh[2] : fresh[0]);
+                }
+                out[l] = position;
+                continue;
+            }
+            out[l] = position;
+            if (samples) {
+                accumulate_sample(*samples, state.stats.binning, position);
+            }
+        }
+    }
+
+    void run(size_t begin, size_t end) {
+        // Whole blocks take the lane path; a partition boundary inside a
+        // block is stepped one particle at a time.
+        const size_t head_end = std::min(
+            end, (begin + k_dde_lanes - 1) / k_dde_lanes * k_dde_lanes);
+        size_t index = begin;
+        for (; index < head_end; ++index) {
+            step_block<1>(index);
+        }
+        for (; index + k_dde_lanes <= end; index += k_dde_lanes) {
+            step_block<k_dde_lanes>(index);
+        }
+        for (; index < end; ++index) {
+            step_block<1>(index);
+        }
+    }
+};
+
+} // namespace
+
+int dde_history_slots(float tau, float dt) {
+    const float step = std::max(dt, 1e-6f);
+    const float delay = std::max(tau, 2.0f * step);
+    // Two more than the delay spans: the segment the oldest lookup falls in
+    // and the slot the step writes.
+    return static_cast<int>(std::ceil(delay / step)) + 2;
+}
+
+bool dde_history_matches(const dde_particle_field &field, float tau,
+                         float dt) {
+    const float step = std::max(dt, 1e-6f);
+    return field.dt == step && field.tau == std::max(tau, 2.0f * step);
+}
+
+size_t dde_particle_capacity(const dde_particle_field &field, int dimension,
+                             float tau, float dt) {
+    const double bytes_per_particle =
+        static_cast<double>(dde_history_slots(tau, dt)) * 2.0 * dimension *
+        sizeof(float);
+    const double budget =
+        std::max(static_cast<double>(field.budget_mb), 1.0) * 1024.0 * 1024.0;
+    const size_t capacity =
+        static_cast<size_t>(budget / bytes_per_particle) / k_dde_lanes *
+        k_dde_lanes;
+    return std::max<size_t>(capacity, k_dde_lanes);
+}
+
+void allocate_dde_history(dde_particle_field &field, int dimension,
+                          float tau, float dt, size_t count) {
+    particle_array<float>().swap(field.history);
+    field.dimension = dimension;
+    field.count = dimension > 0 ? count : 0;
+    if (dimension == 0) {
+        field.slots = 0;
+        return;
+    }
+    field.dt = std::max(dt, 1e-6f);
+    field.tau = std::max(tau, 2.0f * field.dt);
+    field.slots = dde_history_slots(tau, dt);
+    field.step = static_cast<uint64_t>(field.slots);
+    const size_t blocks = (count + k_dde_lanes - 1) / k_dde_lanes;
+    field.history.resize(blocks * block_stride(dimension, field.slots));
+}
+
+void seed_dde_particles(simulation_state &state, size_t begin, size_t end,
+                        uint32_t seed) {
+    dde_particle_field &field = state.dde;
+    const int n = field.dimension;
+    mt19937 rng{seed};
+    normal_distribution<float> normal_dist(0.0f, 1.0f);
+    float values[3];
+    for (size_t index = begin; index < end; ++index) {
+        float norm_sq = 0.0f;
+        for (int d = 0; d < n; ++d) {
+            values[d] = normal_dist(rng);
+            norm_sq += values[d] * values[d];
+        }
+        if (norm_sq < 1e-6f) {
+            values[0] = 1.0f;
+            norm_sq = 1.0f;
+        }
+        float radius;
+        if (state.particle_spawn_from_origin) {
+            const float jitter_scale =
+                glm::max(state.particle_origin_jitter, 1e-4f);
+            radius = glm::clamp(std::abs(normal_dist(rng)) * jitter_scale,
+                                1e-5f, jitter_scale * 2.0f);
+        } else {
+            radius = (std::abs(normal_dist(rng)) * 0.5f + 0.5f) *
+                     state.particle_spawn_radius;
+        }
+        const float scale = radius / std::sqrt(norm_sq);
+        for (int d = 0; d < n; ++d) {
+            values[d] = field.spawn_center[d] + values[d] * scale;
+        }
+        fill_lane(field, index, values);
+        // A constant history embeds on the diagonal.
+        const vec3 position(values[0], n > 1 ? values[1] : values[0],
+                            n > 2 ? values[2] : values[0]);
+        state.particle_positions[index] = position;
+        state.particle_phases[index] = compute_spawn_phase(position);
+        state.particle_still_steps[index] = 0;
+    }
+}
+
+bool restart_dde_history(simulation_state &state, float tau, float dt) {
+    dde_particle_field &field = state.dde;
+    const int n = field.dimension;
+    const size_t count = field.count;
+    if (n == 0 || dde_particle_capacity(field, n, tau, dt) < count) {
+        return false;
+    }
+    CHAOSEQ_PROFILE_SCOPE("restart_dde_history");
+    dde_particle_field old;
+    old.dimension = n;
+    old.slots = field.slots;
+    old.step = field.step;
+    old.history.swap(field.history);
+    allocate_dde_history(field, n, tau, dt, count);
+    plan_particle_partitions(state, count);
+    run_particle_partitions(state, [&](size_t begin, size_t end,
+                                       unsigned int) {
+        float values[3];
+        for (size_t index = begin; index < end; ++index) {
+            dde_particle_state(old, index, values);
+            fill_lane(field, index, values);
+        }
+    });
+    return true;
+}
+
+void integrate_dde_range(simulation_state &state, size_t begin, size_t end,
+                         invariant_accumulator *samples, size_t &diverged) {
+    dde_particle_field &field = state.dde;
+    dispatch_dde_system(state, [&](auto dimension, auto deriv) {
+        constexpr int D = decltype(dimension)::value;
+        const double lag = static_cast<double>(field.tau) / field.dt;
+        dde_range_kernel<D, decltype(deriv)> kernel{
+            state,
+            field,
+            deriv,
+            samples,
+            diverged,
+            state.particle_escape_radius * state.particle_escape_radius,
+            state.cull_mode != particle_cull_mode::off,
+            hash_particle(state.particle_launches),
+            {make_lookup(field, -lag), make_lookup(field, 0.5 - lag),
+             make_lookup(field, 1.0 - lag)},
+            make_lookup(field, 1.0 - 0.5 * lag),
+            make_lookup(field, 1.0 - lag)};
+        kernel.run(begin, end);
+    });
+    CHAOSEQ_PROFILE_COUNT(profile_counter::particle_steps, end - begin);
+    CHAOSEQ_PROFILE_COUNT(profile_counter::derivative_evaluations,
+                          4 * (end - begin));
+}
+
+void dde_particle_state(const dde_particle_field &field, size_t index,
+                        float *out) {
+    const size_t slot =
+        static_cast<size_t>(field.step % static_cast<uint64_t>(field.slots));
+    const float *value =
+        field.history.data() +
+        history_offset(field.dimension, field.slots, index / k_dde_lanes,
+                       slot, 0) +
+        index % k_dde_lanes;
+    for (int d = 0; d < field.dimension; ++d) {
+        out[d] = value[d * k_dde_lanes];
+    }
+}
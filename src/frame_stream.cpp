@@ -0,0 +1,239 @@
+#include "frame_stream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr int k_frame_read_attempts = 8;
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t slot_stride(uint64_t capacity) {
+    return align_up(sizeof(frame_slot_header) +
+                        capacity * (3 * sizeof(float) + sizeof(uint32_t)),
+                    64);
+}
+
+frame_slot_header *slot_at(void *base, const frame_stream_header &header,
+                           uint64_t sequence) {
+    char *slots = static_cast<char *>(base) + header.slots_offset;
+    return reinterpret_cast<frame_slot_header *>(
+        slots + (sequence % header.slot_count) * header.slot_stride);
+}
+
+void unmap_stream(frame_stream &stream) {
+    if (!stream.base) {
+        return;
+    }
+    stream.header->closed.store(1, memory_order_release);
+    munmap(stream.base, stream.bytes);
+    shm_unlink(stream.name.c_str());
+    stream.base = nullptr;
+    stream.bytes = 0;
+    stream.header = nullptr;
+    stream.writing = nullptr;
+}
+
+// Replaces any region under the stream's name. Readers of the old region
+// see `closed` and reopen.
+bool map_stream(frame_stream &stream, uint64_t capacity) {
+    unmap_stream(stream);
+    shm_unlink(stream.name.c_str());
+    const int fd =
+        shm_open(stream.name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        cerr << "Failed to create frame stream " << stream.name << "\n";
+        return false;
+    }
+    const uint64_t slots_offset = align_up(sizeof(frame_stream_header), 64);
+    const uint64_t stride = slot_stride(capacity);
+    const uint64_t bytes = slots_offset + stride * k_frame_stream_slots;
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        cerr << "Failed to size frame stream " << stream.name << "\n";
+        close(fd);
+        shm_unlink(stream.name.c_str());
+        return false;
+    }
+    void *base =
+        mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        cerr << "Failed to map frame stream " << stream.name << "\n";
+        shm_unlink(stream.name.c_str());
+        return false;
+    }
+    stream.base = base;
+    stream.bytes = bytes;
+    stream.header = new (base) frame_stream_header();
+    stream.header->magic = k_frame_stream_magic;
+    stream.header->version = k_frame_stream_version;
+    stream.header->slot_count = k_frame_stream_slots;
+    stream.header->slot_capacity = capacity;
+    stream.header->slot_stride = stride;
+    stream.header->slots_offset = slots_offset;
+    stream.header->bytes = bytes;
+    for (uint32_t slot = 0; slot < k_frame_stream_slots; ++slot) {
+        new (slot_at(base, *stream.header, slot)) frame_slot_header();
+    }
+    return true;
+}
+
+} // namespace
+
+float *begin_frame(frame_stream &stream, size_t count) {
+    if (!stream.header || stream.header->slot_capacity < count) {
+        // Headroom so a slowly growing particle count does not recreate the
+        // region, and every reader with it, on each change.
+        const uint64_t capacity = max<uint64_t>(count + count / 4, 1024);
+        if (!map_stream(stream, capacity)) {
+            stream.enabled = false;
+            return nullptr;
+        }
+    }
+    const uint64_t sequence = stream.sequence + 1;
+    frame_slot_header *slot = slot_at(stream.base, *stream.header, sequence);
+    slot->lock.store(2 * sequence - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    stream.writing = slot;
+    return reinterpret_cast<float *>(slot + 1);
+}
+
+void end_frame(frame_stream &stream, const system_params &params, float t,
+               size_t count) {
+    frame_slot_header *slot = stream.writing;
+    if (!slot) {
+        return;
+    }
+    const uint64_t sequence = stream.sequence + 1;
+    slot->sequence = sequence;
+    slot->timestamp_ns = chrono::duration_cast<chrono::nanoseconds>(
+                             chrono::steady_clock::now().time_since_epoch())
+                             .count();
+    slot->time = t;
+    slot->system = static_cast<uint32_t>(params.current_system);
+    system_params copy = params;
+    const vector<named_parameter> parameters = system_parameters(copy);
+    slot->parameter_count = static_cast<uint32_t>(
+        min<size_t>(parameters.size(), k_frame_max_parameters));
+    for (uint32_t i = 0; i < slot->parameter_count; ++i) {
+        slot->parameters[i] = *parameters[i].value;
+    }
+    slot->particle_count = count;
+    slot->lock.store(2 * sequence, memory_order_release);
+    stream.header->published.store(sequence, memory_order_release);
+    stream.sequence = sequence;
+    stream.writing = nullptr;
+}
+
+void close_frame_stream(frame_stream &stream) { unmap_stream(stream); }
+
+bool open_frame_stream_reader(frame_stream_reader &reader,
+                              const string &name) {
+    close_frame_stream_reader(reader);
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0 ||
+        static_cast<size_t>(info.st_size) < sizeof(frame_stream_header)) {
+        close(fd);
+        return false;
+    }
+    const size_t bytes = static_cast<size_t>(info.st_size);
+    void *base = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    const auto *header = static_cast<const frame_stream_header *>(base);
+    if (header->magic != k_frame_stream_magic ||
+        header->version != k_frame_stream_version || header->bytes != bytes ||
+        header->slot_count == 0 ||
+        header->slots_offset + header->slot_stride * header->slot_count >
+            bytes) {
+        cerr << "Frame stream " << name << " has an unknown layout\n";
+        munmap(base, bytes);
+        return false;
+    }
+    reader.name = name;
+    reader.base = base;
+    reader.bytes = bytes;
+    reader.header = header;
+    reader.last_sequence = 0;
+    reader.frames_skipped = 0;
+    return true;
+}
+
+frame_read_result read_frame(frame_stream_reader &reader, frame_info &info,
+                             vector<float> &positions,
+                             vector<uint32_t> *ids) {
+    if (!reader.header ||
+        reader.header->closed.load(memory_order_acquire) != 0) {
+        return frame_read_result::closed;
+    }
+    const frame_stream_header &header = *reader.header;
+    for (int attempt = 0; attempt < k_frame_read_attempts; ++attempt) {
+        const uint64_t sequence = header.published.load(memory_order_acquire);
+        if (sequence == 0 || sequence == reader.last_sequence) {
+            return frame_read_result::no_frame;
+        }
+        const frame_slot_header *slot = slot_at(reader.base, header, sequence);
+        const uint64_t lock = slot->lock.load(memory_order_acquire);
+        if (lock != 2 * sequence) {
+            // Already being overwritten by a newer frame.
+            continue;
+        }
+        const uint64_t count = slot->particle_count;
+        if (count > header.slot_capacity) {
+            continue;
+        }
+        info.sequence = slot->sequence;
+        info.timestamp_ns = slot->timestamp_ns;
+        info.time = slot->time;
+        info.system = static_cast<system_type>(slot->system);
+        const uint32_t parameter_count =
+            min(slot->parameter_count, k_frame_max_parameters);
+        info.parameters.assign(slot->parameters,
+                               slot->parameters + parameter_count);
+        positions.resize(count * 3);
+        memcpy(positions.data(), slot + 1, count * 3 * sizeof(float));
+        if (ids) {
+            ids->resize(count);
+            memcpy(ids->data(),
+                   reinterpret_cast<const float *>(slot + 1) + 3 * count,
+                   count * sizeof(uint32_t));
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (slot->lock.load(memory_order_relaxed) != lock) {
+            continue;
+        }
+        if (reader.last_sequence != 0 && sequence > reader.last_sequence + 1) {
+            reader.frames_skipped += sequence - reader.last_sequence - 1;
+        }
+        reader.last_sequence = sequence;
+        return frame_read_result::frame;
+    }
+    return frame_read_result::no_frame;
+}
+
+void close_frame_stream_reader(frame_stream_reader &reader) {
+    if (reader.base) {
+        munmap(reader.base, reader.bytes);
+    }
+    reader.base = nullptr;
+    reader.bytes = 0;
+    reader.header = nullptr;
+}
@@ -0,0 +1,274 @@
+#include "invariant_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+void reset_totals(invariant_accumulator &accumulator) {
+    for (int axis = 0; axis < 3; ++axis) {
+        accumulator.axes[axis] = running_moments{};
+    }
+    fill(accumulator.marginals.begin(), accumulator.marginals.end(), 0);
+    fill(accumulator.projection.begin(), accumulator.projection.end(), 0u);
+    accumulator.outside = 0;
+}
+
+void size_accumulator(invariant_accumulator &accumulator,
+                      const invariant_settings &settings) {
+    const size_t marginal_bins = 3 * static_cast<size_t>(settings.bins);
+    const size_t projection_bins =
+        static_cast<size_t>(settings.projection_size) *
+        static_cast<size_t>(settings.projection_size);
+    if (accumulator.marginals.size() != marginal_bins) {
+        accumulator.marginals.assign(marginal_bins, 0);
+    }
+    if (accumulator.projection.size() != projection_bins) {
+        accumulator.projection.assign(projection_bins, 0u);
+    }
+}
+
+double standard_deviation(const running_moments &moments) {
+    return std::sqrt(moments.variance());
+}
+
+template <typename Count>
+bool write_pgm(const Count *counts, int width, int height, const char *path) {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "Failed to open image file: " << path << "\n";
+        return false;
+    }
+    const size_t w = static_cast<size_t>(width);
+    const size_t h = static_cast<size_t>(height);
+    const Count peak = w * h > 0 ? *max_element(counts, counts + w * h) : 0;
+    const double scale =
+        peak > 0 ? 255.0 / std::log1p(static_cast<double>(peak)) : 0.0;
+    out << "P5\n" << w << " " << h << "\n255\n";
+    vector<unsigned char> row(w);
+    for (size_t y = h; y-- > 0;) {
+        for (size_t x = 0; x < w; ++x) {
+            row[x] = static_cast<unsigned char>(
+                std::log1p(static_cast<double>(counts[y * w + x])) * scale);
+        }
+        out.write(reinterpret_cast<const char *>(row.data()),
+                  static_cast<streamsize>(w));
+    }
+    return static_cast<bool>(out);
+}
+
+} // namespace
+
+double running_moments::skewness() const {
+    if (count < 3 || m2 <= 0.0) {
+        return 0.0;
+    }
+    return std::sqrt(static_cast<double>(count)) * m3 / std::pow(m2, 1.5);
+}
+
+running_moments merge_moments(const running_moments &a,
+                              const running_moments &b) {
+    if (a.count == 0) {
+        return b;
+    }
+    if (b.count == 0) {
+        return a;
+    }
+    const double n_a = static_cast<double>(a.count);
+    const double n_b = static_cast<double>(b.count);
+    const double n = n_a + n_b;
+    const double delta = b.mean - a.mean;
+    running_moments merged;
+    merged.count = a.count + b.count;
+    merged.mean = a.mean + delta * n_b / n;
+    merged.m2 = a.m2 + b.m2 + delta * delta * n_a * n_b / n;
+    merged.m3 = a.m3 + b.m3 +
+                delta * delta * delta * n_a * n_b * (n_a - n_b) / (n * n) +
+                3.0 * delta * (n_a * b.m2 - n_b * a.m2) / n;
+    return merged;
+}
+
+void clear_invariant_stats(invariant_stats &stats) {
+    stats.range_valid = false;
+    stats.substeps = 0;
+    stats.samples = 0;
+    stats.threads.clear();
+    stats.total = invariant_accumulator{};
+    for (running_moments &moments : stats.previous_window) {
+        moments = running_moments{};
+    }
+    stats.have_previous_window = false;
+    stats.window_fill = 0;
+    stats.quiet_windows = 0;
+    stats.drift = -1.0;
+    stats.settled = false;
+    stats.settled_time = -1.0f;
+}
+
+void fit_invariant_range(invariant_stats &stats, const vec3 &low,
+                         const vec3 &high) {
+    const vec3 margin = glm::max((high - low) * 0.25f, vec3(1e-3f));
+    stats.settings.range_min = low - margin;
+    stats.settings.range_max = high + margin;
+    stats.range_valid = true;
+}
+
+bool begin_invariant_sample(invariant_stats &stats, size_t worker_count) {
+    invariant_settings &settings = stats.settings;
+    const uint64_t every =
+        static_cast<uint64_t>(std::max(settings.sample_every, 1));
+    if (stats.substeps++ % every != 0) {
+        return false;
+    }
+    settings.bins = std::max(settings.bins, 1);
+    settings.projection_size = std::max(settings.projection_size, 1);
+    stats.range_valid = true;
+
+    invariant_binning &binning = stats.binning;
+    const vec3 extent =
+        glm::max(settings.range_max - settings.range_min, vec3(1e-6f));
+    binning.origin = settings.range_min;
+    binning.bins = settings.bins;
+    binning.scale = vec3(static_cast<float>(settings.bins)) / extent;
+    binning.axis_u = settings.axis_u;
+    binning.axis_v = settings.axis_v;
+    binning.projection_size = settings.projection_size;
+    binning.projection_origin = vec2(settings.range_min[settings.axis_u],
+                                     settings.range_min[settings.axis_v]);
+    binning.projection_scale =
+        vec2(static_cast<float>(settings.projection_size)) /
+        vec2(extent[settings.axis_u], extent[settings.axis_v]);
+
+    if (stats.threads.size() < worker_count) {
+        stats.threads.resize(worker_count);
+    }
+    for (invariant_accumulator &accumulator : stats.threads) {
+        size_accumulator(accumulator, settings);
+    }
+    return true;
+}
+
+void finish_invariant_sample(invariant_stats &stats, float t) {
+    ++stats.samples;
+    if (++stats.window_fill < std::max(stats.settings.window_samples, 1)) {
+        return;
+    }
+    stats.window_fill = 0;
+
+    running_moments window[3];
+    for (invariant_accumulator &accumulator : stats.threads) {
+        for (int axis = 0; axis < 3; ++axis) {
+            window[axis] =
+                merge_moments(window[axis], accumulator.window[axis]);
+            accumulator.window[axis] = running_moments{};
+        }
+    }
+    if (stats.have_previous_window) {
+        double drift = 0.0;
+        for (int axis = 0; axis < 3; ++axis) {
+            const double scale =
+                std::max(standard_deviation(stats.previous_window[axis]),
+                         1e-12);
+            const double change =
+                std::abs(window[axis].mean -
+                         stats.previous_window[axis].mean) +
+                std::abs(standard_deviation(window[axis]) -
+                         standard_deviation(stats.previous_window[axis]));
+            drift = std::max(drift, change / scale);
+        }
+        stats.drift = drift;
+        stats.quiet_windows =
+            drift < stats.settings.tolerance ? stats.quiet_windows + 1 : 0;
+        if (!stats.settled &&
+            stats.quiet_windows >= std::max(stats.settings.settle_windows, 1)) {
+            stats.settled = true;
+            stats.settled_time = t;
+            if (stats.discard_transient) {
+                for (invariant_accumulator &accumulator : stats.threads) {
+                    reset_totals(accumulator);
+                }
+                stats.samples = 0;
+            }
+        }
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        stats.previous_window[axis] = window[axis];
+    }
+    stats.have_previous_window = true;
+}
+
+void collect_invariant_stats(invariant_stats &stats) {
+    invariant_accumulator &total = stats.total;
+    size_accumulator(total, stats.settings);
+    reset_totals(total);
+    for (const invariant_accumulator &accumulator : stats.threads) {
+        for (int axis = 0; axis < 3; ++axis) {
+            total.axes[axis] =
+                merge_moments(total.axes[axis], accumulator.axes[axis]);
+        }
+        if (accumulator.marginals.size() == total.marginals.size()) {
+            for (size_t i = 0; i < total.marginals.size(); ++i) {
+                total.marginals[i] += accumulator.marginals[i];
+            }
+        }
+        if (accumulator.projection.size() == total.projection.size()) {
+            for (size_t i = 0; i < total.projection.size(); ++i) {
+                total.projection[i] += accumulator.projection[i];
+            }
+        }
+        total.outside += accumulator.outside;
+    }
+}
+
+bool export_invariant_csv(const invariant_stats &stats, const char *path) {
+    ofstream out(path);
+    if (!out) {
+        cerr << "Failed to open statistics file: " << path << "\n";
+        return false;
+    }
+    const invariant_accumulator &total = stats.total;
+    const invariant_settings &settings = stats.settings;
+    out << "samples," << stats.samples << ",settled," << stats.settled
+        << ",settled_time," << stats.settled_time << ",outside,"
+        << total.outside << "\n";
+    out << "axis,count,mean,std,skewness\n";
+    static const char axis_names[3] = {'x', 'y', 'z'};
+    for (int axis = 0; axis < 3; ++axis) {
+        const running_moments &moments = total.axes[axis];
+        out << axis_names[axis] << "," << moments.count << "," << moments.mean
+            << "," << standard_deviation(moments) << "," << moments.skewness()
+            << "\n";
+    }
+    out << "bin,x,count_x,y,count_y,z,count_z\n";
+    const size_t bins = static_cast<size_t>(settings.bins);
+    if (total.marginals.size() == 3 * bins) {
+        const vec3 width = (settings.range_max - settings.range_min) /
+                           static_cast<float>(settings.bins);
+        for (size_t bin = 0; bin < bins; ++bin) {
+            out << bin;
+            for (int axis = 0; axis < 3; ++axis) {
+                out << ","
+                    << settings.range_min[axis] +
+                           (static_cast<float>(bin) + 0.5f) * width[axis]
+                    << "," << total.marginals[axis * bins + bin];
+            }
+            out << "\n";
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+bool write_count_pgm(const uint32_t *counts, int width, int height,
+                     const char *path) {
+    return write_pgm(counts, width, height, path);
+}
+
+bool write_count_pgm(const uint64_t *counts, int width, int height,
+                     const char *path) {
+    return write_pgm(counts, width, height, path);
+}
@@ -0,0 +1,348 @@
+#include "lattice.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Sites per block. With the halos, the four stage buffers of a block take
+// about 64 KiB and stay in L2 through all four RK4 stages.
+constexpr size_t k_lattice_block = 4096;
+constexpr int k_min_sites = 64;
+constexpr int k_max_sites = 1 << 20;
+
+uint32_t hash_site(uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+    return value;
+}
+
+float hash_unit(uint32_t value) {
+    return (static_cast<float>(hash_site(value) >> 8) + 0.5f) *
+           (1.0f / 16777216.0f);
+}
+
+template <typename Model> constexpr int halo_stages() {
+    return Model::is_map ? 1 : 4;
+}
+
+// Stage buffer length for one block of a model.
+template <typename Model> constexpr size_t block_span() {
+    return k_lattice_block +
+           static_cast<size_t>(halo_stages<Model>() *
+                               (Model::left + Model::right));
+}
+
+// Copies count values of the ring starting at site first, wrapping around.
+void load_ring(const float *state, size_t sites, size_t first, size_t count,
+               float *out) {
+    size_t source = first;
+    while (count > 0) {
+        const size_t run = std::min(count, sites - source);
+        memcpy(out, state + source, run * sizeof(float));
+        out += run;
+        count -= run;
+        source = 0;
+    }
+}
+
+// Advances sites [begin, end) into out. Every stage of the block runs over
+// the stage buffers while they are in cache: each RK4 stage is one fused
+// loop that evaluates the stencil, accumulates into acc and forms the next
+// stage input, instead of one sweep over the whole ring per k_i and tmp.
+// Each stage needs the previous one `left + right` sites wider, so the
+// buffers start with four halos that are computed redundantly.
+template <typename Model>
+void step_block(const Model &model, const float *state, size_t sites,
+                size_t begin, size_t end, float dt, float *scratch,
+                float *out) {
+    constexpr size_t L = Model::left;
+    constexpr size_t R = Model::right;
+    constexpr size_t S = halo_stages<Model>();
+    const size_t span = end - begin + S * (L + R);
+    float *u0 = scratch;
+    load_ring(state, sites, (begin + sites - S * L % sites) % sites, span,
+              u0);
+    if (Model::is_map) {
+        for (size_t j = L; j < span - R; ++j) {
+            out[j - L] = model(u0 + j);
+        }
+        return;
+    }
+
+    constexpr size_t stride = block_span<Model>();
+    float *acc = u0 + stride;
+    float *a = acc + stride;
+    float *b = a + stride;
+    const float half = 0.5f * dt;
+    const float sixth = dt / 6.0f;
+    for (size_t j = L; j < span - R; ++j) {
+        const float k = model(u0 + j);
+        acc[j] = k;
+        a[j] = u0[j] + half * k;
+    }
+    for (size_t j = 2 * L; j < span - 2 * R; ++j) {
+        const float k = model(a + j);
+        acc[j] += 2.0f * k;
+        b[j] = u0[j] + half * k;
+    }
+    for (size_t j = 3 * L; j < span - 3 * R; ++j) {
+        const float k = model(b + j);
+        acc[j] += 2.0f * k;
+        a[j] = u0[j] + dt * k;
+    }
+    for (size_t j = 4 * L; j < span - 4 * R; ++j) {
+        out[j - 4 * L] = u0[j] + sixth * (acc[j] + model(a + j));
+    }
+}
+
+size_t block_count(size_t sites) {
+    return (sites + k_lattice_block - 1) / k_lattice_block;
+}
+
+unsigned int plan_lattice_blocks(lattice_state &lattice, worker_pool &pool) {
+    start_worker_pool(pool);
+    const size_t blocks = block_count(lattice.current.size());
+    const unsigned int thread_count =
+        static_cast<unsigned int>(std::min<size_t>(
+            std::max(1u, worker_count(pool)), std::max<size_t>(blocks, 1)));
+    if (lattice.block_bounds.size() != thread_count + 1 ||
+        lattice.block_bounds.back() != blocks) {
+        partition_by_weight(pool, blocks, thread_count, lattice.block_bounds);
+    }
+    lattice.scratch.resize(thread_count);
+    return thread_count;
+}
+
+uint32_t heat_color(float value, float low, float high) {
+    const float t =
+        glm::clamp((value - low) / std::max(high - low, 1e-6f), 0.0f, 1.0f);
+    // Blue through white to red.
+    float r = 1.0f;
+    float g = 1.0f;
+    float b = 1.0f;
+    if (t < 0.5f) {
+        r = g = 2.0f * t;
+    } else {
+        g = b = 2.0f * (1.0f - t);
+    }
+    if (!std::isfinite(value)) {
+        r = g = b = 0.0f;
+    }
+    return 0xFF000000u | (static_cast<uint32_t>(255.0f * b) << 16) |
+           (static_cast<uint32_t>(255.0f * g) << 8) |
+           static_cast<uint32_t>(255.0f * r);
+}
+
+// Probe ring, delay embedding and one heatmap row for the newest state.
+void record_step(lattice_state &lattice, vector<vec3> *embedding) {
+    const lattice_settings &settings = lattice.settings;
+    const float *state = lattice.current.data();
+    const size_t sites = lattice.current.size();
+    const size_t probe =
+        static_cast<size_t>(glm::clamp(settings.probe_site, 0,
+                                       static_cast<int>(sites) - 1));
+    const float value = state[probe];
+    if (!std::isfinite(value)) {
+        lattice.diverged = true;
+    }
+
+    const size_t delay = static_cast<size_t>(std::max(settings.delay_steps, 1));
+    const size_t window = 2 * delay + 1;
+    if (lattice.probe_history.size() != window) {
+        lattice.probe_history.assign(window, 0.0f);
+        lattice.probe_head = 0;
+        lattice.probe_filled = 0;
+    }
+    lattice.probe_history[lattice.probe_head] = value;
+    const size_t newest = lattice.probe_head;
+    lattice.probe_head = (lattice.probe_head + 1) % window;
+    lattice.probe_filled = std::min(lattice.probe_filled + 1, window);
+    if (embedding && lattice.probe_filled == window) {
+        embedding->emplace_back(
+            value, lattice.probe_history[(newest + window - delay) % window],
+            lattice.probe_history[(newest + window - 2 * delay) % window]);
+    }
+
+    const int columns = lattice.columns;
+    const int rows = settings.history_rows;
+    if (columns <= 0 ||
+        lattice.history.size() != static_cast<size_t>(rows) * columns) {
+        return;
+    }
+    // Sampled rather than averaged: averaging a chaotic field over a
+    // thousand sites would only show its mean.
+    uint32_t *row = lattice.history.data() +
+                    static_cast<size_t>(lattice.history_head) * columns;
+    for (int column = 0; column < columns; ++column) {
+        const size_t site = static_cast<size_t>(column) * sites /
+                            static_cast<size_t>(columns);
+        row[column] =
+            heat_color(state[site], settings.display_min, settings.display_max);
+    }
+    lattice.history_head = (lattice.history_head + 1) % rows;
+    lattice.pending_rows = std::min(lattice.pending_rows + 1, rows);
+}
+
+} // namespace
+
+void reset_lattice(lattice_state &lattice, worker_pool &pool) {
+    lattice_settings &settings = lattice.settings;
+    settings.sites = glm::clamp(settings.sites, k_min_sites, k_max_sites);
+    settings.history_rows = glm::clamp(settings.history_rows, 16, 2048);
+    const size_t sites = static_cast<size_t>(settings.sites);
+
+    particle_array<float>().swap(lattice.current);
+    particle_array<float>().swap(lattice.next);
+    lattice.current.resize(sites);
+    lattice.next.resize(sites);
+    const unsigned int thread_count = plan_lattice_blocks(lattice, pool);
+
+    // The worker that integrates a block also touches it first, in both
+    // buffers, and allocates its own stage buffers.
+    const uint32_t seed = random_device{}();
+    const size_t scratch_size =
+        4 * std::max(block_span<Lorenz96Args>(),
+                     block_span<CoupledLogisticArgs>());
+    const vector<size_t> &bounds = lattice.block_bounds;
+    run_workers(pool, thread_count, [&](unsigned int worker) {
+        vector<float> &scratch = lattice.scratch[worker];
+        if (scratch.size() < scratch_size) {
+            scratch.assign(scratch_size, 0.0f);
+        }
+        const size_t begin = bounds[worker] * k_lattice_block;
+        const size_t end = std::min(bounds[worker + 1] * k_lattice_block,
+                                    sites);
+        for (size_t site = begin; site < end; ++site) {
+            const float noise =
+                hash_unit(static_cast<uint32_t>(site) ^ seed);
+            lattice.current[site] =
+                settings.model == lattice_model::lorenz96
+                    ? settings.lorenz96.forcing + 0.01f * (noise - 0.5f)
+                    : 0.05f + 0.9f * noise;
+            lattice.next[site] = 0.0f;
+        }
+    });
+
+    lattice.steps = 0;
+    lattice.time = 0.0;
+    lattice.diverged = false;
+    lattice.seconds_per_step = 0.0;
+    lattice.probe_history.clear();
+    lattice.columns = std::min(settings.sites, k_lattice_columns);
+    lattice.history.assign(
+        static_cast<size_t>(settings.history_rows) * lattice.columns,
+        0xFF000000u);
+    lattice.history_head = 0;
+    lattice.pending_rows = settings.history_rows;
+}
+
+void advance_lattice(lattice_state &lattice, worker_pool &pool, int steps,
+                     vector<vec3> *embedding) {
+    if (lattice.current.empty() || lattice.diverged || steps <= 0) {
+        return;
+    }
+    CHAOSEQ_PROFILE_SCOPE("advance_lattice");
+    const auto start = chrono::steady_clock::now();
+    const unsigned int thread_count = plan_lattice_blocks(lattice, pool);
+    const size_t sites = lattice.current.size();
+    const float dt = glm::clamp(lattice.settings.dt, 1e-6f, 0.2f);
+    const vector<size_t> &bounds = lattice.block_bounds;
+
+    auto run = [&](const auto &model) {
+        using model_type = std::decay_t<decltype(model)>;
+        int step = 0;
+        for (; step < steps && !lattice.diverged; ++step) {
+            const float *state = lattice.current.data();
+            float *next = lattice.next.data();
+            run_workers(pool, thread_count, [&](unsigned int worker) {
+                float *scratch = lattice.scratch[worker].data();
+                for (size_t block = bounds[worker]; block < bounds[worker + 1];
+                     ++block) {
+                    const size_t begin = block * k_lattice_block;
+                    const size_t end =
+                        std::min(begin + k_lattice_block, sites);
+                    step_block(model, state, sites, begin, end, dt, scratch,
+                               next + begin);
+                }
+            });
+            lattice.current.swap(lattice.next);
+            ++lattice.steps;
+            lattice.time += model_type::is_map ? 1.0 : dt;
+            record_step(lattice, embedding);
+        }
+        CHAOSEQ_PROFILE_COUNT(profile_counter::derivative_evaluations,
+                              halo_stages<model_type>() * sites * step);
+        return step;
+    };
+    const lattice_settings &settings = lattice.settings;
+    const int done = settings.model == lattice_model::coupled_logistic
+                         ? run(settings.coupled_logistic)
+                         : run(settings.lorenz96);
+    if (done > 0) {
+        lattice.seconds_per_step =
+            chrono::duration<double>(chrono::steady_clock::now() - start)
+                .count() /
+            done;
+    }
+}
+
+void upload_lattice_texture(lattice_state &lattice) {
+    const int columns = lattice.columns;
+    const int rows = lattice.settings.history_rows;
+    if (lattice.pending_rows == 0 || columns <= 0 ||
+        lattice.history.size() != static_cast<size_t>(rows) * columns) {
+        return;
+    }
+    if (lattice.texture == 0) {
+        glGenTextures(1, &lattice.texture);
+        glBindTexture(GL_TEXTURE_2D, lattice.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        // The UI scrolls the ring with texture coordinates.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+    glBindTexture(GL_TEXTURE_2D, lattice.texture);
+    GLint width = 0;
+    GLint height = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    if (width != columns || height != rows ||
+        lattice.pending_rows >= rows) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, columns, rows, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, lattice.history.data());
+    } else {
+        // Only the new rows, in at most two runs around the ring.
+        int first = (lattice.history_head - lattice.pending_rows + rows) % rows;
+        int remaining = lattice.pending_rows;
+        while (remaining > 0) {
+            const int run = std::min(remaining, rows - first);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, columns, run, GL_RGBA,
+                            GL_UNSIGNED_BYTE,
+                            lattice.history.data() +
+                                static_cast<size_t>(first) * columns);
+            remaining -= run;
+            first = 0;
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    lattice.pending_rows = 0;
+}
+
+void release_lattice_gpu(lattice_state &lattice) {
+    if (lattice.texture != 0) {
+        glDeleteTextures(1, &lattice.texture);
+        lattice.texture = 0;
+    }
+}
@@ -1,10 +1,13 @@
+#include "embedded_shaders.hpp"
+#include "profiler.hpp"
+#include "scenario.hpp"
 #include "simulation.hpp"
+#include "snapshot.hpp"
 #include "ui.hpp"
 
+#include <chrono>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
 
 using namespace std;
@@ -22,19 +25,45 @@ static double g_orbit_last_y = 0.0;
 static bool g_frame_key_down = false;
 static bool g_show_ui = true;
 static bool g_ui_toggle_key_down = false;
-
-static string load_text_file(const char *path) {
-    ifstream file(path, ios::binary);
-    if (!file) {
-        cerr << "Failed to open shader file: " << path << "\n";
-        return {};
+static bool g_show_profiler = false;
+static bool g_profiler_toggle_key_down = false;
+// Time of the last input event. Frames are only drawn on demand: while
+// nothing animates the loop sleeps until input arrives.
+static double g_last_input_time = 0.0;
+
+// ImGui needs a few frames after input to settle hover and popup state and
+// opens tooltips after a delay, so drawing goes on this long after input.
+constexpr double k_input_settle_seconds = 0.5;
+// Frame interval while the window is unfocused but still animating.
+constexpr double k_unfocused_frame_interval = 1.0 / 15.0;
+// How often an idle loop wakes to show the progress of a basin job.
+constexpr double k_idle_poll_interval = 0.25;
+
+static const char *shader_source(const char *name) {
+    const char *source = embedded_shader(name);
+    if (!source) {
+        cerr << "Missing embedded shader: " << name << "\n";
+        return "";
     }
-    stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    return source;
+}
+
+static void note_input() { g_last_input_time = glfwGetTime(); }
+
+static void key_callback(GLFWwindow *, int, int, int, int) { note_input(); }
+
+static void char_callback(GLFWwindow *, unsigned int) { note_input(); }
+
+static void mouse_button_callback(GLFWwindow *, int, int, int) {
+    note_input();
 }
 
+static void window_focus_callback(GLFWwindow *, int) { note_input(); }
+
+static void window_refresh_callback(GLFWwindow *) { note_input(); }
+
 static void mouse_callback(GLFWwindow *, double xpos, double ypos) {
+    note_input();
     if (g_sim.current_camera_mode != camera_mode::fps ||
         !g_mouse_look_enabled) {
         return;
@@ -43,6 +72,7 @@ static void mouse_callback(GLFWwindow *, double xpos, double ypos) {
 }
 
 static void scroll_callback(GLFWwindow *, double, double yoffset) {
+    note_input();
     if (g_sim.current_camera_mode == camera_mode::fps) {
         g_camera.fov = glm::clamp(g_camera.fov - static_cast<float>(yoffset),
                                   10.0f, 90.0f);
@@ -55,6 +85,7 @@ static void scroll_callback(GLFWwindow *, double, double yoffset) {
 }
 
 static void framebuffer_size_callback(GLFWwindow *, int width, int height) {
+    note_input();
     g_window_width = width;
     g_window_height = height;
     glViewport(0, 0, width, height);
@@ -85,41 +116,190 @@ static void handle_orbit_drag(GLFWwindow *window) {
     }
 }
 
-int main(int, char **) {
+// Polls the keyboard and mouse buttons once a frame. Scripted runs skip it,
+// so a stray key cannot change what a scenario measures.
+static void process_input(GLFWwindow *window, float frame_dt) {
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+        glfwSetWindowShouldClose(window, true);
+    }
+
+    const ImGuiIO &io = ImGui::GetIO();
+    if (g_sim.current_camera_mode == camera_mode::fps) {
+        const bool want_capture = g_show_ui && io.WantCaptureMouse;
+        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) ==
+                GLFW_PRESS &&
+            !want_capture) {
+            if (!g_mouse_look_enabled) {
+                g_mouse_look_enabled = true;
+                glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+                g_camera.first_mouse = true;
+            }
+        } else if (g_mouse_look_enabled) {
+            g_mouse_look_enabled = false;
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        }
+    } else {
+        if (g_mouse_look_enabled) {
+            g_mouse_look_enabled = false;
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        }
+        handle_orbit_drag(window);
+    }
+
+    const bool i_pressed = (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS);
+    if (i_pressed && !g_ui_toggle_key_down) {
+        g_show_ui = !g_show_ui;
+    }
+    g_ui_toggle_key_down = i_pressed;
+
+    const bool p_pressed = (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS);
+    if (p_pressed && !g_profiler_toggle_key_down) {
+        g_show_profiler = !g_show_profiler;
+    }
+    g_profiler_toggle_key_down = p_pressed;
+
+    if (g_sim.current_camera_mode == camera_mode::fps &&
+        !(g_show_ui && io.WantCaptureKeyboard)) {
+        g_camera.process_keyboard(window, frame_dt);
+    }
+
+    const bool f_pressed = (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS);
+    if (f_pressed && !g_frame_key_down) {
+        frame_particles(g_sim, g_orbit_camera, g_camera, g_orbit_dragging);
+    }
+    g_frame_key_down = f_pressed;
+}
+
+// Handles events until the next frame is due: at once while the scene
+// animates, at a reduced rate while the window is unfocused, and otherwise
+// after input arrives or a running basin job has progress to show. Returns
+// whether the loop slept, so the idle time can be kept out of the next dt.
+static bool wait_for_next_frame(GLFWwindow *window, bool animating) {
+    const bool focused = glfwGetWindowAttrib(window, GLFW_FOCUSED) != 0;
+    if (animating) {
+        if (focused) {
+            glfwPollEvents();
+        } else {
+            glfwWaitEventsTimeout(k_unfocused_frame_interval);
+        }
+        return false;
+    }
+    if (glfwGetTime() - g_last_input_time < k_input_settle_seconds) {
+        glfwPollEvents();
+        return false;
+    }
+    const double idle_since = g_last_input_time;
+    while (g_last_input_time == idle_since &&
+           !glfwWindowShouldClose(window)) {
+        glfwWaitEventsTimeout(k_idle_poll_interval);
+        // A shown basin map needs frames while it fills in, and one more
+        // after the job finishes for the final upload.
+        const basin_mapper &basin = g_sim.basin;
+        if (g_show_ui && basin.show_window && basin.job &&
+            (!basin.job->finished || !basin.uploaded_final)) {
+            break;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const auto startup_begin = chrono::steady_clock::now();
+    const char *snapshot_path = nullptr;
+    const char *scenario_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--snapshot" && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if (arg == "--scenario" && i + 1 < argc) {
+            scenario_path = argv[++i];
+        } else if (arg == "--stream") {
+            g_sim.stream.enabled = true;
+            if (i + 1 < argc && argv[i + 1][0] == '/') {
+                g_sim.stream.name = argv[++i];
+            }
+        } else {
+            cerr << "Usage: " << argv[0]
+                 << " [--snapshot <file>] [--stream [/shm-name]]"
+                    " [--scenario <file>]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    // A scenario replaces the user's input with a script and times each
+    // frame drawn into an offscreen framebuffer.
+    scenario_runner scenario;
+    if (scenario_path && !load_scenario(scenario_path, scenario.script)) {
+        return EXIT_FAILURE;
+    }
+
+#if GLFW_VERSION_MAJOR * 100 + GLFW_VERSION_MINOR >= 304
+    // The null platform opens no display; with the EGL context below it
+    // gets a surfaceless context, so scripted runs need no X server.
+    if (scenario_path) {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
+#endif
+    // Without a display or a GL driver a scenario is skipped, not failed.
+    const int no_context_status =
+        scenario_path ? k_scenario_skipped : EXIT_FAILURE;
     if (!glfwInit()) {
         cerr << "Failed to init GLFW\n";
-        return EXIT_FAILURE;
+        return no_context_status;
     }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    if (scenario_path) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
 
-    GLFWwindow *window = glfwCreateWindow(g_window_width, g_window_height,
-                                          "3D ODE Simulator", nullptr, nullptr);
+    // Prefer 4.3 for the compute rasterizer, but 4.0 is enough for the rest.
+    GLFWwindow *window = nullptr;
+    for (int minor : {3, 0}) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+        window = glfwCreateWindow(g_window_width, g_window_height,
+                                  "3D ODE Simulator", nullptr, nullptr);
+        if (window) {
+            break;
+        }
+    }
     if (!window) {
         cerr << "Failed to create OpenGL context\n";
         glfwTerminate();
-        return EXIT_FAILURE;
+        return no_context_status;
     }
 
     glfwMakeContextCurrent(window);
+    if (scenario_path) {
+        glfwSwapInterval(0);
+    }
 
     if (!gladLoadGL()) {
         cerr << "Failed to init GLAD\n";
-        return EXIT_FAILURE;
+        return no_context_status;
     }
 
     if (const GLubyte *version = glGetString(GL_VERSION)) {
         cout << "OpenGL " << version << "\n";
     }
     glEnable(GL_MULTISAMPLE);
+    g_sim.compute_supported = GLAD_GL_VERSION_4_3 != 0;
 
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    if (scenario_path) {
+        create_offscreen_frame(g_sim, g_window_width, g_window_height);
+    } else {
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetCharCallback(window, char_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        glfwSetWindowFocusCallback(window, window_focus_callback);
+        glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    }
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -136,74 +316,88 @@ int main(int, char **) {
     glEnable(GL_PROGRAM_POINT_SIZE);
 
     create_axes(g_sim);
-    g_orbit_camera.target = reset_simulation(g_sim);
+    // Particles are seeded after the first frame is on screen.
+    g_orbit_camera.target = reset_simulation(g_sim, false);
     sync_fps_from_orbit(g_orbit_camera, g_camera);
+    if (snapshot_path) {
+        load_snapshot(g_sim, g_camera, g_orbit_camera, snapshot_path);
+    }
 
-    const string axes_vertex_source = load_text_file("shader/basic.vert");
-    const string axes_fragment_source = load_text_file("shader/basic.frag");
-    Shader axes_shader(axes_vertex_source.c_str(),
-                       axes_fragment_source.c_str());
-
-    const string particle_vertex_source =
-        load_text_file("shader/particle.vert");
-    const string particle_fragment_source =
-        load_text_file("shader/particle.frag");
-    Shader particle_shader(particle_vertex_source.c_str(),
-                           particle_fragment_source.c_str());
-
+    // Only the programs needed for the default view are built up front; the
+    // rest are built once the first frame has been presented.
+    Shader axes_shader(shader_source("basic.vert"),
+                       shader_source("basic.frag"));
+    Shader particle_shader(shader_source("particle.vert"),
+                           shader_source("particle.frag"));
+    Shader particle_accum_shader;
+    Shader tonemap_shader;
+    Shader trail_shader;
+    Shader point_raster_shader;
+    Shader point_resolve_shader;
+    bool deferred_ready = false;
+
+    auto deferred_init = [&]() {
+        const auto deferred_begin = chrono::steady_clock::now();
+        if (g_sim.particle_positions.empty()) {
+            initialize_particle_field(g_sim);
+            update_particle_gpu(g_sim);
+        }
+        particle_accum_shader.compile(shader_source("particle.vert"),
+                                      shader_source("particle_accum.frag"));
+        tonemap_shader.compile(shader_source("fullscreen.vert"),
+                               shader_source("tonemap.frag"));
+        trail_shader.compile(shader_source("trail.vert"),
+                             shader_source("trail.frag"));
+        if (g_sim.compute_supported) {
+            point_raster_shader.compile_compute(
+                shader_source("point_raster.comp"));
+            point_resolve_shader.compile(shader_source("fullscreen.vert"),
+                                         shader_source("point_resolve.frag"));
+        }
+        deferred_ready = true;
+        int cache_hits = 0;
+        int cache_misses = 0;
+        shader_cache_stats(cache_hits, cache_misses);
+        cout << "Deferred init: "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                                deferred_begin)
+                    .count()
+             << " ms (program cache " << cache_hits << " hits, "
+             << cache_misses << " misses)\n";
+    };
+
+    if (scenario_path) {
+        deferred_init();
+    }
     double last_time = glfwGetTime();
+    mat4 last_mvp(0.0f);
 
     while (!glfwWindowShouldClose(window)) {
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-            glfwSetWindowShouldClose(window, true);
-        }
-
-        ImGuiIO &loop_io = ImGui::GetIO();
-        if (g_sim.current_camera_mode == camera_mode::fps) {
-            const bool want_capture = g_show_ui && loop_io.WantCaptureMouse;
-            if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) ==
-                    GLFW_PRESS &&
-                !want_capture) {
-                if (!g_mouse_look_enabled) {
-                    g_mouse_look_enabled = true;
-                    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-                    g_camera.first_mouse = true;
-                }
-            } else if (g_mouse_look_enabled) {
-                g_mouse_look_enabled = false;
-                glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-            }
-        } else {
-            if (g_mouse_look_enabled) {
-                g_mouse_look_enabled = false;
-                glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-            }
-            handle_orbit_drag(window);
+        const auto frame_begin = chrono::steady_clock::now();
+        if (scenario_path &&
+            !scenario_begin_frame(scenario, g_sim, g_orbit_camera, g_camera)) {
+            break;
         }
-
+        profiler_begin_frame();
         const double now = glfwGetTime();
-        const float frame_dt = static_cast<float>(now - last_time);
+        // Scripted runs advance a fixed step, so every run does the same work.
+        const float frame_dt = scenario_path
+                                   ? scenario.script.frame_dt
+                                   : static_cast<float>(now - last_time);
         last_time = now;
 
-        const bool i_pressed = (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS);
-        if (i_pressed && !g_ui_toggle_key_down) {
-            g_show_ui = !g_show_ui;
-        }
-        g_ui_toggle_key_down = i_pressed;
-
-        if (g_sim.current_camera_mode == camera_mode::fps &&
-            !(g_show_ui && loop_io.WantCaptureKeyboard)) {
-            g_camera.process_keyboard(window, frame_dt);
+        if (!scenario_path) {
+            process_input(window, frame_dt);
         }
 
-        const bool f_pressed = (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS);
-        if (f_pressed && !g_frame_key_down) {
-            frame_particles(g_sim, g_orbit_camera, g_camera, g_orbit_dragging);
-        }
-        g_frame_key_down = f_pressed;
-
         step_simulation(g_sim, frame_dt);
+        if (g_sim.correlation.enabled && !g_sim.paused) {
+            update_correlation_estimate(
+                g_sim.correlation, g_sim.particle_positions.data(),
+                primary_segment_count(g_sim), g_sim.workers, now, false);
+        }
         update_particle_gpu(g_sim);
+        update_trails_gpu(g_sim);
 
         const float aspect = (g_window_height > 0)
                                  ? static_cast<float>(g_window_width) /
@@ -219,6 +413,8 @@ int main(int, char **) {
         }
         const mat4 model_matrix(1.0f);
         const mat4 mvp = projection * view_matrix * model_matrix;
+        const bool camera_moved = mvp != last_mvp;
+        last_mvp = mvp;
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -227,25 +423,94 @@ int main(int, char **) {
         if (g_show_ui) {
             draw_ui(g_sim, g_camera, g_orbit_camera, g_mouse_look_enabled,
                     g_orbit_dragging);
+            if (g_sim.poincare.enabled) {
+                draw_poincare_ui(g_sim);
+            }
+            if (g_sim.basin.show_window) {
+                draw_basin_ui(g_sim);
+            }
+            if (g_sim.stats.enabled) {
+                draw_stats_ui(g_sim);
+            }
+            if (g_sim.lattice.enabled) {
+                draw_lattice_ui(g_sim);
+            }
+            if (g_sim.correlation.enabled) {
+                draw_correlation_ui(g_sim);
+            }
+            if (g_show_profiler) {
+                draw_profiler_overlay(&g_show_profiler);
+            }
         }
 
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         draw_axes(axes_shader, g_sim, mvp);
-        draw_particles(particle_shader, g_sim, view_matrix, projection);
+        if (deferred_ready) {
+            draw_trails(trail_shader, g_sim, mvp);
+        }
+        switch (deferred_ready ? g_sim.render_mode
+                               : particle_render_mode::alpha_blend) {
+        case particle_render_mode::alpha_blend:
+            draw_particles(particle_shader, g_sim, view_matrix, projection);
+            break;
+        case particle_render_mode::additive_hdr:
+            draw_particles_hdr(particle_accum_shader, tonemap_shader, g_sim,
+                               view_matrix, projection, g_window_width,
+                               g_window_height);
+            break;
+        case particle_render_mode::compute_raster:
+            draw_particles_compute(point_raster_shader, point_resolve_shader,
+                                   g_sim, view_matrix, projection,
+                                   g_window_width, g_window_height);
+            break;
+        }
 
         if (g_show_ui) {
+            CHAOSEQ_PROFILE_SCOPE("imgui");
+            CHAOSEQ_PROFILE_GPU_SCOPE("imgui");
             ImGui::Render();
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         } else {
             ImGui::EndFrame();
         }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (!scenario_path) {
+            CHAOSEQ_PROFILE_SCOPE("swap_buffers");
+            glfwSwapBuffers(window);
+        }
+        if (scenario_path) {
+            glfwPollEvents();
+        } else if (wait_for_next_frame(window, !g_sim.paused ||
+                                                   camera_moved ||
+                                                   !deferred_ready)) {
+            last_time = glfwGetTime();
+        }
+        profiler_end_frame(frame_dt);
+        if (scenario_path) {
+            // Count the GPU work queued by this frame as part of it.
+            glFinish();
+            scenario_end_frame(
+                scenario, chrono::duration<double, milli>(
+                              chrono::steady_clock::now() - frame_begin)
+                              .count());
+        }
+
+        if (!deferred_ready) {
+            const auto first_frame = chrono::steady_clock::now();
+            cout << "Time to first frame: "
+                 << chrono::duration<double, milli>(first_frame -
+                                                    startup_begin)
+                        .count()
+                 << " ms\n";
+            deferred_init();
+            // Keep the deferred work out of the next frame's dt.
+            last_time = glfwGetTime();
+        }
     }
 
+    profiler_release_gpu();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -257,7 +522,18 @@ int main(int, char **) {
         glDeleteBuffers(1, &g_sim.particle_pos_vbo);
         glDeleteBuffers(1, &g_sim.particle_phase_vbo);
     }
+    release_render_targets(g_sim);
+    release_trails(g_sim);
+    release_poincare_gpu(g_sim.poincare);
+    stop_basin_job(g_sim.basin);
+    release_basin_gpu(g_sim.basin);
+    release_stats_gpu(g_sim);
+    release_lattice_gpu(g_sim.lattice);
+    close_frame_stream(g_sim.stream);
 
     glfwTerminate();
+    if (scenario_path) {
+        return report_scenario(scenario) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,498 @@
+#include "nd_particles.hpp"
+#include "profiler.hpp"
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+constexpr size_t k_fit_samples = 16384;
+constexpr int k_jacobi_sweeps = 32;
+
+uint32_t hash_particle(uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+    return value;
+}
+
+float hash_unit(uint32_t &seed) {
+    seed = hash_particle(seed + 0x9e3779b9u);
+    return (static_cast<float>(seed >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+// A fresh state inside the spawn ball, for particles that escaped.
+void respawn_nd_state(float *values, int dimension, uint32_t seed,
+                      const float *center, float spawn_radius) {
+    float norm_sq = 0.0f;
+    for (int d = 0; d < dimension; ++d) {
+        values[d] = hash_unit(seed) - 0.5f;
+        norm_sq += values[d] * values[d];
+    }
+    const float scale = spawn_radius * (0.5f + 0.5f * hash_unit(seed)) /
+                        std::sqrt(std::max(norm_sq, 1e-12f));
+    for (int d = 0; d < dimension; ++d) {
+        values[d] = center[d] + values[d] * scale;
+    }
+}
+
+// Works on plain floats and on lanes alike.
+template <int D, typename T>
+void project_state(const nd_projection &projection, const nd_vec<D, T> &state,
+                   T (&out)[3], T &radius_sq) {
+    out[0] = T(0.0f);
+    out[1] = T(0.0f);
+    out[2] = T(0.0f);
+    radius_sq = T(0.0f);
+    for (int d = 0; d < D; ++d) {
+        const T value = state[d] - T(projection.center[d]);
+        out[0] = out[0] + T(projection.rows[0][d]) * value;
+        out[1] = out[1] + T(projection.rows[1][d]) * value;
+        out[2] = out[2] + T(projection.rows[2][d]) * value;
+        radius_sq = radius_sq + state[d] * state[d];
+    }
+}
+
+template <int D, typename Deriv> struct nd_range_kernel {
+    simulation_state &state;
+    const Deriv &deriv;
+    float dt;
+    const sde_coefficients *noise;
+    invariant_accumulator *samples;
+    particle_retire_list &retired;
+    float *components[D];
+    float escape_sq;
+    float still_sq;
+    int stall_steps;
+    particle_cull_mode cull_mode;
+    uint32_t launch_seed;
+
+    // W particles starting at index: load, step, store, project.
+    template <int W> void step_block(size_t index) {
+        using lanes = float_lanes<W>;
+        nd_vec<D, lanes> values;
+        for (int d = 0; d < D; ++d) {
+            for (int l = 0; l < W; ++l) {
+                values[d].lane[l] = components[d][index + l];
+            }
+        }
+        const nd_vec<D, lanes> before = values;
+        if (noise) {
+            float normals[D][W];
+            gaussian_lanes<W, D>(state.noise.seed, state.noise.launch, index,
+                                 normals);
+            const nd_vec<D, lanes> drift = deriv(values);
+            for (int d = 0; d < D; ++d) {
+                lanes xi;
+                for (int l = 0; l < W; ++l) {
+                    xi.lane[l] = normals[d][l];
+                }
+                values[d] = sde_component(*noise, values[d], drift[d], xi);
+            }
+        } else {
+            values = rk4_step(deriv, values, dt);
+        }
+        const nd_projection &projection = state.nd.projection;
+        lanes projected[3];
+        lanes radius_sq;
+        project_state(projection, values, projected, radius_sq);
+        for (int d = 0; d < D; ++d) {
+            for (int l = 0; l < W; ++l) {
+                components[d][index + l] = values[d].lane[l];
+            }
+        }
+        lanes moved_sq(0.0f);
+        for (int d = 0; d < D; ++d) {
+            const lanes delta = values[d] - before[d];
+            moved_sq = moved_sq + delta * delta;
+        }
+        vec3 *out = state.particle_positions.data() + index;
+        for (int l = 0; l < W; ++l) {
+            out[l] = vec3(projected[0].lane[l], projected[1].lane[l],
+                          projected[2].lane[l]);
+            if (!lost(index + l, radius_sq.lane[l], moved_sq.lane[l])) {
+                if (samples) {
+                    accumulate_sample(*samples, state.stats.binning, out[l]);
+                }
+                continue;
+            }
+            if (cull_mode == particle_cull_mode::respawn) {
+                respawn_particle(index + l);
+            }
+        }
+    }
+
+    // Counts an escaped or stalled particle and, while culling, lists it as
+    // retired. Escape is measured in the state space, a stall by the length
+    // of the step there, so a projection that flattens the motion does not
+    // stall a moving particle. Keep All only counts the escapes.
+    bool lost(size_t index, float radius_sq, float moved_sq) {
+        // Written so NaN fails the comparison too.
+        const bool escaped = !(radius_sq <= escape_sq);
+        if (cull_mode == particle_cull_mode::off) {
+            retired.diverged += escaped ? 1 : 0;
+            return escaped;
+        }
+        uint16_t &still = state.particle_still_steps[index];
+        if (escaped) {
+            ++retired.diverged;
+        } else if (moved_sq >= still_sq) {
+            still = 0;
+            return false;
+        } else if (++still >= stall_steps) {
+            ++retired.stalled;
+        } else {
+            return false;
+        }
+        still = 0;
+        retired.indices.push_back(static_cast<uint32_t>(index));
+        return true;
+    }
+
+    // Reseeds a retired particle inside the spawn ball.
+    void respawn_particle(size_t index) {
+        nd_vec<D> fresh;
+        respawn_nd_state(fresh.component, D,
+                         hash_particle(static_cast<uint32_t>(index) ^
+                                       launch_seed),
+                         state.nd.spawn_center, state.particle_spawn_radius);
+        float ignored;
+        float projected[3];
+        project_state(state.nd.projection, fresh, projected, ignored);
+        for (int d = 0; d < D; ++d) {
+            components[d][index] = fresh[d];
+        }
+        state.particle_positions[index] =
+            vec3(projected[0], projected[1], projected[2]);
+    }
+
+    void run(size_t begin, size_t end) {
+        // Lane blocks start on multiples of k_nd_lanes; the ragged head and
+        // tail of the partition take the one-lane path.
+        const size_t head_end =
+            std::min(end, (begin + k_nd_lanes - 1) / k_nd_lanes * k_nd_lanes);
+        size_t index = begin;
+        for (; index < head_end; ++index) {
+            step_block<1>(index);
+        }
+        for (; index + k_nd_lanes <= end; index += k_nd_lanes) {
+            step_block<k_nd_lanes>(index);
+        }
+        for (; index < end; ++index) {
+            step_block<1>(index);
+        }
+    }
+};
+
+// Cyclic Jacobi rotations; eigenvectors end up in the columns of vectors.
+void symmetric_eigen(double (&matrix)[k_max_system_dimension]
+                                     [k_max_system_dimension],
+                     int n, double *values,
+                     double (&vectors)[k_max_system_dimension]
+                                      [k_max_system_dimension]) {
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            vectors[i][j] = i == j ? 1.0 : 0.0;
+        }
+    }
+    for (int sweep = 0; sweep < k_jacobi_sweeps; ++sweep) {
+        double off = 0.0;
+        for (int p = 0; p < n; ++p) {
+            for (int q = p + 1; q < n; ++q) {
+                off += matrix[p][q] * matrix[p][q];
+            }
+        }
+        if (off < 1e-18) {
+            break;
+        }
+        for (int p = 0; p < n; ++p) {
+            for (int q = p + 1; q < n; ++q) {
+                if (std::abs(matrix[p][q]) < 1e-30) {
+                    continue;
+                }
+                const double theta =
+                    (matrix[q][q] - matrix[p][p]) / (2.0 * matrix[p][q]);
+                const double t =
+                    (theta >= 0.0 ? 1.0 : -1.0) /
+                    (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c = 1.0 / std::sqrt(t * t + 1.0);
+                const double s = t * c;
+                for (int k = 0; k < n; ++k) {
+                    const double kp = matrix[k][p];
+                    const double kq = matrix[k][q];
+                    matrix[k][p] = c * kp - s * kq;
+                    matrix[k][q] = s * kp + c * kq;
+                }
+                for (int k = 0; k < n; ++k) {
+                    const double pk = matrix[p][k];
+                    const double qk = matrix[q][k];
+                    matrix[p][k] = c * pk - s * qk;
+                    matrix[q][k] = s * pk + c * qk;
+                }
+                for (int k = 0; k < n; ++k) {
+                    const double kp = vectors[k][p];
+                    const double kq = vectors[k][q];
+                    vectors[k][p] = c * kp - s * kq;
+                    vectors[k][q] = s * kp + c * kq;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        values[i] = matrix[i][i];
+    }
+}
+
+bool rows_empty(const nd_projection &projection) {
+    for (const auto &row : projection.rows) {
+        for (float value : row) {
+            if (value != 0.0f) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+void allocate_nd_components(nd_particle_field &field, int dimension,
+                            size_t count) {
+    field.dimension = dimension;
+    for (int d = 0; d < k_max_system_dimension; ++d) {
+        particle_array<float>().swap(field.components[d]);
+        if (d < dimension) {
+            field.components[d].resize(count);
+        }
+    }
+}
+
+void update_nd_projection(nd_projection &projection, int dimension) {
+    if (dimension <= 0) {
+        return;
+    }
+    for (int &axis : projection.axes) {
+        axis = glm::clamp(axis, 0, dimension - 1);
+    }
+    const bool coordinates =
+        projection.mode == nd_projection_mode::coordinates ||
+        rows_empty(projection);
+    if (projection.mode == nd_projection_mode::principal &&
+        rows_empty(projection)) {
+        projection.refit = true;
+    }
+    if (!coordinates) {
+        return;
+    }
+    for (int row = 0; row < 3; ++row) {
+        for (int d = 0; d < k_max_system_dimension; ++d) {
+            projection.rows[row][d] = d == projection.axes[row] ? 1.0f : 0.0f;
+        }
+    }
+    for (float &value : projection.center) {
+        value = 0.0f;
+    }
+}
+
+void fit_principal_projection(nd_particle_field &field, size_t count) {
+    const int n = field.dimension;
+    nd_projection &projection = field.projection;
+    projection.refit = false;
+    projection.launches_since_fit = 0;
+    if (n <= 0 || count == 0) {
+        return;
+    }
+    CHAOSEQ_PROFILE_SCOPE("fit_principal_projection");
+    const size_t stride = std::max<size_t>(1, count / k_fit_samples);
+    auto finite_at = [&](size_t index) {
+        for (int d = 0; d < n; ++d) {
+            if (!std::isfinite(field.components[d][index])) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    double mean[k_max_system_dimension] = {};
+    size_t used = 0;
+    for (size_t index = 0; index < count; index += stride) {
+        if (!finite_at(index)) {
+            continue;
+        }
+        for (int d = 0; d < n; ++d) {
+            mean[d] += field.components[d][index];
+        }
+        ++used;
+    }
+    if (used < 2) {
+        return;
+    }
+    for (int d = 0; d < n; ++d) {
+        mean[d] /= static_cast<double>(used);
+    }
+    double covariance[k_max_system_dimension][k_max_system_dimension] = {};
+    for (size_t index = 0; index < count; index += stride) {
+        if (!finite_at(index)) {
+            continue;
+        }
+        double delta[k_max_system_dimension];
+        for (int d = 0; d < n; ++d) {
+            delta[d] = field.components[d][index] - mean[d];
+        }
+        for (int i = 0; i < n; ++i) {
+            for (int j = i; j < n; ++j) {
+                covariance[i][j] += delta[i] * delta[j];
+            }
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int j = i; j < n; ++j) {
+            covariance[i][j] /= static_cast<double>(used - 1);
+            covariance[j][i] = covariance[i][j];
+        }
+    }
+
+    double values[k_max_system_dimension];
+    double vectors[k_max_system_dimension][k_max_system_dimension];
+    symmetric_eigen(covariance, n, values, vectors);
+    int order[k_max_system_dimension];
+    for (int i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    sort(order, order + n, [&](int a, int b) { return values[a] > values[b]; });
+    double total = 0.0;
+    for (int i = 0; i < n; ++i) {
+        total += std::max(values[i], 0.0);
+    }
+
+    for (int row = 0; row < 3; ++row) {
+        for (int d = 0; d < k_max_system_dimension; ++d) {
+            projection.rows[row][d] = 0.0f;
+        }
+        if (row >= n) {
+            continue;
+        }
+        const int column = order[row];
+        // Point each axis towards its largest component so that refits do
+        // not mirror the picture.
+        int largest = 0;
+        for (int d = 1; d < n; ++d) {
+            if (std::abs(vectors[d][column]) >
+                std::abs(vectors[largest][column])) {
+                largest = d;
+            }
+        }
+        const double sign = vectors[largest][column] < 0.0 ? -1.0 : 1.0;
+        for (int d = 0; d < n; ++d) {
+            projection.rows[row][d] =
+                static_cast<float>(sign * vectors[d][column]);
+        }
+    }
+    for (int d = 0; d < k_max_system_dimension; ++d) {
+        projection.center[d] = d < n ? static_cast<float>(mean[d]) : 0.0f;
+        projection.explained[d] =
+            d < n && total > 0.0
+                ? static_cast<float>(std::max(values[order[d]], 0.0) / total)
+                : 0.0f;
+    }
+}
+
+void seed_nd_particles(simulation_state &state, size_t begin, size_t end,
+                       uint32_t seed) {
+    nd_particle_field &field = state.nd;
+    const int n = field.dimension;
+    mt19937 rng{seed};
+    normal_distribution<float> normal_dist(0.0f, 1.0f);
+    float values[k_max_system_dimension];
+    for (size_t index = begin; index < end; ++index) {
+        float norm_sq = 0.0f;
+        for (int d = 0; d < n; ++d) {
+            values[d] = normal_dist(rng);
+            norm_sq += values[d] * values[d];
+        }
+        if (norm_sq < 1e-6f) {
+            values[0] = 1.0f;
+            norm_sq = 1.0f;
+        }
+        float radius;
+        if (state.particle_spawn_from_origin) {
+            const float jitter_scale =
+                glm::max(state.particle_origin_jitter, 1e-4f);
+            radius = glm::clamp(std::abs(normal_dist(rng)) * jitter_scale,
+                                1e-5f, jitter_scale * 2.0f);
+        } else {
+            radius = (std::abs(normal_dist(rng)) * 0.5f + 0.5f) *
+                     state.particle_spawn_radius;
+        }
+        const float scale = radius / std::sqrt(norm_sq);
+        for (int d = 0; d < n; ++d) {
+            values[d] = field.spawn_center[d] + values[d] * scale;
+            field.components[d][index] = values[d];
+        }
+        const vec3 position = project_nd_state(field.projection, n, values);
+        state.particle_positions[index] = position;
+        state.particle_phases[index] = compute_spawn_phase(position);
+        state.particle_still_steps[index] = 0;
+    }
+}
+
+void integrate_nd_range(simulation_state &state, size_t begin, size_t end,
+                        float dt, const sde_coefficients *noise,
+                        invariant_accumulator *samples,
+                        particle_retire_list &retired) {
+    const float still_distance = state.particle_stall_speed * dt;
+    dispatch_nd_system(state, [&](auto dimension, auto deriv) {
+        constexpr int D = decltype(dimension)::value;
+        static_assert(D <= k_max_system_dimension,
+                      "k_max_system_dimension sizes the components");
+        nd_range_kernel<D, decltype(deriv)> kernel{
+            state,
+            deriv,
+            dt,
+            noise,
+            samples,
+            retired,
+            {},
+            state.particle_escape_radius * state.particle_escape_radius,
+            still_distance * still_distance,
+            std::max(state.particle_stall_steps, 1),
+            state.cull_mode,
+            hash_particle(state.particle_launches)};
+        for (int d = 0; d < D; ++d) {
+            kernel.components[d] = state.nd.components[d].data();
+        }
+        kernel.run(begin, end);
+    });
+    CHAOSEQ_PROFILE_COUNT(profile_counter::particle_steps, end - begin);
+    CHAOSEQ_PROFILE_COUNT(profile_counter::derivative_evaluations,
+                          (noise ? 1 : 4) * (end - begin));
+}
+
+void reproject_nd_particles(simulation_state &state) {
+    nd_particle_field &field = state.nd;
+    const int n = field.dimension;
+    const size_t count = state.particle_positions.size();
+    if (n == 0 || count == 0) {
+        return;
+    }
+    plan_particle_partitions(state, count);
+    run_particle_partitions(
+        state, [&](size_t begin, size_t end, unsigned int) {
+            float values[k_max_system_dimension];
+            for (size_t index = begin; index < end; ++index) {
+                for (int d = 0; d < n; ++d) {
+                    values[d] = field.components[d][index];
+                }
+                state.particle_positions[index] =
+                    project_nd_state(field.projection, n, values);
+            }
+        });
+    state.particle_positions_dirty = true;
+}
@@ -0,0 +1,266 @@
+#include "particle_order.hpp"
+#include "profiler.hpp"
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+constexpr size_t k_locality_samples = 4096;
+constexpr uint32_t k_radix_buckets = 1u << k_morton_radix_bits;
+constexpr int k_radix_passes =
+    (3 * k_morton_bits + k_morton_radix_bits - 1) / k_morton_radix_bits;
+// Non-finite particles sort after every cell.
+constexpr uint32_t k_non_finite_key = (1u << (3 * k_morton_bits)) - 1u;
+
+static_assert(3 * k_morton_bits <= 32, "Morton codes are 32-bit");
+
+bool finite_position(const vec3 &p) {
+    return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+}
+
+// Inserts two zero bits above each of the low ten bits.
+uint32_t spread_bits(uint32_t value) {
+    value &= 0x3ffu;
+    value = (value | (value << 16)) & 0x030000ffu;
+    value = (value | (value << 8)) & 0x0300f00fu;
+    value = (value | (value << 4)) & 0x030c30c3u;
+    value = (value | (value << 2)) & 0x09249249u;
+    return value;
+}
+
+uint32_t quantize(float value, float low, float scale) {
+    const float cell = (value - low) * scale;
+    return static_cast<uint32_t>(
+        glm::clamp(cell, 0.0f, static_cast<float>((1 << k_morton_bits) - 1)));
+}
+
+// New array whose element i is values[order[i]], written by the partition
+// owners so the fresh pages land on their memory nodes.
+template <typename T>
+void gather_particles(simulation_state &state, particle_array<T> &values,
+                      const vector<uint32_t> &order) {
+    particle_array<T> sorted;
+    sorted.resize(values.size());
+    run_particle_partitions(state,
+                            [&](size_t begin, size_t end, unsigned int) {
+                                for (size_t i = begin; i < end; ++i) {
+                                    sorted[i] = values[order[i]];
+                                }
+                            });
+    values.swap(sorted);
+}
+
+// Morton code of every particle into keys, identity into order.
+void compute_morton_keys(simulation_state &state, particle_reorder &reorder) {
+    const size_t count = state.particle_positions.size();
+    const size_t partitions = state.particle_partitions.size() - 1;
+    vector<vec3> lows(partitions, vec3(INFINITY));
+    vector<vec3> highs(partitions, vec3(-INFINITY));
+    run_particle_partitions(
+        state, [&](size_t begin, size_t end, unsigned int worker) {
+            float low[3] = {INFINITY, INFINITY, INFINITY};
+            float high[3] = {-INFINITY, -INFINITY, -INFINITY};
+            for (size_t i = begin; i < end; ++i) {
+                const vec3 &p = state.particle_positions[i];
+                if (!finite_position(p)) {
+                    continue;
+                }
+                low[0] = std::min(low[0], p.x);
+                low[1] = std::min(low[1], p.y);
+                low[2] = std::min(low[2], p.z);
+                high[0] = std::max(high[0], p.x);
+                high[1] = std::max(high[1], p.y);
+                high[2] = std::max(high[2], p.z);
+            }
+            lows[worker] = vec3(low[0], low[1], low[2]);
+            highs[worker] = vec3(high[0], high[1], high[2]);
+        });
+    vec3 low(INFINITY);
+    vec3 high(-INFINITY);
+    for (size_t w = 0; w < partitions; ++w) {
+        low = glm::min(low, lows[w]);
+        high = glm::max(high, highs[w]);
+    }
+    // Cubic cells keep the curve's neighbourhoods round on a flat cloud.
+    const vec3 extent = high - low;
+    const float longest =
+        std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-20f));
+    const float scale = static_cast<float>(1 << k_morton_bits) / longest;
+
+    reorder.keys.resize(count);
+    reorder.order.resize(count);
+    reorder.keys_swap.resize(count);
+    reorder.order_swap.resize(count);
+    run_particle_partitions(state, [&](size_t begin, size_t end,
+                                       unsigned int) {
+        for (size_t i = begin; i < end; ++i) {
+            const vec3 &p = state.particle_positions[i];
+            reorder.order[i] = static_cast<uint32_t>(i);
+            if (!finite_position(p)) {
+                reorder.keys[i] = k_non_finite_key;
+                continue;
+            }
+            reorder.keys[i] = spread_bits(quantize(p.x, low.x, scale)) |
+                              spread_bits(quantize(p.y, low.y, scale)) << 1 |
+                              spread_bits(quantize(p.z, low.z, scale)) << 2;
+        }
+    });
+}
+
+// Stable LSD radix sort of (keys, order). Each worker histograms and
+// scatters its own partition; a digit's slots are handed out worker by
+// worker, so equal digits keep their relative order across partitions.
+void radix_sort_keys(simulation_state &state, particle_reorder &reorder) {
+    const size_t count = reorder.keys.size();
+    const size_t partitions = state.particle_partitions.size() - 1;
+    reorder.histograms.resize(partitions * k_radix_buckets);
+    for (int pass = 0; pass < k_radix_passes; ++pass) {
+        const int shift = pass * k_morton_radix_bits;
+        fill(reorder.histograms.begin(), reorder.histograms.end(), 0u);
+        run_particle_partitions(
+            state, [&](size_t begin, size_t end, unsigned int worker) {
+                uint32_t *histogram =
+                    reorder.histograms.data() + worker * k_radix_buckets;
+                for (size_t i = begin; i < end; ++i) {
+                    ++histogram[(reorder.keys[i] >> shift) &
+                                (k_radix_buckets - 1)];
+                }
+            });
+        // Exclusive offsets, digit-major then worker. A pass where every key
+        // shares the digit would only copy.
+        uint32_t running = 0;
+        bool uniform = false;
+        for (uint32_t digit = 0; digit < k_radix_buckets; ++digit) {
+            const uint32_t first = running;
+            for (size_t w = 0; w < partitions; ++w) {
+                uint32_t &slot =
+                    reorder.histograms[w * k_radix_buckets + digit];
+                const uint32_t amount = slot;
+                slot = running;
+                running += amount;
+            }
+            uniform = uniform || running - first == count;
+        }
+        if (uniform) {
+            continue;
+        }
+        run_particle_partitions(
+            state, [&](size_t begin, size_t end, unsigned int worker) {
+                uint32_t *offsets =
+                    reorder.histograms.data() + worker * k_radix_buckets;
+                for (size_t i = begin; i < end; ++i) {
+                    const uint32_t key = reorder.keys[i];
+                    const uint32_t slot =
+                        offsets[(key >> shift) & (k_radix_buckets - 1)]++;
+                    reorder.keys_swap[slot] = key;
+                    reorder.order_swap[slot] = reorder.order[i];
+                }
+            });
+        reorder.keys.swap(reorder.keys_swap);
+        reorder.order.swap(reorder.order_swap);
+    }
+}
+
+} // namespace
+
+float measure_particle_locality(const simulation_state &state) {
+    const size_t count = state.particle_positions.size();
+    if (count < 2) {
+        return 0.0f;
+    }
+    const size_t stride =
+        std::max<size_t>(1, (count - 1) / k_locality_samples);
+    float low[3] = {INFINITY, INFINITY, INFINITY};
+    float high[3] = {-INFINITY, -INFINITY, -INFINITY};
+    double sum = 0.0;
+    size_t pairs = 0;
+    for (size_t i = 0; i + 1 < count; i += stride) {
+        const vec3 &a = state.particle_positions[i];
+        const vec3 &b = state.particle_positions[i + 1];
+        if (!finite_position(a) || !finite_position(b)) {
+            continue;
+        }
+        const float dx = b.x - a.x;
+        const float dy = b.y - a.y;
+        const float dz = b.z - a.z;
+        sum += std::sqrt(dx * dx + dy * dy + dz * dz);
+        ++pairs;
+        low[0] = std::min(low[0], a.x);
+        low[1] = std::min(low[1], a.y);
+        low[2] = std::min(low[2], a.z);
+        high[0] = std::max(high[0], a.x);
+        high[1] = std::max(high[1], a.y);
+        high[2] = std::max(high[2], a.z);
+    }
+    if (pairs == 0) {
+        return 0.0f;
+    }
+    const float dx = high[0] - low[0];
+    const float dy = high[1] - low[1];
+    const float dz = high[2] - low[2];
+    const float diagonal = std::sqrt(dx * dx + dy * dy + dz * dz);
+    if (!(diagonal > 0.0f)) {
+        return 0.0f;
+    }
+    return static_cast<float>(sum / static_cast<double>(pairs)) / diagonal;
+}
+
+bool reorder_particles(simulation_state &state) {
+    const size_t count = state.particle_positions.size();
+    if (count < 2 || state.dde.dimension > 0 || segments_active(state)) {
+        return false;
+    }
+    CHAOSEQ_PROFILE_SCOPE("reorder_particles");
+    const auto start = chrono::steady_clock::now();
+    particle_reorder &reorder = state.reorder;
+    plan_particle_partitions(state, count);
+    compute_morton_keys(state, reorder);
+    radix_sort_keys(state, reorder);
+
+    const vector<uint32_t> &order = reorder.order;
+    gather_particles(state, state.particle_positions, order);
+    gather_particles(state, state.particle_phases, order);
+    gather_particles(state, state.particle_still_steps, order);
+    gather_particles(state, state.particle_ids, order);
+    for (int d = 0; d < state.nd.dimension; ++d) {
+        gather_particles(state, state.nd.components[d], order);
+    }
+    state.particle_phases_dirty = true;
+    state.particle_positions_dirty = true;
+    // Trail history is stored per particle slot and no longer lines up.
+    reset_trail_ring(state.particle_trails);
+
+    reorder.baseline = measure_particle_locality(state);
+    reorder.locality = reorder.baseline;
+    reorder.frames_since_sort = 0;
+    reorder.pending = false;
+    ++reorder.sorts;
+    reorder.last_ms = chrono::duration<double, milli>(
+                          chrono::steady_clock::now() - start)
+                          .count();
+    return true;
+}
+
+bool update_particle_order(simulation_state &state) {
+    particle_reorder &reorder = state.reorder;
+    // A sort clears the particle trails, so it waits while they are drawn.
+    if (!reorder.enabled || state.dde.dimension > 0 ||
+        segments_active(state) || state.show_particle_trails) {
+        return false;
+    }
+    ++reorder.frames_since_sort;
+    reorder.locality = measure_particle_locality(state);
+    const bool due =
+        (reorder.interval > 0 &&
+         reorder.frames_since_sort >= reorder.interval) ||
+        (reorder.degrade_ratio > 0.0f && reorder.baseline > 0.0f &&
+         reorder.locality > reorder.baseline * reorder.degrade_ratio) ||
+        reorder.pending;
+    return due && reorder_particles(state);
+}
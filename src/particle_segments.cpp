@@ -0,0 +1,225 @@
+#include "particle_segments.hpp"
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+static_assert(k_segment_chunk % k_particle_lanes == 0,
+              "chunks hold whole lane blocks");
+
+bool comparable_system(system_type type) {
+    return system_dimension(type) == 3 && !system_has_delay(type);
+}
+
+bool finite_position(const vec3 &p) {
+    return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+}
+
+// Bounds of the finite particles of one segment, before its placement.
+bool segment_bounds(const simulation_state &state,
+                    const particle_segment &segment, vec3 &low, vec3 &high) {
+    bool found = false;
+    const size_t end = segment.first + segment.count;
+    for (size_t index = segment.first; index < end; ++index) {
+        const vec3 &position = state.particle_positions[index];
+        if (!finite_position(position)) {
+            continue;
+        }
+        low = found ? glm::min(low, position) : position;
+        high = found ? glm::max(high, position) : position;
+        found = true;
+    }
+    return found;
+}
+
+} // namespace
+
+bool segments_active(const simulation_state &state) {
+    const particle_segments &segments = state.segments;
+    return segments.enabled && segments.list.size() > 1 &&
+           comparable_system(state.current_system) &&
+           state.nd.dimension == 0 && state.dde.dimension == 0;
+}
+
+const system_params &segment_params(const simulation_state &state,
+                                    size_t segment) {
+    if (segment == 0) {
+        return state;
+    }
+    return state.segments.list[segment].params;
+}
+
+void add_segment(simulation_state &state) {
+    vector<particle_segment> &list = state.segments.list;
+    if (list.size() >= static_cast<size_t>(k_max_segments)) {
+        return;
+    }
+    if (list.empty()) {
+        list.emplace_back();
+    }
+    particle_segment segment;
+    segment.params = static_cast<const system_params &>(state);
+    list.push_back(segment);
+}
+
+void remove_segment(simulation_state &state, size_t segment) {
+    vector<particle_segment> &list = state.segments.list;
+    if (segment == 0 || segment >= list.size()) {
+        return;
+    }
+    list.erase(list.begin() + static_cast<ptrdiff_t>(segment));
+}
+
+void assign_segment_ranges(particle_segments &segments, size_t total) {
+    vector<particle_segment> &list = segments.list;
+    if (list.empty()) {
+        return;
+    }
+    const size_t lanes = static_cast<size_t>(k_particle_lanes);
+    const size_t share = total / list.size() / lanes * lanes;
+    size_t first = 0;
+    for (particle_segment &segment : list) {
+        segment.first = first;
+        segment.count = share;
+        first += share;
+    }
+    list.back().count += total - first;
+    segments.arrange_countdown = k_segment_arrange_frames;
+}
+
+void shrink_segment_ranges(particle_segments &segments,
+                           const vector<uint32_t> &removed) {
+    size_t first = 0;
+    for (particle_segment &segment : segments.list) {
+        const auto low = lower_bound(removed.begin(), removed.end(),
+                                     segment.first);
+        const auto high = lower_bound(removed.begin(), removed.end(),
+                                      segment.first + segment.count);
+        segment.first = first;
+        segment.count -= static_cast<size_t>(high - low);
+        first += segment.count;
+    }
+}
+
+void run_segment_chunks(
+    simulation_state &state, unsigned int thread_count,
+    const function<void(const segment_chunk &, unsigned int)> &task) {
+    particle_segments &segments = state.segments;
+    segments.chunks.clear();
+    for (size_t s = 0; s < segments.list.size(); ++s) {
+        const particle_segment &segment = segments.list[s];
+        const size_t end = segment.first + segment.count;
+        for (size_t begin = segment.first; begin < end;
+             begin += k_segment_chunk) {
+            segments.chunks.push_back({begin, std::min(begin + k_segment_chunk,
+                                                       end),
+                                       static_cast<uint32_t>(s)});
+        }
+    }
+    segments.next_chunk = 0;
+    run_workers(state.workers, thread_count, [&](unsigned int worker) {
+        for (size_t chunk = segments.next_chunk++;
+             chunk < segments.chunks.size(); chunk = segments.next_chunk++) {
+            task(segments.chunks[chunk], worker);
+        }
+    });
+}
+
+void update_segment_layout(simulation_state &state) {
+    particle_segments &segments = state.segments;
+    if (!segments_active(state) || segments.arrange_countdown < 0) {
+        return;
+    }
+    if (segments.arrange_countdown-- == 0) {
+        arrange_segments(state);
+    }
+}
+
+void arrange_segments(simulation_state &state) {
+    particle_segments &segments = state.segments;
+    segments.arrange_countdown = -1;
+    if (!segments_active(state)) {
+        return;
+    }
+    vec3 low0;
+    vec3 high0;
+    particle_segment &primary = segments.list[0];
+    primary.offset = vec3(0.0f);
+    primary.scale = 1.0f;
+    if (!segment_bounds(state, primary, low0, high0)) {
+        return;
+    }
+    const vec3 center0 = 0.5f * (low0 + high0);
+    const float width0 = std::max(high0.x - low0.x, 1e-3f);
+    const float size0 = std::max(length(high0 - low0), 1e-3f);
+    const float gap = segments.spacing * width0;
+    float cursor = high0.x + gap;
+    for (size_t s = 1; s < segments.list.size(); ++s) {
+        particle_segment &segment = segments.list[s];
+        vec3 low;
+        vec3 high;
+        if (!segment_bounds(state, segment, low, high)) {
+            continue;
+        }
+        segment.scale =
+            segments.match_size
+                ? size0 / std::max(length(high - low), 1e-3f)
+                : 1.0f;
+        const vec3 center = 0.5f * (low + high);
+        segment.offset = center0 - center * segment.scale;
+        segment.offset.x = cursor - low.x * segment.scale;
+        cursor += (high.x - low.x) * segment.scale + gap;
+    }
+}
+
+bool placed_particle_bounds(const simulation_state &state, vec3 &out_min,
+                            vec3 &out_max) {
+    if (!segments_active(state)) {
+        return compute_particle_bounds(state, out_min, out_max);
+    }
+    bool found = false;
+    for (const particle_segment &segment : state.segments.list) {
+        vec3 low;
+        vec3 high;
+        if (!segment_bounds(state, segment, low, high)) {
+            continue;
+        }
+        low = low * segment.scale + segment.offset;
+        high = high * segment.scale + segment.offset;
+        out_min = found ? glm::min(out_min, low) : low;
+        out_max = found ? glm::max(out_max, high) : high;
+        found = true;
+    }
+    return found;
+}
+
+void set_segment_uniforms(const Shader &shader,
+                          const simulation_state &state) {
+    const bool active = segments_active(state);
+    const vector<particle_segment> &list = state.segments.list;
+    shader.set_int("uSegmentCount",
+                   active ? static_cast<int>(list.size()) : 0);
+    if (!active) {
+        return;
+    }
+    for (size_t s = 0; s < list.size(); ++s) {
+        const string index = "[" + to_string(s) + "]";
+        shader.set_int("uSegmentEnd" + index,
+                       static_cast<int>(list[s].first + list[s].count));
+        shader.set_vec4("uSegmentPlacement" + index,
+                        vec4(list[s].offset, list[s].scale));
+    }
+}
+
+size_t primary_segment_count(const simulation_state &state) {
+    if (!segments_active(state)) {
+        return state.particle_positions.size();
+    }
+    return state.segments.list[0].count;
+}
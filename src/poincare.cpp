@@ -0,0 +1,290 @@
+#include "poincare.hpp"
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+constexpr size_t k_fit_sample = 256;
+
+vec3 hermite(const vec3 &p0, const vec3 &m0, const vec3 &p1, const vec3 &m1,
+             float s) {
+    const float s2 = s * s;
+    const float s3 = s2 * s;
+    return (2.0f * s3 - 3.0f * s2 + 1.0f) * p0 + (s3 - 2.0f * s2 + s) * m0 +
+           (-2.0f * s3 + 3.0f * s2) * p1 + (s3 - s2) * m1;
+}
+
+vec3 hermite_tangent(const vec3 &p0, const vec3 &m0, const vec3 &p1,
+                     const vec3 &m1, float s) {
+    const float s2 = s * s;
+    return (6.0f * s2 - 6.0f * s) * p0 + (3.0f * s2 - 4.0f * s + 1.0f) * m0 +
+           (-6.0f * s2 + 6.0f * s) * p1 + (3.0f * s2 - 2.0f * s) * m1;
+}
+
+void density_add(section_cloud &cloud, const vec2 &uv) {
+    const vec2 extent = cloud.bounds_max - cloud.bounds_min;
+    const vec2 cell = (uv - cloud.bounds_min) / extent *
+                      static_cast<float>(k_section_grid_size);
+    if (!(cell.x >= 0.0f && cell.y >= 0.0f &&
+          cell.x < static_cast<float>(k_section_grid_size) &&
+          cell.y < static_cast<float>(k_section_grid_size))) {
+        ++cloud.outside;
+        return;
+    }
+    uint32_t &value = cloud.density[static_cast<size_t>(cell.y) *
+                                        k_section_grid_size +
+                                    static_cast<size_t>(cell.x)];
+    ++value;
+    cloud.density_max = std::max(cloud.density_max, value);
+}
+
+// Refits the display bounds to the stored points and re-bins all of them.
+void rebuild_density(section_cloud &cloud, const section_frame &frame) {
+    cloud.density.assign(static_cast<size_t>(k_section_grid_size) *
+                             k_section_grid_size,
+                         0u);
+    cloud.density_max = 0;
+    cloud.outside = 0;
+    cloud.bounds_valid = false;
+    if (cloud.count == 0) {
+        return;
+    }
+    vec2 lo(numeric_limits<float>::max());
+    vec2 hi(-numeric_limits<float>::max());
+    for (size_t i = 0; i < cloud.count; ++i) {
+        const vec2 uv = section_coordinates(frame, cloud.points[i]);
+        if (!isfinite(uv.x) || !isfinite(uv.y)) {
+            continue;
+        }
+        lo = glm::min(lo, uv);
+        hi = glm::max(hi, uv);
+    }
+    if (lo.x > hi.x || lo.y > hi.y) {
+        return;
+    }
+    const vec2 margin = glm::max((hi - lo) * 0.05f, vec2(1e-3f));
+    cloud.bounds_min = lo - margin;
+    cloud.bounds_max = hi + margin;
+    cloud.bounds_valid = true;
+    for (size_t i = 0; i < cloud.count; ++i) {
+        density_add(cloud, section_coordinates(frame, cloud.points[i]));
+    }
+    cloud.outside = 0;
+    cloud.dirty = true;
+}
+
+} // namespace
+
+vec2 section_coordinates(const section_frame &frame, const vec3 &point) {
+    return vec2(dot(frame.u, point), dot(frame.v, point));
+}
+
+void prepare_poincare(poincare_state &poincare, size_t worker_count) {
+    const int plane_count = std::min(static_cast<int>(poincare.planes.size()),
+                                     k_max_section_planes);
+    for (int i = 0; i < k_max_section_planes; ++i) {
+        section_frame &frame = poincare.frames[i];
+        if (i >= plane_count) {
+            frame.enabled = false;
+            continue;
+        }
+        const section_plane &plane = poincare.planes[static_cast<size_t>(i)];
+        const float normal_length = length(plane.normal);
+        frame.enabled = plane.enabled && normal_length > 1e-6f;
+        if (!frame.enabled) {
+            continue;
+        }
+        frame.normal = plane.normal / normal_length;
+        frame.offset = plane.offset / normal_length;
+        frame.direction = plane.direction;
+        const vec3 helper = std::abs(frame.normal.x) < 0.9f
+                                ? vec3(1.0f, 0.0f, 0.0f)
+                                : vec3(0.0f, 1.0f, 0.0f);
+        frame.u = normalize(helper - frame.normal * dot(frame.normal, helper));
+        frame.v = cross(frame.normal, frame.u);
+    }
+    poincare.thread_hits.resize(std::max<size_t>(worker_count, 1));
+}
+
+void detect_section_crossings(const simulation_state &state,
+                              const vec3 &before, const vec3 &after, float dt,
+                              vector<section_hit> &hits) {
+    const poincare_state &poincare = state.poincare;
+    for (int i = 0; i < k_max_section_planes; ++i) {
+        const section_frame &frame = poincare.frames[i];
+        if (!frame.enabled) {
+            continue;
+        }
+        const float d0 = dot(frame.normal, before) - frame.offset;
+        const float d1 = dot(frame.normal, after) - frame.offset;
+        const bool rising = d0 < 0.0f && d1 >= 0.0f;
+        const bool falling = d0 > 0.0f && d1 <= 0.0f;
+        if (!(rising && frame.direction >= 0) &&
+            !(falling && frame.direction <= 0)) {
+            continue;
+        }
+        // Crossings are rare (about one per orbit), so the two extra
+        // derivative evaluations for a cubic Hermite refinement are cheap
+        // compared to the RK4 steps in between.
+        const vec3 m0 = evaluate_derivative(state, before) * dt;
+        const vec3 m1 = evaluate_derivative(state, after) * dt;
+        float s = d0 / (d0 - d1);
+        for (int iteration = 0; iteration < 3; ++iteration) {
+            const float g =
+                dot(frame.normal, hermite(before, m0, after, m1, s)) -
+                frame.offset;
+            const float dg =
+                dot(frame.normal, hermite_tangent(before, m0, after, m1, s));
+            if (std::abs(dg) < 1e-12f) {
+                break;
+            }
+            const float next = glm::clamp(s - g / dg, 0.0f, 1.0f);
+            const bool converged = std::abs(next - s) < 1e-6f;
+            s = next;
+            if (converged) {
+                break;
+            }
+        }
+        hits.push_back({hermite(before, m0, after, m1, s), i});
+    }
+}
+
+void merge_section_hits(poincare_state &poincare) {
+    for (vector<section_hit> &hits : poincare.thread_hits) {
+        for (const section_hit &hit : hits) {
+            section_cloud &cloud = poincare.clouds[hit.plane];
+            const section_frame &frame = poincare.frames[hit.plane];
+            if (cloud.points.size() != poincare.capacity) {
+                cloud.points.resize(poincare.capacity);
+                cloud.head = 0;
+                cloud.count = 0;
+                cloud.bounds_valid = false;
+            }
+            cloud.points[cloud.head] = hit.position;
+            cloud.head = (cloud.head + 1) % poincare.capacity;
+            cloud.count = std::min(cloud.count + 1, poincare.capacity);
+            ++poincare.total_hits;
+            if (cloud.bounds_valid) {
+                density_add(cloud, section_coordinates(frame, hit.position));
+                cloud.dirty = true;
+            } else if (cloud.count >= k_fit_sample) {
+                rebuild_density(cloud, frame);
+            }
+        }
+        hits.clear();
+    }
+    for (int i = 0; i < k_max_section_planes; ++i) {
+        section_cloud &cloud = poincare.clouds[i];
+        // Refit once the attractor has clearly wandered out of the bounds
+        // picked from the first few hits.
+        if (cloud.bounds_valid && cloud.outside > k_fit_sample &&
+            cloud.outside * 100 > cloud.count) {
+            rebuild_density(cloud, poincare.frames[i]);
+        }
+    }
+}
+
+void clear_section_plane(poincare_state &poincare, int plane) {
+    if (plane < 0 || plane >= k_max_section_planes) {
+        return;
+    }
+    section_cloud &cloud = poincare.clouds[plane];
+    cloud.head = 0;
+    cloud.count = 0;
+    cloud.bounds_valid = false;
+    cloud.outside = 0;
+    cloud.density.clear();
+    cloud.density_max = 0;
+    cloud.dirty = true;
+}
+
+void clear_poincare(poincare_state &poincare) {
+    for (int i = 0; i < k_max_section_planes; ++i) {
+        clear_section_plane(poincare, i);
+    }
+    for (vector<section_hit> &hits : poincare.thread_hits) {
+        hits.clear();
+    }
+    poincare.total_hits = 0;
+}
+
+bool export_poincare_csv(const poincare_state &poincare, const char *path) {
+    ofstream out(path);
+    if (!out) {
+        cerr << "Failed to open section export file: " << path << "\n";
+        return false;
+    }
+    out << "plane,x,y,z,u,v\n";
+    for (int i = 0; i < k_max_section_planes; ++i) {
+        const section_cloud &cloud = poincare.clouds[i];
+        const size_t first =
+            cloud.count < cloud.points.size() ? 0 : cloud.head;
+        for (size_t n = 0; n < cloud.count; ++n) {
+            const vec3 &point =
+                cloud.points[(first + n) % cloud.points.size()];
+            const vec2 uv = section_coordinates(poincare.frames[i], point);
+            out << i << "," << point.x << "," << point.y << "," << point.z
+                << "," << uv.x << "," << uv.y << "\n";
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+void upload_section_texture(poincare_state &poincare) {
+    const int plane = glm::clamp(poincare.display_plane, 0,
+                                 k_max_section_planes - 1);
+    section_cloud &cloud = poincare.clouds[plane];
+    if (!cloud.dirty && poincare.texture != 0 &&
+        poincare.texture_plane == plane) {
+        return;
+    }
+    if (poincare.texture == 0) {
+        glGenTextures(1, &poincare.texture);
+        glBindTexture(GL_TEXTURE_2D, poincare.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    const size_t texels =
+        static_cast<size_t>(k_section_grid_size) * k_section_grid_size;
+    vector<uint32_t> pixels(texels, 0xFF000000u);
+    if (cloud.density.size() == texels && cloud.density_max > 0) {
+        const float scale =
+            1.0f / std::log1p(static_cast<float>(cloud.density_max));
+        for (size_t i = 0; i < texels; ++i) {
+            if (cloud.density[i] == 0) {
+                continue;
+            }
+            const float value =
+                std::log1p(static_cast<float>(cloud.density[i])) * scale;
+            const uint32_t r = static_cast<uint32_t>(255.0f * std::sqrt(value));
+            const uint32_t g = static_cast<uint32_t>(255.0f * value);
+            const uint32_t b =
+                static_cast<uint32_t>(255.0f * (0.35f + 0.65f * value * value));
+            pixels[i] = 0xFF000000u | (b << 16) | (g << 8) | r;
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, poincare.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, k_section_grid_size,
+                 k_section_grid_size, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    cloud.dirty = false;
+    poincare.texture_plane = plane;
+}
+
+void release_poincare_gpu(poincare_state &poincare) {
+    if (poincare.texture != 0) {
+        glDeleteTextures(1, &poincare.texture);
+        poincare.texture = 0;
+    }
+}
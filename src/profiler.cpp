@@ -0,0 +1,450 @@
+#include "profiler.hpp"
+
+#ifdef CHAOSEQ_PROFILE
+
+#include "glitter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr int k_history = 240;
+constexpr size_t k_trace_frames = 300;
+constexpr int k_gpu_latency = 4;
+
+struct profile_event {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+struct gpu_event {
+    const char *name;
+    uint64_t issue_ns;
+    uint64_t duration_ns;
+};
+
+struct thread_log {
+    vector<profile_event> events;
+};
+
+struct rolling_series {
+    float values[k_history] = {};
+    int head = 0;
+
+    void push(float value) {
+        values[head] = value;
+        head = (head + 1) % k_history;
+    }
+    float latest() const { return values[(head + k_history - 1) % k_history]; }
+    float average() const {
+        float sum = 0.0f;
+        for (float value : values) {
+            sum += value;
+        }
+        return sum / static_cast<float>(k_history);
+    }
+    float peak() const { return *max_element(values, values + k_history); }
+};
+
+struct frame_trace {
+    uint64_t begin_ns = 0;
+    uint64_t end_ns = 0;
+    vector<pair<int, profile_event>> events;
+    vector<gpu_event> gpu;
+    uint64_t counters[static_cast<int>(profile_counter::count)] = {};
+};
+
+struct gpu_timer {
+    const char *name = nullptr;
+    GLuint queries[k_gpu_latency] = {};
+    uint64_t issue_ns[k_gpu_latency] = {};
+    bool pending[k_gpu_latency] = {};
+};
+
+struct profiler_data {
+    chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+    thread_log logs[k_profiler_max_threads];
+    atomic<uint64_t> counters[static_cast<int>(profile_counter::count)] = {};
+
+    uint64_t frame_index = 0;
+    uint64_t frame_begin_ns = 0;
+    float frame_dt = 0.0f;
+    rolling_series frame_ms;
+    map<string, rolling_series> cpu_series;
+    map<string, rolling_series> gpu_series;
+    rolling_series worker_ms[k_profiler_max_threads];
+    int worker_slots_seen = 0;
+    rolling_series counter_rates[static_cast<int>(profile_counter::count)];
+
+    vector<gpu_timer> gpu_timers;
+    int active_gpu_timer = -1;
+    // Open GPU scopes, and the depth of the one whose query is running.
+    int gpu_depth = 0;
+    int active_gpu_depth = 0;
+    vector<gpu_event> pending_gpu_events;
+
+    deque<frame_trace> trace;
+    string export_status;
+};
+
+profiler_data &profiler() {
+    static profiler_data data;
+    return data;
+}
+
+thread_local thread_log *t_log = nullptr;
+
+const char *counter_label(profile_counter counter) {
+    switch (counter) {
+    case profile_counter::derivative_evaluations:
+        return "derivative evals/s";
+    case profile_counter::particle_steps:
+        return "particle-steps/s";
+    case profile_counter::bytes_uploaded:
+        return "bytes uploaded/s";
+    case profile_counter::count:
+        break;
+    }
+    return "";
+}
+
+void draw_series(const char *label, const rolling_series &series) {
+    ImGui::Text("%-24s %7.3f ms  avg %7.3f  max %7.3f", label,
+                series.latest(), series.average(), series.peak());
+    ImGui::PushID(label);
+    ImGui::PlotHistogram("##history", series.values, k_history, series.head,
+                         nullptr, 0.0f, max(series.peak(), 1e-3f),
+                         ImVec2(-1.0f, 36.0f));
+    ImGui::PopID();
+}
+
+void write_json_string(ofstream &out, const char *text) {
+    out << '"';
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+uint64_t profiler_now_ns() {
+    return static_cast<uint64_t>(
+        chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - profiler().epoch)
+            .count());
+}
+
+void profiler_bind_thread(int slot) {
+    slot = std::clamp(slot, 0, k_profiler_max_threads - 1);
+    t_log = &profiler().logs[slot];
+}
+
+void profiler_record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+    if (!t_log) {
+        t_log = &profiler().logs[0];
+    }
+    t_log->events.push_back({name, start_ns, end_ns});
+}
+
+void profiler_add(profile_counter counter, uint64_t amount) {
+    profiler()
+        .counters[static_cast<int>(counter)]
+        .fetch_add(amount, memory_order_relaxed);
+}
+
+void profiler_begin_frame() {
+    profiler_data &data = profiler();
+    data.frame_begin_ns = profiler_now_ns();
+}
+
+void profiler_gpu_begin(const char *name) {
+    profiler_data &data = profiler();
+    ++data.gpu_depth;
+    if (data.active_gpu_timer >= 0) {
+        // GL_TIME_ELAPSED queries cannot nest; the outer scope wins.
+        return;
+    }
+    int index = -1;
+    for (size_t i = 0; i < data.gpu_timers.size(); ++i) {
+        if (strcmp(data.gpu_timers[i].name, name) == 0) {
+            index = static_cast<int>(i);
+            break;
+        }
+    }
+    if (index < 0) {
+        gpu_timer timer;
+        timer.name = name;
+        glGenQueries(k_gpu_latency, timer.queries);
+        data.gpu_timers.push_back(timer);
+        index = static_cast<int>(data.gpu_timers.size() - 1);
+    }
+    gpu_timer &timer = data.gpu_timers[static_cast<size_t>(index)];
+    const int slot = static_cast<int>(data.frame_index % k_gpu_latency);
+    if (timer.pending[slot]) {
+        // The driver is more than k_gpu_latency frames behind; skip this
+        // sample rather than stalling on the old result.
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, timer.queries[slot]);
+    timer.pending[slot] = true;
+    timer.issue_ns[slot] = profiler_now_ns();
+    data.active_gpu_timer = index;
+    data.active_gpu_depth = data.gpu_depth;
+}
+
+void profiler_gpu_end() {
+    profiler_data &data = profiler();
+    // Only the scope that began the query ends it; a skipped inner scope
+    // must not cut the outer measurement short.
+    if (data.active_gpu_timer >= 0 &&
+        data.gpu_depth == data.active_gpu_depth) {
+        glEndQuery(GL_TIME_ELAPSED);
+        data.active_gpu_timer = -1;
+    }
+    data.gpu_depth = std::max(data.gpu_depth - 1, 0);
+}
+
+void profiler_release_gpu() {
+    profiler_data &data = profiler();
+    for (gpu_timer &timer : data.gpu_timers) {
+        glDeleteQueries(k_gpu_latency, timer.queries);
+    }
+    data.gpu_timers.clear();
+    data.active_gpu_timer = -1;
+    data.gpu_depth = 0;
+}
+
+void profiler_end_frame(float frame_dt) {
+    profiler_data &data = profiler();
+    const uint64_t frame_end_ns = profiler_now_ns();
+    data.frame_dt = frame_dt;
+    data.frame_ms.push(static_cast<float>(frame_end_ns - data.frame_begin_ns) *
+                       1e-6f);
+
+    frame_trace trace;
+    trace.begin_ns = data.frame_begin_ns;
+    trace.end_ns = frame_end_ns;
+
+    map<string, float> frame_totals;
+    for (int slot = 0; slot < k_profiler_max_threads; ++slot) {
+        vector<profile_event> &events = data.logs[slot].events;
+        if (events.empty()) {
+            if (slot > 0) {
+                data.worker_ms[slot].push(0.0f);
+            }
+            continue;
+        }
+        uint64_t first_start = events.front().start_ns;
+        uint64_t last_end = events.front().end_ns;
+        map<string, float> slot_totals;
+        for (const profile_event &event : events) {
+            slot_totals[event.name] +=
+                static_cast<float>(event.end_ns - event.start_ns) * 1e-6f;
+            first_start = min(first_start, event.start_ns);
+            last_end = max(last_end, event.end_ns);
+            trace.events.emplace_back(slot, event);
+        }
+        // Scopes recorded on several workers report the slowest worker, which
+        // is what the main thread ends up waiting for.
+        for (const auto &entry : slot_totals) {
+            float &total = frame_totals[entry.first];
+            total = max(total, entry.second);
+        }
+        if (slot > 0) {
+            data.worker_ms[slot].push(static_cast<float>(last_end -
+                                                         first_start) *
+                                      1e-6f);
+            data.worker_slots_seen = max(data.worker_slots_seen, slot);
+        }
+        events.clear();
+    }
+    for (const auto &entry : frame_totals) {
+        data.cpu_series[entry.first];
+    }
+    for (auto &entry : data.cpu_series) {
+        const auto found = frame_totals.find(entry.first);
+        entry.second.push(found == frame_totals.end() ? 0.0f : found->second);
+    }
+
+    map<string, float> gpu_totals;
+    for (gpu_timer &timer : data.gpu_timers) {
+        for (int slot = 0; slot < k_gpu_latency; ++slot) {
+            if (!timer.pending[slot]) {
+                continue;
+            }
+            GLint available = 0;
+            glGetQueryObjectiv(timer.queries[slot], GL_QUERY_RESULT_AVAILABLE,
+                               &available);
+            if (!available) {
+                continue;
+            }
+            GLuint64 elapsed_ns = 0;
+            glGetQueryObjectui64v(timer.queries[slot], GL_QUERY_RESULT,
+                                  &elapsed_ns);
+            timer.pending[slot] = false;
+            gpu_totals[timer.name] += static_cast<float>(elapsed_ns) * 1e-6f;
+            trace.gpu.push_back({timer.name, timer.issue_ns[slot],
+                                 static_cast<uint64_t>(elapsed_ns)});
+        }
+        data.gpu_series[timer.name];
+    }
+    for (auto &entry : data.gpu_series) {
+        const auto found = gpu_totals.find(entry.first);
+        if (found != gpu_totals.end()) {
+            entry.second.push(found->second);
+        }
+    }
+
+    const float inv_dt = frame_dt > 0.0f ? 1.0f / frame_dt : 0.0f;
+    for (int index = 0; index < static_cast<int>(profile_counter::count);
+         ++index) {
+        const uint64_t value =
+            data.counters[index].exchange(0, memory_order_relaxed);
+        trace.counters[index] = value;
+        data.counter_rates[index].push(static_cast<float>(value) * inv_dt);
+    }
+
+    data.trace.push_back(std::move(trace));
+    if (data.trace.size() > k_trace_frames) {
+        data.trace.pop_front();
+    }
+    ++data.frame_index;
+}
+
+bool profiler_export_chrome_trace(const char *path) {
+    profiler_data &data = profiler();
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "Failed to open trace file: " << path << "\n";
+        return false;
+    }
+    constexpr int k_gpu_tid = 1000;
+    char buffer[64];
+    auto micros = [&](uint64_t ns) {
+        snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(ns) * 1e-3);
+        return buffer;
+    };
+
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+           "\"args\":{\"name\":\"main\"}},\n";
+    for (int slot = 1; slot <= data.worker_slots_seen; ++slot) {
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << slot << ",\"args\":{\"name\":\"worker " << slot << "\"}},\n";
+    }
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << k_gpu_tid << ",\"args\":{\"name\":\"GPU\"}}";
+
+    for (const frame_trace &frame : data.trace) {
+        for (const auto &entry : frame.events) {
+            const profile_event &event = entry.second;
+            out << ",\n{\"name\":";
+            write_json_string(out, event.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << entry.first
+                << ",\"ts\":" << micros(event.start_ns);
+            out << ",\"dur\":" << micros(event.end_ns - event.start_ns) << "}";
+        }
+        // GL_TIME_ELAPSED only yields durations, so GPU spans are anchored at
+        // the CPU time the query was issued.
+        for (const gpu_event &event : frame.gpu) {
+            out << ",\n{\"name\":";
+            write_json_string(out, event.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << k_gpu_tid
+                << ",\"ts\":" << micros(event.issue_ns);
+            out << ",\"dur\":" << micros(event.duration_ns) << "}";
+        }
+        out << ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":"
+            << micros(frame.end_ns) << ",\"args\":{";
+        for (int index = 0; index < static_cast<int>(profile_counter::count);
+             ++index) {
+            if (index > 0) {
+                out << ",";
+            }
+            write_json_string(out,
+                              counter_label(static_cast<profile_counter>(index)));
+            out << ":" << frame.counters[index];
+        }
+        out << "}}";
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+void draw_profiler_overlay(bool *open) {
+    profiler_data &data = profiler();
+    ImGui::SetNextWindowSize(ImVec2(460.0f, 520.0f), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Profiler", open)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("frame %.2f ms (%.1f fps)", data.frame_ms.latest(),
+                data.frame_dt > 0.0f ? 1.0f / data.frame_dt : 0.0f);
+    if (ImGui::Button("Export Chrome Trace")) {
+        constexpr const char *k_trace_path = "chaoseq_trace.json";
+        data.export_status =
+            profiler_export_chrome_trace(k_trace_path)
+                ? string("wrote ") + k_trace_path
+                : string("failed to write ") + k_trace_path;
+    }
+    if (!data.export_status.empty()) {
+        ImGui::SameLine();
+        ImGui::Text("%s", data.export_status.c_str());
+    }
+
+    if (ImGui::CollapsingHeader("CPU", ImGuiTreeNodeFlags_DefaultOpen)) {
+        draw_series("frame", data.frame_ms);
+        for (const auto &entry : data.cpu_series) {
+            draw_series(entry.first.c_str(), entry.second);
+        }
+    }
+    if (ImGui::CollapsingHeader("GPU", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (const auto &entry : data.gpu_series) {
+            draw_series(entry.first.c_str(), entry.second);
+        }
+    }
+    if (ImGui::CollapsingHeader("Workers")) {
+        char label[32];
+        for (int slot = 1; slot <= data.worker_slots_seen; ++slot) {
+            snprintf(label, sizeof(label), "worker %d", slot);
+            draw_series(label, data.worker_ms[slot]);
+        }
+    }
+    if (ImGui::CollapsingHeader("Counters", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (int index = 0; index < static_cast<int>(profile_counter::count);
+             ++index) {
+            const rolling_series &series = data.counter_rates[index];
+            const char *label =
+                counter_label(static_cast<profile_counter>(index));
+            ImGui::Text("%-24s %.3e  avg %.3e", label, series.latest(),
+                        series.average());
+            ImGui::PushID(index);
+            ImGui::PlotHistogram("##rate", series.values, k_history,
+                                 series.head, nullptr, 0.0f,
+                                 max(series.peak(), 1.0f),
+                                 ImVec2(-1.0f, 36.0f));
+            ImGui::PopID();
+        }
+    }
+
+    ImGui::End();
+}
+
+#endif
@@ -0,0 +1,389 @@
+#include "scenario.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+bool timed(scenario_op op) {
+    return op == scenario_op::warmup || op == scenario_op::frames ||
+           op == scenario_op::drag || op == scenario_op::orbit;
+}
+
+bool parse_number(const string &text, float &value) {
+    char *end = nullptr;
+    value = strtof(text.c_str(), &end);
+    return !text.empty() && *end == '\0' && std::isfinite(value);
+}
+
+bool parse_count(const string &text, int &value) {
+    char *end = nullptr;
+    const long parsed = strtol(text.c_str(), &end, 10);
+    value = static_cast<int>(parsed);
+    return !text.empty() && *end == '\0' && parsed > 0 && parsed <= 1 << 24;
+}
+
+// The rest of the line after the last argument read.
+string rest_of(istringstream &in) {
+    string label;
+    getline(in >> ws, label);
+    return label;
+}
+
+bool parse_command(const string &verb, istringstream &in,
+                   scenario_script &script, scenario_command &command) {
+    string a;
+    string b;
+    string c;
+    string d;
+    if (verb == "frame-dt") {
+        return in >> a && parse_number(a, script.frame_dt) &&
+               script.frame_dt > 0.0f;
+    }
+    if (verb == "hitch") {
+        return in >> a && parse_number(a, script.budget.hitch_ms) &&
+               script.budget.hitch_ms > 0.0f;
+    }
+    if (verb == "budget") {
+        if (!(in >> a >> b)) {
+            return false;
+        }
+        if (a == "p50") {
+            return parse_number(b, script.budget.p50_ms);
+        }
+        if (a == "p99") {
+            return parse_number(b, script.budget.p99_ms);
+        }
+        // Zero hitches is a valid budget.
+        int hitches = 0;
+        if (a != "hitches" || (b != "0" && !parse_count(b, hitches))) {
+            return false;
+        }
+        script.budget.hitches = hitches;
+        return true;
+    }
+    if (verb == "system") {
+        system_type type;
+        command.op = scenario_op::system;
+        return in >> command.name && parse_system_type(command.name, type);
+    }
+    if (verb == "set") {
+        command.op = scenario_op::set;
+        if (!(in >> a)) {
+            return false;
+        }
+        const size_t equals = a.find('=');
+        command.name = a.substr(0, equals);
+        return equals != string::npos &&
+               parse_number(a.substr(equals + 1), command.from);
+    }
+    if (verb == "particles") {
+        command.op = scenario_op::particles;
+        return in >> a && parse_count(a, command.frames);
+    }
+    if (verb == "render") {
+        command.op = scenario_op::render;
+        in >> a;
+        const char *modes[] = {"alpha", "hdr", "compute"};
+        for (int mode = 0; mode < 3; ++mode) {
+            if (a == modes[mode]) {
+                command.mode = mode;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (verb == "trails") {
+        command.op = scenario_op::trails;
+        in >> a;
+        command.mode = a == "on";
+        return a == "on" || a == "off";
+    }
+    if (verb == "camera") {
+        command.op = scenario_op::camera;
+        in >> a;
+        command.mode = static_cast<int>(a == "orbit" ? camera_mode::orbit
+                                                     : camera_mode::fps);
+        return a == "orbit" || a == "fps";
+    }
+    if (verb == "warmup" || verb == "frames") {
+        command.op =
+            verb == "warmup" ? scenario_op::warmup : scenario_op::frames;
+        if (!(in >> a) || !parse_count(a, command.frames)) {
+            return false;
+        }
+        command.label = rest_of(in);
+        return true;
+    }
+    if (verb == "drag") {
+        command.op = scenario_op::drag;
+        if (!(in >> command.name >> b >> c >> d) ||
+            !parse_number(b, command.from) || !parse_number(c, command.to) ||
+            !parse_count(d, command.frames)) {
+            return false;
+        }
+        command.label = rest_of(in);
+        return true;
+    }
+    if (verb == "orbit") {
+        command.op = scenario_op::orbit;
+        if (!(in >> a >> b) || !parse_number(a, command.from) ||
+            !parse_count(b, command.frames)) {
+            return false;
+        }
+        command.label = rest_of(in);
+        return true;
+    }
+    return false;
+}
+
+bool set_parameter(simulation_state &state, const scenario_command &command,
+                   float value, const string &path) {
+    float *parameter = find_system_parameter(state, command.name);
+    if (!parameter) {
+        cerr << path << ":" << command.line << ": "
+             << system_name(state.current_system) << " has no parameter "
+             << command.name << "\n";
+        return false;
+    }
+    *parameter = value;
+    build_active_system(state);
+    return true;
+}
+
+void use_camera_mode(simulation_state &state, camera_mode mode,
+                     orbit_camera &orbit, Camera &camera) {
+    if (state.current_camera_mode == mode) {
+        return;
+    }
+    if (mode == camera_mode::orbit) {
+        sync_orbit_from_fps(state, camera, orbit);
+    } else {
+        sync_fps_from_orbit(orbit, camera);
+    }
+    state.current_camera_mode = mode;
+}
+
+bool apply_command(scenario_runner &runner, const scenario_command &command,
+                   simulation_state &state, orbit_camera &orbit,
+                   Camera &camera) {
+    switch (command.op) {
+    case scenario_op::system:
+        parse_system_type(command.name, state.current_system);
+        orbit.target = reset_simulation(state);
+        return true;
+    case scenario_op::set:
+        return set_parameter(state, command, command.from,
+                             runner.script.path);
+    case scenario_op::particles:
+        state.particle_count = static_cast<size_t>(command.frames);
+        initialize_particle_field(state);
+        update_particle_gpu(state);
+        return true;
+    case scenario_op::render:
+        state.render_mode = static_cast<particle_render_mode>(command.mode);
+        if (state.render_mode == particle_render_mode::compute_raster &&
+            !state.compute_supported) {
+            cerr << runner.script.path << ":" << command.line
+                 << ": compute rasterizer needs OpenGL 4.3, using alpha "
+                    "blending\n";
+            state.render_mode = particle_render_mode::alpha_blend;
+        }
+        return true;
+    case scenario_op::trails:
+        state.show_particle_trails = command.mode != 0;
+        return true;
+    case scenario_op::camera:
+        use_camera_mode(state, static_cast<camera_mode>(command.mode), orbit,
+                        camera);
+        return true;
+    default:
+        return true;
+    }
+}
+
+float percentile(const vector<float> &sorted, float fraction) {
+    if (sorted.empty()) {
+        return 0.0f;
+    }
+    const size_t rank = static_cast<size_t>(
+        std::ceil(fraction * static_cast<float>(sorted.size())));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+struct frame_summary {
+    size_t frames = 0;
+    float p50 = 0.0f;
+    float p99 = 0.0f;
+    float max = 0.0f;
+    int hitches = 0;
+};
+
+frame_summary summarize(const float *first, const float *end,
+                        float hitch_ms) {
+    frame_summary summary;
+    vector<float> sorted(first, end);
+    sort(sorted.begin(), sorted.end());
+    summary.frames = sorted.size();
+    summary.p50 = percentile(sorted, 0.50f);
+    summary.p99 = percentile(sorted, 0.99f);
+    summary.max = sorted.empty() ? 0.0f : sorted.back();
+    summary.hitches = static_cast<int>(
+        sorted.end() - upper_bound(sorted.begin(), sorted.end(), hitch_ms));
+    return summary;
+}
+
+void print_summary(const char *label, const frame_summary &summary,
+                   float hitch_ms) {
+    printf("  %-24s %6zu frames  p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms  "
+           "hitches %d",
+           label, summary.frames, static_cast<double>(summary.p50),
+           static_cast<double>(summary.p99), static_cast<double>(summary.max),
+           summary.hitches);
+    if (hitch_ms > 0.0f) {
+        printf(" (> %.1f ms)", static_cast<double>(hitch_ms));
+    }
+    printf("\n");
+}
+
+} // namespace
+
+bool load_scenario(const char *path, scenario_script &script) {
+    ifstream in(path);
+    if (!in) {
+        cerr << "Failed to open scenario " << path << "\n";
+        return false;
+    }
+    script = scenario_script{};
+    script.path = path;
+    string text;
+    int line = 0;
+    while (getline(in, text)) {
+        ++line;
+        text = text.substr(0, text.find('#'));
+        istringstream words(text);
+        string verb;
+        if (!(words >> verb)) {
+            continue;
+        }
+        scenario_command command;
+        command.line = line;
+        if (!parse_command(verb, words, script, command)) {
+            cerr << path << ":" << line << ": invalid command: " << text
+                 << "\n";
+            return false;
+        }
+        if (verb == "frame-dt" || verb == "hitch" || verb == "budget") {
+            continue;
+        }
+        if (command.label.empty()) {
+            command.label = verb + " (line " + to_string(line) + ")";
+        }
+        command.budget = script.budget;
+        script.commands.push_back(command);
+    }
+    if (none_of(script.commands.begin(), script.commands.end(),
+                [](const scenario_command &command) {
+                    return timed(command.op) &&
+                           command.op != scenario_op::warmup;
+                })) {
+        cerr << path << ": no measured frames\n";
+        return false;
+    }
+    return true;
+}
+
+bool scenario_begin_frame(scenario_runner &runner, simulation_state &state,
+                          orbit_camera &orbit, Camera &camera) {
+    const vector<scenario_command> &commands = runner.script.commands;
+    while (!runner.failed && runner.command < commands.size()) {
+        const scenario_command &command = commands[runner.command];
+        if (!timed(command.op)) {
+            runner.failed = !apply_command(runner, command, state, orbit,
+                                           camera);
+            ++runner.command;
+            continue;
+        }
+        if (runner.frame == 0 && command.op != scenario_op::warmup) {
+            const size_t first = runner.frame_ms.size();
+            runner.segments.push_back(
+                {command.label, first, first, command.budget});
+        }
+        if (command.op == scenario_op::drag) {
+            const float progress =
+                static_cast<float>(runner.frame) /
+                static_cast<float>(std::max(command.frames - 1, 1));
+            runner.failed = !set_parameter(
+                state, command,
+                command.from + (command.to - command.from) * progress,
+                runner.script.path);
+        } else if (command.op == scenario_op::orbit) {
+            use_camera_mode(state, camera_mode::orbit, orbit, camera);
+            orbit.yaw += command.from / static_cast<float>(command.frames);
+            sync_fps_from_orbit(orbit, camera);
+        }
+        return !runner.failed;
+    }
+    return false;
+}
+
+void scenario_end_frame(scenario_runner &runner, double ms) {
+    const scenario_command &command =
+        runner.script.commands[runner.command];
+    if (command.op != scenario_op::warmup) {
+        runner.frame_ms.push_back(static_cast<float>(ms));
+        runner.segments.back().end = runner.frame_ms.size();
+    }
+    if (++runner.frame >= command.frames) {
+        runner.frame = 0;
+        ++runner.command;
+    }
+}
+
+bool report_scenario(const scenario_runner &runner) {
+    const scenario_script &script = runner.script;
+    printf("Scenario %s\n", script.path.c_str());
+    bool passed = true;
+    auto check = [&](const char *name, double value, double limit) {
+        const bool ok = value <= limit;
+        printf("    budget %-8s %8.2f <= %8.2f  %s\n", name, value, limit,
+               ok ? "pass" : "FAIL");
+        passed = passed && ok;
+    };
+    const float *times = runner.frame_ms.data();
+    int total_hitches = 0;
+    for (const scenario_segment &segment : runner.segments) {
+        const scenario_budget &budget = segment.budget;
+        const frame_summary summary = summarize(
+            times + segment.first, times + segment.end, budget.hitch_ms);
+        print_summary(segment.label.c_str(), summary, budget.hitch_ms);
+        total_hitches += summary.hitches;
+        if (budget.p50_ms > 0.0f) {
+            check("p50", summary.p50, budget.p50_ms);
+        }
+        if (budget.p99_ms > 0.0f) {
+            check("p99", summary.p99, budget.p99_ms);
+        }
+        if (budget.hitches >= 0) {
+            check("hitches", summary.hitches, budget.hitches);
+        }
+    }
+    // Each frame is a hitch or not by the threshold of its own segment.
+    frame_summary total =
+        summarize(times, times + runner.frame_ms.size(), 0.0f);
+    total.hitches = total_hitches;
+    print_summary("total", total, 0.0f);
+
+    if (runner.failed || runner.command != script.commands.size()) {
+        printf("  FAIL: the script stopped early\n");
+        return false;
+    }
+    return passed;
+}
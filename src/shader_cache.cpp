@@ -0,0 +1,169 @@
+#include "shader_cache.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t k_cache_magic = 0x43505243; // "CRPC"
+constexpr uint64_t k_fnv_offset = 14695981039346656037ull;
+constexpr uint64_t k_fnv_prime = 1099511628211ull;
+
+int g_cache_hits = 0;
+int g_cache_misses = 0;
+
+struct cache_entry_header {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+};
+
+bool cache_supported() {
+    static int supported = -1;
+    if (supported < 0) {
+        GLint formats = 0;
+        if (GLAD_GL_VERSION_4_1) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        supported = formats > 0 ? 1 : 0;
+    }
+    return supported == 1;
+}
+
+filesystem::path cache_directory() {
+    if (const char *xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return filesystem::path(xdg) / "chaoseq";
+    }
+    if (const char *home = getenv("HOME"); home && *home) {
+        return filesystem::path(home) / ".cache" / "chaoseq";
+    }
+    return {};
+}
+
+filesystem::path cache_path(uint64_t key) {
+    const filesystem::path directory = cache_directory();
+    if (directory.empty()) {
+        return {};
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin",
+             static_cast<unsigned long long>(key));
+    return directory / name;
+}
+
+uint64_t hash_text(uint64_t hash, const char *text) {
+    if (text) {
+        for (const char *c = text; *c; ++c) {
+            hash = (hash ^ static_cast<unsigned char>(*c)) * k_fnv_prime;
+        }
+    }
+    // Separator, so {"ab", "c"} and {"a", "bc"} hash differently.
+    return (hash ^ 0xFFu) * k_fnv_prime;
+}
+
+} // namespace
+
+uint64_t shader_cache_key(initializer_list<const char *> sources) {
+    uint64_t hash = k_fnv_offset;
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION,
+                        GL_SHADING_LANGUAGE_VERSION}) {
+        hash = hash_text(
+            hash, reinterpret_cast<const char *>(glGetString(name)));
+    }
+    for (const char *source : sources) {
+        hash = hash_text(hash, source);
+    }
+    return hash;
+}
+
+GLuint load_cached_program(uint64_t key) {
+    if (!cache_supported()) {
+        return 0;
+    }
+    const filesystem::path path = cache_path(key);
+    ifstream file(path, ios::binary);
+    cache_entry_header header{};
+    if (!file || !file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        header.magic != k_cache_magic || header.length == 0) {
+        ++g_cache_misses;
+        return 0;
+    }
+    vector<char> binary(header.length);
+    if (!file.read(binary.data(), static_cast<streamsize>(binary.size()))) {
+        ++g_cache_misses;
+        return 0;
+    }
+    const GLuint program = glCreateProgram();
+    glProgramBinary(program, static_cast<GLenum>(header.format), binary.data(),
+                    static_cast<GLsizei>(binary.size()));
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        // Drivers may reject binaries at any time; fall back to a compile.
+        glDeleteProgram(program);
+        ++g_cache_misses;
+        return 0;
+    }
+    ++g_cache_hits;
+    return program;
+}
+
+void prepare_cached_program(GLuint program) {
+    if (cache_supported()) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                            GL_TRUE);
+    }
+}
+
+void store_cached_program(GLuint program, uint64_t key) {
+    if (!cache_supported()) {
+        return;
+    }
+    const filesystem::path path = cache_path(key);
+    if (path.empty()) {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    error_code error;
+    filesystem::create_directories(path.parent_path(), error);
+    if (error) {
+        cerr << "Failed to create shader cache directory: "
+             << path.parent_path() << "\n";
+        return;
+    }
+    // Write then rename, so a concurrent run never reads a partial entry.
+    filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        const cache_entry_header header{k_cache_magic,
+                                        static_cast<uint32_t>(format),
+                                        static_cast<uint32_t>(length)};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(binary.data(), static_cast<streamsize>(binary.size()));
+        if (!file) {
+            return;
+        }
+    }
+    filesystem::rename(temporary, path, error);
+}
+
+void shader_cache_stats(int &hits, int &misses) {
+    hits = g_cache_hits;
+    misses = g_cache_misses;
+}
@@ -1,9 +1,11 @@
 #include "simulation.hpp"
+#include "profiler.hpp"
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <iostream>
 #include <random>
-#include <thread>
 
 using namespace std;
 using namespace glm;
@@ -30,46 +32,6 @@ void orbit_camera::clamp_radius() {
     radius = glm::clamp(radius, min_radius, max_radius);
 }
 
-glm::vec3 evaluate_derivative(const simulation_state &state,
-                              const vec3 &position) {
-    switch (state.current_system) {
-    case system_type::lorenz:
-        return deriv_lorenz(state.lorenz_args, position);
-    case system_type::rossler:
-        return deriv_rossler(state.rossler_args, position);
-    case system_type::thomas:
-        return deriv_thomas(state.thomas_args, position);
-    case system_type::aizawa:
-        return deriv_aizawa(state.aizawa_args, position);
-    case system_type::dadras:
-        return deriv_dadras(state.dadras_args, position);
-    case system_type::chen:
-        return deriv_chen(state.chen_args, position);
-    case system_type::lorenz83:
-        return deriv_lorenz83(state.lorenz83_args, position);
-    case system_type::halvorsen:
-        return deriv_halvorsen(state.halvorsen_args, position);
-    case system_type::rabinovich:
-        return deriv_rabinovich(state.rabinovich_args, position);
-    case system_type::three_scroll:
-        return deriv_three_scroll(state.three_scroll_args, position);
-    case system_type::sprott:
-        return deriv_sprott(state.sprott_args, position);
-    case system_type::four_wing:
-        return deriv_four_wing(state.four_wing_args, position);
-    }
-    return vec3(0.0f);
-}
-
-glm::vec3 integrate_particle_rk4(const simulation_state &state,
-                                 const vec3 &position, float dt) {
-    const vec3 k1 = evaluate_derivative(state, position);
-    const vec3 k2 = evaluate_derivative(state, position + 0.5f * dt * k1);
-    const vec3 k3 = evaluate_derivative(state, position + 0.5f * dt * k2);
-    const vec3 k4 = evaluate_derivative(state, position + dt * k3);
-    return position + (dt / 6.0f) * (k1 + 2.0f * k2 + 2.0f * k3 + k4);
-}
-
 float compute_spawn_phase(const vec3 &position) {
     vec3 direction = position;
     float distance = length(direction);
@@ -115,51 +77,157 @@ void ensure_particle_buffers(simulation_state &state) {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+void allocate_particle_arrays(simulation_state &state, size_t count) {
+    const int dimension = system_dimension(state.current_system);
+    const bool delay = system_has_delay(state.current_system);
+    const int nd_dimension = dimension > 3 && !delay ? dimension : 0;
+    const int dde_dimension = delay ? dimension : 0;
+    const float step_dt = glm::clamp(state.base_dt, 1e-6f, 0.2f);
+    if (state.dde.dimension != dde_dimension ||
+        (delay && (state.dde.count != count ||
+                   !dde_history_matches(state.dde, system_delay(state),
+                                        step_dt)))) {
+        allocate_dde_history(state.dde, dde_dimension, system_delay(state),
+                             step_dt, count);
+    }
+    if (state.particle_positions.size() == count &&
+        state.nd.dimension == nd_dimension) {
+        return;
+    }
+    // Start from fresh storage rather than growing in place, so no page has
+    // been touched before the owning worker writes it.
+    particle_array<vec3>().swap(state.particle_positions);
+    particle_array<float>().swap(state.particle_phases);
+    particle_array<uint16_t>().swap(state.particle_still_steps);
+    particle_array<uint32_t>().swap(state.particle_ids);
+    state.particle_positions.resize(count);
+    state.particle_phases.resize(count);
+    state.particle_still_steps.resize(count);
+    state.particle_ids.resize(count);
+    allocate_nd_components(state.nd, nd_dimension, count);
+}
+
+unsigned int plan_particle_partitions(simulation_state &state, size_t total) {
+    constexpr size_t k_min_per_thread = 4096;
+    start_worker_pool(state.workers);
+    const unsigned int max_threads = static_cast<unsigned int>(
+        (total + k_min_per_thread - 1) / k_min_per_thread);
+    const unsigned int thread_count = std::min(
+        std::max(1u, max_threads), std::max(1u, worker_count(state.workers)));
+    if (state.particle_partitions.size() != thread_count + 1 ||
+        state.particle_partitions.back() != total) {
+        partition_by_weight(state.workers, total, thread_count,
+                            state.particle_partitions);
+    }
+    return thread_count;
+}
+
+void run_particle_partitions(
+    simulation_state &state,
+    const function<void(size_t, size_t, unsigned int)> &task) {
+    const vector<size_t> &bounds = state.particle_partitions;
+    if (bounds.size() <= 2) {
+        task(0, bounds.empty() ? 0 : bounds.back(), 0);
+        return;
+    }
+    run_workers(state.workers, static_cast<unsigned int>(bounds.size() - 1),
+                [&](unsigned int worker) {
+                    task(bounds[worker], bounds[worker + 1], worker);
+                });
+}
+
 void initialize_particle_field(simulation_state &state) {
     ensure_particle_buffers(state);
 
     if (state.particle_count == 0) {
         state.particle_count = 1;
     }
-    state.particle_positions.resize(state.particle_count);
-    state.particle_phases.resize(state.particle_count);
-
-    mt19937 rng{random_device{}()};
-    normal_distribution<float> normal_dist(0.0f, 1.0f);
+    // Delay systems keep a history per particle, so the budget may hold
+    // fewer particles than asked for.
+    size_t count = state.particle_count;
+    if (system_has_delay(state.current_system)) {
+        count = std::min(
+            count, dde_particle_capacity(
+                       state.dde, system_dimension(state.current_system),
+                       system_delay(state),
+                       glm::clamp(state.base_dt, 1e-6f, 0.2f)));
+    }
+    allocate_particle_arrays(state, count);
+    assign_segment_ranges(state.segments, count);
+    state.particles_diverged = 0;
+    state.particles_stalled = 0;
+    state.particles_respawned = 0;
 
-    for (size_t index = 0; index < state.particle_count; ++index) {
-        vec3 direction(normal_dist(rng), normal_dist(rng), normal_dist(rng));
-        if (dot(direction, direction) < 1e-6f) {
-            direction = vec3(1.0f, 0.0f, 0.0f);
+    // Each worker seeds its own partition, which also places those pages on
+    // its memory node.
+    const uint32_t seed = random_device{}();
+    if (state.nd.dimension > 0) {
+        update_nd_projection(state.nd.projection, state.nd.dimension);
+        state.nd.projection.refit = true;
+    }
+    plan_particle_partitions(state, count);
+    run_particle_partitions(state, [&](size_t begin, size_t end,
+                                       unsigned int worker) {
+        for (size_t index = begin; index < end; ++index) {
+            state.particle_ids[index] = static_cast<uint32_t>(index);
         }
-        direction = normalize(direction);
+        if (state.nd.dimension > 0) {
+            seed_nd_particles(state, begin, end,
+                              seed ^ (0x9e3779b9u * (worker + 1)));
+            return;
+        }
+        if (state.dde.dimension > 0) {
+            seed_dde_particles(state, begin, end,
+                               seed ^ (0x9e3779b9u * (worker + 1)));
+            return;
+        }
+        mt19937 rng{seed ^ (0x9e3779b9u * (worker + 1))};
+        normal_distribution<float> normal_dist(0.0f, 1.0f);
 
-        vec3 position;
-        if (state.particle_spawn_from_origin) {
-            const float jitter_scale =
-                glm::max(state.particle_origin_jitter, 1e-4f);
-            float radius = abs(normal_dist(rng)) * jitter_scale;
-            radius = glm::clamp(radius, 1e-5f, jitter_scale * 2.0f);
-            position = direction * radius;
-        } else {
-            const float radius = abs(normal_dist(rng)) * 0.5f + 0.5f;
-            position = direction * radius * state.particle_spawn_radius;
+        for (size_t index = begin; index < end; ++index) {
+            vec3 direction(normal_dist(rng), normal_dist(rng),
+                           normal_dist(rng));
+            if (dot(direction, direction) < 1e-6f) {
+                direction = vec3(1.0f, 0.0f, 0.0f);
+            }
+            direction = normalize(direction);
+
+            vec3 position;
+            if (state.particle_spawn_from_origin) {
+                const float jitter_scale =
+                    glm::max(state.particle_origin_jitter, 1e-4f);
+                float radius = abs(normal_dist(rng)) * jitter_scale;
+                radius = glm::clamp(radius, 1e-5f, jitter_scale * 2.0f);
+                position = direction * radius;
+            } else {
+                const float radius = abs(normal_dist(rng)) * 0.5f + 0.5f;
+                position = direction * radius * state.particle_spawn_radius;
+            }
+            state.particle_positions[index] = position;
+            state.particle_phases[index] = compute_spawn_phase(position);
+            state.particle_still_steps[index] = 0;
         }
-        state.particle_positions[index] = position;
-        state.particle_phases[index] = compute_spawn_phase(position);
-    }
+    });
 
     glBindBuffer(GL_ARRAY_BUFFER, state.particle_phase_vbo);
     glBufferData(GL_ARRAY_BUFFER,
                  state.particle_phases.size() * sizeof(float),
                  state.particle_phases.data(), GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    state.particle_phases_dirty = false;
+    state.particle_positions_dirty = true;
+
+    reset_trail_ring(state.particle_trails);
+    clear_invariant_stats(state.stats);
+    state.reorder.pending = true;
 }
 
 void update_particle_gpu(simulation_state &state) {
     if (state.particle_positions.empty()) {
         return;
     }
+    CHAOSEQ_PROFILE_SCOPE("update_particle_gpu");
+    CHAOSEQ_PROFILE_GPU_SCOPE("update_particle_gpu");
     ensure_particle_buffers(state);
     glBindBuffer(GL_ARRAY_BUFFER, state.particle_pos_vbo);
     const size_t required_bytes =
@@ -168,71 +236,513 @@ void update_particle_gpu(simulation_state &state) {
         glBufferData(GL_ARRAY_BUFFER, required_bytes,
                      state.particle_positions.data(), GL_DYNAMIC_DRAW);
         state.particle_buffer_capacity = state.particle_positions.size();
-    } else {
+        CHAOSEQ_PROFILE_COUNT(profile_counter::bytes_uploaded, required_bytes);
+    } else if (state.particle_positions_dirty) {
         glBufferSubData(GL_ARRAY_BUFFER, 0, required_bytes,
                         state.particle_positions.data());
+        CHAOSEQ_PROFILE_COUNT(profile_counter::bytes_uploaded, required_bytes);
+    }
+    state.particle_positions_dirty = false;
+    if (state.particle_phases_dirty) {
+        glBindBuffer(GL_ARRAY_BUFFER, state.particle_phase_vbo);
+        glBufferData(GL_ARRAY_BUFFER,
+                     state.particle_phases.size() * sizeof(float),
+                     state.particle_phases.data(), GL_STATIC_DRAW);
+        state.particle_phases_dirty = false;
     }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+namespace {
+
+constexpr uint16_t k_particle_retired = 0xFFFF;
+
+enum class particle_fate { alive, diverged, stalled };
+
+// Cheap per-particle hash used to pick respawn donors and jitter without
+// sharing an RNG between workers.
+uint32_t hash_particle(uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+    return value;
+}
+
+float hash_unit(uint32_t &seed) {
+    seed = hash_particle(seed + 0x9e3779b9u);
+    return static_cast<float>(seed >> 8) * (1.0f / 16777216.0f);
+}
+
+particle_fate classify_particle(uint16_t &still, const vec3 &before,
+                                const vec3 &after, float escape_sq,
+                                float still_sq, int stall_steps) {
+    // Written so that NaN fails the comparison and counts as escaped.
+    if (!(dot(after, after) <= escape_sq)) {
+        return particle_fate::diverged;
+    }
+    const vec3 delta = after - before;
+    if (dot(delta, delta) >= still_sq) {
+        still = 0;
+        return particle_fate::alive;
+    }
+    if (still < k_particle_retired - 1) {
+        ++still;
+    }
+    return still >= stall_steps ? particle_fate::stalled
+                                : particle_fate::alive;
+}
+
+// Standard normals of the particle being stepped, generated k_particle_lanes
+// particles at a time as a range is walked in order.
+struct particle_noise {
+    uint32_t seed = 0;
+    uint64_t launch = 0;
+    size_t first = 0;
+    bool filled = false;
+    float normals[3][k_particle_lanes];
+
+    vec3 at(size_t index) {
+        if (!filled || index < first || index - first >= k_particle_lanes) {
+            first = index;
+            filled = true;
+            gaussian_lanes<k_particle_lanes, 3>(seed, launch, first, normals);
+        }
+        const size_t lane = index - first;
+        return vec3(normals[0][lane], normals[1][lane], normals[2][lane]);
+    }
+};
+
+// RK4 steps of the particle being stepped, taken k_particle_lanes particles at
+// a time for presets where system_steps_in_lanes holds. A block reads the
+// positions ahead of index, so the range must be walked in order and index
+// must not have been written yet; lanes past end repeat the last particle.
+struct particle_lane_steps {
+    const system_params *params = nullptr;
+    const vec3 *positions = nullptr;
+    float dt = 0.0f;
+    size_t end = 0;
+    size_t first = 0;
+    bool filled = false;
+    vec3 after[k_particle_lanes];
+
+    vec3 at(size_t index) {
+        if (!filled || index < first || index - first >= k_particle_lanes) {
+            first = index;
+            filled = true;
+            step_block();
+        }
+        return after[index - first];
+    }
+
+    void step_block() {
+        vec3_lanes<k_particle_lanes> lanes;
+        for (int lane = 0; lane < k_particle_lanes; ++lane) {
+            const vec3 &position = positions[std::min(first + lane, end - 1)];
+            lanes.x.lane[lane] = position.x;
+            lanes.y.lane[lane] = position.y;
+            lanes.z.lane[lane] = position.z;
+        }
+        lanes = rk4_step(
+            [this](const vec3_lanes<k_particle_lanes> &value) {
+                return evaluate_derivative(*params, value);
+            },
+            lanes, dt);
+        for (int lane = 0; lane < k_particle_lanes; ++lane) {
+            after[lane].x = lanes.x.lane[lane];
+            after[lane].y = lanes.y.lane[lane];
+            after[lane].z = lanes.z.lane[lane];
+        }
+    }
+};
+
+vec3 integrate_particle_sde(const system_params &params,
+                            const sde_coefficients &sde,
+                            const vec3 &position, const vec3 &xi) {
+    const vec3 drift = evaluate_derivative(params, position);
+    return vec3(sde_component(sde, position.x, drift.x, xi.x),
+                sde_component(sde, position.y, drift.y, xi.y),
+                sde_component(sde, position.z, drift.z, xi.z));
+}
+
+// Moves the particles retired from [begin, end), listed in retired from
+// first_retired on, next to a live donor from the same range. Only this
+// worker writes the range, so donors can be read without synchronization.
+// Without a donor the particle is reseeded inside the spawn ball.
+void respawn_retired(simulation_state &state, size_t begin, size_t end,
+                     const particle_retire_list &retired, size_t first_retired,
+                     uint32_t frame_seed) {
+    const size_t range = end - begin;
+    const uint16_t donor_limit =
+        static_cast<uint16_t>(std::max(state.particle_stall_steps / 2, 1));
+    for (size_t r = first_retired; r < retired.indices.size(); ++r) {
+        const uint32_t index = retired.indices[r];
+        uint32_t seed = hash_particle(index ^ frame_seed);
+        vec3 position(0.0f);
+        bool found = false;
+        for (int attempt = 0; attempt < 8 && !found; ++attempt) {
+            const size_t donor =
+                begin + static_cast<size_t>(hash_unit(seed) *
+                                            static_cast<float>(range));
+            if (donor < end &&
+                state.particle_still_steps[donor] < donor_limit) {
+                position = state.particle_positions[donor];
+                found = true;
+            }
+        }
+        vec3 direction(hash_unit(seed) - 0.5f, hash_unit(seed) - 0.5f,
+                       hash_unit(seed) - 0.5f);
+        if (dot(direction, direction) < 1e-8f) {
+            direction = vec3(1.0f, 0.0f, 0.0f);
+        }
+        direction = normalize(direction);
+        if (found) {
+            // Chaotic flow separates the copy from its donor within a few
+            // Lyapunov times, so a tiny offset is enough.
+            position += direction * 1e-3f * (1.0f + length(position));
+        } else {
+            position = direction * state.particle_spawn_radius *
+                       (0.5f + 0.5f * hash_unit(seed));
+        }
+        state.particle_positions[index] = position;
+        state.particle_still_steps[index] = 0;
+    }
+}
+
+// Stable stream compaction of the retired particles. The per-worker lists
+// cover consecutive ranges, so their concatenation is already sorted. The
+// state variables of N-dimensional particles move with their slots.
+void compact_particles(simulation_state &state) {
+    size_t write = 0;
+    size_t read = 0;
+    const size_t total = state.particle_positions.size();
+    nd_particle_field &nd = state.nd;
+    auto move_particle = [&]() {
+        state.particle_positions[write] = state.particle_positions[read];
+        state.particle_phases[write] = state.particle_phases[read];
+        state.particle_still_steps[write] = state.particle_still_steps[read];
+        state.particle_ids[write] = state.particle_ids[read];
+        for (int d = 0; d < nd.dimension; ++d) {
+            nd.components[d][write] = nd.components[d][read];
+        }
+    };
+    for (const particle_retire_list &retired : state.particle_retired) {
+        for (uint32_t index : retired.indices) {
+            for (; read < index; ++read, ++write) {
+                move_particle();
+            }
+            read = static_cast<size_t>(index) + 1;
+        }
+    }
+    if (read == write) {
+        return;
+    }
+    for (; read < total; ++read, ++write) {
+        move_particle();
+    }
+    state.particle_positions.resize(write);
+    state.particle_phases.resize(write);
+    state.particle_still_steps.resize(write);
+    state.particle_ids.resize(write);
+    for (int d = 0; d < nd.dimension; ++d) {
+        nd.components[d].resize(write);
+    }
+    state.particle_phases_dirty = true;
+    // Trail history is stored per particle slot and no longer lines up.
+    reset_trail_ring(state.particle_trails);
+}
+
+} // namespace
+
 void advance_particles(simulation_state &state, float dt) {
     const size_t particle_total = state.particle_positions.size();
     if (particle_total == 0) {
         return;
     }
 
-    auto integrate_range = [&](size_t begin, size_t end) {
-        for (size_t index = begin; index < end; ++index) {
-            state.particle_positions[index] =
-                integrate_particle_rk4(state, state.particle_positions[index],
-                                       dt);
-        }
-    };
-
-    constexpr size_t k_min_per_thread = 4096;
-    const unsigned int hardware_threads =
-        std::max(1u, thread::hardware_concurrency());
-    const unsigned int max_threads =
-        static_cast<unsigned int>((particle_total + k_min_per_thread - 1) /
-                                  k_min_per_thread);
     const unsigned int thread_count =
-        std::min(std::max(1u, max_threads), hardware_threads);
+        plan_particle_partitions(state, particle_total);
+    state.particle_positions_dirty = true;
 
-    if (thread_count <= 1) {
-        integrate_range(0, particle_total);
-        return;
+    // N-dimensional and delay particles have no vec3 derivative for the
+    // section crossings. Both handle lost particles inside their kernels;
+    // the N-dimensional one lists them for compaction like the 3D path,
+    // while the delay kernel only reseeds its escapes.
+    const bool nd = state.nd.dimension > 0;
+    const bool dde = state.dde.dimension > 0;
+    const bool sections = state.poincare.enabled && !nd && !dde;
+    if (sections) {
+        prepare_poincare(state.poincare, thread_count);
+    }
+    const bool culling = state.cull_mode != particle_cull_mode::off && !dde;
+    // Each segment runs its own system; the workers claim chunks of them.
+    const bool segmented = segments_active(state);
+    if (dde) {
+        state.particle_retired.resize(thread_count);
+        if (!dde_history_matches(state.dde, system_delay(state), dt) &&
+            !restart_dde_history(state, system_delay(state), dt)) {
+            // A longer delay or a smaller step outgrew the budget.
+            initialize_particle_field(state);
+            return;
+        }
+    }
+    if (nd) {
+        state.particle_retired.resize(thread_count);
+        nd_projection &projection = state.nd.projection;
+        if (projection.mode == nd_projection_mode::principal &&
+            (projection.refit ||
+             (projection.refit_interval > 0 &&
+              ++projection.launches_since_fit >=
+                  static_cast<uint32_t>(projection.refit_interval)))) {
+            fit_principal_projection(state.nd, particle_total);
+        }
+    }
+    if (culling) {
+        state.particle_still_steps.resize(particle_total, 0);
+        state.particle_retired.resize(thread_count);
+    }
+    const float escape_sq =
+        state.particle_escape_radius * state.particle_escape_radius;
+    const float still_distance = state.particle_stall_speed * dt;
+    const float still_sq = still_distance * still_distance;
+    const int stall_steps = std::max(state.particle_stall_steps, 1);
+    const uint32_t frame_seed = hash_particle(++state.particle_launches);
+    // Each particle's increments come from its own Philox stream, counted
+    // by state.noise.launch, which advances after the launch. The delay
+    // systems stay deterministic.
+    const bool noisy = state.noise.mode != noise_mode::off && !dde;
+    const sde_coefficients sde = make_sde_coefficients(state.noise, dt);
+
+    // Statistics are gathered inside the integration loops on sampling
+    // substeps, so they cost no extra pass over the particles.
+    bool sampling = false;
+    if (state.stats.enabled) {
+        if (state.stats.settings.auto_range && !state.stats.range_valid) {
+            vec3 low;
+            vec3 high;
+            if (compute_particle_bounds(state, low, high)) {
+                fit_invariant_range(state.stats, low, high);
+            }
+        }
+        sampling = begin_invariant_sample(state.stats, thread_count);
     }
+    const invariant_binning &binning = state.stats.binning;
+
+    // Returns whether the particle was retired.
+    auto retire_check = [&](size_t index, const vec3 &before, const vec3 &after,
+                            particle_retire_list &retired) {
+        uint16_t &still = state.particle_still_steps[index];
+        switch (classify_particle(still, before, after, escape_sq, still_sq,
+                                  stall_steps)) {
+        case particle_fate::alive:
+            return false;
+        case particle_fate::diverged:
+            ++retired.diverged;
+            break;
+        case particle_fate::stalled:
+            ++retired.stalled;
+            break;
+        }
+        still = k_particle_retired;
+        retired.indices.push_back(static_cast<uint32_t>(index));
+        return true;
+    };
 
-    vector<thread> workers;
-    workers.reserve(thread_count - 1);
-    size_t start = 0;
-    const size_t base_chunk = particle_total / thread_count;
-    const size_t remainder = particle_total % thread_count;
-    for (unsigned int t = 0; t < thread_count; ++t) {
-        const size_t chunk = base_chunk + (t < remainder ? 1 : 0);
-        const size_t end = start + chunk;
-        if (t + 1 == thread_count) {
-            integrate_range(start, end);
+    // Segments other than 0 run their own system and are not measured.
+    auto integrate_range = [&](size_t begin, size_t end, unsigned int worker,
+                               size_t segment) {
+        invariant_accumulator *samples =
+            sampling && segment == 0 ? &state.stats.threads[worker] : nullptr;
+        if (nd) {
+            integrate_nd_range(state, begin, end, dt,
+                               noisy ? &sde : nullptr, samples,
+                               state.particle_retired[worker]);
+            return;
+        }
+        if (dde) {
+            integrate_dde_range(state, begin, end, samples,
+                                state.particle_retired[worker].diverged);
+            return;
+        }
+        particle_noise noise;
+        noise.seed = state.noise.seed;
+        noise.launch = state.noise.launch;
+        const system_params &params = segment_params(state, segment);
+        particle_lane_steps lane_steps;
+        lane_steps.params = &params;
+        lane_steps.positions = state.particle_positions.data();
+        lane_steps.dt = dt;
+        lane_steps.end = end;
+        const bool in_lanes =
+            !noisy && system_steps_in_lanes(params.current_system);
+        auto integrate_particle = [&](size_t index, const vec3 &position) {
+            if (in_lanes) {
+                return lane_steps.at(index);
+            }
+            if (!noisy) {
+                return integrate_particle_rk4(params, position, dt);
+            }
+            return integrate_particle_sde(params, sde, position,
+                                          noise.at(index));
+        };
+        const size_t first_retired =
+            culling ? state.particle_retired[worker].indices.size() : 0;
+        if (sections && segment == 0) {
+            vector<section_hit> &hits = state.poincare.thread_hits[worker];
+            for (size_t index = begin; index < end; ++index) {
+                const vec3 before = state.particle_positions[index];
+                const vec3 after = integrate_particle(index, before);
+                detect_section_crossings(state, before, after, dt, hits);
+                state.particle_positions[index] = after;
+                const bool retired =
+                    culling && retire_check(index, before, after,
+                                            state.particle_retired[worker]);
+                if (samples && !retired) {
+                    accumulate_sample(*samples, binning, after);
+                }
+            }
+        } else if (culling) {
+            particle_retire_list &retired = state.particle_retired[worker];
+            for (size_t index = begin; index < end; ++index) {
+                const vec3 before = state.particle_positions[index];
+                const vec3 after = integrate_particle(index, before);
+                state.particle_positions[index] = after;
+                if (!retire_check(index, before, after, retired) && samples) {
+                    accumulate_sample(*samples, binning, after);
+                }
+            }
+        } else if (samples) {
+            for (size_t index = begin; index < end; ++index) {
+                const vec3 after =
+                    integrate_particle(index, state.particle_positions[index]);
+                state.particle_positions[index] = after;
+                accumulate_sample(*samples, binning, after);
+            }
         } else {
-            workers.emplace_back([&, start, end]() { integrate_range(start, end); });
+            for (size_t index = begin; index < end; ++index) {
+                state.particle_positions[index] =
+                    integrate_particle(index, state.particle_positions[index]);
+            }
+        }
+        if (culling && state.cull_mode == particle_cull_mode::respawn) {
+            respawn_retired(state, begin, end, state.particle_retired[worker],
+                            first_retired, frame_seed);
+        }
+        CHAOSEQ_PROFILE_COUNT(profile_counter::particle_steps, end - begin);
+        CHAOSEQ_PROFILE_COUNT(profile_counter::derivative_evaluations,
+                              (noisy ? 1 : 4) * (end - begin));
+    };
+
+    auto finish_retired = [&]() {
+        if (!culling) {
+            return;
+        }
+        CHAOSEQ_PROFILE_SCOPE("finish_retired");
+        size_t retired_total = 0;
+        for (const particle_retire_list &retired : state.particle_retired) {
+            state.particles_diverged += retired.diverged;
+            state.particles_stalled += retired.stalled;
+            retired_total += retired.indices.size();
+        }
+        if (state.cull_mode == particle_cull_mode::compact) {
+            if (segmented) {
+                // Chunks were claimed out of order; compaction needs the
+                // retired indices sorted.
+                vector<particle_retire_list> &lists = state.particle_retired;
+                for (size_t list = 1; list < lists.size(); ++list) {
+                    lists[0].indices.insert(lists[0].indices.end(),
+                                            lists[list].indices.begin(),
+                                            lists[list].indices.end());
+                    lists[list].indices.clear();
+                }
+                sort(lists[0].indices.begin(), lists[0].indices.end());
+            }
+            compact_particles(state);
+            if (segmented) {
+                shrink_segment_ranges(state.segments,
+                                      state.particle_retired[0].indices);
+            }
+        } else {
+            state.particles_respawned += retired_total;
+        }
+        for (particle_retire_list &retired : state.particle_retired) {
+            retired.indices.clear();
+            retired.diverged = 0;
+            retired.stalled = 0;
+        }
+    };
+
+    if (segmented) {
+        run_segment_chunks(state, thread_count,
+                           [&](const segment_chunk &chunk,
+                               unsigned int worker) {
+                               CHAOSEQ_PROFILE_SCOPE("integrate_range");
+                               integrate_range(chunk.begin, chunk.end, worker,
+                                               chunk.segment);
+                           });
+    } else {
+        run_particle_partitions(
+            state, [&](size_t begin, size_t end, unsigned int worker) {
+                CHAOSEQ_PROFILE_SCOPE("integrate_range");
+                integrate_range(begin, end, worker, 0);
+            });
+    }
+    if (sections) {
+        CHAOSEQ_PROFILE_SCOPE("merge_section_hits");
+        merge_section_hits(state.poincare);
+    }
+    if (dde) {
+        ++state.dde.step;
+    }
+    if ((nd && !culling) || dde) {
+        for (particle_retire_list &retired : state.particle_retired) {
+            state.particles_diverged += retired.diverged;
+            if (state.cull_mode != particle_cull_mode::off) {
+                state.particles_respawned += retired.diverged;
+            }
+            retired.diverged = 0;
         }
-        start = end;
     }
-    for (thread &worker : workers) {
-        worker.join();
+    if (sampling) {
+        finish_invariant_sample(state.stats, state.t + dt);
+    }
+    if (noisy) {
+        ++state.noise.launch;
+    }
+    finish_retired();
+}
+
+void publish_particle_frame(simulation_state &state) {
+    CHAOSEQ_PROFILE_SCOPE("publish_particle_frame");
+    const size_t count = state.particle_positions.size();
+    float *out = begin_frame(state.stream, count);
+    if (!out) {
+        return;
     }
+    plan_particle_partitions(state, count);
+    uint32_t *ids = frame_ids(out, count);
+    run_particle_partitions(
+        state, [&](size_t begin, size_t end, unsigned int) {
+            memcpy(out + 3 * begin, state.particle_positions.data() + begin,
+                   (end - begin) * sizeof(vec3));
+            memcpy(ids + begin, state.particle_ids.data() + begin,
+                   (end - begin) * sizeof(uint32_t));
+        });
+    end_frame(state.stream, state, state.t, count);
 }
 
 bool compute_particle_bounds(const simulation_state &state, vec3 &out_min,
                              vec3 &out_max) {
-    if (state.particle_positions.empty()) {
+    const size_t count = primary_segment_count(state);
+    if (count == 0) {
         return false;
     }
     out_min = state.particle_positions.front();
     out_max = out_min;
-    for (const vec3 &position : state.particle_positions) {
-        out_min = glm::min(out_min, position);
-        out_max = glm::max(out_max, position);
+    for (size_t index = 1; index < count; ++index) {
+        out_min = glm::min(out_min, state.particle_positions[index]);
+        out_max = glm::max(out_max, state.particle_positions[index]);
     }
     return true;
 }
@@ -259,7 +769,7 @@ void create_axes(simulation_state &state) {
     glBindVertexArray(0);
 }
 
-glm::vec3 reset_simulation(simulation_state &state) {
+vector<float> build_active_system(simulation_state &state) {
     vector<float> initial_state{0.1f, 0.0f, 0.0f};
 
     switch (state.current_system) {
@@ -304,23 +814,87 @@ glm::vec3 reset_simulation(simulation_state &state) {
         state.system = make_four_wing_system(state.four_wing_args);
         initial_state = {0.1f, 0.1f, 0.1f};
         break;
+    case system_type::hyper_rossler:
+        state.system = make_hyper_rossler_system(state.hyper_rossler_args);
+        initial_state = {-10.0f, -6.0f, 0.0f, 10.0f};
+        break;
+    case system_type::lorenz_stenflo:
+        state.system = make_lorenz_stenflo_system(state.lorenz_stenflo_args);
+        initial_state = {1.0f, 1.0f, 1.0f, 1.0f};
+        break;
+    case system_type::mackey_glass:
+    case system_type::delayed_lorenz: {
+        // The reference follows particle 0, which keeps its own history;
+        // the system only carries the dimension.
+        const int dimension = system_dimension(state.current_system);
+        state.system = ODESystem{};
+        state.system.dim = dimension;
+        state.system.deriv = [dimension](const vector<float> &,
+                                         vector<float> &derivative, float) {
+            derivative.assign(static_cast<size_t>(dimension), 0.0f);
+        };
+        if (state.current_system == system_type::mackey_glass) {
+            initial_state = {1.2f};
+        } else {
+            initial_state = {1.0f, 1.0f, 1.0f};
+        }
+        break;
+    }
+    }
+    return initial_state;
+}
+
+vec3 trajectory_point(const simulation_state &state) {
+    if (state.dde.dimension > 0 && !state.particle_positions.empty()) {
+        return state.particle_positions[0];
+    }
+    const int dimension = static_cast<int>(state.state.size());
+    if (dimension > 3) {
+        return project_nd_state(state.nd.projection, dimension,
+                                state.state.data());
     }
+    return vec3(state.state[0], state.state[1], state.state[2]);
+}
 
-    state.state = initial_state;
+glm::vec3 reset_simulation(simulation_state &state, bool seed_particles) {
+    state.state = build_active_system(state);
+    const int dimension = system_dimension(state.current_system);
+    if (dimension > 3) {
+        for (int d = 0; d < k_max_system_dimension; ++d) {
+            state.nd.spawn_center[d] =
+                d < dimension ? state.state[static_cast<size_t>(d)] : 0.0f;
+        }
+        update_nd_projection(state.nd.projection, dimension);
+        state.nd.projection.refit = true;
+    }
+    if (system_has_delay(state.current_system)) {
+        for (int d = 0; d < 3; ++d) {
+            state.dde.spawn_center[d] =
+                d < dimension ? state.state[static_cast<size_t>(d)] : 0.0f;
+        }
+    }
     state.t = 0.0f;
     state.time_accumulator = 0.0f;
     state.integrator = IntegratorRK4{};
+    state.trails_last_t = -1.0f;
+    state.trajectory_pending.clear();
+    reset_trail_ring(state.trajectory_trail);
+    clear_poincare(state.poincare);
+    clear_invariant_stats(state.stats);
 
-    initialize_particle_field(state);
-    update_particle_gpu(state);
+    if (seed_particles) {
+        initialize_particle_field(state);
+        update_particle_gpu(state);
+    }
 
-    return vec3(state.state[0], state.state[1], state.state[2]);
+    return trajectory_point(state);
 }
 
 void step_simulation(simulation_state &state, float frame_dt) {
     if (state.paused) {
         return;
     }
+    CHAOSEQ_PROFILE_SCOPE("step_simulation");
 
     state.time_accumulator += frame_dt;
     const float max_accumulator = 2.0f;
@@ -330,11 +904,26 @@ void step_simulation(simulation_state &state, float frame_dt) {
 
     const float step_dt = glm::clamp(state.base_dt, 1e-6f, 0.2f);
 
+    // The lattice probe's delay embedding replaces the reference trajectory.
+    lattice_state &lattice = state.lattice;
+    const bool lattice_embedding =
+        lattice.enabled && lattice.settings.embed_in_view;
+
     int iterations = 0;
     constexpr int max_iterations = 4096;
     while (state.time_accumulator >= step_dt && iterations < max_iterations) {
-        state.integrator.step(state.system, state.state, state.t, step_dt);
-        advance_particles(state, step_dt);
+        if (state.dde.dimension > 0) {
+            advance_particles(state, step_dt);
+            dde_particle_state(state.dde, 0, state.state.data());
+        } else {
+            state.integrator.step(state.system, state.state, state.t,
+                                  step_dt);
+            CHAOSEQ_PROFILE_COUNT(profile_counter::derivative_evaluations, 4);
+            advance_particles(state, step_dt);
+        }
+        if (state.show_trajectory && !lattice_embedding) {
+            state.trajectory_pending.push_back(trajectory_point(state));
+        }
         state.t += step_dt;
         state.time_accumulator -= step_dt;
         ++iterations;
@@ -342,13 +931,29 @@ void step_simulation(simulation_state &state, float frame_dt) {
     if (iterations == max_iterations) {
         state.time_accumulator = 0.0f;
     }
+    if (iterations > 0) {
+        update_particle_order(state);
+        update_segment_layout(state);
+    }
+    if (iterations > 0 && state.stream.enabled) {
+        publish_particle_frame(state);
+    }
+    if (lattice.enabled) {
+        if (lattice.current.empty()) {
+            reset_lattice(lattice, state.workers);
+        }
+        advance_lattice(lattice, state.workers,
+                        lattice.settings.steps_per_frame,
+                        state.show_trajectory && lattice_embedding
+                            ? &state.trajectory_pending
+                            : nullptr);
+    }
 }
 
-void draw_particles(const Shader &shader, const simulation_state &state,
-                    const mat4 &view_matrix, const mat4 &projection) {
-    if (state.particle_positions.empty()) {
-        return;
-    }
+static void set_particle_uniforms(const Shader &shader,
+                                  const simulation_state &state,
+                                  const mat4 &view_matrix,
+                                  const mat4 &projection) {
     shader.use();
     shader.set_mat4("uView", view_matrix);
     shader.set_mat4("uProj", projection);
@@ -356,11 +961,347 @@ void draw_particles(const Shader &shader, const simulation_state &state,
     shader.set_float("uTime", state.t);
     shader.set_float("uColorSpeed", state.particle_color_speed);
     shader.set_int("uMonochrome", state.particles_monochrome ? 1 : 0);
+    set_segment_uniforms(shader, state);
+}
+
+void draw_particles(const Shader &shader, const simulation_state &state,
+                    const mat4 &view_matrix, const mat4 &projection) {
+    if (state.particle_positions.empty()) {
+        return;
+    }
+    CHAOSEQ_PROFILE_SCOPE("draw_particles");
+    CHAOSEQ_PROFILE_GPU_SCOPE("draw_particles");
+    set_particle_uniforms(shader, state, view_matrix, projection);
     glBindVertexArray(state.particle_vao);
     glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(state.particle_positions.size()));
     glBindVertexArray(0);
 }
 
+void ensure_hdr_target(simulation_state &state, int width, int height) {
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    if (state.hdr_fbo != 0 && state.hdr_width == width &&
+        state.hdr_height == height) {
+        return;
+    }
+    if (state.hdr_fbo == 0) {
+        glGenFramebuffers(1, &state.hdr_fbo);
+        glGenTextures(1, &state.hdr_color_texture);
+    }
+    if (state.fullscreen_vao == 0) {
+        glGenVertexArrays(1, &state.fullscreen_vao);
+    }
+    glBindTexture(GL_TEXTURE_2D, state.hdr_color_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA,
+                 GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, state.hdr_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           state.hdr_color_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        cerr << "HDR accumulation framebuffer is incomplete\n";
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, state.frame_fbo);
+    state.hdr_width = width;
+    state.hdr_height = height;
+}
+
+void create_offscreen_frame(simulation_state &state, int width, int height) {
+    constexpr GLsizei k_samples = 4; // as the window requests
+    glGenFramebuffers(1, &state.frame_fbo);
+    glGenRenderbuffers(1, &state.frame_color_rbo);
+    glGenRenderbuffers(1, &state.frame_depth_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, state.frame_color_rbo);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, k_samples, GL_RGBA8,
+                                     width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, state.frame_depth_rbo);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, k_samples,
+                                     GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, state.frame_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, state.frame_color_rbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, state.frame_depth_rbo);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        cerr << "Offscreen frame framebuffer is incomplete\n";
+    }
+}
+
+void release_render_targets(simulation_state &state) {
+    if (state.hdr_fbo != 0) {
+        glDeleteFramebuffers(1, &state.hdr_fbo);
+        glDeleteTextures(1, &state.hdr_color_texture);
+        state.hdr_fbo = 0;
+        state.hdr_color_texture = 0;
+        state.hdr_width = 0;
+        state.hdr_height = 0;
+    }
+    if (state.raster_accum_ssbo != 0) {
+        glDeleteBuffers(1, &state.raster_accum_ssbo);
+        state.raster_accum_ssbo = 0;
+        state.raster_width = 0;
+        state.raster_height = 0;
+    }
+    if (state.fullscreen_vao != 0) {
+        glDeleteVertexArrays(1, &state.fullscreen_vao);
+        state.fullscreen_vao = 0;
+    }
+    if (state.frame_fbo != 0) {
+        glDeleteFramebuffers(1, &state.frame_fbo);
+        glDeleteRenderbuffers(1, &state.frame_color_rbo);
+        glDeleteRenderbuffers(1, &state.frame_depth_rbo);
+        state.frame_fbo = 0;
+        state.frame_color_rbo = 0;
+        state.frame_depth_rbo = 0;
+    }
+}
+
+void draw_particles_hdr(const Shader &accum_shader,
+                        const Shader &tonemap_shader, simulation_state &state,
+                        const mat4 &view_matrix, const mat4 &projection,
+                        int width, int height) {
+    if (state.particle_positions.empty()) {
+        return;
+    }
+    CHAOSEQ_PROFILE_SCOPE("draw_particles");
+    CHAOSEQ_PROFILE_GPU_SCOPE("draw_particles");
+    ensure_hdr_target(state, width, height);
+
+    // Additive blending is commutative, so the result no longer depends on
+    // draw order and the accumulation pass needs no depth buffer at all.
+    glBindFramebuffer(GL_FRAMEBUFFER, state.hdr_fbo);
+    glViewport(0, 0, state.hdr_width, state.hdr_height);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    set_particle_uniforms(accum_shader, state, view_matrix, projection);
+    accum_shader.set_float("uIntensity", state.hdr_intensity);
+    glBindVertexArray(state.particle_vao);
+    glDrawArrays(GL_POINTS, 0,
+                 static_cast<GLsizei>(state.particle_positions.size()));
+
+    glBindFramebuffer(GL_FRAMEBUFFER, state.frame_fbo);
+    glViewport(0, 0, width, height);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    tonemap_shader.use();
+    tonemap_shader.set_int("uAccum", 0);
+    tonemap_shader.set_float("uExposure", state.hdr_exposure);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, state.hdr_color_texture);
+    glBindVertexArray(state.fullscreen_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void ensure_raster_target(simulation_state &state, int width, int height) {
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    if (state.raster_accum_ssbo != 0 && state.raster_width == width &&
+        state.raster_height == height) {
+        return;
+    }
+    if (state.raster_accum_ssbo == 0) {
+        glGenBuffers(1, &state.raster_accum_ssbo);
+    }
+    if (state.fullscreen_vao == 0) {
+        glGenVertexArrays(1, &state.fullscreen_vao);
+    }
+    const size_t bytes = static_cast<size_t>(width) *
+                         static_cast<size_t>(height) * 4 * sizeof(GLuint);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.raster_accum_ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(bytes),
+                 nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    state.raster_width = width;
+    state.raster_height = height;
+}
+
+void draw_particles_compute(const Shader &raster_shader,
+                            const Shader &resolve_shader,
+                            simulation_state &state, const mat4 &view_matrix,
+                            const mat4 &projection, int width, int height) {
+    if (state.particle_positions.empty()) {
+        return;
+    }
+    CHAOSEQ_PROFILE_SCOPE("draw_particles");
+    CHAOSEQ_PROFILE_GPU_SCOPE("draw_particles");
+    ensure_raster_target(state, width, height);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.raster_accum_ssbo);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                      GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, state.particle_pos_vbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, state.particle_phase_vbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, state.raster_accum_ssbo);
+
+    constexpr GLuint k_group_size = 256;
+    const GLuint count = static_cast<GLuint>(state.particle_positions.size());
+    set_particle_uniforms(raster_shader, state, view_matrix, projection);
+    raster_shader.set_int("uCount", static_cast<int>(count));
+    raster_shader.set_int("uWidth", state.raster_width);
+    raster_shader.set_int("uHeight", state.raster_height);
+    raster_shader.set_float("uIntensity", state.hdr_intensity);
+    glDispatchCompute((count + k_group_size - 1) / k_group_size, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    resolve_shader.use();
+    resolve_shader.set_int("uWidth", state.raster_width);
+    resolve_shader.set_float("uExposure", state.hdr_exposure);
+    glBindVertexArray(state.fullscreen_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+
+    for (GLuint binding = 0; binding < 3; ++binding) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    }
+}
+
+void upload_stats_texture(simulation_state &state) {
+    const invariant_stats &stats = state.stats;
+    const int size = stats.settings.projection_size;
+    const size_t texels = static_cast<size_t>(size) * static_cast<size_t>(size);
+    if (stats.total.projection.size() != texels) {
+        return;
+    }
+    if (state.stats_texture == 0) {
+        glGenTextures(1, &state.stats_texture);
+        glBindTexture(GL_TEXTURE_2D, state.stats_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    const vector<uint32_t> &counts = stats.total.projection;
+    const uint32_t peak = *max_element(counts.begin(), counts.end());
+    vector<uint32_t> pixels(texels, 0xFF000000u);
+    if (peak > 0) {
+        const float scale = 1.0f / std::log1p(static_cast<float>(peak));
+        for (size_t i = 0; i < texels; ++i) {
+            if (counts[i] == 0) {
+                continue;
+            }
+            const float value =
+                std::log1p(static_cast<float>(counts[i])) * scale;
+            const uint32_t r = static_cast<uint32_t>(255.0f * std::sqrt(value));
+            const uint32_t g = static_cast<uint32_t>(255.0f * value);
+            const uint32_t b =
+                static_cast<uint32_t>(255.0f * (0.35f + 0.65f * value * value));
+            pixels[i] = 0xFF000000u | (b << 16) | (g << 8) | r;
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, state.stats_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void release_stats_gpu(simulation_state &state) {
+    if (state.stats_texture != 0) {
+        glDeleteTextures(1, &state.stats_texture);
+        state.stats_texture = 0;
+    }
+}
+
+void update_trails_gpu(simulation_state &state) {
+    CHAOSEQ_PROFILE_SCOPE("update_trails_gpu");
+    const size_t budget_bytes =
+        static_cast<size_t>(state.trail_budget_mb * 1024.0f * 1024.0f);
+
+    if (state.show_trajectory) {
+        ensure_trail_ring(state.trajectory_trail, 1,
+                          trail_length_within_budget(
+                              1, state.trajectory_trail_length, budget_bytes));
+        push_trail_points(state.trajectory_trail,
+                          state.trajectory_pending.data(),
+                          state.trajectory_pending.size());
+    }
+    state.trajectory_pending.clear();
+
+    const size_t particle_total = state.particle_positions.size();
+    if (!state.show_particle_trails || particle_total == 0) {
+        release_trail_ring(state.particle_trails);
+        return;
+    }
+    const int length = trail_length_within_budget(
+        particle_total, state.particle_trail_length, budget_bytes);
+    if (length < 2) {
+        release_trail_ring(state.particle_trails);
+        return;
+    }
+    if (ensure_trail_ring(state.particle_trails, particle_total, length)) {
+        glBindVertexArray(state.particle_trails.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, state.particle_phase_vbo);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(float),
+                              static_cast<void *>(nullptr));
+        glVertexAttribDivisor(1, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    // One slice per simulated frame, copied on the GPU from the position VBO
+    // that update_particle_gpu just filled.
+    if (state.t != state.trails_last_t) {
+        copy_trail_slice(state.particle_trails, state.particle_pos_vbo);
+        state.trails_last_t = state.t;
+    }
+}
+
+void draw_trails(const Shader &shader, const simulation_state &state,
+                 const mat4 &view_proj) {
+    const bool particle_trails = state.show_particle_trails &&
+                                 state.particle_trails.filled >= 2;
+    const bool trajectory = state.show_trajectory &&
+                            state.trajectory_trail.filled >= 2;
+    if (!particle_trails && !trajectory) {
+        return;
+    }
+    CHAOSEQ_PROFILE_SCOPE("draw_trails");
+    CHAOSEQ_PROFILE_GPU_SCOPE("draw_trails");
+    glDepthMask(GL_FALSE);
+    shader.use();
+    shader.set_mat4("uViewProj", view_proj);
+    set_segment_uniforms(shader, state);
+    shader.set_float("uTime", state.t);
+    shader.set_float("uColorSpeed", state.particle_color_speed);
+    shader.set_int("uMonochrome", state.particles_monochrome ? 1 : 0);
+    if (particle_trails) {
+        shader.set_int("uUsePhase", 1);
+        shader.set_float("uOpacity", state.trail_opacity);
+        draw_trail_ring(shader, state.particle_trails);
+    }
+    if (trajectory) {
+        shader.set_int("uUsePhase", 0);
+        shader.set_vec3("uColor", state.trajectory_color);
+        shader.set_float("uOpacity", 1.0f);
+        draw_trail_ring(shader, state.trajectory_trail);
+    }
+    glDepthMask(GL_TRUE);
+}
+
+void release_trails(simulation_state &state) {
+    release_trail_ring(state.particle_trails);
+    release_trail_ring(state.trajectory_trail);
+}
+
 void draw_axes(const Shader &shader, const simulation_state &state,
                const mat4 &mvp) {
     if (!state.show_axes) {
@@ -412,7 +1353,7 @@ void sync_fps_from_orbit(const orbit_camera &orbit, Camera &fps) {
 void frame_particles(simulation_state &state, orbit_camera &orbit, Camera &fps,
                      bool &orbit_dragging) {
     vec3 bounds_min, bounds_max;
-    if (!compute_particle_bounds(state, bounds_min, bounds_max)) {
+    if (!placed_particle_bounds(state, bounds_min, bounds_max)) {
         return;
     }
     const vec3 center = 0.5f * (bounds_min + bounds_max);
@@ -0,0 +1,273 @@
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+constexpr char k_snapshot_magic[8] = {'C', 'H', 'A', 'O', 'S', 'N', 'A', 'P'};
+constexpr uint32_t k_snapshot_version = 1;
+constexpr uint64_t k_snapshot_block_alignment = 4096;
+
+static_assert(is_trivially_copyable<system_params>::value,
+              "system_params is written to snapshots as raw bytes");
+static_assert(sizeof(vec3) == 3 * sizeof(float),
+              "particle positions are stored as packed float triples");
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;
+    uint32_t params_bytes;
+    uint32_t camera_mode;
+
+    float t;
+    float base_dt;
+    float trajectory[3];
+
+    float camera_position[3];
+    float camera_yaw;
+    float camera_pitch;
+    float camera_fov;
+
+    float orbit_target[3];
+    float orbit_radius;
+    float orbit_yaw;
+    float orbit_pitch;
+
+    uint64_t particle_count;
+    uint64_t params_offset;
+    uint64_t positions_offset;
+    uint64_t phases_offset;
+    uint64_t file_bytes;
+};
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool valid_system(uint32_t value) {
+    return value <= static_cast<uint32_t>(system_type::four_wing);
+}
+
+} // namespace
+
+bool save_snapshot(const simulation_state &state, const Camera &camera,
+                   const orbit_camera &orbit, const char *path) {
+    if (state.nd.dimension > 0 || state.dde.dimension > 0) {
+        cerr << "Snapshots hold three-variable particle fields only\n";
+        return false;
+    }
+    snapshot_header header{};
+    memcpy(header.magic, k_snapshot_magic, sizeof(header.magic));
+    header.version = k_snapshot_version;
+    header.header_bytes = sizeof(snapshot_header);
+    header.params_bytes = sizeof(system_params);
+    header.camera_mode = static_cast<uint32_t>(state.current_camera_mode);
+    header.t = state.t;
+    header.base_dt = state.base_dt;
+    for (size_t i = 0; i < 3 && i < state.state.size(); ++i) {
+        header.trajectory[i] = state.state[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        header.camera_position[i] = camera.position[i];
+        header.orbit_target[i] = orbit.target[i];
+    }
+    header.camera_yaw = camera.yaw;
+    header.camera_pitch = camera.pitch;
+    header.camera_fov = camera.fov;
+    header.orbit_radius = orbit.radius;
+    header.orbit_yaw = orbit.yaw;
+    header.orbit_pitch = orbit.pitch;
+
+    // The header holds one parameter set, so with segments active only the
+    // particles of segment 0, at the front of the arrays, are written.
+    const uint64_t count = primary_segment_count(state);
+    const uint64_t positions_bytes = count * sizeof(vec3);
+    const uint64_t phases_bytes = count * sizeof(float);
+    header.particle_count = count;
+    header.params_offset = sizeof(snapshot_header);
+    header.positions_offset =
+        align_up(header.params_offset + sizeof(system_params),
+                 k_snapshot_block_alignment);
+    header.phases_offset = align_up(header.positions_offset + positions_bytes,
+                                    k_snapshot_block_alignment);
+    header.file_bytes = header.phases_offset + phases_bytes;
+
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out) {
+        cerr << "Failed to open snapshot file: " << path << "\n";
+        return false;
+    }
+    const system_params &params = state;
+    auto pad_to = [&](uint64_t offset) {
+        static const char zeros[k_snapshot_block_alignment] = {};
+        const uint64_t position = static_cast<uint64_t>(out.tellp());
+        if (offset > position) {
+            out.write(zeros, static_cast<streamsize>(offset - position));
+        }
+    };
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(&params), sizeof(params));
+    pad_to(header.positions_offset);
+    out.write(reinterpret_cast<const char *>(state.particle_positions.data()),
+              static_cast<streamsize>(positions_bytes));
+    pad_to(header.phases_offset);
+    out.write(reinterpret_cast<const char *>(state.particle_phases.data()),
+              static_cast<streamsize>(phases_bytes));
+    out.close();
+    if (!out) {
+        cerr << "Failed to write snapshot file: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool load_snapshot(simulation_state &state, Camera &camera,
+                   orbit_camera &orbit, const char *path) {
+    const auto start = chrono::steady_clock::now();
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        cerr << "Failed to open snapshot file: " << path << "\n";
+        return false;
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0 ||
+        static_cast<uint64_t>(info.st_size) < sizeof(snapshot_header)) {
+        cerr << "Snapshot file is truncated: " << path << "\n";
+        close(fd);
+        return false;
+    }
+    const size_t file_bytes = static_cast<size_t>(info.st_size);
+    void *mapping = mmap(nullptr, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        cerr << "Failed to map snapshot file: " << path << "\n";
+        return false;
+    }
+    madvise(mapping, file_bytes, MADV_WILLNEED);
+    const char *bytes = static_cast<const char *>(mapping);
+
+    snapshot_header header;
+    memcpy(&header, bytes, sizeof(header));
+    const uint64_t positions_bytes = header.particle_count * sizeof(vec3);
+    const uint64_t phases_bytes = header.particle_count * sizeof(float);
+    const char *error = nullptr;
+    if (memcmp(header.magic, k_snapshot_magic, sizeof(header.magic)) != 0) {
+        error = "not a snapshot file";
+    } else if (header.version != k_snapshot_version ||
+               header.header_bytes != sizeof(snapshot_header) ||
+               header.params_bytes != sizeof(system_params)) {
+        error = "snapshot was written by an incompatible build";
+    } else if (header.file_bytes != file_bytes ||
+               header.particle_count == 0 ||
+               header.particle_count > file_bytes / sizeof(vec3) ||
+               header.params_offset + sizeof(system_params) > file_bytes ||
+               header.positions_offset + positions_bytes > file_bytes ||
+               header.phases_offset + phases_bytes > file_bytes) {
+        error = "snapshot file is truncated or corrupt";
+    }
+    system_params params;
+    if (!error) {
+        memcpy(&params, bytes + header.params_offset, sizeof(params));
+        if (!valid_system(static_cast<uint32_t>(params.current_system))) {
+            error = "snapshot names an unknown system";
+        }
+    }
+    if (error) {
+        cerr << "Failed to load snapshot " << path << ": " << error << "\n";
+        munmap(mapping, file_bytes);
+        return false;
+    }
+
+    static_cast<system_params &>(state) = params;
+    build_active_system(state);
+    state.state.assign(header.trajectory, header.trajectory + 3);
+    state.t = header.t;
+    state.base_dt = glm::clamp(header.base_dt, 1e-6f, 0.2f);
+    state.time_accumulator = 0.0f;
+    state.integrator = IntegratorRK4{};
+    state.current_camera_mode = header.camera_mode == 1 ? camera_mode::orbit
+                                                        : camera_mode::fps;
+    state.trails_last_t = -1.0f;
+    state.trajectory_pending.clear();
+    reset_trail_ring(state.trajectory_trail);
+    reset_trail_ring(state.particle_trails);
+    clear_poincare(state.poincare);
+    clear_invariant_stats(state.stats);
+
+    camera.position = vec3(header.camera_position[0],
+                           header.camera_position[1],
+                           header.camera_position[2]);
+    camera.yaw = header.camera_yaw;
+    camera.pitch = header.camera_pitch;
+    camera.fov = header.camera_fov;
+    camera.first_mouse = true;
+    orbit.target = vec3(header.orbit_target[0], header.orbit_target[1],
+                        header.orbit_target[2]);
+    orbit.radius = header.orbit_radius;
+    orbit.yaw = header.orbit_yaw;
+    orbit.pitch = header.orbit_pitch;
+    orbit.clamp_pitch();
+    orbit.clamp_radius();
+
+    // The mapped blocks go to the driver as they are; the CPU copies are
+    // only needed because the integrator runs on the host.
+    const size_t count = static_cast<size_t>(header.particle_count);
+    const char *positions = bytes + header.positions_offset;
+    const char *phases = bytes + header.phases_offset;
+    ensure_particle_buffers(state);
+    glBindBuffer(GL_ARRAY_BUFFER, state.particle_pos_vbo);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(positions_bytes),
+                 positions, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, state.particle_phase_vbo);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(phases_bytes), phases,
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    state.particle_buffer_capacity = count;
+    state.particle_phases_dirty = false;
+    state.particle_positions_dirty = false;
+
+    // The partition owners do the copies, so the host arrays end up on the
+    // memory node of the worker that integrates them.
+    state.particle_count = count;
+    allocate_particle_arrays(state, count);
+    plan_particle_partitions(state, count);
+    run_particle_partitions(state, [&](size_t begin, size_t end,
+                                       unsigned int) {
+        memcpy(state.particle_positions.data() + begin,
+               positions + begin * sizeof(vec3), (end - begin) * sizeof(vec3));
+        memcpy(state.particle_phases.data() + begin,
+               phases + begin * sizeof(float), (end - begin) * sizeof(float));
+        fill(state.particle_still_steps.begin() + begin,
+             state.particle_still_steps.begin() + end, uint16_t{0});
+        iota(state.particle_ids.begin() + begin,
+             state.particle_ids.begin() + end, static_cast<uint32_t>(begin));
+    });
+    state.particles_diverged = 0;
+    state.particles_stalled = 0;
+    state.particles_respawned = 0;
+    state.reorder.pending = true;
+    // Snapshots hold one system; the extra segments are not saved.
+    state.segments.enabled = false;
+
+    munmap(mapping, file_bytes);
+    const double elapsed_ms =
+        chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+            .count();
+    cout << "Loaded snapshot " << path << " (" << count << " particles) in "
+         << elapsed_ms << " ms\n";
+    return true;
+}
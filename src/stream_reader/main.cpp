@@ -0,0 +1,90 @@
+#include "frame_stream.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Example client of the live frame stream: follows the viewer's frames and
+// prints one line per frame it reads. It reopens the stream when the viewer
+// restarts or grows the region.
+
+static void print_usage(const char *program) {
+    cerr << "Usage: " << program << " [options] [/name]\n"
+         << "  /name        shared-memory region (default "
+         << k_default_frame_stream_name << ")\n"
+         << "  --frames <n> exit after n frames (default: run until the "
+            "viewer exits)\n";
+}
+
+int main(int argc, char **argv) {
+    string name = k_default_frame_stream_name;
+    long long frame_limit = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            char *end = nullptr;
+            frame_limit = strtoll(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || frame_limit < 0) {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i][0] == '/') {
+            name = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    frame_stream_reader reader;
+    frame_info info;
+    vector<float> xyz;
+    vector<uint32_t> ids;
+    long long frames = 0;
+    bool waiting_reported = false;
+    while (frame_limit == 0 || frames < frame_limit) {
+        if (!reader.header && !open_frame_stream_reader(reader, name)) {
+            if (!waiting_reported) {
+                cerr << "Waiting for frame stream " << name << "\n";
+                waiting_reported = true;
+            }
+            this_thread::sleep_for(chrono::milliseconds(250));
+            continue;
+        }
+        const frame_read_result result = read_frame(reader, info, xyz, &ids);
+        if (result == frame_read_result::closed) {
+            close_frame_stream_reader(reader);
+            waiting_reported = false;
+            continue;
+        }
+        if (result == frame_read_result::no_frame) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+            continue;
+        }
+        const size_t count = ids.size();
+        double center[3] = {};
+        for (size_t p = 0; p < count; ++p) {
+            for (int axis = 0; axis < 3; ++axis) {
+                center[axis] += xyz[3 * p + static_cast<size_t>(axis)];
+            }
+        }
+        for (double &value : center) {
+            value /= static_cast<double>(count > 0 ? count : 1);
+        }
+        printf("frame %llu  t %.3f  %s  %zu particles  mean (%.3f, %.3f, "
+               "%.3f)  skipped %llu\n",
+               static_cast<unsigned long long>(info.sequence),
+               static_cast<double>(info.time), system_name(info.system),
+               count, center[0], center[1], center[2],
+               static_cast<unsigned long long>(reader.frames_skipped));
+        ++frames;
+    }
+    close_frame_stream_reader(reader);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#include "system_params.hpp"
+
+using namespace std;
+
+namespace {
+
+constexpr system_type k_all_systems[] = {
+    system_type::lorenz,
+    system_type::rossler,
+    system_type::thomas,
+    system_type::aizawa,
+    system_type::dadras,
+    system_type::chen,
+    system_type::lorenz83,
+    system_type::halvorsen,
+    system_type::rabinovich,
+    system_type::three_scroll,
+    system_type::sprott,
+    system_type::four_wing,
+    system_type::hyper_rossler,
+    system_type::lorenz_stenflo,
+    system_type::mackey_glass,
+    system_type::delayed_lorenz};
+
+} // namespace
+
+const char *system_name(system_type type) {
+    switch (type) {
+    case system_type::lorenz:
+        return "lorenz";
+    case system_type::rossler:
+        return "rossler";
+    case system_type::thomas:
+        return "thomas";
+    case system_type::aizawa:
+        return "aizawa";
+    case system_type::dadras:
+        return "dadras";
+    case system_type::chen:
+        return "chen";
+    case system_type::lorenz83:
+        return "lorenz83";
+    case system_type::halvorsen:
+        return "halvorsen";
+    case system_type::rabinovich:
+        return "rabinovich";
+    case system_type::three_scroll:
+        return "three_scroll";
+    case system_type::sprott:
+        return "sprott";
+    case system_type::four_wing:
+        return "four_wing";
+    case system_type::hyper_rossler:
+        return "hyper_rossler";
+    case system_type::lorenz_stenflo:
+        return "lorenz_stenflo";
+    case system_type::mackey_glass:
+        return "mackey_glass";
+    case system_type::delayed_lorenz:
+        return "delayed_lorenz";
+    }
+    return "unknown";
+}
+
+bool parse_system_type(const string &name, system_type &type) {
+    for (system_type candidate : k_all_systems) {
+        if (name == system_name(candidate)) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+int system_dimension(system_type type) {
+    switch (type) {
+    case system_type::lorenz:
+        return LorenzArgs::dimension;
+    case system_type::rossler:
+        return RosslerArgs::dimension;
+    case system_type::thomas:
+        return ThomasArgs::dimension;
+    case system_type::aizawa:
+        return AizawaArgs::dimension;
+    case system_type::dadras:
+        return DadrasArgs::dimension;
+    case system_type::chen:
+        return ChenArgs::dimension;
+    case system_type::lorenz83:
+        return Lorenz83Args::dimension;
+    case system_type::halvorsen:
+        return HalvorsenArgs::dimension;
+    case system_type::rabinovich:
+        return RabinovichArgs::dimension;
+    case system_type::three_scroll:
+        return ThreeScrollArgs::dimension;
+    case system_type::sprott:
+        return SprottArgs::dimension;
+    case system_type::four_wing:
+        return FourWingArgs::dimension;
+    case system_type::hyper_rossler:
+        return HyperRosslerArgs::dimension;
+    case system_type::lorenz_stenflo:
+        return LorenzStenfloArgs::dimension;
+    case system_type::mackey_glass:
+        return MackeyGlassArgs::dimension;
+    case system_type::delayed_lorenz:
+        return DelayedLorenzArgs::dimension;
+    }
+    return 3;
+}
+
+bool system_has_delay(system_type type) {
+    return type == system_type::mackey_glass ||
+           type == system_type::delayed_lorenz;
+}
+
+float system_delay(const system_params &params) {
+    switch (params.current_system) {
+    case system_type::mackey_glass:
+        return params.mackey_glass_args.tau;
+    case system_type::delayed_lorenz:
+        return params.delayed_lorenz_args.tau;
+    default:
+        return 0.0f;
+    }
+}
+
+vector<named_parameter> system_parameters(system_params &params) {
+    switch (params.current_system) {
+    case system_type::lorenz:
+        return {{"sigma", &params.lorenz_args.sigma},
+                {"rho", &params.lorenz_args.rho},
+                {"beta", &params.lorenz_args.beta}};
+    case system_type::rossler:
+        return {{"a", &params.rossler_args.a},
+                {"b", &params.rossler_args.b},
+                {"c", &params.rossler_args.c}};
+    case system_type::thomas:
+        return {{"b", &params.thomas_args.b}};
+    case system_type::aizawa:
+        return {{"a", &params.aizawa_args.a}, {"b", &params.aizawa_args.b},
+                {"c", &params.aizawa_args.c}, {"d", &params.aizawa_args.d},
+                {"e", &params.aizawa_args.e}, {"f", &params.aizawa_args.f}};
+    case system_type::dadras:
+        return {{"a", &params.dadras_args.a}, {"b", &params.dadras_args.b},
+                {"c", &params.dadras_args.c}, {"d", &params.dadras_args.d},
+                {"e", &params.dadras_args.e}};
+    case system_type::chen:
+        return {{"alpha", &params.chen_args.alpha},
+                {"beta", &params.chen_args.beta},
+                {"delta", &params.chen_args.delta}};
+    case system_type::lorenz83:
+        return {{"a", &params.lorenz83_args.a},
+                {"b", &params.lorenz83_args.b},
+                {"f", &params.lorenz83_args.f},
+                {"g", &params.lorenz83_args.g}};
+    case system_type::halvorsen:
+        return {{"a", &params.halvorsen_args.a}};
+    case system_type::rabinovich:
+        return {{"alpha", &params.rabinovich_args.alpha},
+                {"gamma", &params.rabinovich_args.gamma}};
+    case system_type::three_scroll:
+        return {{"a", &params.three_scroll_args.a},
+                {"b", &params.three_scroll_args.b},
+                {"c", &params.three_scroll_args.c},
+                {"d", &params.three_scroll_args.d},
+                {"e", &params.three_scroll_args.e},
+                {"f", &params.three_scroll_args.f}};
+    case system_type::sprott:
+        return {{"a", &params.sprott_args.a}, {"b", &params.sprott_args.b}};
+    case system_type::four_wing:
+        return {{"a", &params.four_wing_args.a},
+                {"b", &params.four_wing_args.b},
+                {"c", &params.four_wing_args.c}};
+    case system_type::hyper_rossler:
+        return {{"a", &params.hyper_rossler_args.a},
+                {"b", &params.hyper_rossler_args.b},
+                {"c", &params.hyper_rossler_args.c},
+                {"d", &params.hyper_rossler_args.d}};
+    case system_type::lorenz_stenflo:
+        return {{"a", &params.lorenz_stenflo_args.a},
+                {"b", &params.lorenz_stenflo_args.b},
+                {"r", &params.lorenz_stenflo_args.r},
+                {"s", &params.lorenz_stenflo_args.s}};
+    case system_type::mackey_glass:
+        return {{"beta", &params.mackey_glass_args.beta},
+                {"gamma", &params.mackey_glass_args.gamma},
+                {"n", &params.mackey_glass_args.n},
+                {"tau", &params.mackey_glass_args.tau}};
+    case system_type::delayed_lorenz:
+        return {{"sigma", &params.delayed_lorenz_args.sigma},
+                {"rho", &params.delayed_lorenz_args.rho},
+                {"beta", &params.delayed_lorenz_args.beta},
+                {"tau", &params.delayed_lorenz_args.tau}};
+    }
+    return {};
+}
+
+float *find_system_parameter(system_params &params, const string &name) {
+    for (const named_parameter &parameter : system_parameters(params)) {
+        if (name == parameter.name) {
+            return parameter.value;
+        }
+    }
+    return nullptr;
+}
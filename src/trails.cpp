@@ -0,0 +1,129 @@
+#include "trails.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+int trail_length_within_budget(size_t stride, int requested,
+                               size_t budget_bytes) {
+    if (stride == 0 || requested <= 0) {
+        return 0;
+    }
+    static GLint max_texels = 0;
+    if (max_texels == 0) {
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+        max_texels = std::max(max_texels, 65536);
+    }
+    const size_t slice_bytes = stride * sizeof(vec3);
+    size_t length = std::min(static_cast<size_t>(requested),
+                             budget_bytes / slice_bytes);
+    length = std::min(length, static_cast<size_t>(max_texels) / stride);
+    return static_cast<int>(length);
+}
+
+bool ensure_trail_ring(trail_ring &ring, size_t stride, int length) {
+    if (ring.buffer != 0 && ring.stride == stride && ring.length == length) {
+        return false;
+    }
+    if (ring.buffer == 0) {
+        glGenVertexArrays(1, &ring.vao);
+        glGenBuffers(1, &ring.buffer);
+        glGenTextures(1, &ring.texture);
+    }
+    ring.stride = stride;
+    ring.length = length;
+    reset_trail_ring(ring);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, ring.buffer);
+    glBufferData(GL_TEXTURE_BUFFER,
+                 static_cast<GLsizeiptr>(stride * static_cast<size_t>(length) *
+                                         sizeof(vec3)),
+                 nullptr, GL_DYNAMIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, ring.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, ring.buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return true;
+}
+
+void reset_trail_ring(trail_ring &ring) {
+    ring.head = 0;
+    ring.filled = 0;
+}
+
+void release_trail_ring(trail_ring &ring) {
+    if (ring.buffer == 0) {
+        return;
+    }
+    glDeleteTextures(1, &ring.texture);
+    glDeleteBuffers(1, &ring.buffer);
+    glDeleteVertexArrays(1, &ring.vao);
+    ring = trail_ring{};
+}
+
+static void advance_head(trail_ring &ring, int slots) {
+    ring.head = (ring.head + slots) % ring.length;
+    ring.filled = std::min(ring.filled + slots, ring.length);
+}
+
+void push_trail_points(trail_ring &ring, const vec3 *points, size_t count) {
+    if (ring.buffer == 0 || ring.length == 0 || ring.stride == 0) {
+        return;
+    }
+    // Whole slices only; anything older than one full ring would be
+    // overwritten anyway.
+    size_t slices = count / ring.stride;
+    if (slices > static_cast<size_t>(ring.length)) {
+        points += (slices - static_cast<size_t>(ring.length)) * ring.stride;
+        slices = static_cast<size_t>(ring.length);
+    }
+    const size_t slice_bytes = ring.stride * sizeof(vec3);
+    glBindBuffer(GL_TEXTURE_BUFFER, ring.buffer);
+    while (slices > 0) {
+        const size_t run = std::min(
+            slices, static_cast<size_t>(ring.length - ring.head));
+        glBufferSubData(GL_TEXTURE_BUFFER,
+                        static_cast<GLintptr>(static_cast<size_t>(ring.head) *
+                                              slice_bytes),
+                        static_cast<GLsizeiptr>(run * slice_bytes), points);
+        points += run * ring.stride;
+        slices -= run;
+        advance_head(ring, static_cast<int>(run));
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void copy_trail_slice(trail_ring &ring, GLuint source_buffer) {
+    if (ring.buffer == 0 || ring.length == 0 || ring.stride == 0) {
+        return;
+    }
+    const size_t slice_bytes = ring.stride * sizeof(vec3);
+    glBindBuffer(GL_COPY_READ_BUFFER, source_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                        static_cast<GLintptr>(static_cast<size_t>(ring.head) *
+                                              slice_bytes),
+                        static_cast<GLsizeiptr>(slice_bytes));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    advance_head(ring, 1);
+}
+
+void draw_trail_ring(const Shader &shader, const trail_ring &ring) {
+    if (ring.buffer == 0 || ring.filled < 2) {
+        return;
+    }
+    shader.set_int("uHistory", 0);
+    shader.set_int("uStride", static_cast<int>(ring.stride));
+    shader.set_int("uLength", ring.length);
+    shader.set_int("uHead", ring.head);
+    shader.set_int("uFilled", ring.filled);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, ring.texture);
+    glBindVertexArray(ring.vao);
+    glDrawArraysInstanced(GL_LINE_STRIP, 0, ring.filled,
+                          static_cast<GLsizei>(ring.stride));
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
@@ -1,10 +1,89 @@
 #include "ui.hpp"
+#include "snapshot.hpp"
 
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
 #include <imgui.h>
 
 using namespace std;
 using namespace glm;
 
+namespace {
+
+// Which linear map takes the N-dimensional particles to the rendered 3D
+// points.
+void draw_projection_ui(simulation_state &state) {
+    nd_projection &projection = state.nd.projection;
+    const int dimension = state.nd.dimension;
+    ImGui::Separator();
+    ImGui::Text("Projection (%dD to 3D)", dimension);
+    bool changed = false;
+    int mode = static_cast<int>(projection.mode);
+    const char *modes[] = {"Coordinates", "Principal Axes", "Custom"};
+    if (ImGui::Combo("Projection", &mode, modes, IM_ARRAYSIZE(modes))) {
+        projection.mode = static_cast<nd_projection_mode>(mode);
+        if (projection.mode == nd_projection_mode::principal) {
+            fit_principal_projection(state.nd, state.particle_positions.size());
+        }
+        changed = true;
+    }
+    static const char *row_names[] = {"X", "Y", "Z"};
+    switch (projection.mode) {
+    case nd_projection_mode::coordinates: {
+        static const char *axis_names[] = {"x", "y", "z", "w", "v", "u"};
+        for (int row = 0; row < 3; ++row) {
+            ImGui::PushID(row);
+            changed |= ImGui::Combo(row_names[row], &projection.axes[row],
+                                    axis_names, dimension);
+            ImGui::PopID();
+        }
+        break;
+    }
+    case nd_projection_mode::principal:
+        ImGui::SliderInt("Refit Every", &projection.refit_interval, 0, 4096,
+                         projection.refit_interval > 0 ? "%d steps"
+                                                       : "manual");
+        if (ImGui::Button("Refit Now")) {
+            fit_principal_projection(state.nd, state.particle_positions.size());
+            changed = true;
+        }
+        ImGui::SameLine();
+        ImGui::Text("variance %.1f%% / %.1f%% / %.1f%%",
+                    static_cast<double>(projection.explained[0] * 100.0f),
+                    static_cast<double>(projection.explained[1] * 100.0f),
+                    static_cast<double>(projection.explained[2] * 100.0f));
+        break;
+    case nd_projection_mode::custom:
+        for (int row = 0; row < 3; ++row) {
+            ImGui::PushID(row);
+            ImGui::Text("%s", row_names[row]);
+            for (int d = 0; d < dimension; ++d) {
+                ImGui::SameLine();
+                ImGui::PushID(d);
+                ImGui::SetNextItemWidth(56.0f);
+                changed |= ImGui::DragFloat("##row", &projection.rows[row][d],
+                                            0.01f, -4.0f, 4.0f, "%.2f");
+                ImGui::PopID();
+            }
+            ImGui::PopID();
+        }
+        break;
+    }
+    if (changed) {
+        update_nd_projection(projection, dimension);
+        reproject_nd_particles(state);
+        update_particle_gpu(state);
+        reset_trail_ring(state.particle_trails);
+        reset_trail_ring(state.trajectory_trail);
+        clear_invariant_stats(state.stats);
+    }
+}
+
+} // namespace
+
 void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
              bool &mouse_look_enabled, bool &orbit_dragging) {
     ImGui::Begin("Simulation Controls");
@@ -20,7 +99,11 @@ void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
                                          "Rabinovich-Fabrikant",
                                          "Three-Scroll Unified",
                                          "Sprott",
-                                         "Four-Wing"};
+                                         "Four-Wing",
+                                         "Hyperchaotic R\u00F6ssler (4D)",
+                                         "Lorenz-Stenflo (4D)",
+                                         "Mackey-Glass (delay)",
+                                         "Delayed Lorenz"};
     int system_index = static_cast<int>(state.current_system);
     if (ImGui::Combo("System", &system_index, system_names,
                      IM_ARRAYSIZE(system_names))) {
@@ -180,11 +263,84 @@ void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
             state.system = make_four_wing_system(state.four_wing_args);
         }
         break;
+    case system_type::hyper_rossler:
+        ImGui::Text("Hyperchaotic R\u00F6ssler Parameters");
+        args_changed |=
+            ImGui::SliderFloat("a", &state.hyper_rossler_args.a, 0.0f, 1.0f);
+        args_changed |=
+            ImGui::SliderFloat("b", &state.hyper_rossler_args.b, 0.0f, 10.0f);
+        args_changed |=
+            ImGui::SliderFloat("c", &state.hyper_rossler_args.c, 0.0f, 2.0f);
+        args_changed |=
+            ImGui::SliderFloat("d", &state.hyper_rossler_args.d, 0.0f, 0.2f);
+        if (args_changed) {
+            state.system = make_hyper_rossler_system(state.hyper_rossler_args);
+        }
+        break;
+    case system_type::lorenz_stenflo:
+        ImGui::Text("Lorenz-Stenflo Parameters");
+        args_changed |=
+            ImGui::SliderFloat("a", &state.lorenz_stenflo_args.a, 0.1f, 5.0f);
+        args_changed |=
+            ImGui::SliderFloat("b", &state.lorenz_stenflo_args.b, 0.1f, 5.0f);
+        args_changed |=
+            ImGui::SliderFloat("r", &state.lorenz_stenflo_args.r, 0.1f, 60.0f);
+        args_changed |=
+            ImGui::SliderFloat("s", &state.lorenz_stenflo_args.s, 0.0f, 5.0f);
+        if (args_changed) {
+            state.system =
+                make_lorenz_stenflo_system(state.lorenz_stenflo_args);
+        }
+        break;
+    // The particles read these arguments every step; a new tau rebuilds
+    // their history on the next one.
+    case system_type::mackey_glass:
+        ImGui::Text("Mackey-Glass Parameters");
+        args_changed |= ImGui::SliderFloat(
+            "beta", &state.mackey_glass_args.beta, 0.0f, 1.0f);
+        args_changed |= ImGui::SliderFloat(
+            "gamma", &state.mackey_glass_args.gamma, 0.0f, 1.0f);
+        args_changed |=
+            ImGui::SliderFloat("n", &state.mackey_glass_args.n, 1.0f, 20.0f,
+                               "%.0f");
+        args_changed |=
+            ImGui::SliderFloat("tau", &state.mackey_glass_args.tau, 0.1f,
+                               100.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+        break;
+    case system_type::delayed_lorenz:
+        ImGui::Text("Delayed Lorenz Parameters");
+        args_changed |= ImGui::SliderFloat(
+            "sigma", &state.delayed_lorenz_args.sigma, 0.1f, 50.0f);
+        args_changed |= ImGui::SliderFloat(
+            "rho", &state.delayed_lorenz_args.rho, 0.1f, 60.0f);
+        args_changed |= ImGui::SliderFloat(
+            "beta", &state.delayed_lorenz_args.beta, 0.1f, 10.0f);
+        args_changed |=
+            ImGui::SliderFloat("tau", &state.delayed_lorenz_args.tau, 0.001f,
+                               2.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+        break;
+    }
+    if (state.dde.dimension > 0) {
+        ImGui::TextDisabled("History: %d steps of %zu particles",
+                            state.dde.slots, state.dde.count);
+        if (ImGui::SliderFloat("History Budget (MB)", &state.dde.budget_mb,
+                               16.0f, 4096.0f, "%.0f",
+                               ImGuiSliderFlags_Logarithmic)) {
+            initialize_particle_field(state);
+            update_particle_gpu(state);
+        }
+        if (state.dde.count < state.particle_count) {
+            ImGui::TextWrapped("The budget holds %zu of %zu particles at "
+                               "this delay and step.",
+                               state.dde.count, state.particle_count);
+        }
     }
 
     if (args_changed) {
         state.integrator = IntegratorRK4{};
         state.time_accumulator = 0.0f;
+        clear_poincare(state.poincare);
+        clear_invariant_stats(state.stats);
     }
 
     if (ImGui::Button("Reset Args / Initial State")) {
@@ -192,6 +348,25 @@ void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
         args_changed = false;
     }
 
+    if (ImGui::Button("Save Snapshot")) {
+        save_snapshot(state, camera, orbit, k_default_snapshot_path);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load Snapshot")) {
+        load_snapshot(state, camera, orbit, k_default_snapshot_path);
+    }
+
+    if (ImGui::Checkbox("Stream Frames", &state.stream.enabled) &&
+        !state.stream.enabled) {
+        close_frame_stream(state.stream);
+    }
+    if (state.stream.enabled) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("%s  #%llu", state.stream.name.c_str(),
+                            static_cast<unsigned long long>(
+                                state.stream.sequence));
+    }
+
     ImGui::Checkbox("Paused", &state.paused);
     ImGui::Checkbox("Show Axes", &state.show_axes);
     if (ImGui::SliderFloat("Axes Half-Length", &state.axes_length, 0.5f,
@@ -205,6 +380,26 @@ void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
         state.time_accumulator = 0.0f;
     }
     ImGui::Text("dt: %.5f", state.base_dt);
+    int noise_mode_index = static_cast<int>(state.noise.mode);
+    const char *noise_modes[] = {"Off", "Additive", "Multiplicative"};
+    if (ImGui::Combo("Noise", &noise_mode_index, noise_modes,
+                     IM_ARRAYSIZE(noise_modes))) {
+        state.noise.mode = static_cast<noise_mode>(noise_mode_index);
+    }
+    if (state.noise.mode != noise_mode::off) {
+        int scheme_index = static_cast<int>(state.noise.scheme);
+        const char *schemes[] = {"Euler-Maruyama", "Platen (order 1.0)"};
+        if (ImGui::Combo("Scheme", &scheme_index, schemes,
+                         IM_ARRAYSIZE(schemes))) {
+            state.noise.scheme = static_cast<sde_scheme>(scheme_index);
+        }
+        ImGui::SliderFloat("Sigma", &state.noise.sigma, 0.001f, 20.0f,
+                           "%.3f", ImGuiSliderFlags_Logarithmic);
+        int noise_seed = static_cast<int>(state.noise.seed);
+        if (ImGui::InputInt("Noise Seed", &noise_seed)) {
+            state.noise.seed = static_cast<uint32_t>(noise_seed);
+        }
+    }
 
     ImGui::Separator();
     ImGui::Text("Particles");
@@ -215,6 +410,72 @@ void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
         initialize_particle_field(state);
         update_particle_gpu(state);
     }
+    // The delay kernel reseeds its escapes in place and has no stall test,
+    // so delay systems offer neither Compact nor the stall sliders.
+    const bool delay = state.dde.dimension > 0;
+    if (delay) {
+        const char *cull_modes[] = {"Keep All", "Respawn"};
+        int cull_mode_index =
+            state.cull_mode == particle_cull_mode::off ? 0 : 1;
+        if (ImGui::Combo("Lost Particles", &cull_mode_index, cull_modes,
+                         IM_ARRAYSIZE(cull_modes))) {
+            state.cull_mode = cull_mode_index == 0
+                                  ? particle_cull_mode::off
+                                  : particle_cull_mode::respawn;
+        }
+    } else {
+        int cull_mode_index = static_cast<int>(state.cull_mode);
+        const char *cull_modes[] = {"Keep All", "Compact", "Respawn"};
+        if (ImGui::Combo("Lost Particles", &cull_mode_index, cull_modes,
+                         IM_ARRAYSIZE(cull_modes))) {
+            state.cull_mode =
+                static_cast<particle_cull_mode>(cull_mode_index);
+        }
+    }
+    if (state.cull_mode != particle_cull_mode::off) {
+        ImGui::SliderFloat("Escape Radius", &state.particle_escape_radius,
+                           10.0f, 1e6f, "%.0f", ImGuiSliderFlags_Logarithmic);
+        if (delay) {
+            ImGui::TextDisabled("Delay systems respawn escapes only.");
+        } else {
+            ImGui::SliderFloat("Stall Speed", &state.particle_stall_speed,
+                               1e-6f, 1.0f, "%.6f",
+                               ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderInt("Stall Steps", &state.particle_stall_steps, 16,
+                             16384, "%d", ImGuiSliderFlags_Logarithmic);
+        }
+        ImGui::Text("Live %zu / %zu", state.particle_positions.size(),
+                    state.particle_count);
+        ImGui::Text("Diverged %zu  Stalled %zu  Respawned %zu",
+                    state.particles_diverged, state.particles_stalled,
+                    state.particles_respawned);
+        if (state.particle_positions.size() < state.particle_count &&
+            !delay && ImGui::Button("Refill Particles")) {
+            initialize_particle_field(state);
+            update_particle_gpu(state);
+        }
+    }
+    particle_reorder &reorder = state.reorder;
+    ImGui::Checkbox("Morton Reorder", &reorder.enabled);
+    if (reorder.enabled) {
+        ImGui::SliderInt("Reorder Interval", &reorder.interval, 0, 6000,
+                         reorder.interval == 0 ? "off" : "%d frames");
+        ImGui::SliderFloat("Reorder Degrade", &reorder.degrade_ratio, 0.0f,
+                           8.0f,
+                           reorder.degrade_ratio == 0.0f ? "off" : "%.2fx");
+        ImGui::Text("Locality %.2e (%.2e after sort)", reorder.locality,
+                    reorder.baseline);
+        ImGui::Text("Sorts %zu  last %.2f ms", reorder.sorts,
+                    reorder.last_ms);
+        if (ImGui::Button("Reorder Now")) {
+            reorder_particles(state);
+        }
+        if (state.dde.dimension > 0) {
+            ImGui::TextDisabled("Delay systems keep their particle order.");
+        } else if (state.show_particle_trails) {
+            ImGui::TextDisabled("Paused while particle trails are shown.");
+        }
+    }
     if (ImGui::Checkbox("Spawn From Origin",
                         &state.particle_spawn_from_origin)) {
         initialize_particle_field(state);
@@ -238,10 +499,124 @@ void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
                        60.0f);
     ImGui::SliderFloat("Color Speed", &state.particle_color_speed, 0.0f, 2.0f);
     ImGui::Checkbox("Monochrome Particles", &state.particles_monochrome);
+    int render_mode_index = static_cast<int>(state.render_mode);
+    const char *render_modes[] = {"Alpha Blend", "Additive HDR",
+                                  "Compute Raster"};
+    const int render_mode_count = state.compute_supported
+                                      ? IM_ARRAYSIZE(render_modes)
+                                      : IM_ARRAYSIZE(render_modes) - 1;
+    if (ImGui::Combo("Render Mode", &render_mode_index, render_modes,
+                     render_mode_count)) {
+        state.render_mode = static_cast<particle_render_mode>(render_mode_index);
+    }
+    if (!state.compute_supported) {
+        ImGui::TextDisabled("Compute raster needs OpenGL 4.3");
+    }
+    if (state.render_mode != particle_render_mode::alpha_blend) {
+        ImGui::SliderFloat("Exposure", &state.hdr_exposure, 0.01f, 20.0f,
+                           "%.3f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Intensity", &state.hdr_intensity, 0.001f, 2.0f,
+                           "%.3f", ImGuiSliderFlags_Logarithmic);
+    }
     if (ImGui::Button("Reseed Particles")) {
         initialize_particle_field(state);
         update_particle_gpu(state);
     }
+    if (state.nd.dimension > 0) {
+        draw_projection_ui(state);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Segments");
+    particle_segments &segments = state.segments;
+    bool reseed = false;
+    if (ImGui::Checkbox("Compare Systems", &segments.enabled)) {
+        if (segments.enabled && segments.list.size() < 2) {
+            add_segment(state);
+        }
+        reseed = true;
+    }
+    if (segments.enabled) {
+        if (!segments_active(state)) {
+            ImGui::TextDisabled(
+                "Needs a three-variable system without a delay.");
+        }
+        // The three-variable presets come first in system_names.
+        const int comparable_count =
+            static_cast<int>(system_type::hyper_rossler);
+        ImGui::Text("Segment 0: %s, %zu particles",
+                    system_names[static_cast<int>(state.current_system)],
+                    segments.list.empty() ? 0 : segments.list[0].count);
+        for (size_t s = 1; s < segments.list.size(); ++s) {
+            particle_segment &segment = segments.list[s];
+            ImGui::PushID(static_cast<int>(s));
+            ImGui::Text("Segment %zu: %zu particles", s, segment.count);
+            int preset = static_cast<int>(segment.params.current_system);
+            if (ImGui::Combo("System", &preset, system_names,
+                             comparable_count)) {
+                segment.params.current_system =
+                    static_cast<system_type>(preset);
+                reseed = true;
+            }
+            for (const named_parameter &parameter :
+                 system_parameters(segment.params)) {
+                ImGui::DragFloat(parameter.name, parameter.value, 0.01f);
+            }
+            const bool remove = ImGui::Button("Remove");
+            ImGui::PopID();
+            if (remove) {
+                remove_segment(state, s);
+                reseed = true;
+                break;
+            }
+        }
+        if (segments.list.size() < static_cast<size_t>(k_max_segments) &&
+            ImGui::Button("Add Segment")) {
+            add_segment(state);
+            reseed = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Arrange")) {
+            arrange_segments(state);
+        }
+        ImGui::SliderFloat("Segment Spacing", &segments.spacing, 0.0f, 2.0f);
+        ImGui::Checkbox("Match Sizes", &segments.match_size);
+    }
+    if (reseed) {
+        initialize_particle_field(state);
+        update_particle_gpu(state);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Trails");
+    ImGui::Checkbox("Particle Trails", &state.show_particle_trails);
+    ImGui::SliderInt("Trail Length", &state.particle_trail_length, 2, 256);
+    ImGui::SliderFloat("Trail Opacity", &state.trail_opacity, 0.01f, 1.0f);
+    ImGui::SliderFloat("Trail Budget (MB)", &state.trail_budget_mb, 16.0f,
+                       2048.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+    if (state.show_particle_trails) {
+        const size_t budget_bytes =
+            static_cast<size_t>(state.trail_budget_mb * 1024.0f * 1024.0f);
+        const int effective_length = trail_length_within_budget(
+            state.particle_positions.size(), state.particle_trail_length,
+            budget_bytes);
+        if (effective_length < 2) {
+            ImGui::Text("Budget too small for this particle count");
+        } else {
+            ImGui::Text("Effective length %d (%.1f MB)", effective_length,
+                        static_cast<double>(state.particle_positions.size() *
+                                            effective_length * sizeof(vec3)) /
+                            (1024.0 * 1024.0));
+        }
+    }
+    ImGui::Checkbox("Show Trajectory", &state.show_trajectory);
+    ImGui::Checkbox("Poincar\u00E9 Section", &state.poincare.enabled);
+    ImGui::Checkbox("Basin Mapper", &state.basin.show_window);
+    ImGui::Checkbox("Statistics", &state.stats.enabled);
+    ImGui::Checkbox("Lattice", &state.lattice.enabled);
+    ImGui::Checkbox("Correlation Dimension", &state.correlation.enabled);
+    ImGui::SliderInt("Trajectory Length", &state.trajectory_trail_length, 16,
+                     65536, "%d", ImGuiSliderFlags_Logarithmic);
 
     ImGui::Separator();
     ImGui::Text("Camera");
@@ -279,17 +654,497 @@ void draw_ui(simulation_state &state, Camera &camera, orbit_camera &orbit,
 
     ImGui::Separator();
     ImGui::Text("t = %.3f", state.t);
-    if (state.system.dim >= 3 && state.state.size() >= 3) {
-        ImGui::Text("state = (%.3f, %.3f, %.3f)", state.state[0],
-                    state.state[1], state.state[2]);
+    if (state.system.dim >= 3 &&
+        state.state.size() >= static_cast<size_t>(state.system.dim)) {
+        char text[160];
+        int used = snprintf(text, sizeof(text), "state = (");
+        for (int i = 0; i < state.system.dim && used > 0 &&
+                        used < static_cast<int>(sizeof(text));
+             ++i) {
+            used += snprintf(text + used, sizeof(text) - used, "%s%.3f",
+                             i > 0 ? ", " : "",
+                             static_cast<double>(state.state[i]));
+        }
+        ImGui::Text("%s)", text);
     }
     float speed_magnitude = 0.0f;
-    if (state.system.dim >= 3 && state.state.size() >= 3) {
-        const vec3 state_vector(state.state[0], state.state[1], state.state[2]);
-        const vec3 derivative = evaluate_derivative(state, state_vector);
-        speed_magnitude = length(derivative);
+    if (state.system.dim >= 3 && state.system.deriv) {
+        vector<float> derivative;
+        state.system.deriv(state.state, derivative, state.t);
+        for (float component : derivative) {
+            speed_magnitude += component * component;
+        }
+        speed_magnitude = std::sqrt(speed_magnitude);
     }
     ImGui::Text("speed = %.3f", speed_magnitude);
 
     ImGui::End();
 }
+
+void draw_poincare_ui(simulation_state &state) {
+    poincare_state &poincare = state.poincare;
+    ImGui::SetNextWindowSize(ImVec2(440.0f, 640.0f), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Poincar\u00E9 Section", &poincare.enabled)) {
+        ImGui::End();
+        return;
+    }
+    if (state.nd.dimension > 0 || state.dde.dimension > 0) {
+        ImGui::TextWrapped("Sections are detected for three-variable systems "
+                           "without a delay only.");
+    }
+
+    static const char *direction_names[] = {"Falling", "Both", "Rising"};
+    for (size_t i = 0; i < poincare.planes.size(); ++i) {
+        section_plane &plane = poincare.planes[i];
+        const int plane_index = static_cast<int>(i);
+        ImGui::PushID(plane_index);
+        bool plane_changed = false;
+        ImGui::Text("Plane %d", plane_index);
+        ImGui::SameLine();
+        plane_changed |= ImGui::Checkbox("Enabled", &plane.enabled);
+        plane_changed |=
+            ImGui::DragFloat3("Normal", &plane.normal.x, 0.01f, -1.0f, 1.0f);
+        plane_changed |= ImGui::DragFloat("Offset", &plane.offset, 0.05f);
+        int direction_index = plane.direction + 1;
+        if (ImGui::Combo("Direction", &direction_index, direction_names,
+                         IM_ARRAYSIZE(direction_names))) {
+            plane.direction = direction_index - 1;
+            plane_changed = true;
+        }
+        if (plane_changed) {
+            clear_section_plane(poincare, plane_index);
+        }
+        const bool remove =
+            poincare.planes.size() > 1 && ImGui::Button("Remove Plane");
+        ImGui::PopID();
+        if (remove) {
+            poincare.planes.erase(poincare.planes.begin() +
+                                  static_cast<std::ptrdiff_t>(i));
+            clear_poincare(poincare);
+            break;
+        }
+    }
+    if (static_cast<int>(poincare.planes.size()) < k_max_section_planes &&
+        ImGui::Button("Add Plane")) {
+        poincare.planes.push_back(section_plane{});
+    }
+
+    ImGui::Separator();
+    int capacity_k = static_cast<int>(poincare.capacity / 1024);
+    if (ImGui::SliderInt("Capacity (k hits)", &capacity_k, 16, 8192, "%d",
+                         ImGuiSliderFlags_Logarithmic)) {
+        poincare.capacity = static_cast<size_t>(capacity_k) * 1024;
+        clear_poincare(poincare);
+    }
+    const char *plane_labels[] = {"Plane 0", "Plane 1", "Plane 2", "Plane 3"};
+    ImGui::Combo("Display", &poincare.display_plane, plane_labels,
+                 static_cast<int>(poincare.planes.size()));
+    poincare.display_plane =
+        glm::clamp(poincare.display_plane, 0,
+                   static_cast<int>(poincare.planes.size()) - 1);
+    const section_cloud &cloud = poincare.clouds[poincare.display_plane];
+    ImGui::Text("hits: %zu stored, %llu total", cloud.count,
+                static_cast<unsigned long long>(poincare.total_hits));
+    if (ImGui::Button("Clear")) {
+        clear_poincare(poincare);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export CSV")) {
+        export_poincare_csv(poincare, "poincare_section.csv");
+    }
+
+    upload_section_texture(poincare);
+    if (cloud.bounds_valid) {
+        ImGui::Text("u [%.3f, %.3f]  v [%.3f, %.3f]", cloud.bounds_min.x,
+                    cloud.bounds_max.x, cloud.bounds_min.y,
+                    cloud.bounds_max.y);
+    } else {
+        ImGui::Text("Waiting for crossings...");
+    }
+    const float side = glm::max(ImGui::GetContentRegionAvail().x, 64.0f);
+    ImGui::Image((ImTextureID)(intptr_t)poincare.texture, ImVec2(side, side),
+                 ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
+
+    ImGui::End();
+}
+
+void draw_basin_ui(simulation_state &state) {
+    basin_mapper &mapper = state.basin;
+    basin_settings &settings = mapper.settings;
+    ImGui::SetNextWindowSize(ImVec2(440.0f, 720.0f), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Basin Mapper", &mapper.show_window)) {
+        ImGui::End();
+        return;
+    }
+    if (system_dimension(state.current_system) != 3 ||
+        system_has_delay(state.current_system)) {
+        ImGui::TextWrapped("The basin mapper classifies three-variable "
+                           "systems without a delay only.");
+        ImGui::End();
+        return;
+    }
+
+    static const char *axis_names[] = {"x", "y", "z"};
+    ImGui::Combo("Horizontal Axis", &settings.axis_u, axis_names,
+                 IM_ARRAYSIZE(axis_names));
+    ImGui::Combo("Vertical Axis", &settings.axis_v, axis_names,
+                 IM_ARRAYSIZE(axis_names));
+    ImGui::DragFloat3("Center", &settings.center.x, 0.1f);
+    ImGui::DragFloat2("Half Extent", &settings.extent.x, 0.1f, 0.01f, 1000.0f);
+    ImGui::SliderInt("Resolution", &settings.resolution, 16, 2048, "%d",
+                     ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderInt("Depth", &settings.depth, 1, 256, "%d",
+                     ImGuiSliderFlags_Logarithmic);
+    if (settings.depth > 1) {
+        ImGui::DragFloat("Depth Half Extent", &settings.extent_w, 0.1f, 0.01f,
+                         1000.0f);
+    }
+    if (ImGui::TreeNode("Classification")) {
+        ImGui::SliderFloat("dt", &settings.dt, 0.0005f, 0.05f, "%.4f",
+                           ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderInt("Transient Steps", &settings.transient_steps, 0,
+                         100000, "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderInt("Window Steps", &settings.window_steps, 16, 100000,
+                         "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::DragFloat("Escape Radius", &settings.escape_radius, 1.0f, 1.0f,
+                         1e6f);
+        ImGui::SliderFloat("Fixed Point Speed", &settings.fixed_point_speed,
+                           1e-6f, 1e-1f, "%.6f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Match Tolerance", &settings.match_tolerance,
+                           0.01f, 10.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+        ImGui::TreePop();
+    }
+
+    const bool running = mapper.job && !mapper.job->finished.load() &&
+                         !mapper.job->cancel.load();
+    if (ImGui::Button(running ? "Restart" : "Start")) {
+        start_basin_job(mapper, state);
+    }
+    if (running) {
+        ImGui::SameLine();
+        if (ImGui::Button("Stop")) {
+            stop_basin_job(mapper);
+        }
+    }
+    if (!mapper.job) {
+        ImGui::Text("Uses the parameters of the active system at start.");
+        ImGui::End();
+        return;
+    }
+
+    basin_job &job = *mapper.job;
+    ImGui::SameLine();
+    if (ImGui::Button("Export")) {
+        export_basin(job, mapper.display_slice, "basin");
+    }
+    ImGui::ProgressBar(basin_progress(job), ImVec2(-1.0f, 0.0f));
+    if (job.depth > 1) {
+        ImGui::SliderInt("Slice", &mapper.display_slice, 0, job.depth - 1);
+    }
+
+    upload_basin_texture(mapper, glfwGetTime());
+    const float side = glm::max(ImGui::GetContentRegionAvail().x, 64.0f);
+    ImGui::Image((ImTextureID)(intptr_t)mapper.texture, ImVec2(side, side),
+                 ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
+
+    const size_t slice_cells =
+        static_cast<size_t>(job.width) * static_cast<size_t>(job.height);
+    auto legend_row = [&](uint8_t label, const char *text) {
+        const vec3 color = basin_label_color(label, job);
+        const float share = 100.0f *
+                            static_cast<float>(mapper.slice_counts[label]) /
+                            static_cast<float>(slice_cells);
+        ImGui::ColorButton("##swatch",
+                           ImVec4(color.x, color.y, color.z, 1.0f),
+                           ImGuiColorEditFlags_NoTooltip,
+                           ImVec2(12.0f, 12.0f));
+        ImGui::SameLine();
+        ImGui::Text("%s  %.1f%%", text, share);
+    };
+    ImGui::PushID("legend");
+    legend_row(basin_label_diverged, "Diverged");
+    ImGui::PushID(1);
+    legend_row(basin_label_undetermined, "Undetermined");
+    ImGui::PopID();
+    {
+        lock_guard<mutex> lock(job.attractor_mutex);
+        for (size_t i = 0; i < job.attractors.size(); ++i) {
+            const basin_attractor &attractor = job.attractors[i];
+            char text[128];
+            snprintf(text, sizeof(text), "%s (%.2f, %.2f, %.2f) spread %.2f",
+                     attractor.fixed_point ? "Fixed point" : "Attractor",
+                     attractor.centroid.x, attractor.centroid.y,
+                     attractor.centroid.z, attractor.spread);
+            ImGui::PushID(static_cast<int>(i) + 2);
+            legend_row(static_cast<uint8_t>(basin_label_first_attractor + i),
+                       text);
+            ImGui::PopID();
+        }
+    }
+    ImGui::PopID();
+
+    ImGui::End();
+}
+
+void draw_stats_ui(simulation_state &state) {
+    invariant_stats &stats = state.stats;
+    invariant_settings &settings = stats.settings;
+    ImGui::SetNextWindowSize(ImVec2(440.0f, 720.0f), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Statistics", &stats.enabled)) {
+        ImGui::End();
+        return;
+    }
+
+    bool layout_changed = false;
+    ImGui::SliderInt("Sample Every", &settings.sample_every, 1, 256, "%d",
+                     ImGuiSliderFlags_Logarithmic);
+    layout_changed |= ImGui::SliderInt("Bins", &settings.bins, 16, 1024, "%d",
+                                       ImGuiSliderFlags_Logarithmic);
+    layout_changed |= ImGui::SliderInt("Projection Size",
+                                       &settings.projection_size, 64, 1024,
+                                       "%d", ImGuiSliderFlags_Logarithmic);
+    static const char *axis_names[] = {"x", "y", "z"};
+    layout_changed |= ImGui::Combo("Horizontal Axis", &settings.axis_u,
+                                   axis_names, IM_ARRAYSIZE(axis_names));
+    layout_changed |= ImGui::Combo("Vertical Axis", &settings.axis_v,
+                                   axis_names, IM_ARRAYSIZE(axis_names));
+    if (ImGui::TreeNode("Convergence")) {
+        ImGui::SliderInt("Window Samples", &settings.window_samples, 1, 256,
+                         "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderInt("Quiet Windows", &settings.settle_windows, 1, 16);
+        ImGui::SliderFloat("Tolerance", &settings.tolerance, 1e-4f, 0.5f,
+                           "%.4f", ImGuiSliderFlags_Logarithmic);
+        ImGui::Checkbox("Discard Transient", &stats.discard_transient);
+        ImGui::TreePop();
+    }
+    if (layout_changed || ImGui::Button("Restart")) {
+        clear_invariant_stats(stats);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export")) {
+        collect_invariant_stats(stats);
+        export_invariant_csv(stats, "chaoseq_stats.csv");
+        write_count_pgm(stats.total.projection.data(),
+                        settings.projection_size, settings.projection_size,
+                        "chaoseq_projection.pgm");
+    }
+
+    if (stats.settled) {
+        ImGui::Text("Settled at t = %.2f", stats.settled_time);
+    } else if (stats.drift >= 0.0) {
+        ImGui::Text("Settling: drift %.4f (tolerance %.4f)", stats.drift,
+                    settings.tolerance);
+    } else {
+        ImGui::Text("Settling...");
+    }
+
+    collect_invariant_stats(stats);
+    const invariant_accumulator &total = stats.total;
+    ImGui::Text("%llu samples, %llu outside the box",
+                static_cast<unsigned long long>(total.axes[0].count),
+                static_cast<unsigned long long>(total.outside));
+    vector<float> marginal(static_cast<size_t>(settings.bins));
+    for (int axis = 0; axis < 3; ++axis) {
+        const running_moments &moments = total.axes[axis];
+        ImGui::Text("%s  mean %9.4f  std %8.4f  skew %7.4f", axis_names[axis],
+                    moments.mean, std::sqrt(moments.variance()),
+                    moments.skewness());
+        if (total.marginals.size() == 3 * marginal.size()) {
+            for (size_t bin = 0; bin < marginal.size(); ++bin) {
+                marginal[bin] = static_cast<float>(
+                    total.marginals[static_cast<size_t>(axis) *
+                                        marginal.size() +
+                                    bin]);
+            }
+            ImGui::PushID(axis);
+            ImGui::PlotHistogram("##marginal", marginal.data(),
+                                 static_cast<int>(marginal.size()), 0,
+                                 nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+            ImGui::PopID();
+        }
+    }
+
+    const double now = glfwGetTime();
+    if (now - state.stats_upload_time > 0.25) {
+        upload_stats_texture(state);
+        state.stats_upload_time = now;
+    }
+    if (state.stats_texture != 0) {
+        const float side = glm::max(ImGui::GetContentRegionAvail().x, 64.0f);
+        ImGui::Image((ImTextureID)(intptr_t)state.stats_texture,
+                     ImVec2(side, side), ImVec2(0.0f, 1.0f),
+                     ImVec2(1.0f, 0.0f));
+    }
+
+    ImGui::End();
+}
+
+void draw_lattice_ui(simulation_state &state) {
+    lattice_state &lattice = state.lattice;
+    lattice_settings &settings = lattice.settings;
+    ImGui::SetNextWindowSize(ImVec2(520.0f, 640.0f), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Lattice", &lattice.enabled)) {
+        ImGui::End();
+        return;
+    }
+
+    bool rebuild = false;
+    static const char *model_names[] = {"Lorenz-96", "Coupled Logistic"};
+    int model = static_cast<int>(settings.model);
+    if (ImGui::Combo("Model", &model, model_names,
+                     IM_ARRAYSIZE(model_names))) {
+        settings.model = static_cast<lattice_model>(model);
+        const bool map = settings.model == lattice_model::coupled_logistic;
+        settings.display_min = map ? 0.0f : -8.0f;
+        settings.display_max = map ? 1.0f : 12.0f;
+        rebuild = true;
+    }
+    rebuild |= ImGui::SliderInt("Sites", &settings.sites, 64, 1 << 20, "%d",
+                                ImGuiSliderFlags_Logarithmic);
+    if (settings.model == lattice_model::lorenz96) {
+        ImGui::DragFloat("F", &settings.lorenz96.forcing, 0.01f, -20.0f,
+                         40.0f);
+        ImGui::SliderFloat("dt", &settings.dt, 0.0005f, 0.05f, "%.4f",
+                           ImGuiSliderFlags_Logarithmic);
+    } else {
+        ImGui::DragFloat("r", &settings.coupled_logistic.r, 0.001f, 0.0f,
+                         4.0f);
+        ImGui::SliderFloat("Coupling", &settings.coupled_logistic.coupling,
+                           0.0f, 1.0f);
+    }
+    ImGui::SliderInt("Steps per Frame", &settings.steps_per_frame, 1, 256,
+                     "%d", ImGuiSliderFlags_Logarithmic);
+    rebuild |= ImGui::SliderInt("History Rows", &settings.history_rows, 16,
+                                2048, "%d", ImGuiSliderFlags_Logarithmic);
+    ImGui::DragFloat2("Color Range", &settings.display_min, 0.05f);
+    if (rebuild || ImGui::Button("Reset")) {
+        reset_lattice(lattice, state.workers);
+    }
+
+    ImGui::SliderInt("Probe Site", &settings.probe_site, 0,
+                     std::max(settings.sites - 1, 0));
+    ImGui::SliderInt("Delay Steps", &settings.delay_steps, 1, 256);
+    ImGui::Checkbox("Embed Probe in View", &settings.embed_in_view);
+
+    if (lattice.diverged) {
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.3f, 1.0f),
+                           "Diverged at step %llu; reduce dt or reset.",
+                           static_cast<unsigned long long>(lattice.steps));
+    }
+    const double sites = static_cast<double>(lattice.current.size());
+    ImGui::Text("t = %.3f, %llu steps", lattice.time,
+                static_cast<unsigned long long>(lattice.steps));
+    if (lattice.seconds_per_step > 0.0) {
+        ImGui::Text("%.3f ms/step, %.1f M site updates/s",
+                    1000.0 * lattice.seconds_per_step,
+                    sites / lattice.seconds_per_step * 1e-6);
+    }
+
+    upload_lattice_texture(lattice);
+    if (lattice.texture != 0) {
+        // Rows wrap in texture space, so the oldest row is drawn first.
+        const float width = glm::max(ImGui::GetContentRegionAvail().x, 64.0f);
+        const float offset = static_cast<float>(lattice.history_head) /
+                             static_cast<float>(settings.history_rows);
+        ImGui::Image((ImTextureID)(intptr_t)lattice.texture,
+                     ImVec2(width, glm::max(
+                                       ImGui::GetContentRegionAvail().y,
+                                       64.0f)),
+                     ImVec2(0.0f, offset), ImVec2(1.0f, offset + 1.0f));
+    }
+
+    ImGui::End();
+}
+
+void draw_correlation_ui(simulation_state &state) {
+    correlation_estimator &estimator = state.correlation;
+    correlation_settings &settings = estimator.settings;
+    correlation_result &result = estimator.result;
+    ImGui::SetNextWindowSize(ImVec2(440.0f, 560.0f), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Correlation Dimension", &estimator.enabled)) {
+        ImGui::End();
+        return;
+    }
+
+    bool changed = false;
+    changed |= ImGui::SliderInt("Radii", &settings.radii, 4,
+                                k_max_correlation_radii);
+    changed |= ImGui::SliderFloat("Smallest (x diag)", &settings.min_fraction,
+                                  1e-5f, 0.01f, "%.5f",
+                                  ImGuiSliderFlags_Logarithmic);
+    changed |= ImGui::SliderFloat("Largest (x diag)", &settings.max_fraction,
+                                  0.005f, 0.5f, "%.3f",
+                                  ImGuiSliderFlags_Logarithmic);
+    int references = static_cast<int>(settings.reference_points);
+    if (ImGui::SliderInt("Reference Points", &references, 256, 262144, "%d",
+                         ImGuiSliderFlags_Logarithmic)) {
+        settings.reference_points = static_cast<size_t>(references);
+        changed = true;
+    }
+    const int last_radius = settings.radii - 1;
+    bool refit = ImGui::SliderInt("Fit From", &settings.fit_first, 0,
+                                  last_radius);
+    refit |= ImGui::SliderInt("Fit To", &settings.fit_last, 0, last_radius);
+    settings.fit_last = glm::max(settings.fit_last, settings.fit_first);
+    if (refit && !changed) {
+        fit_correlation_dimension(settings, result);
+    }
+    ImGui::Checkbox("Automatic", &estimator.automatic);
+    if (estimator.automatic) {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120.0f);
+        ImGui::SliderFloat("Every (s)", &estimator.interval, 0.1f, 30.0f,
+                           "%.1f", ImGuiSliderFlags_Logarithmic);
+    }
+    if (changed || ImGui::Button("Compute Now")) {
+        update_correlation_estimate(estimator, state.particle_positions.data(),
+                                    primary_segment_count(state),
+                                    state.workers, glfwGetTime(), true);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export") && !result.radii.empty()) {
+        export_correlation_csv(result, "chaoseq_correlation.csv");
+    }
+
+    if (result.sum.empty()) {
+        ImGui::Text("No estimate yet.");
+        ImGui::End();
+        return;
+    }
+    ImGui::Text("%zu points, %zu references, %.1f ms", result.points,
+                result.references, 1000.0 * result.seconds);
+    if (result.valid) {
+        ImGui::Text("D2 = %.3f over r in [%.4g, %.4g] (rms %.3f)",
+                    result.dimension,
+                    static_cast<double>(result.radii[static_cast<size_t>(
+                        glm::clamp(settings.fit_first, 0, last_radius))]),
+                    static_cast<double>(result.radii[static_cast<size_t>(
+                        glm::clamp(settings.fit_last, 0, last_radius))]),
+                    result.residual);
+    } else {
+        ImGui::Text("Too few pairs in the fit range.");
+    }
+
+    // log10 C(r) against the radius index, which is uniform in log r.
+    vector<float> log_sum(result.sum.size(), 0.0f);
+    float lowest = 0.0f;
+    for (size_t k = 0; k < result.sum.size(); ++k) {
+        if (result.sum[k] > 0.0) {
+            log_sum[k] = static_cast<float>(std::log10(result.sum[k]));
+            lowest = glm::min(lowest, log_sum[k]);
+        }
+    }
+    for (size_t k = 0; k < result.sum.size(); ++k) {
+        if (!(result.sum[k] > 0.0)) {
+            log_sum[k] = lowest;
+        }
+    }
+    const float width = ImGui::GetContentRegionAvail().x;
+    ImGui::PlotLines("##log_sum", log_sum.data(),
+                     static_cast<int>(log_sum.size()), 0, "log10 C(r)",
+                     lowest, 0.0f, ImVec2(width, 140.0f));
+    ImGui::PlotLines("##local_slope", result.local_slope.data(),
+                     static_cast<int>(result.local_slope.size()), 0,
+                     "local slope", 0.0f, 3.5f, ImVec2(width, 100.0f));
+    ImGui::End();
+}
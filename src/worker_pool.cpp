@@ -0,0 +1,271 @@
+#include "worker_pool.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// CPU affinity and the sysfs topology are Linux-only; elsewhere every
+// worker runs unpinned with weight 1 and the OS places it.
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+vector<cpu_slot> unpinned_slots() {
+    return vector<cpu_slot>(max(1u, thread::hardware_concurrency()));
+}
+
+#ifdef __linux__
+
+// Parses a sysfs CPU list such as "0-3,8,10-11".
+vector<int> parse_cpu_list(const string &text) {
+    vector<int> cpus;
+    size_t position = 0;
+    while (position < text.size()) {
+        size_t end = text.find(',', position);
+        if (end == string::npos) {
+            end = text.size();
+        }
+        const string item = text.substr(position, end - position);
+        int first = 0;
+        int last = 0;
+        const int fields = sscanf(item.c_str(), "%d-%d", &first, &last);
+        if (fields == 1) {
+            cpus.push_back(first);
+        } else if (fields == 2) {
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        position = end + 1;
+    }
+    return cpus;
+}
+
+bool read_first_line(const string &path, string &line) {
+    ifstream file(path);
+    return static_cast<bool>(getline(file, line));
+}
+
+vector<int> read_cpu_list(const string &path) {
+    string line;
+    return read_first_line(path, line) ? parse_cpu_list(line) : vector<int>{};
+}
+
+#endif
+
+void worker_main(worker_pool &pool, unsigned int index) {
+    pin_current_thread(pool.slots[index].cpu);
+    CHAOSEQ_PROFILE_THREAD(static_cast<int>(index) + 1);
+    uint64_t seen = 0;
+    unique_lock<mutex> lock(pool.mutex);
+    for (;;) {
+        pool.wake.wait(lock, [&]() {
+            return pool.stopping || pool.generation != seen;
+        });
+        if (pool.stopping) {
+            return;
+        }
+        seen = pool.generation;
+        if (index >= pool.active) {
+            continue;
+        }
+        const function<void(unsigned int)> &task = *pool.task;
+        lock.unlock();
+        task(index);
+        lock.lock();
+        if (--pool.remaining == 0) {
+            pool.done.notify_one();
+        }
+    }
+}
+
+} // namespace
+
+vector<cpu_slot> detect_cpu_slots() {
+#ifndef __linux__
+    return unpinned_slots();
+#else
+    vector<int> allowed;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                allowed.push_back(cpu);
+            }
+        }
+    }
+    if (allowed.empty()) {
+        return unpinned_slots();
+    }
+
+    const string cpu_root = "/sys/devices/system/cpu/cpu";
+    vector<int> node_of(static_cast<size_t>(allowed.back()) + 1, 0);
+    for (int node = 0;; ++node) {
+        const string path = "/sys/devices/system/node/node" +
+                             to_string(node) + "/cpulist";
+        string line;
+        if (!read_first_line(path, line)) {
+            break;
+        }
+        for (int cpu : parse_cpu_list(line)) {
+            if (cpu >= 0 && static_cast<size_t>(cpu) < node_of.size()) {
+                node_of[static_cast<size_t>(cpu)] = node;
+            }
+        }
+    }
+
+    // Intel hybrid parts expose the two core types as separate PMUs; other
+    // hybrid parts (arm big.LITTLE) publish a per-CPU capacity instead.
+    const vector<int> atom_cpus = read_cpu_list("/sys/devices/cpu_atom/cpus");
+    const bool intel_hybrid =
+        !atom_cpus.empty() &&
+        !read_cpu_list("/sys/devices/cpu_core/cpus").empty();
+
+    struct candidate {
+        cpu_slot slot;
+        bool secondary_thread;
+        float capacity;
+    };
+    vector<candidate> candidates;
+    float max_capacity = 0.0f;
+    for (int cpu : allowed) {
+        const string base = cpu_root + to_string(cpu);
+        candidate entry{};
+        entry.slot.cpu = cpu;
+        entry.slot.node = node_of[static_cast<size_t>(cpu)];
+        const vector<int> siblings =
+            read_cpu_list(base + "/topology/thread_siblings_list");
+        entry.secondary_thread =
+            !siblings.empty() &&
+            *min_element(siblings.begin(), siblings.end()) != cpu;
+        string line;
+        entry.capacity = read_first_line(base + "/cpu_capacity", line)
+                             ? static_cast<float>(atof(line.c_str()))
+                             : 0.0f;
+        max_capacity = max(max_capacity, entry.capacity);
+        if (intel_hybrid &&
+            find(atom_cpus.begin(), atom_cpus.end(), cpu) != atom_cpus.end()) {
+            // E-cores retire RK4 steps at roughly 60% of a P-core.
+            entry.slot.weight = 0.6f;
+        }
+        candidates.push_back(entry);
+    }
+    if (!intel_hybrid && max_capacity > 0.0f) {
+        for (candidate &entry : candidates) {
+            entry.slot.weight = max(entry.capacity / max_capacity, 0.1f);
+        }
+    }
+
+    stable_sort(candidates.begin(), candidates.end(),
+                [](const candidate &a, const candidate &b) {
+                    if (a.secondary_thread != b.secondary_thread) {
+                        return !a.secondary_thread;
+                    }
+                    if (a.slot.node != b.slot.node) {
+                        return a.slot.node < b.slot.node;
+                    }
+                    return a.slot.weight > b.slot.weight;
+                });
+    vector<cpu_slot> slots;
+    slots.reserve(candidates.size());
+    for (const candidate &entry : candidates) {
+        slots.push_back(entry.slot);
+    }
+    return slots;
+#endif
+}
+
+void pin_current_thread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        cerr << "Failed to pin worker to CPU " << cpu << "\n";
+    }
+#else
+    (void)cpu;
+#endif
+}
+
+worker_pool::~worker_pool() { stop_worker_pool(*this); }
+
+void start_worker_pool(worker_pool &pool, unsigned int max_threads) {
+    if (!pool.threads.empty()) {
+        return;
+    }
+    pool.slots = detect_cpu_slots();
+    if (max_threads > 0 && pool.slots.size() > max_threads) {
+        pool.slots.resize(max_threads);
+    }
+    pool.stopping = false;
+    pool.threads.reserve(pool.slots.size());
+    for (unsigned int index = 0; index < pool.slots.size(); ++index) {
+        pool.threads.emplace_back(worker_main, ref(pool), index);
+    }
+}
+
+void stop_worker_pool(worker_pool &pool) {
+    {
+        lock_guard<mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+    for (thread &worker : pool.threads) {
+        worker.join();
+    }
+    pool.threads.clear();
+}
+
+unsigned int worker_count(const worker_pool &pool) {
+    return static_cast<unsigned int>(pool.threads.size());
+}
+
+void run_workers(worker_pool &pool, unsigned int count,
+                 const function<void(unsigned int)> &task) {
+    if (pool.threads.empty()) {
+        for (unsigned int index = 0; index < count; ++index) {
+            task(index);
+        }
+        return;
+    }
+    count = min(count, worker_count(pool));
+    unique_lock<mutex> lock(pool.mutex);
+    pool.task = &task;
+    pool.active = count;
+    pool.remaining = count;
+    ++pool.generation;
+    pool.wake.notify_all();
+    pool.done.wait(lock, [&]() { return pool.remaining == 0; });
+    pool.task = nullptr;
+}
+
+void partition_by_weight(const worker_pool &pool, size_t total,
+                         unsigned int count, vector<size_t> &bounds) {
+    count = max(count, 1u);
+    bounds.assign(count + 1, 0);
+    double weight_sum = 0.0;
+    for (unsigned int i = 0; i < count; ++i) {
+        weight_sum += i < pool.slots.size() ? pool.slots[i].weight : 1.0f;
+    }
+    double running = 0.0;
+    for (unsigned int i = 0; i < count; ++i) {
+        running += i < pool.slots.size() ? pool.slots[i].weight : 1.0f;
+        bounds[i + 1] = min(total, static_cast<size_t>(
+                                       static_cast<double>(total) * running /
+                                       weight_sum));
+    }
+    bounds[count] = total;
+}
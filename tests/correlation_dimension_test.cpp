@@ -0,0 +1,88 @@
+// Compares the hash-grid pair counts of count_correlation_pairs against a
+// brute-force count over every ordered pair, on radius ranges narrow enough
+// that many radii share one octave.
+
+#include "correlation_dimension.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Deterministic points in the unit cube.
+vector<vec3> make_points(size_t count) {
+    vector<vec3> points(count);
+    uint32_t state = 12345u;
+    auto next = [&]() {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+    };
+    for (vec3 &p : points) {
+        p.x = next();
+        p.y = next();
+        p.z = next();
+    }
+    return points;
+}
+
+bool check_range(const vector<vec3> &points, worker_pool &pool, float low,
+                 float high, int radii) {
+    correlation_settings settings;
+    settings.radii = radii;
+    settings.min_radius = low;
+    settings.max_radius = high;
+    settings.reference_points = 0;
+    correlation_grid grid;
+    correlation_result result;
+    if (!count_correlation_pairs(points.data(), points.size(), settings, pool,
+                                 grid, result)) {
+        printf("radii %.3f..%.3f: no result\n", static_cast<double>(low),
+               static_cast<double>(high));
+        return false;
+    }
+    int wrong = 0;
+    for (size_t k = 0; k < result.radii.size(); ++k) {
+        const float r_sq = result.radii[k] * result.radii[k];
+        uint64_t expected = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            for (size_t j = 0; j < points.size(); ++j) {
+                const float dx = points[j].x - points[i].x;
+                const float dy = points[j].y - points[i].y;
+                const float dz = points[j].z - points[i].z;
+                if (i != j && dx * dx + dy * dy + dz * dz < r_sq) {
+                    ++expected;
+                }
+            }
+        }
+        if (result.pairs[k] != expected) {
+            printf("radii %.3f..%.3f: C(r) at k=%zu counts %llu pairs, "
+                   "expected %llu\n",
+                   static_cast<double>(low), static_cast<double>(high), k,
+                   static_cast<unsigned long long>(result.pairs[k]),
+                   static_cast<unsigned long long>(expected));
+            ++wrong;
+        }
+    }
+    return wrong == 0;
+}
+
+} // namespace
+
+int main() {
+    const vector<vec3> points = make_points(3000);
+    worker_pool pool;
+    bool passed = true;
+    passed = check_range(points, pool, 0.1f, 0.15f, 24) && passed;
+    passed = check_range(points, pool, 0.1f, 0.12f, 24) && passed;
+    passed = check_range(points, pool, 0.01f, 0.2f, 24) && passed;
+    if (!passed) {
+        return EXIT_FAILURE;
+    }
+    printf("correlation pair counts match brute force\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+// Checks fast_sin and fast_cos against the double-precision libm result
+// over the ranges whose error bounds include/fast_math.hpp documents.
+
+#include "fast_math.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+namespace {
+
+// Worst error over count evenly spaced points in [-range, range]. max_ulp
+// only counts results of at least k_fast_trig_ulp_floor.
+struct trig_error {
+    double max_ulp = 0.0;
+    double max_abs = 0.0;
+    float worst_x = 0.0f; // argument of max_ulp
+};
+
+trig_error measure_error(float range, uint32_t count) {
+    trig_error error;
+    const double step = 2.0 * range / max<uint32_t>(count - 1, 1);
+    for (uint32_t i = 0; i < count; ++i) {
+        const float x = static_cast<float>(-range + step * i);
+        for (int function = 0; function < 2; ++function) {
+            const double exact = function == 0 ? sin(static_cast<double>(x))
+                                               : cos(static_cast<double>(x));
+            const float value = function == 0 ? fast_sin(x) : fast_cos(x);
+            const double difference = fabs(value - exact);
+            error.max_abs = max(error.max_abs, difference);
+            const float rounded = fabs(static_cast<float>(exact));
+            if (rounded < k_fast_trig_ulp_floor) {
+                continue;
+            }
+            const double ulp = nextafter(rounded, INFINITY) - rounded;
+            if (difference / ulp > error.max_ulp) {
+                error.max_ulp = difference / ulp;
+                error.worst_x = x;
+            }
+        }
+    }
+    return error;
+}
+
+} // namespace
+
+int main() {
+    constexpr uint32_t k_points = 1u << 23;
+    const trig_error exact = measure_error(k_fast_trig_exact_range, k_points);
+    const trig_error wide = measure_error(k_fast_trig_range, k_points);
+    const bool exact_ok = exact.max_ulp <= k_fast_trig_max_ulp &&
+                          exact.max_abs <= k_fast_trig_max_abs;
+    const bool wide_ok = wide.max_abs <= k_fast_trig_range_abs;
+    printf("|x| <= %g: max %.2f ulp at %g, max abs %.3g  %s\n",
+           static_cast<double>(k_fast_trig_exact_range), exact.max_ulp,
+           static_cast<double>(exact.worst_x), exact.max_abs,
+           exact_ok ? "ok" : "FAIL");
+    printf("|x| <= %g: max abs %.3g  %s\n",
+           static_cast<double>(k_fast_trig_range), wide.max_abs,
+           wide_ok ? "ok" : "FAIL");
+    return exact_ok && wide_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
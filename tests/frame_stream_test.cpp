@@ -0,0 +1,93 @@
+// Publishes frames through the producer side of the frame stream and reads
+// them back with the reader API, linked from the chaoseq_frame_stream
+// library the way an outside tool would: the newest frame with its ids, the
+// frames a slow reader skipped, and `closed` once the producer goes away.
+
+#include "frame_stream.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void publish(frame_stream &stream, const system_params &params, float t,
+             size_t count) {
+    float *out = begin_frame(stream, count);
+    if (!out) {
+        return;
+    }
+    uint32_t *ids = frame_ids(out, count);
+    for (size_t p = 0; p < count; ++p) {
+        out[3 * p] = t;
+        out[3 * p + 1] = static_cast<float>(p);
+        out[3 * p + 2] = -static_cast<float>(p);
+        ids[p] = static_cast<uint32_t>(count - p);
+    }
+    end_frame(stream, params, t, count);
+}
+
+bool check(const char *what, bool ok) {
+    printf("%s  %s\n", what, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    frame_stream stream;
+    stream.name = "/chaoseq_frames_test_" + to_string(getpid());
+    system_params params;
+    params.current_system = system_type::thomas;
+
+    publish(stream, params, 1.0f, 100);
+    frame_stream_reader reader;
+    if (!check("open", open_frame_stream_reader(reader, stream.name))) {
+        close_frame_stream(stream);
+        return EXIT_FAILURE;
+    }
+    frame_info info;
+    vector<float> xyz;
+    vector<uint32_t> ids;
+    bool passed = true;
+    passed = check("first frame", read_frame(reader, info, xyz, &ids) ==
+                                          frame_read_result::frame &&
+                                      info.sequence == 1 &&
+                                      info.system == system_type::thomas &&
+                                      !info.parameters.empty()) &&
+             passed;
+    passed = check("no new frame", read_frame(reader, info, xyz, &ids) ==
+                                       frame_read_result::no_frame) &&
+             passed;
+
+    for (int frame = 2; frame <= 5; ++frame) {
+        publish(stream, params, static_cast<float>(frame), 64);
+    }
+    const bool newest = read_frame(reader, info, xyz, &ids) ==
+                        frame_read_result::frame;
+    passed = check("newest frame", newest && info.sequence == 5 &&
+                                       info.time == 5.0f &&
+                                       xyz.size() == 3 * 64 &&
+                                       ids.size() == 64) &&
+             passed;
+    bool payload = newest;
+    for (size_t p = 0; payload && p < ids.size(); ++p) {
+        payload = xyz[3 * p] == 5.0f &&
+                  xyz[3 * p + 1] == static_cast<float>(p) &&
+                  xyz[3 * p + 2] == -static_cast<float>(p) &&
+                  ids[p] == 64 - p;
+    }
+    passed = check("positions and ids", payload) && passed;
+    passed = check("skipped frames", reader.frames_skipped == 3) && passed;
+
+    close_frame_stream(stream);
+    passed = check("closed", read_frame(reader, info, xyz, &ids) ==
+                                 frame_read_result::closed) &&
+             passed;
+    close_frame_stream_reader(reader);
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
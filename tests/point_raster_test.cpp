@@ -0,0 +1,139 @@
+// Runs shader/point_raster.comp on a surfaceless EGL context, Mesa's
+// llvmpipe under ctest, with every point on one pixel. A few points must add
+// up exactly; enough of them to pass the fixed-point range must saturate the
+// pixel instead of wrapping it dark. Exits with 77, which ctest reports as
+// skipped, when no GL 4.3 context can be created.
+
+#include "Shader.hpp"
+#include "embedded_shaders.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+constexpr int k_skipped = 77;
+// Odd, so the centre of the screen falls on a pixel centre and each point
+// deposits all of its energy there.
+constexpr int k_size = 63;
+
+bool create_context() {
+    const auto get_display =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (!get_display) {
+        return false;
+    }
+    const EGLDisplay display = get_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                           EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) ||
+        !eglBindAPI(EGL_OPENGL_API)) {
+        return false;
+    }
+    const EGLint attributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                 4,
+                                 EGL_CONTEXT_MINOR_VERSION,
+                                 3,
+                                 EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                 EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                 EGL_NONE};
+    const EGLContext context = eglCreateContext(
+        display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    return context != EGL_NO_CONTEXT &&
+           eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                          context) &&
+           gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+}
+
+// Rasterizes count points at the origin and returns the four channels of
+// the pixel they land on.
+vector<uint32_t> raster_points(const Shader &shader, GLuint count) {
+    const vector<float> positions(3 * static_cast<size_t>(count), 0.0f);
+    const vector<float> phases(count, 0.0f);
+    const vector<uint32_t> cleared(4 * k_size * k_size, 0u);
+    GLuint buffers[3];
+    glGenBuffers(3, buffers);
+    auto upload = [&](GLuint binding, const void *data, size_t bytes) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[binding]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(bytes),
+                     data, GL_DYNAMIC_COPY);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[binding]);
+    };
+    upload(0, positions.data(), positions.size() * sizeof(float));
+    upload(1, phases.data(), phases.size() * sizeof(float));
+    upload(2, cleared.data(), cleared.size() * sizeof(uint32_t));
+
+    shader.use();
+    shader.set_int("uCount", static_cast<int>(count));
+    glDispatchCompute((count + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    const size_t centre = k_size / 2 * k_size + k_size / 2;
+    vector<uint32_t> pixel(4);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                       static_cast<GLintptr>(centre * 4 * sizeof(uint32_t)),
+                       4 * sizeof(uint32_t), pixel.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glDeleteBuffers(3, buffers);
+    return pixel;
+}
+
+bool check_pixel(const char *name, const vector<uint32_t> &pixel,
+                 uint64_t expected) {
+    bool ok = true;
+    for (uint32_t channel : pixel) {
+        ok = ok && channel == expected;
+    }
+    printf("%s: %u %u %u %u, expected %llu  %s\n", name, pixel[0], pixel[1],
+           pixel[2], pixel[3], static_cast<unsigned long long>(expected),
+           ok ? "ok" : "FAIL");
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    if (!create_context() || !GLAD_GL_VERSION_4_3) {
+        printf("no surfaceless GL 4.3 context, skipped\n");
+        return k_skipped;
+    }
+    printf("%s\n", reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+
+    Shader shader;
+    shader.compile_compute(embedded_shader("point_raster.comp"));
+    shader.use();
+    shader.set_mat4("uView", mat4(1.0f));
+    shader.set_mat4("uProj", mat4(1.0f));
+    // At the origin the attenuated size clamps to 72 pixels.
+    shader.set_float("uPointSize", 1000.0f);
+    shader.set_float("uTime", 0.0f);
+    shader.set_float("uColorSpeed", 0.0f);
+    shader.set_int("uMonochrome", 1);
+    shader.set_int("uWidth", k_size);
+    shader.set_int("uHeight", k_size);
+    shader.set_float("uIntensity", 1.0f);
+    shader.set_int("uSegmentCount", 0);
+
+    // Same arithmetic as the shader for one point of intensity 1.
+    const float energy = 1.0f * 0.6f * 72.0f * 72.0f;
+    const uint64_t per_point = static_cast<uint32_t>(energy * 256.0f + 0.5f);
+    bool passed = check_pixel("100 points", raster_points(shader, 100),
+                              100 * per_point);
+    // About three times the range of a uint channel.
+    const GLuint bright = 1u << 14;
+    passed = check_pixel("16384 points", raster_points(shader, bright),
+                         0xFFFFFFFFu) &&
+             passed;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}